@@ -0,0 +1 @@
+../cpu_statistics.h
\ No newline at end of file
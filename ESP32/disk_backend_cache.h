@@ -0,0 +1 @@
+../disk_backend_cache.h
\ No newline at end of file
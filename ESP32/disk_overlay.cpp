@@ -0,0 +1 @@
+../disk_overlay.cpp
\ No newline at end of file
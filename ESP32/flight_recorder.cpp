@@ -0,0 +1 @@
+../flight_recorder.cpp
\ No newline at end of file
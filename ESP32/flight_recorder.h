@@ -0,0 +1 @@
+../flight_recorder.h
\ No newline at end of file
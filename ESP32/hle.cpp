@@ -0,0 +1 @@
+../hle.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../journal.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../profiler.cpp
\ No newline at end of file
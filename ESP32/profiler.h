@@ -0,0 +1 @@
+../profiler.h
\ No newline at end of file
@@ -0,0 +1 @@
+../cpu_statistics.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../disk_backend_cache.cpp
\ No newline at end of file
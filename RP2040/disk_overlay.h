@@ -0,0 +1 @@
+../disk_overlay.h
\ No newline at end of file
@@ -0,0 +1 @@
+../hle.h
\ No newline at end of file
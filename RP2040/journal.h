@@ -0,0 +1 @@
+../journal.h
\ No newline at end of file
@@ -0,0 +1 @@
+../trace_recorder.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../trace_recorder.h
\ No newline at end of file
@@ -0,0 +1,519 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+// Micro-benchmarks for the emulator hot paths. Results are emitted as JSON
+// so that they can be compared between commits.
+
+#include <algorithm>
+#include <ArduinoJson.h>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "bus.h"
+#include "cpu.h"
+#include "disk_backend_file.h"
+#include "disk_backend_mmap.h"
+#include "disk_backend_ram.h"
+#include "disk_backend_uring.h"
+#include "error.h"
+#include "gen.h"
+#include "log.h"
+#include "mmu.h"
+#include "rk05.h"
+#include "rl02.h"
+#include "rp06.h"
+#include "utils.h"
+
+
+constexpr const uint16_t program_start = 01000;
+constexpr const uint16_t isr_address   = 03000;
+constexpr const uint16_t dma_address   = 010000;
+constexpr const uint16_t stack_top     = 0140000;
+constexpr const uint32_t dma_n_bytes   = 4096;
+constexpr const uint32_t disk_size     = 4 * 1024 * 1024;
+
+static volatile uint32_t sink = 0;
+
+typedef struct {
+	std::string name;
+	std::string kind;  // "instructions", "accesses", "interrupts", "transfers"
+	uint32_t    bytes_per_op;  // for transfers
+	std::function<void(uint64_t)> run;  // perform n operations
+} benchmark_t;
+
+typedef struct {
+	bus                 *b;
+	std::atomic_uint32_t event;
+	std::atomic_bool     disk_read_activity;
+	std::atomic_bool     disk_write_activity;
+	std::string          disk_file;
+	bool                 disk_mmap;
+	bool                 disk_ram;
+	unsigned             disk_queue_depth;
+} bench_env_t;
+
+static void help()
+{
+	printf("-h       this help\n");
+	printf("-f x     only run the benchmarks with x in their name\n");
+	printf("-l       list the benchmarks\n");
+	printf("-t x     minimum duration of one measurement in milliseconds (default: 200)\n");
+	printf("-r x     number of measurements per benchmark, the best and median are reported (default: 5)\n");
+	printf("-o x     write the JSON results to file x instead of stdout\n");
+	printf("-m       use the mmap disk backend instead of the file backend\n");
+	printf("-W       use the RAM disk backend instead of the file backend\n");
+	printf("-q x     use the asynchronous (io_uring) disk backend with queue depth x instead of the file backend\n");
+}
+
+// offset field for a BR-type instruction at 'from' jumping to 'to'
+static uint16_t branch(const uint16_t opcode, const uint16_t from, const uint16_t to)
+{
+	return opcode | (((to - (from + 2)) / 2) & 0377);
+}
+
+static void load_program(bus *const b, const std::vector<uint16_t> & program)
+{
+	uint16_t a = program_start;
+
+	for(auto word: program) {
+		b->write_word(a, word);
+		a += 2;
+	}
+}
+
+static void reset_cpu(bench_env_t *const env)
+{
+	bus *b = env->b;
+	cpu *c = b->getCpu();
+
+	c->reset();
+	c->lowlevel_register_sp_set(0, stack_top);
+	c->setPC(program_start);
+
+	b->getMMU()->reset();
+}
+
+static void set_mmu(bus *const b, const bool enable)
+{
+	// identity map kernel I-space, page 7 to the I/O page
+	for(int i=0; i<8; i++) {
+		b->write_word(ADDR_PDR_K_START + i * 2, 077406);  // full length, read/write
+		b->write_word(ADDR_PAR_K_START + i * 2, i == 7 ? 0177600 : i * 0200);
+	}
+
+	b->write_word(ADDR_MMR0, enable ? 1 : 0);
+}
+
+static std::function<void(uint64_t)> step_loop(bench_env_t *const env, const std::vector<uint16_t> & program, const bool mmu)
+{
+	return [env, program, mmu](const uint64_t n) {
+		reset_cpu(env);
+		load_program(env->b, program);
+		set_mmu(env->b, mmu);
+
+		cpu *c = env->b->getCpu();
+		for(uint64_t i=0; i<n; i++)
+			c->step();
+	};
+}
+
+// register to register arithmetic, loops back to the start
+static std::vector<uint16_t> program_alu()
+{
+	std::vector<uint16_t> p {
+		0060102,  // ADD R1,R2
+		0005203,  // INC R3
+		0010204,  // MOV R2,R4
+		0040504,  // BIC R5,R4
+		0006304,  // ASL R4
+		0074003,  // XOR R0,R3
+		0005300,  // DEC R0
+	};
+	p.push_back(branch(0000400, program_start + p.size() * 2, program_start));  // BR
+
+	return p;
+}
+
+// memory to memory copies through auto-increment
+static std::vector<uint16_t> program_memory()
+{
+	std::vector<uint16_t> p {
+		0012700, dma_address,            // MOV #dma_address,R0
+		0012701, dma_address + 01000,    // MOV #dma_address+1000,R1
+		0012021,                         // MOV (R0)+,(R1)+
+		0012021,
+		0012021,
+		0012021,
+		0066061, 000002, 000004,         // ADD 2(R0),4(R1)
+		0105021,                         // CLRB (R1)+
+	};
+	p.push_back(branch(0000400, program_start + p.size() * 2, program_start));  // BR
+
+	return p;
+}
+
+// subroutine calls: JSR/RTS and stack traffic
+static std::vector<uint16_t> program_jsr()
+{
+	std::vector<uint16_t> p {
+		0004767, 000000,  // JSR PC,sub
+		0010546,          // MOV R5,-(SP)
+		0012605,          // MOV (SP)+,R5
+	};
+	p.push_back(branch(0000400, program_start + p.size() * 2, program_start));  // BR
+	p[1] = p.size() * 2 - 4;  // displacement relative to the word after JSR
+	p.push_back(0005201);  // sub: INC R1
+	p.push_back(0000207);  // RTS PC
+
+	return p;
+}
+
+static std::vector<benchmark_t> get_benchmarks(bench_env_t *const env)
+{
+	bus *b = env->b;
+
+	std::vector<benchmark_t> out;
+
+	out.push_back({ "cpu-step/alu",            "instructions", 0, step_loop(env, program_alu(),    false) });
+	out.push_back({ "cpu-step/memory",         "instructions", 0, step_loop(env, program_memory(), false) });
+	out.push_back({ "cpu-step/jsr-rts",        "instructions", 0, step_loop(env, program_jsr(),    false) });
+	out.push_back({ "cpu-step/alu-mmu",        "instructions", 0, step_loop(env, program_alu(),    true ) });
+	out.push_back({ "cpu-step/memory-mmu",     "instructions", 0, step_loop(env, program_memory(), true ) });
+
+	for(int mmu_on=0; mmu_on<2; mmu_on++) {
+		out.push_back({ mmu_on ? "mmu/calculate-physical-address-on" : "mmu/calculate-physical-address-off", "accesses", 0, [env, mmu_on](const uint64_t n) {
+			reset_cpu(env);
+			set_mmu(env->b, mmu_on);
+
+			mmu     *m   = env->b->getMMU();
+			uint32_t sum = 0;
+			for(uint64_t i=0; i<n; i++)
+				sum += m->calculate_physical_address(0, (i * 2) & 0157776, i & 1, i_space);
+
+			sink = sum;  // prevent the loop from being optimized away
+		} });
+	}
+
+	out.push_back({ "bus/read-ram", "accesses", 0, [env, b](const uint64_t n) {
+		reset_cpu(env);
+
+		uint32_t sum = 0;
+		for(uint64_t i=0; i<n; i++)
+			sum += b->read_word((i * 2) & 0077776);
+
+		sink = sum;
+	} });
+
+	out.push_back({ "bus/write-ram", "accesses", 0, [env, b](const uint64_t n) {
+		reset_cpu(env);
+
+		for(uint64_t i=0; i<n; i++)
+			b->write_word((i * 2) & 0077776, i);
+	} });
+
+	const std::vector<std::pair<std::string, uint16_t> > io_registers {
+		{ "psw",  ADDR_PSW },
+		{ "mmr0", ADDR_MMR0 },
+		{ "kw11", ADDR_LFC },
+		{ "rl02", RL02_CSR },
+		{ "rk05", RK05_DS },
+		{ "rp06", RP06_CS1 },
+	};
+
+	for(auto & reg: io_registers) {
+		uint16_t a = reg.second;
+
+		out.push_back({ "bus/read-io-" + reg.first, "accesses", 0, [env, b, a](const uint64_t n) {
+			reset_cpu(env);
+
+			uint32_t sum = 0;
+			for(uint64_t i=0; i<n; i++)
+				sum += b->read_word(a);
+
+			sink = sum;
+		} });
+	}
+
+	out.push_back({ "bus/write-io-kw11", "accesses", 0, [env, b](const uint64_t n) {
+		reset_cpu(env);
+
+		for(uint64_t i=0; i<n; i++)
+			b->write_word(ADDR_LFC, 0);
+	} });
+
+	// queue an interrupt from a "BR ." loop, let it be dispatched and return with RTI
+	out.push_back({ "cpu/interrupt-roundtrip", "interrupts", 0, [env, b](const uint64_t n) {
+		reset_cpu(env);
+		load_program(b, { 0000777 });  // BR .
+		b->write_word(isr_address + 0, 0005202);  // INC R2
+		b->write_word(isr_address + 2, 0000002);  // RTI
+		b->write_word(0100, isr_address);
+		b->write_word(0102, 0340);
+
+		cpu *c = b->getCpu();
+		for(uint64_t i=0; i<n; i++) {
+			c->queue_interrupt(6, 0100);
+
+			// the interrupt is dispatched in the same step() as the first instruction of the ISR
+			uint16_t count = c->get_register(2);
+			while(c->get_register(2) == count)
+				c->step();
+
+			c->step();  // RTI
+		}
+	} });
+
+	const uint16_t dma_words = 65536 - dma_n_bytes / 2;
+
+	for(int write=0; write<2; write++) {
+		out.push_back({ std::string("disk/rk05-") + (write ? "write" : "read"), "transfers", dma_n_bytes, [env, b, write, dma_words](const uint64_t n) {
+			reset_cpu(env);
+
+			for(uint64_t i=0; i<n; i++) {
+				b->write_word(RK05_WC, dma_words);
+				b->write_word(RK05_BA, dma_address);
+				b->write_word(RK05_DA, (i * 8) % 4800);  // sector address
+				b->write_word(RK05_CS, ((write ? 1 : 2) << 1) | 1);  // GO
+			}
+		} });
+
+		out.push_back({ std::string("disk/rl02-") + (write ? "write" : "read"), "transfers", dma_n_bytes, [env, b, write, dma_words](const uint64_t n) {
+			reset_cpu(env);
+
+			for(uint64_t i=0; i<n; i++) {
+				b->write_word(RL02_BAR, dma_address);
+				b->write_word(RL02_DAR, (i % 256) << 6);  // cylinder/head, sector 0
+				b->write_word(RL02_MPR, dma_words);
+				b->write_word(RL02_CSR, (write ? 5 : 6) << 1);
+			}
+		} });
+
+		out.push_back({ std::string("disk/rp06-") + (write ? "write" : "read"), "transfers", dma_n_bytes, [env, b, write, dma_words](const uint64_t n) {
+			reset_cpu(env);
+
+			for(uint64_t i=0; i<n; i++) {
+				b->write_word(RP06_WC,  dma_words);
+				b->write_word(RP06_UBA, dma_address);
+				b->write_word(RP06_DA,  0);
+				b->write_word(RP06_DC,  i % 16);
+				b->write_word(RP06_CS1, (write ? 060 : 070) | 1);  // GO
+			}
+		} });
+	}
+
+	return out;
+}
+
+static bool create_disk_devices(bench_env_t *const env)
+{
+	char name[] = "/tmp/kek-bench-XXXXXX";
+	int  fd     = mkstemp(name);
+	if (fd == -1)
+		return false;
+
+	bool ok = ftruncate(fd, disk_size) == 0;
+	close(fd);
+
+	if (!ok)
+		return false;
+
+	env->disk_file = name;
+
+	bus *b = env->b;
+
+	auto rk05_dev = new rk05(b, &env->disk_read_activity, &env->disk_write_activity);
+	rk05_dev->begin();
+	b->add_rk05(rk05_dev);
+
+	auto rl02_dev = new rl02(b, &env->disk_read_activity, &env->disk_write_activity);
+	rl02_dev->begin();
+	b->add_rl02(rl02_dev);
+
+	auto rp06_dev = new rp06(b, &env->disk_read_activity, &env->disk_write_activity);
+	rp06_dev->begin();
+	b->add_RP06(rp06_dev);
+
+	std::vector<disk_device *> devices { rk05_dev, rl02_dev, rp06_dev };
+	for(auto & dev: devices) {
+		disk_backend *backend = nullptr;
+		if (env->disk_mmap)
+			backend = new disk_backend_mmap(env->disk_file, disk_backend_mmap::sm_shutdown, 0);
+		else if (env->disk_ram)
+			backend = new disk_backend_ram(env->disk_file, 0);
+		else if (env->disk_queue_depth > 0)
+			backend = new disk_backend_uring(env->disk_file, env->disk_queue_depth);
+		else
+			backend = new disk_backend_file(env->disk_file);
+		if (backend->begin(false) == false)
+			return false;
+
+		dev->access_disk_backends()->push_back(backend);
+	}
+
+	return true;
+}
+
+// time one run of n operations, in nanoseconds
+static uint64_t measure(const benchmark_t & bm, const uint64_t n)
+{
+	uint64_t start = get_us();
+
+	bm.run(n);
+
+	return (get_us() - start) * 1000;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string filter;
+	std::string output_file;
+	bool        list_only = false;
+	uint64_t    target_ms = 200;
+	int         n_repeats = 5;
+	bool        disk_mmap = false;
+	bool        disk_ram  = false;
+	unsigned    disk_queue_depth = 0;
+
+	int opt = -1;
+	while((opt = getopt(argc, argv, "hf:lt:r:o:mWq:")) != -1)
+	{
+		switch(opt) {
+			case 'h':
+				help();
+				return 1;
+
+			case 'f':
+				filter = optarg;
+				break;
+
+			case 'l':
+				list_only = true;
+				break;
+
+			case 't':
+				target_ms = std::max(1, atoi(optarg));
+				break;
+
+			case 'r':
+				n_repeats = std::max(1, atoi(optarg));
+				break;
+
+			case 'o':
+				output_file = optarg;
+				break;
+
+			case 'm':
+				disk_mmap = true;
+				break;
+
+			case 'W':
+				disk_ram = true;
+				break;
+
+			case 'q':
+				disk_queue_depth = std::max(1, atoi(optarg));
+				break;
+
+			default:
+				fprintf(stderr, "-%c is not understood\n", opt);
+				return 1;
+		}
+	}
+
+	setlogfile(nullptr, ll_error, ll_error, false);
+
+	bench_env_t env;
+	env.event               = EVENT_NONE;
+	env.disk_read_activity  = false;
+	env.disk_write_activity = false;
+	env.disk_mmap           = disk_mmap;
+	env.disk_ram            = disk_ram;
+	env.disk_queue_depth    = disk_queue_depth;
+
+	env.b = new bus();
+	env.b->set_memory_size(DEFAULT_N_PAGES);
+
+	cpu *c = new cpu(env.b, &env.event);
+	env.b->add_cpu(c);
+
+	if (create_disk_devices(&env) == false)
+		error_exit(true, "Cannot create temporary disk image");
+
+	auto benchmarks = get_benchmarks(&env);
+
+	JsonDocument j;
+	j["built"]     = __DATE__ " " __TIME__;
+	j["target-ms"] = target_ms;
+	j["repeats"]   = n_repeats;
+	JsonArray results = j["results"].to<JsonArray>();
+
+	for(auto & bm: benchmarks) {
+		if (filter.empty() == false && bm.name.find(filter) == std::string::npos)
+			continue;
+
+		if (list_only) {
+			printf("%s\n", bm.name.c_str());
+			continue;
+		}
+
+		// find the number of operations that takes at least target_ms (this also warms up)
+		uint64_t n = 1000;
+		for(;;) {
+			uint64_t took = measure(bm, n);
+			if (took >= target_ms * 1000000)
+				break;
+
+			n = took < target_ms * 10000 ? n * 100 : n * (target_ms * 1000000 * 11 / 10) / took + 1;
+		}
+
+		std::vector<double> ns_per_op;
+		for(int i=0; i<n_repeats; i++)
+			ns_per_op.push_back(double(measure(bm, n)) / n);
+
+		std::sort(ns_per_op.begin(), ns_per_op.end());
+
+		double best   = ns_per_op.front();
+		double median = ns_per_op.at(ns_per_op.size() / 2);
+
+		JsonObject result = results.add<JsonObject>();
+		result["name"]             = bm.name;
+		result["unit"]             = bm.kind;
+		result["ops"]              = n;
+		result["ns-per-op"]        = best;
+		result["ns-per-op-median"] = median;
+		if (bm.kind == "instructions")
+			result["mips"]     = 1000. / best;
+		if (bm.bytes_per_op)
+			result["mb-per-s"] = bm.bytes_per_op * 1000. / best;
+
+		fprintf(stderr, "%-40s %10.1f ns/op\n", bm.name.c_str(), best);
+	}
+
+	if (!list_only) {
+		std::string out;
+		serializeJsonPretty(j, out);
+
+		if (output_file.empty())
+			printf("%s\n", out.c_str());
+		else {
+			FILE *fh = fopen(output_file.c_str(), "w");
+			if (!fh)
+				error_exit(true, "Cannot create %s", output_file.c_str());
+
+			fprintf(fh, "%s\n", out.c_str());
+			fclose(fh);
+		}
+	}
+
+	delete env.b;
+
+	unlink(env.disk_file.c_str());
+
+	return 0;
+}
@@ -0,0 +1,317 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <cinttypes>
+#include <errno.h>
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+#include "bic_runner.h"
+#include "bus.h"
+#include "console_headless.h"
+#include "cpu.h"
+#include "gen.h"
+#include "kw11-l.h"
+#include "loaders.h"
+#include "log.h"
+#include "tm-11.h"
+#include "tty.h"
+#include "utils.h"
+
+
+// the XXDP/MAINDEC diagnostics report errors in free format; these are
+// the fragments that all error printouts in the BIC/ set contain
+static const char *const error_markers[] = { "ERRORPC", "ERROR PC", " BAD", "ABORTED", "DIDN'T", "FAILED" };
+
+constexpr const char     pass_marker[]     = "END PASS";
+constexpr const uint32_t step_batch        = 4096;  // instructions between checks
+
+typedef enum { BR_PASS, BR_ERROR, BR_HALT, BR_TIMEOUT, BR_NOT_LOADED, BR_INTERRUPTED } bic_result_type_t;
+
+static const char *const bic_result_names[] = { "pass", "error", "halt", "timeout", "not loaded", "interrupted" };
+
+typedef struct {
+	std::string       file;
+	bic_result_type_t result;
+	int               passes;
+	std::string       detail;  // the error line, the prompt it hangs on, ...
+	uint64_t          instructions;
+	uint64_t          duration_us;
+} bic_result_t;
+
+// collects the console output of one diagnostic line by line
+class bic_output_scanner
+{
+private:
+	std::mutex  lock;
+	std::string line;
+	std::string previous_line;
+	int         passes { 0 };
+	std::string error_line;
+
+	void process_line()
+	{
+		if (line.find(pass_marker) != std::string::npos)
+			passes++;
+		else if (error_line.empty()) {
+			for(auto & marker: error_markers) {
+				if (line.find(marker) != std::string::npos) {
+					// the line before is often the description of the error
+					error_line = previous_line.empty() ? line : previous_line + " | " + line;
+					break;
+				}
+			}
+		}
+
+		previous_line = line;
+		line.clear();
+	}
+
+public:
+	void put_char(const char c)
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		if (c == 13 || c == 10) {
+			if (line.empty() == false)
+				process_line();
+		}
+		else if (c >= 32 && c < 127) {  // skip fill characters
+			line += c;
+		}
+	}
+
+	int get_passes()
+	{
+		std::unique_lock<std::mutex> lck(lock);
+		return passes;
+	}
+
+	std::string get_error_line()
+	{
+		std::unique_lock<std::mutex> lck(lock);
+		return error_line;
+	}
+
+	// e.g. a question that is never answered
+	std::string get_last_line()
+	{
+		std::unique_lock<std::mutex> lck(lock);
+		return line.empty() ? previous_line : line;
+	}
+};
+
+static std::string get_diagnostic_name(const std::string & file)
+{
+	std::size_t slash = file.rfind('/');
+	std::string name  = slash == std::string::npos ? file : file.substr(slash + 1);
+	std::size_t dot   = name.rfind('.');
+
+	return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static bic_result_t run_diagnostic(const bic_batch_settings_t & settings, const std::string & file, std::atomic_uint32_t *const global_event)
+{
+	bic_result_t result { file, BR_NOT_LOADED, 0, "", 0, 0 };
+
+	std::atomic_uint32_t event { EVENT_NONE };
+	bic_output_scanner   scanner;
+
+	console_headless *cnsl = new console_headless(&event, format("kek-bic-%s.txt", get_diagnostic_name(file).c_str()));
+	cnsl->set_output_handler([&scanner](const char c) { scanner.put_char(c); });
+
+	bus *b = new bus();
+	b->set_memory_size(settings.ram_size.has_value() ? settings.ram_size.value() : DEFAULT_N_PAGES);
+	b->set_console_switches(settings.console_switches);
+
+	cpu *c = new cpu(b, &event);
+	b->add_cpu(c);
+
+	// some diagnostics probe for the controllers, so the usual set is present (without disks)
+	auto rk05_dev = new rk05(b, cnsl->get_disk_read_activity_flag(), cnsl->get_disk_write_activity_flag());
+	rk05_dev->begin();
+	b->add_rk05(rk05_dev);
+
+	auto rl02_dev = new rl02(b, cnsl->get_disk_read_activity_flag(), cnsl->get_disk_write_activity_flag());
+	rl02_dev->begin();
+	b->add_rl02(rl02_dev);
+
+	auto rp06_dev = new rp06(b, cnsl->get_disk_read_activity_flag(), cnsl->get_disk_write_activity_flag());
+	rp06_dev->begin();
+	b->add_RP06(rp06_dev);
+
+	b->add_tm11(new tm_11(b));
+
+	b->add_tty(new tty(cnsl, b));
+
+	cnsl->set_bus(b);
+	cnsl->begin();
+
+	auto start = load_tape(b, file);
+
+	if (start.has_value()) {
+		c->set_register(7, start.value());
+
+		// a diagnostic waiting for input would block forever in WAIT;
+		// a parked cpu returns instead so that the timeout still works
+		c->set_wakeup_handler([] { });
+
+		*cnsl->get_running_flag() = true;
+		b->getKW11_L()->begin(cnsl);
+
+		c->emulation_start();
+
+		uint64_t start_ts = get_us();
+		uint64_t end_ts   = start_ts + settings.timeout_s * 1000000ll;
+
+		for(;;) {
+			if (c->is_parked() == false || c->unpark()) {
+				for(uint32_t i=0; i<step_batch && event == EVENT_NONE; i++) {
+					c->step();
+
+					if (c->is_parked())
+						break;
+				}
+			}
+			else {
+				myusleep(1000);
+			}
+
+			uint64_t now = get_us();
+
+			result.passes = scanner.get_passes();
+
+			if (result.passes >= settings.n_passes) {
+				result.result = BR_PASS;
+				break;
+			}
+
+			std::string error_line = scanner.get_error_line();
+			if (error_line.empty() == false) {
+				result.result = BR_ERROR;
+				result.detail = error_line;
+				break;
+			}
+
+			if (event != EVENT_NONE) {
+				result.result = BR_HALT;
+				result.detail = format("stopped at PC %06o (event %u)", c->getPC(), uint32_t(event));
+				break;
+			}
+
+			if (*global_event == EVENT_TERMINATE) {
+				result.result = BR_INTERRUPTED;
+				break;
+			}
+
+			if (now >= end_ts) {
+				result.result = BR_TIMEOUT;
+				result.detail = "last output: " + scanner.get_last_line();
+				break;
+			}
+		}
+
+		result.instructions = c->get_instructions_executed_count();
+		result.duration_us  = get_us() - start_ts;
+
+		*cnsl->get_running_flag() = false;
+	}
+	else {
+		result.detail = "cannot load tape";
+	}
+
+	cnsl->stop_thread();
+
+	delete b;
+	delete cnsl;
+
+	return result;
+}
+
+int run_bic_batch(const bic_batch_settings_t & settings, std::atomic_uint32_t *const event)
+{
+	size_t n_workers = settings.n_workers ? settings.n_workers : std::max(1u, std::thread::hardware_concurrency());
+	n_workers = std::min(n_workers, settings.files.size());
+
+	DOLOG(info, true, "BIC: %zu diagnostics on %zu worker threads, %d pass(es) each, %d seconds timeout", settings.files.size(), n_workers, settings.n_passes, settings.timeout_s);
+
+	std::vector<bic_result_t> results(settings.files.size());
+	std::atomic_size_t        next_file { 0 };
+
+	std::vector<std::thread *> workers;
+
+	for(size_t i=0; i<n_workers; i++) {
+		workers.push_back(new std::thread([&, i] {
+			set_thread_name(format("kek:bic-%zu", i));
+
+			for(;;) {
+				size_t nr = next_file++;
+				if (nr >= settings.files.size())
+					break;
+
+				set_log_context(get_diagnostic_name(settings.files[nr]));
+
+				results[nr] = run_diagnostic(settings, settings.files[nr], event);
+
+				set_log_context("");
+			}
+		}));
+	}
+
+	for(auto & th: workers) {
+		th->join();
+		delete th;
+	}
+
+	JsonDocument j;
+	JsonArray j_results = j["results"].to<JsonArray>();
+
+	size_t n_failed = 0;
+
+	printf("%-12s %-11s %6s %10s %8s  %s\n", "diagnostic", "result", "passes", "seconds", "MIPS", "detail");
+
+	for(auto & r: results) {
+		double seconds = r.duration_us / 1000000.;
+		double mips    = r.duration_us ? double(r.instructions) / r.duration_us : 0.;
+
+		if (r.result != BR_PASS)
+			n_failed++;
+
+		printf("%-12s %-11s %6d %10.3f %8.2f  %s\n", get_diagnostic_name(r.file).c_str(), bic_result_names[r.result], r.passes, seconds, mips, r.detail.c_str());
+
+		JsonObject j_result = j_results.add<JsonObject>();
+		j_result["file"]         = r.file;
+		j_result["result"]       = bic_result_names[r.result];
+		j_result["passes"]       = r.passes;
+		j_result["detail"]       = r.detail;
+		j_result["instructions"] = r.instructions;
+		j_result["seconds"]      = seconds;
+		j_result["mips"]         = mips;
+	}
+
+	printf("%zu of %zu diagnostics passed\n", results.size() - n_failed, results.size());
+
+	j["passes-required"] = settings.n_passes;
+	j["timeout"]         = settings.timeout_s;
+	j["passed"]          = results.size() - n_failed;
+	j["failed"]          = n_failed;
+
+	if (settings.report_file.empty() == false) {
+		std::string out;
+		serializeJsonPretty(j, out);
+
+		FILE *fh = fopen(settings.report_file.c_str(), "w");
+		if (fh) {
+			fprintf(fh, "%s\n", out.c_str());
+			fclose(fh);
+		}
+		else {
+			DOLOG(warning, true, "BIC: cannot create \"%s\": %s", settings.report_file.c_str(), strerror(errno));
+		}
+	}
+
+	return n_failed ? 1 : 0;
+}
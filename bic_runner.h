@@ -0,0 +1,26 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+typedef struct {
+	std::vector<std::string> files;      // .BIC (or other absolute loader) tapes
+	int          n_passes;               // a diagnostic passes after this many "END PASS" lines
+	int          timeout_s;              // per diagnostic, wall-clock
+	size_t       n_workers;              // 0: one per host core
+	std::optional<int> ram_size;         // in 8 kB pages
+	uint16_t     console_switches;
+	std::string  report_file;            // JSON, empty: none
+} bic_batch_settings_t;
+
+// runs each diagnostic on its own machine until it printed n_passes
+// pass-counts, reported an error, halted or ran out of time; the
+// machines run concurrently. returns 0 when all diagnostics passed.
+int run_bic_batch(const bic_batch_settings_t & settings, std::atomic_uint32_t *const event);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <optional>
+#include <set>
 #include <string>
 
 #include "bus.h"
@@ -17,5 +18,12 @@ public:
 
 	virtual std::optional<std::string> is_triggered() const = 0;
 
+	// used by the cpu to only evaluate a breakpoint when it can trigger:
+	// the PC values it is limited to (if any), whether it only depends on
+	// memory contents and at which (physical) addresses those are
+	virtual std::optional<std::set<uint16_t> > get_pc_guard() const { return { }; }
+	virtual bool is_memory_only() const { return false; }
+	virtual void get_watched_addresses(std::set<uint32_t> *const, bool *const) const { }
+
 	virtual std::string emit() const = 0;
 };
@@ -29,6 +29,49 @@ std::optional<std::string> breakpoint_and::is_triggered() const
 	return out;
 }
 
+std::optional<std::set<uint16_t> > breakpoint_and::get_pc_guard() const
+{
+	// all must be true, so each PC limit applies
+	std::optional<std::set<uint16_t> > out;
+
+	for(auto & t: triggers) {
+		auto guard = t->get_pc_guard();
+		if (guard.has_value() == false)
+			continue;
+
+		if (out.has_value() == false) {
+			out = guard;
+			continue;
+		}
+
+		std::set<uint16_t> temp;
+		for(auto pc: guard.value()) {
+			if (out.value().find(pc) != out.value().end())
+				temp.insert(pc);
+		}
+
+		out = temp;
+	}
+
+	return out;
+}
+
+bool breakpoint_and::is_memory_only() const
+{
+	for(auto & t: triggers) {
+		if (t->is_memory_only() == false)
+			return false;
+	}
+
+	return true;
+}
+
+void breakpoint_and::get_watched_addresses(std::set<uint32_t> *const addresses, bool *const has_virtual) const
+{
+	for(auto & t: triggers)
+		t->get_watched_addresses(addresses, has_virtual);
+}
+
 std::string breakpoint_and::emit() const
 {
 	std::string out;
@@ -16,5 +16,9 @@ public:
 
 	virtual std::optional<std::string> is_triggered() const override;
 
+	virtual std::optional<std::set<uint16_t> > get_pc_guard() const override;
+	virtual bool is_memory_only() const override;
+	virtual void get_watched_addresses(std::set<uint32_t> *const addresses, bool *const has_virtual) const override;
+
 	virtual std::string emit() const override;
 };
@@ -40,6 +40,21 @@ std::optional<std::string> breakpoint_memory::is_triggered() const
 	return format("MEM%c%c[%08o]=%06o", word_mode == wm_byte ? 'B' : 'W', is_virtual ? 'V' : 'P', addr, v);
 }
 
+void breakpoint_memory::get_watched_addresses(std::set<uint32_t> *const addresses, bool *const has_virtual) const
+{
+	uint32_t a = addr;
+
+	if (is_virtual) {
+		*has_virtual = true;  // the mapping can change
+
+		a = b->getMMU()->calculate_physical_address(rm_cur, addr).physical_instruction;  // same as peek_word
+	}
+
+	addresses->insert(a & ~1);
+	if (word_mode == wm_word)
+		addresses->insert((a + 1) & ~1);
+}
+
 std::pair<breakpoint_memory *, std::optional<std::string> > breakpoint_memory::parse(bus *const b, const std::string & in)
 {
 	auto parts = split(in, "=");
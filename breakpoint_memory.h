@@ -20,6 +20,9 @@ public:
 
 	virtual std::optional<std::string> is_triggered() const override;
 
+	virtual bool is_memory_only() const override { return true; }
+	virtual void get_watched_addresses(std::set<uint32_t> *const addresses, bool *const has_virtual) const override;
+
 	static std::pair<breakpoint_memory *, std::optional<std::string> > parse(bus *const b, const std::string & in);
 
 	virtual std::string emit() const override;
@@ -25,6 +25,38 @@ std::optional<std::string> breakpoint_or::is_triggered() const
 	return { };
 }
 
+std::optional<std::set<uint16_t> > breakpoint_or::get_pc_guard() const
+{
+	// any can be true, so only limited when each of them is
+	std::set<uint16_t> out;
+
+	for(auto & t: triggers) {
+		auto guard = t->get_pc_guard();
+		if (guard.has_value() == false)
+			return { };
+
+		out.insert(guard.value().begin(), guard.value().end());
+	}
+
+	return out;
+}
+
+bool breakpoint_or::is_memory_only() const
+{
+	for(auto & t: triggers) {
+		if (t->is_memory_only() == false)
+			return false;
+	}
+
+	return true;
+}
+
+void breakpoint_or::get_watched_addresses(std::set<uint32_t> *const addresses, bool *const has_virtual) const
+{
+	for(auto & t: triggers)
+		t->get_watched_addresses(addresses, has_virtual);
+}
+
 std::string breakpoint_or::emit() const
 {
 	std::string out;
@@ -72,6 +72,14 @@ std::optional<std::string> breakpoint_register::is_triggered() const
 	return get_name(hwreg_t(register_nr)) + "=" + format("%06o", v);
 }
 
+std::optional<std::set<uint16_t> > breakpoint_register::get_pc_guard() const
+{
+	if (register_nr == 7)
+		return values;
+
+	return { };
+}
+
 std::pair<breakpoint_register *, std::optional<std::string> > breakpoint_register::parse(bus *const b, const std::string & in)
 {
 	auto parts = split(in, "=");
@@ -23,6 +23,8 @@ public:
 
 	virtual std::optional<std::string> is_triggered() const override;
 
+	virtual std::optional<std::set<uint16_t> > get_pc_guard() const override;
+
 	static std::pair<breakpoint_register *, std::optional<std::string> > parse(bus *const b, const std::string & in);
 
 	virtual std::string emit() const override;
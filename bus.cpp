@@ -15,6 +15,7 @@
 #include "memory.h"
 #include "mmu.h"
 #include "tm-11.h"
+#include "trace_recorder.h"
 #include "tty.h"
 #include "utils.h"
 
@@ -140,7 +141,7 @@ void bus::set_memory_size(const int n_pages)
 
 	mmu_->begin(m, c);
 
-	TRACE("Memory is now %u kB in size", n_bytes / 1024);
+	TRACE(tc_bus_io, "Memory is now %u kB in size", n_bytes / 1024);
 }
 
 void bus::reset()
@@ -261,38 +262,38 @@ uint16_t bus::read(const uint16_t addr_in, const word_mode_t word_mode, const rm
 		//// REGISTERS ////
 		if (a >= ADDR_KERNEL_R && a <= ADDR_KERNEL_R + 5) { // kernel R0-R5
 			uint16_t temp = c->get_register(a - ADDR_KERNEL_R) & (word_mode == wm_byte ? 0xff : 0xffff);
-			TRACE("READ-I/O kernel R%d: %06o", a - ADDR_KERNEL_R, temp);
+			TRACE(tc_bus_io, "READ-I/O kernel R%d: %06o", a - ADDR_KERNEL_R, temp);
 			return temp;
 		}
 		if (a >= ADDR_USER_R && a <= ADDR_USER_R + 5) { // user R0-R5
 			uint16_t temp = c->get_register(a - ADDR_USER_R) & (word_mode == wm_byte ? 0xff : 0xffff);
-			TRACE("READ-I/O user R%d: %06o", a - ADDR_USER_R, temp);
+			TRACE(tc_bus_io, "READ-I/O user R%d: %06o", a - ADDR_USER_R, temp);
 			return temp;
 		}
 		if (a == ADDR_KERNEL_SP) { // kernel SP
 			uint16_t temp = c->getStackPointer(0) & (word_mode == wm_byte ? 0xff : 0xffff);
-			TRACE("READ-I/O kernel SP: %06o", temp);
+			TRACE(tc_bus_io, "READ-I/O kernel SP: %06o", temp);
 			return temp;
 		}
 		if (a == ADDR_PC) { // PC
 			uint16_t temp = c->getPC() & (word_mode == wm_byte ? 0xff : 0xffff);
-			TRACE("READ-I/O PC: %06o", temp);
+			TRACE(tc_bus_io, "READ-I/O PC: %06o", temp);
 			return temp;
 		}
 		if (a == ADDR_SV_SP) { // supervisor SP
 			uint16_t temp = c->getStackPointer(1) & (word_mode == wm_byte ? 0xff : 0xffff);
-			TRACE("READ-I/O supervisor SP: %06o", temp);
+			TRACE(tc_bus_io, "READ-I/O supervisor SP: %06o", temp);
 			return temp;
 		}
 		if (a == ADDR_USER_SP) { // user SP
 			uint16_t temp = c->getStackPointer(3) & (word_mode == wm_byte ? 0xff : 0xffff);
-			TRACE("READ-I/O user SP: %06o", temp);
+			TRACE(tc_bus_io, "READ-I/O user SP: %06o", temp);
 			return temp;
 		}
 		///^ registers ^///
 
 		if ((a & 1) && word_mode == wm_word) [[unlikely]] {
-			TRACE("READ-I/O odd address %06o UNHANDLED", a);
+			TRACE(tc_bus_io, "READ-I/O odd address %06o UNHANDLED", a);
 			mmu_->trap_if_odd(addr_in, run_mode, space, false);
 			throw 0;
 			return 0;
@@ -300,19 +301,19 @@ uint16_t bus::read(const uint16_t addr_in, const word_mode_t word_mode, const rm
 
 		if (a == ADDR_CPU_ERR) { // cpu error register
 			uint16_t temp = mmu_->getCPUERR() & 0xff;
-			TRACE("READ-I/O CPU error: %03o", temp);
+			TRACE(tc_bus_io, "READ-I/O CPU error: %03o", temp);
 			return temp;
 		}
 
 		if (a == ADDR_MAINT) { // MAINT
 			uint16_t temp = 1; // POWER OK
-			TRACE("READ-I/O MAINT: %o", temp);
+			TRACE(tc_bus_io, "READ-I/O MAINT: %o", temp);
 			return temp;
 		}
 
 		if (a == ADDR_CONSW) { // console switch & display register
 			uint16_t temp = console_switches;
-			TRACE("READ-I/O console switch: %o", temp);
+			TRACE(tc_bus_io, "READ-I/O console switch: %o", temp);
 			return temp;
 		}
 
@@ -326,13 +327,13 @@ uint16_t bus::read(const uint16_t addr_in, const word_mode_t word_mode, const rm
 			else
 				temp = a == ADDR_PIR ? PIR & 255 : PIR >> 8;
 
-			TRACE("READ-I/O PIR: %o", temp);
+			TRACE(tc_bus_io, "READ-I/O PIR: %o", temp);
 			return temp;
 		}
 
 		if (a == ADDR_SYSTEM_ID) {
 			uint16_t temp = 011064;
-			TRACE("READ-I/O system id: %o", temp);
+			TRACE(tc_bus_io, "READ-I/O system id: %o", temp);
 			return temp;
 		}
 
@@ -341,7 +342,7 @@ uint16_t bus::read(const uint16_t addr_in, const word_mode_t word_mode, const rm
 
 		if (a == ADDR_LP11CSR) { // printer, CSR register, LP11
 			uint16_t temp = 0x80;
-			TRACE("READ-I/O LP11 CSR: %o", temp);
+			TRACE(tc_bus_io, "READ-I/O LP11 CSR: %o", temp);
 			return temp;
 		}
 
@@ -357,113 +358,113 @@ uint16_t bus::read(const uint16_t addr_in, const word_mode_t word_mode, const rm
 		///////////
 
 		if (a >= 0177740 && a <= 0177753) { // cache control register and others
-			TRACE("READ-I/O cache control register/others (%06o): %o", a, 0);
+			TRACE(tc_bus_io, "READ-I/O cache control register/others (%06o): %o", a, 0);
 			// TODO
 			return 0;
 		}
 
 		if (a >= 0170200 && a <= 0170377) { // unibus map
-			TRACE("READ-I/O unibus map (%06o): %o", a, 0);
+			TRACE(tc_bus_io, "READ-I/O unibus map (%06o): %o", a, 0);
 			// TODO
 			return 0;
 		}
 
 		if (a >= 0172100 && a <= 0172137) {  // MM11-LP parity
-			TRACE("READ-I/O MM11-LP parity (%06o): %o", a, 1);
+			TRACE(tc_bus_io, "READ-I/O MM11-LP parity (%06o): %o", a, 1);
 			return 1;
 		}
 
 		if (word_mode == wm_byte) {
 			if (a == ADDR_PSW) { // PSW
 				uint8_t temp = c->getPSW();
-				TRACE("READ-I/O PSW LSB: %03o", temp);
+				TRACE(tc_bus_io, "READ-I/O PSW LSB: %03o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_PSW + 1) {
 				uint8_t temp = c->getPSW() >> 8;
-				TRACE("READ-I/O PSW MSB: %03o", temp);
+				TRACE(tc_bus_io, "READ-I/O PSW MSB: %03o", temp);
 				return temp;
 			}
 			if (a == ADDR_STACKLIM) { // stack limit register
 				uint8_t temp = c->getStackLimitRegister();
-				TRACE("READ-I/O stack limit register (low): %03o", temp);
+				TRACE(tc_bus_io, "READ-I/O stack limit register (low): %03o", temp);
 				return temp;
 			}
 			if (a == ADDR_STACKLIM + 1) { // stack limit register
 				uint8_t temp = c->getStackLimitRegister() >> 8;
-				TRACE("READ-I/O stack limit register (high): %03o", temp);
+				TRACE(tc_bus_io, "READ-I/O stack limit register (high): %03o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_MICROPROG_BREAK_REG) {  // microprogram break register
 				uint8_t temp = microprogram_break_register;
-				TRACE("READ-I/O microprogram break register (low): %03o", temp);
+				TRACE(tc_bus_io, "READ-I/O microprogram break register (low): %03o", temp);
 				return temp;
 			}
 			if (a == ADDR_MICROPROG_BREAK_REG + 1) {  // microprogram break register
 				uint8_t temp = microprogram_break_register >> 8;
-				TRACE("READ-I/O microprogram break register (high): %03o", temp);
+				TRACE(tc_bus_io, "READ-I/O microprogram break register (high): %03o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_MMR0) {
 				uint8_t temp = mmu_->getMMR0();
-				TRACE("READ-I/O MMR0 LO: %03o", temp);
+				TRACE(tc_bus_io, "READ-I/O MMR0 LO: %03o", temp);
 				return temp;
 			}
 			if (a == ADDR_MMR0 + 1) {
 				uint8_t temp = mmu_->getMMR0() >> 8;
-				TRACE("READ-I/O MMR0 HI: %03o", temp);
+				TRACE(tc_bus_io, "READ-I/O MMR0 HI: %03o", temp);
 				return temp;
 			}
 		}
 		else {
 			if (a == ADDR_MMR0) {
 				uint16_t temp = mmu_->getMMR0();
-				TRACE("READ-I/O MMR0: %06o", temp);
+				TRACE(tc_bus_io, "READ-I/O MMR0: %06o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_MMR1) { // MMR1
 				uint16_t temp = mmu_->getMMR1();
-				TRACE("READ-I/O MMR1: %06o", temp);
+				TRACE(tc_bus_io, "READ-I/O MMR1: %06o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_MMR2) { // MMR2
 				uint16_t temp = mmu_->getMMR2();
-				TRACE("READ-I/O MMR2: %06o", temp);
+				TRACE(tc_bus_io, "READ-I/O MMR2: %06o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_MMR3) { // MMR3
 				uint16_t temp = mmu_->getMMR3();
-				TRACE("READ-I/O MMR3: %06o", temp);
+				TRACE(tc_bus_io, "READ-I/O MMR3: %06o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_PSW) { // PSW
 				uint16_t temp = c->getPSW();
-				TRACE("READ-I/O PSW: %06o", temp);
+				TRACE(tc_bus_io, "READ-I/O PSW: %06o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_STACKLIM) { // stack limit register
 				uint16_t temp = c->getStackLimitRegister();
-				TRACE("READ-I/O stack limit register: %06o", temp);
+				TRACE(tc_bus_io, "READ-I/O stack limit register: %06o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_CPU_ERR) { // cpu error register
 				uint16_t temp = mmu_->getCPUERR();
-				TRACE("READ-I/O CPUERR: %06o", temp);
+				TRACE(tc_bus_io, "READ-I/O CPUERR: %06o", temp);
 				return temp;
 			}
 
 			if (a == ADDR_MICROPROG_BREAK_REG) {  // microprogram break register
 				uint16_t temp = microprogram_break_register;
-				TRACE("READ-I/O microprogram break register: %06o", temp);
+				TRACE(tc_bus_io, "READ-I/O microprogram break register: %06o", temp);
 				return temp;
 			}
 		}
@@ -491,17 +492,17 @@ uint16_t bus::read(const uint16_t addr_in, const word_mode_t word_mode, const rm
 
 		if (a == ADDR_SYSSIZE + 2) {  // system size HI
 			uint16_t temp = system_size >> 16;
-			TRACE("READ-I/O accessing system size HI: %06o", temp);
+			TRACE(tc_bus_io, "READ-I/O accessing system size HI: %06o", temp);
 			return temp;
 		}
 
 		if (a == ADDR_SYSSIZE) {  // system size LO
 			uint16_t temp = system_size;
-			TRACE("READ-I/O accessing system size LO: %06o", temp);
+			TRACE(tc_bus_io, "READ-I/O accessing system size LO: %06o", temp);
 			return temp;
 		}
 
-		TRACE("READ-I/O UNHANDLED read %08o (%c), (base: %o)", m_offset, word_mode == wm_byte ? 'B' : ' ', mmu_->get_io_base());
+		TRACE(tc_bus_io, "READ-I/O UNHANDLED read %08o (%c), (base: %o)", m_offset, word_mode == wm_byte ? 'B' : ' ', mmu_->get_io_base());
 
 		c->trap(004);  // no such i/o
 		throw 1;
@@ -510,7 +511,7 @@ uint16_t bus::read(const uint16_t addr_in, const word_mode_t word_mode, const rm
 	}
 
 	if ((addr_in & 1) && word_mode == wm_word) {
-		TRACE("READ from %06o - odd address!", addr_in);
+		TRACE(tc_bus_io, "READ from %06o - odd address!", addr_in);
 		mmu_->trap_if_odd(addr_in, run_mode, space, false);
 		throw 2;
 		return 0;
@@ -527,7 +528,7 @@ uint16_t bus::read(const uint16_t addr_in, const word_mode_t word_mode, const rm
 	else
 		temp = m->read_word(m_offset);
 
-	TRACE("READ from %06o/%07o %c %c: %06o (%s)", addr_in, m_offset, space == d_space ? 'D' : 'I', word_mode == wm_byte ? 'B' : 'W', temp, mode_selection == rm_prev ? "prev" : "cur");
+	TRACE(tc_bus_io, "READ from %06o/%07o %c %c: %06o (%s)", addr_in, m_offset, space == d_space ? 'D' : 'I', word_mode == wm_byte ? 'B' : 'W', temp, mode_selection == rm_prev ? "prev" : "cur");
 
 	return temp;
 }
@@ -559,15 +560,21 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 
 	uint32_t m_offset = mmu_->calculate_physical_address(run_mode, addr_in, true, space);
 
+	if (c->get_tracer())
+		c->get_tracer()->add_memory_write(addr_in, word_mode, value);
+
 	uint32_t io_base  = mmu_->get_io_base();
 	bool     is_io    = m_offset >= io_base;
 
 	if (is_io) {
 		uint16_t a = m_offset - io_base + 0160000;  // TODO
 
+		if (watch_io_writes) [[unlikely]]
+			m->set_watch_hit();
+
 		if (word_mode == wm_byte) {
 			if (a == ADDR_PSW || a == ADDR_PSW + 1) { // PSW
-				TRACE("WRITE-I/O PSW %s: %03o", a & 1 ? "MSB" : "LSB", value);
+				TRACE(tc_bus_io, "WRITE-I/O PSW %s: %03o", a & 1 ? "MSB" : "LSB", value);
 
 				uint16_t vtemp = c->getPSW();
 
@@ -581,7 +588,7 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 			}
 
 			if (a == ADDR_STACKLIM || a == ADDR_STACKLIM + 1) { // stack limit register
-				TRACE("WRITE-I/O stack limit register %s: %03o", a & 1 ? "MSB" : "LSB", value);
+				TRACE(tc_bus_io, "WRITE-I/O stack limit register %s: %03o", a & 1 ? "MSB" : "LSB", value);
 
 				uint16_t v = c->getStackLimitRegister();
 
@@ -595,7 +602,7 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 			}
 
 			if (a == ADDR_MICROPROG_BREAK_REG || a == ADDR_MICROPROG_BREAK_REG + 1) {  // microprogram break register
-				TRACE("WRITE-I/O micropram break register %s: %03o", a & 1 ? "MSB" : "LSB", value);
+				TRACE(tc_bus_io, "WRITE-I/O micropram break register %s: %03o", a & 1 ? "MSB" : "LSB", value);
 
 				update_word(&microprogram_break_register, a & 1, value);
 
@@ -603,7 +610,7 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 			}
 
 			if (a == ADDR_MMR0 || a == ADDR_MMR0 + 1) { // MMR0
-				TRACE("WRITE-I/O MMR0 register %s: %03o", a & 1 ? "MSB" : "LSB", value);
+				TRACE(tc_bus_io, "WRITE-I/O MMR0 register %s: %03o", a & 1 ? "MSB" : "LSB", value);
 
 				uint16_t temp = mmu_->getMMR0();
 				update_word(&temp, a & 1, value);
@@ -614,77 +621,77 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 		}
 		else {
 			if (a == ADDR_PSW) { // PSW
-				TRACE("WRITE-I/O PSW: %06o", value);
+				TRACE(tc_bus_io, "WRITE-I/O PSW: %06o", value);
 				c->setPSW(value & ~16, false);
 				return { true };
 			}
 
 			if (a == ADDR_STACKLIM) { // stack limit register
-				TRACE("WRITE-I/O stack limit register: %06o", value);
+				TRACE(tc_bus_io, "WRITE-I/O stack limit register: %06o", value);
 				c->setStackLimitRegister(value & 0xff00);
 				return false;
 			}
 
 			if (a >= ADDR_KERNEL_R && a <= ADDR_KERNEL_R + 5) { // kernel R0-R5
 				int reg = a - ADDR_KERNEL_R;
-				TRACE("WRITE-I/O kernel R%d: %06o", reg, value);
+				TRACE(tc_bus_io, "WRITE-I/O kernel R%d: %06o", reg, value);
 				c->set_register(reg, value);
 				return false;
 			}
 			if (a >= ADDR_USER_R && a <= ADDR_USER_R + 5) { // user R0-R5
 				int reg = a - ADDR_USER_R;
-				TRACE("WRITE-I/O user R%d: %06o", reg, value);
+				TRACE(tc_bus_io, "WRITE-I/O user R%d: %06o", reg, value);
 				c->set_register(reg, value);
 				return false;
 			}
 			if (a == ADDR_KERNEL_SP) { // kernel SP
-				TRACE("WRITE-I/O kernel SP: %06o", value);
+				TRACE(tc_bus_io, "WRITE-I/O kernel SP: %06o", value);
 				c->setStackPointer(0, value);
 				return false;
 			}
 			if (a == ADDR_PC) { // PC
-				TRACE("WRITE-I/O PC: %06o", value);
+				TRACE(tc_bus_io, "WRITE-I/O PC: %06o", value);
 				c->setPC(value);
 				return false;
 			}
 			if (a == ADDR_SV_SP) { // supervisor SP
-				TRACE("WRITE-I/O supervisor sp: %06o", value);
+				TRACE(tc_bus_io, "WRITE-I/O supervisor sp: %06o", value);
 				c->setStackPointer(1, value);
 				return false;
 			}
 			if (a == ADDR_USER_SP) { // user SP
-				TRACE("WRITE-I/O user sp: %06o", value);
+				TRACE(tc_bus_io, "WRITE-I/O user sp: %06o", value);
 				c->setStackPointer(3, value);
 				return false;
 			}
 
 			if (a == ADDR_MICROPROG_BREAK_REG) {  // microprogram break register
-				TRACE("WRITE-I/O microprogram break register: %06o", value);
+				TRACE(tc_bus_io, "WRITE-I/O microprogram break register: %06o", value);
 				microprogram_break_register = value & 0xff; // only 8b on 11/70?
 				return false;
 			}
 		}
 
 		if (a == ADDR_CPU_ERR) { // cpu error register
-			TRACE("WRITE-I/O CPUERR: %06o", value);
+			TRACE(tc_bus_io, "WRITE-I/O CPUERR: %06o", value);
 			mmu_->setCPUERR(0);
 			return false;
 		}
 
 		if (a == ADDR_MMR3) { // MMR3
-			TRACE("WRITE-I/O set MMR3: %06o", value);
+			TRACE(tc_bus_io, "WRITE-I/O set MMR3: %06o", value);
 			mmu_->setMMR3(value);
 			return false;
 		}
 
 		if (a == ADDR_MMR0) { // MMR0
-			TRACE("WRITE-I/O set MMR0: %06o", value);
+			TRACE(tc_bus_io, "WRITE-I/O set MMR0: %06o", value);
 			mmu_->setMMR0(value);
 			return false;
 		}
 
 		if (a == ADDR_PIR) { // PIR
-			TRACE("WRITE-I/O set PIR: %06o", value);
+			TRACE(tc_bus_io, "WRITE-I/O set PIR: %06o", value);
 
 			value &= 0177000;
 
@@ -707,25 +714,25 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 		}
 
 		if (tm11 && a >= TM_11_BASE && a < TM_11_END) {
-			TRACE("WRITE-I/O TM11 register %d: %06o", (a - TM_11_BASE) / 2, value);
+			TRACE(tc_bus_io, "WRITE-I/O TM11 register %d: %06o", (a - TM_11_BASE) / 2, value);
 			word_mode == wm_byte ? tm11->write_byte(a, value) : tm11->write_word(a, value);
 			return false;
 		}
 
 		if (rk05_ && a >= RK05_BASE && a < RK05_END) {
-			TRACE("WRITE-I/O RK05 register %d: %06o", (a - RK05_BASE) / 2, value);
+			TRACE(tc_bus_io, "WRITE-I/O RK05 register %d: %06o", (a - RK05_BASE) / 2, value);
 			word_mode == wm_byte ? rk05_->write_byte(a, value) : rk05_->write_word(a, value);
 			return false;
 		}
 
 		if (rl02_ && a >= RL02_BASE && a < RL02_END) {
-			TRACE("WRITE-I/O RL02 register %d: %06o", (a - RL02_BASE) / 2, value);
+			TRACE(tc_bus_io, "WRITE-I/O RL02 register %d: %06o", (a - RL02_BASE) / 2, value);
 			word_mode == wm_byte ? rl02_->write_byte(a, value) : rl02_->write_word(a, value);
 			return false;
 		}
 
 		if (tty_ && a >= PDP11TTY_BASE && a < PDP11TTY_END) {
-			TRACE("WRITE-I/O TTY register %d: %06o", (a - PDP11TTY_BASE) / 2, value);
+			TRACE(tc_bus_io, "WRITE-I/O TTY register %d: %06o", (a - PDP11TTY_BASE) / 2, value);
 			word_mode == wm_byte ? tty_->write_byte(a, value) : tty_->write_word(a, value);
 			return false;
 		}
@@ -741,7 +748,7 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 		}
 
 		if (a >= 0172100 && a <= 0172137) {  // MM11-LP parity
-			TRACE("WRITE-I/O MM11-LP parity (%06o): %o", a, value);
+			TRACE(tc_bus_io, "WRITE-I/O MM11-LP parity (%06o): %o", a, value);
 			return false;
 		}
 
@@ -764,7 +771,7 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 		}
 
 		if (a >= 0170200 && a <= 0170377) { // unibus map
-			TRACE("writing %06o to unibus map (%06o)", value, a);
+			TRACE(tc_bus_io, "writing %06o to unibus map (%06o)", value, a);
 			// TODO
 			return false;
 		}
@@ -782,10 +789,10 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 
 		///////////
 
-		TRACE("WRITE-I/O UNHANDLED %08o(%c): %06o (base: %o)", m_offset, word_mode == wm_byte ? 'B' : 'W', value, mmu_->get_io_base());
+		TRACE(tc_bus_io, "WRITE-I/O UNHANDLED %08o(%c): %06o (base: %o)", m_offset, word_mode == wm_byte ? 'B' : 'W', value, mmu_->get_io_base());
 
 		if (word_mode == wm_word && (a & 1)) [[unlikely]] {
-			TRACE("WRITE-I/O to %08o (value: %06o) - odd address!", m_offset, value);
+			TRACE(tc_bus_io, "WRITE-I/O to %08o (value: %06o) - odd address!", m_offset, value);
 
 			mmu_->trap_if_odd(a, run_mode, space, true);
 
@@ -798,14 +805,14 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 	}
 
 	if ( (addr_in & 1) && word_mode == wm_word) [[unlikely]] {
-		TRACE("WRITE to %06o (value: %06o) - odd address!", addr_in, value);
+		TRACE(tc_bus_io, "WRITE to %06o (value: %06o) - odd address!", addr_in, value);
 
 		mmu_->trap_if_odd(addr_in, run_mode, space, true);
 
 		throw 10;
 	}
 
-	TRACE("WRITE to %06o/%07o %c %c: %06o", addr_in, m_offset, space == d_space ? 'D' : 'I', word_mode == wm_byte ? 'B' : 'W', value);
+	TRACE(tc_bus_io, "WRITE to %06o/%07o %c %c: %06o", addr_in, m_offset, space == d_space ? 'D' : 'I', word_mode == wm_byte ? 'B' : 'W', value);
 
 	if (m_offset >= m->get_memory_size()) {
 		c->trap(004);  // no such RAM
@@ -822,10 +829,10 @@ bool bus::write(const uint16_t addr_in, const word_mode_t word_mode, uint16_t va
 
 void bus::write_physical(const uint32_t a, const uint16_t value)
 {
-	TRACE("physicalWRITE %06o to %o", value, a);
+	TRACE(tc_bus_io, "physicalWRITE %06o to %o", value, a);
 
 	if (a >= m->get_memory_size()) {
-		TRACE("physicalWRITE to %o: trap 004", a);
+		TRACE(tc_bus_io, "physicalWRITE to %o: trap 004", a);
 		c->trap(004);
 		throw 12;
 	}
@@ -837,14 +844,14 @@ void bus::write_physical(const uint32_t a, const uint16_t value)
 uint16_t bus::read_physical(const uint32_t a)
 {
 	if (a >= m->get_memory_size()) {
-		TRACE("physicalREAD from %o: trap 004", a);
+		TRACE(tc_bus_io, "physicalREAD from %o: trap 004", a);
 		c->trap(004);
 		throw 13;
 	}
 
 	uint16_t value = m->read_word(a);
 
-	TRACE("physicalREAD %06o from %o", value, a);
+	TRACE(tc_bus_io, "physicalREAD %06o from %o", value, a);
 
 	return value;
 }
@@ -875,13 +882,13 @@ uint8_t bus::read_unibus_byte(const uint32_t a)
 	uint8_t v = 0;
 	if (a < m->get_memory_size())
 		v = m->read_byte(a);
-	TRACE("read_unibus_byte[%08o]=%03o", a, v);
+	TRACE(tc_bus_io, "read_unibus_byte[%08o]=%03o", a, v);
 	return v;
 }
 
 void bus::write_unibus_byte(const uint32_t a, const uint8_t v)
 {
-	TRACE("write_unibus_byte[%08o]=%03o", a, v);
+	TRACE(tc_bus_io, "write_unibus_byte[%08o]=%03o", a, v);
 	if (a < m->get_memory_size())
 		m->write_byte(a, v);
 }
@@ -78,6 +78,8 @@ private:
 	uint16_t console_switches { 0 };
 	uint16_t console_leds     { 0 };
 
+	bool     watch_io_writes  { false };  // I/O writes (e.g. to the MMU) set the watch-hit flag of the memory
+
 public:
 	bus();
 	~bus();
@@ -97,6 +99,7 @@ public:
 	uint16_t get_console_leds() { return console_leds; }
 
 	void set_memory_size(const int n_pages);
+	void set_watch_io_writes(const bool state) { watch_io_writes = state; }
 
 	void add_ram   (memory *const m      );
 	void add_cpu   (cpu    *const c      );
@@ -68,7 +68,7 @@ static bool setup_telnet_session(const int fd)
 	return true;
 }
 
-comm_tcp_socket_server::comm_tcp_socket_server(const int port) : port(port)
+comm_tcp_socket_server::comm_tcp_socket_server(const int port, const bool own_thread) : port(port), own_thread(own_thread)
 {
 }
 
@@ -91,6 +91,9 @@ comm_tcp_socket_server::~comm_tcp_socket_server()
 
 bool comm_tcp_socket_server::begin()
 {
+	if (own_thread == false)
+		return setup_listener();
+
 	th = new std::thread(std::ref(*this));
 
 	return true;
@@ -111,7 +114,7 @@ bool comm_tcp_socket_server::has_data()
 	int rc = WSAPoll(fds, 1, 0);
 #else
 	pollfd    fds[] { { cfd, POLLIN, 0 } };
-	int rc = poll(fds, 1, 0);
+	int rc = ::poll(fds, 1, 0);
 #endif
 
 	return rc == 1;
@@ -157,12 +160,8 @@ void comm_tcp_socket_server::send_data(const uint8_t *const in, const size_t n)
 	}
 }
 
-void comm_tcp_socket_server::operator()()
+bool comm_tcp_socket_server::setup_listener()
 {
-	set_thread_name("kek:COMMTCPS");
-
-	DOLOG(info, true, "TCP comm thread started for port %d", port);
-
 	fd = socket(AF_INET, SOCK_STREAM, 0);
 
 	int reuse_addr = 1;
@@ -171,7 +170,7 @@ void comm_tcp_socket_server::operator()()
 		fd = INVALID_SOCKET;
 
 		DOLOG(warning, true, "Cannot set reuseaddress for port %d (comm_tcp_socket_server)", port);
-		return;
+		return false;
 	}
 
 	set_nodelay(fd);
@@ -187,7 +186,7 @@ void comm_tcp_socket_server::operator()()
 
 		close(fd);
 		fd = INVALID_SOCKET;
-		return;
+		return false;
 	}
 
 	if (listen(fd, SOMAXCONN) == -1) {
@@ -195,48 +194,67 @@ void comm_tcp_socket_server::operator()()
 		fd = INVALID_SOCKET;
 
 		DOLOG(warning, true, "Cannot listen on port %d (comm_tcp_socket_server)", port);
-		return;
+		return false;
 	}
 
+	return true;
+}
+
+// waits up to 'timeout' ms for a connection
+void comm_tcp_socket_server::accept_connection(const int timeout)
+{
 #if defined(_WIN32)
 	WSAPOLLFD fds[] { { fd, POLLIN, 0 } };
+	int rc = WSAPoll(fds, 1, timeout);
 #else
 	pollfd    fds[] { { fd, POLLIN, 0 } };
+	int rc = ::poll(fds, 1, timeout);
 #endif
+	if (rc == 0)
+		return;
 
-	while(!stop_flag) {
-#if defined(_WIN32)
-		int rc = WSAPoll(fds, 1, 100);
-#else
-		int rc = poll(fds, 1, 100);
-#endif
-		if (rc == 0)
-			continue;
-
-		std::unique_lock<std::mutex> lck(cfd_lock);
+	std::unique_lock<std::mutex> lck(cfd_lock);
 
-		// disconnect any existing client session
-		// yes, one can 'DOS' with this
-		if (cfd != INVALID_SOCKET) {
-			close(cfd);
-			DOLOG(info, false, "Restarting session for port %d", port);
-		}
+	// disconnect any existing client session
+	// yes, one can 'DOS' with this
+	if (cfd != INVALID_SOCKET) {
+		close(cfd);
+		DOLOG(info, false, "Restarting session for port %d", port);
+	}
 
-		cfd = accept(fd, nullptr, nullptr);
+	cfd = accept(fd, nullptr, nullptr);
 
-		if (cfd != INVALID_SOCKET) {
-			set_nodelay(cfd);
+	if (cfd != INVALID_SOCKET) {
+		set_nodelay(cfd);
 
-			DOLOG(info, false, "Connected with %s", get_endpoint_name(cfd).c_str());
-		}
+		DOLOG(info, false, "Connected with %s", get_endpoint_name(cfd).c_str());
+	}
 
 #if 0
-		if (setup_telnet_session(cfd) == false) {
-			close(cfd);
-			cfd = INVALID_SOCKET;
-		}
-#endif
+	if (setup_telnet_session(cfd) == false) {
+		close(cfd);
+		cfd = INVALID_SOCKET;
 	}
+#endif
+}
+
+void comm_tcp_socket_server::poll()
+{
+	if (fd != INVALID_SOCKET)
+		accept_connection(0);
+}
+
+void comm_tcp_socket_server::operator()()
+{
+	set_thread_name("kek:COMMTCPS");
+
+	DOLOG(info, true, "TCP comm thread started for port %d", port);
+
+	if (setup_listener() == false)
+		return;
+
+	while(!stop_flag)
+		accept_connection(100);
 
 	DOLOG(info, true, "comm_tcp_socket_server thread terminating");
 }
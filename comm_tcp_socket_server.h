@@ -22,14 +22,20 @@ class comm_tcp_socket_server: public comm
 {
 private:
 	const int        port      { -1             };
+	const bool       own_thread { true          };
 	std::atomic_bool stop_flag { false          };
 	SOCKET           fd        { INVALID_SOCKET };
 	SOCKET           cfd       { INVALID_SOCKET };
         std::mutex       cfd_lock;
 	std::thread     *th        { nullptr        };
 
+	bool    setup_listener();
+	void    accept_connection(const int timeout);
+
 public:
-	comm_tcp_socket_server(const int port);
+	// without 'own_thread', begin() listens and the owner invokes poll()
+	// to accept connections
+	comm_tcp_socket_server(const int port, const bool own_thread = true);
 	virtual ~comm_tcp_socket_server();
 
 	bool    begin() override;
@@ -47,4 +53,5 @@ public:
 	void    send_data(const uint8_t *const in, const size_t n) override;
 
 	void    operator()();
+	void    poll();
 };
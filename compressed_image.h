@@ -0,0 +1,31 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <stdint.h>
+
+
+// A disk image in chunks that are each compressed with zlib, so that they
+// can be decompressed independently:
+//
+//   header
+//   chunk 0, chunk 1, ...
+//   index: n_chunks + 1 file offsets (uint64_t), chunk i is from
+//          index[i] up to index[i + 1]
+//
+// A chunk that does not get smaller is stored as is: it is recognized by
+// its length being the chunk size. The index is at the end so that the
+// converter can read the image from a pipe. All values are little endian.
+
+static const char compressed_image_magic[8] = { 'K', 'E', 'K', 'C', 'I', 'M', 'G', '1' };
+
+constexpr const uint32_t compressed_image_default_chunk_size = 65536;
+
+typedef struct {
+	char     magic[8];
+	uint32_t chunk_size;  // all chunks but the last one decompress to this many bytes
+	uint32_t n_chunks;
+	uint64_t image_size;  // in bytes
+	uint64_t index_offset;
+} compressed_image_header_t;
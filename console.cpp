@@ -285,7 +285,7 @@ void console::put_char(const char c)
 		tx = 0;
 	else if (c == 10) {
 		if (debug_buffer.empty() == false) {
-			TRACE("TTY: %s", debug_buffer.c_str());
+			TRACE(tc_tty, "TTY: %s", debug_buffer.c_str());
 
 			debug_buffer.clear();
 		}
@@ -341,7 +341,7 @@ void console::put_string(const std::string & what)
 
 void console::operator()()
 {
-	TRACE("Console thread started");
+	TRACE(tc_tty, "Console thread started");
 
 	set_thread_name("kek::console");
 
@@ -372,12 +372,12 @@ void console::operator()()
 
 			uint8_t value = 1;
 			if (xQueueSend(have_data, &value, portMAX_DELAY) == pdFALSE)
-				TRACE("xQueueSend failed");
+				TRACE(tc_tty, "xQueueSend failed");
 #else
 			have_data.notify_all();
 #endif
 		}
 	}
 
-	TRACE("Console thread terminating");
+	TRACE(tc_tty, "Console thread terminating");
 }
@@ -0,0 +1,65 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <errno.h>
+#include <string.h>
+
+#include "console_headless.h"
+#include "log.h"
+#include "utils.h"
+
+
+console_headless::console_headless(std::atomic_uint32_t *const stop_event, const std::string & output_file): console(stop_event)
+{
+	if (output_file.empty() == false) {
+		fh = fopen(output_file.c_str(), "a+");
+
+		if (!fh)
+			DOLOG(warning, true, "console_headless: cannot create \"%s\": %s", output_file.c_str(), strerror(errno));
+	}
+}
+
+console_headless::~console_headless()
+{
+	stop_thread();
+
+	if (fh)
+		fclose(fh);
+}
+
+int console_headless::wait_for_char_ll(const short timeout)
+{
+	myusleep(timeout * 1000l);
+
+	return -1;
+}
+
+void console_headless::put_char_ll(const char c)
+{
+	if (fh) {
+		fputc(c, fh);
+
+		if (c == 10)
+			fflush(fh);
+	}
+
+	if (output_handler)
+		output_handler(c);
+}
+
+void console_headless::put_string_lf(const std::string & what)
+{
+	put_string(what + "\n");
+}
+
+void console_headless::resize_terminal()
+{
+}
+
+void console_headless::refresh_virtual_terminal()
+{
+}
+
+void console_headless::panel_update_thread()
+{
+}
@@ -0,0 +1,40 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <functional>
+#include <stdio.h>
+#include <string>
+
+#include "console.h"
+
+
+// a console without a terminal: there's no input and the output goes to
+// a file (if any). used when running more than one machine in a process.
+class console_headless : public console
+{
+private:
+	FILE *fh { nullptr };
+	std::function<void(const char c)> output_handler;
+
+protected:
+	int  wait_for_char_ll(const short timeout) override;
+
+	void put_char_ll(const char c) override;
+
+public:
+	console_headless(std::atomic_uint32_t *const stop_event, const std::string & output_file);
+	virtual ~console_headless();
+
+	// is invoked for every character the machine prints (e.g. to scan it)
+	void set_output_handler(std::function<void(const char c)> handler) { output_handler = handler; }
+
+	void resize_terminal() override;
+
+	void put_string_lf(const std::string & what) override;
+
+	void refresh_virtual_terminal() override;
+
+	void panel_update_thread() override;
+};
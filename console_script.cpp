@@ -0,0 +1,310 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <ArduinoJson.h>
+#include <chrono>
+#include <errno.h>
+#include <fstream>
+#include <string.h>
+
+#include "bus.h"
+#include "console_script.h"
+#include "cpu.h"
+#include "error.h"
+#include "gen.h"
+#include "log.h"
+#include "utils.h"
+
+
+constexpr const size_t max_output_backlog = 65536;
+
+console_script::console_script(std::atomic_uint32_t *const stop_event, const std::string & script_file, const std::string & results_file, const std::string & transcript_file):
+	console(stop_event),
+	script_file(script_file),
+	results_file(results_file)
+{
+	if (load_script() == false)
+		error_exit(false, "Cannot use script \"%s\"", script_file.c_str());
+
+	if (transcript_file.empty() == false) {
+		transcript = fopen(transcript_file.c_str(), "a+");
+
+		if (!transcript)
+			DOLOG(warning, true, "console_script: cannot create \"%s\": %s", transcript_file.c_str(), strerror(errno));
+	}
+}
+
+console_script::~console_script()
+{
+	stop_script = true;
+	cv_output.notify_all();
+
+	if (script_th) {
+		script_th->join();
+		delete script_th;
+	}
+
+	stop_thread();
+
+	if (transcript)
+		fclose(transcript);
+}
+
+std::string console_script::unescape(const std::string & in)
+{
+	std::string out;
+
+	for(size_t i=0; i<in.size(); i++) {
+		if (in[i] != '\\' || i + 1 == in.size()) {
+			out += in[i];
+			continue;
+		}
+
+		char c = in[++i];
+
+		if (c == 'r')
+			out += '\r';
+		else if (c == 'n')
+			out += '\n';
+		else if (c == 't')
+			out += '\t';
+		else if (c == 'x' && i + 2 < in.size() && parse_number(in.substr(i + 1, 2), 16).has_value()) {
+			out += char(parse_number(in.substr(i + 1, 2), 16).value());
+			i += 2;
+		}
+		else
+			out += c;
+	}
+
+	return out;
+}
+
+bool console_script::load_script()
+{
+	std::ifstream fh(script_file);
+	if (!fh.is_open()) {
+		DOLOG(warning, true, "console_script: cannot open \"%s\"", script_file.c_str());
+		return false;
+	}
+
+	std::string line;
+	int         line_nr = 0;
+
+	while(std::getline(fh, line)) {
+		line_nr++;
+
+		if (line.empty() == false && line.back() == '\r')
+			line.pop_back();
+
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::size_t space     = line.find(' ');
+		std::string command   = line.substr(0, space);
+		std::string parameter = space == std::string::npos ? "" : line.substr(space + 1);
+
+		script_step_t step { SS_EXPECT, parameter, line_nr };
+
+		if (command == "expect" || command == "send") {
+			step.type      = command == "expect" ? SS_EXPECT : SS_SEND;
+			step.parameter = unescape(parameter);
+		}
+		else if (command == "mark")
+			step.type = SS_MARK;
+		else if (command == "timeout" || command == "sleep") {
+			step.type = command == "timeout" ? SS_TIMEOUT : SS_SLEEP;
+
+			if (parse_number(parameter).value_or(-1) < 0) {
+				DOLOG(warning, true, "console_script: \"%s\" on line %d expects a number, not \"%s\"", command.c_str(), line_nr, parameter.c_str());
+				return false;
+			}
+		}
+		else {
+			DOLOG(warning, true, "console_script: \"%s\" on line %d is not understood", command.c_str(), line_nr);
+			return false;
+		}
+
+		if (step.parameter.empty()) {
+			DOLOG(warning, true, "console_script: \"%s\" on line %d requires a parameter", command.c_str(), line_nr);
+			return false;
+		}
+
+		steps.push_back(step);
+	}
+
+	return true;
+}
+
+void console_script::begin()
+{
+	script_th = new std::thread(&console_script::run_script, this);
+}
+
+bool console_script::wait_for_output(const std::string & pattern, const int timeout_s)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	auto end = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_s);
+
+	for(;;) {
+		std::size_t pos = output.find(pattern);
+
+		if (pos != std::string::npos) {
+			output.erase(0, pos + pattern.size());
+			return true;
+		}
+
+		if (stop_script || *stop_event == EVENT_TERMINATE)
+			return false;
+
+		if (cv_output.wait_until(lck, end) == std::cv_status::timeout)
+			return output.find(pattern) != std::string::npos;
+	}
+}
+
+void console_script::run_script()
+{
+	set_thread_name("kek:script");
+
+	cpu     *c          = b->getCpu();
+	uint64_t start_ts   = get_us();
+	uint64_t start_inst = c->get_instructions_executed_count();
+	uint64_t prev_ts    = start_ts;
+	uint64_t prev_inst  = start_inst;
+	int      timeout_s  = 300;
+
+	JsonDocument j;
+	j["script"] = script_file;
+	JsonArray marks = j["marks"].to<JsonArray>();
+
+	bool        ok = true;
+	std::string error;
+
+	for(auto & step: steps) {
+		if (step.type == SS_EXPECT) {
+			if (wait_for_output(step.parameter, timeout_s) == false) {
+				error = format("line %d: expected output did not appear within %d seconds", step.line_nr, timeout_s);
+				ok    = false;
+				break;
+			}
+		}
+		else if (step.type == SS_SEND) {
+			std::unique_lock<std::mutex> lck(lock);
+
+			for(auto ch: step.parameter)
+				input.push_back(ch);
+
+			cv_input.notify_all();
+		}
+		else if (step.type == SS_MARK) {
+			uint64_t now_ts   = get_us();
+			uint64_t now_inst = c->get_instructions_executed_count();
+
+			JsonObject mark = marks.add<JsonObject>();
+			mark["name"]                  = step.parameter;
+			mark["ms"]                    = (now_ts - start_ts) / 1000;
+			mark["instructions"]          = now_inst - start_inst;
+			// since the previous mark
+			mark["interval-ms"]           = (now_ts - prev_ts) / 1000;
+			mark["interval-instructions"] = now_inst - prev_inst;
+			mark["interval-mips"]         = now_ts > prev_ts ? double(now_inst - prev_inst) / (now_ts - prev_ts) : 0.;
+
+			DOLOG(info, false, "console_script: mark \"%s\" at %.3f seconds", step.parameter.c_str(), (now_ts - start_ts) / 1000000.);
+
+			prev_ts   = now_ts;
+			prev_inst = now_inst;
+		}
+		else if (step.type == SS_TIMEOUT) {
+			timeout_s = parse_number(step.parameter).value();
+		}
+		else if (step.type == SS_SLEEP) {
+			myusleep(parse_number(step.parameter).value() * 1000l);
+		}
+
+		if (stop_script)
+			return;
+	}
+
+	uint64_t end_ts   = get_us();
+	uint64_t end_inst = c->get_instructions_executed_count();
+
+	j["completed"]    = ok;
+	if (!ok)
+		j["error"] = error;
+	j["total-ms"]     = (end_ts - start_ts) / 1000;
+	j["instructions"] = end_inst - start_inst;
+	j["mips"]         = end_ts > start_ts ? double(end_inst - start_inst) / (end_ts - start_ts) : 0.;
+
+	std::string out;
+	serializeJsonPretty(j, out);
+
+	if (results_file.empty())
+		printf("%s\n", out.c_str());
+	else {
+		FILE *fh = fopen(results_file.c_str(), "w");
+		if (fh) {
+			fprintf(fh, "%s\n", out.c_str());
+			fclose(fh);
+		}
+		else {
+			DOLOG(warning, true, "console_script: cannot create \"%s\": %s", results_file.c_str(), strerror(errno));
+		}
+	}
+
+	if (!ok)
+		DOLOG(warning, true, "console_script: %s", error.c_str());
+
+	*stop_event = EVENT_TERMINATE;
+}
+
+int console_script::wait_for_char_ll(const short timeout)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	if (input.empty())
+		cv_input.wait_for(lck, std::chrono::milliseconds(timeout));
+
+	if (input.empty())
+		return -1;
+
+	char c = input.front();
+	input.pop_front();
+
+	return c;
+}
+
+void console_script::put_char_ll(const char c)
+{
+	if (transcript) {
+		fputc(c, transcript);
+
+		if (c == 10)
+			fflush(transcript);
+	}
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	output += c;
+
+	if (output.size() > max_output_backlog)
+		output.erase(0, output.size() - max_output_backlog / 2);
+
+	cv_output.notify_all();
+}
+
+void console_script::put_string_lf(const std::string & what)
+{
+	put_string(what + "\n");
+}
+
+void console_script::resize_terminal()
+{
+}
+
+void console_script::refresh_virtual_terminal()
+{
+}
+
+void console_script::panel_update_thread()
+{
+}
@@ -0,0 +1,76 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "console.h"
+
+
+typedef enum { SS_EXPECT, SS_SEND, SS_MARK, SS_TIMEOUT, SS_SLEEP } script_step_type_t;
+
+typedef struct {
+	script_step_type_t type;
+	std::string        parameter;
+	int                line_nr;
+} script_step_t;
+
+// A console driven by an expect-like script instead of a terminal: it
+// waits for patterns in the output, types text and records the time (and
+// instruction count) at marks. When the script ends, the results are
+// written as JSON and the emulation is stopped.
+//
+// script commands (one per line, # for comments):
+//   expect text   wait until 'text' was printed (C-style escapes: \r \n \t \\ \xNN)
+//   send text     type 'text'
+//   mark name     record the elapsed time under 'name'
+//   timeout sec   maximum time for each following expect (default: 300)
+//   sleep ms      pause the script
+class console_script : public console
+{
+private:
+	const std::string          script_file;
+	const std::string          results_file;  // empty: stdout
+	FILE                      *transcript { nullptr };
+	std::vector<script_step_t> steps;
+
+	std::mutex                 lock;
+	std::condition_variable    cv_output;
+	std::condition_variable    cv_input;
+	std::string                output;  // everything not matched yet by an 'expect'
+	std::deque<char>           input;
+
+	std::thread               *script_th { nullptr };
+	std::atomic_bool           stop_script { false };
+
+	static std::string unescape(const std::string & in);
+	bool         load_script();
+	bool         wait_for_output(const std::string & pattern, const int timeout_s);
+	void         run_script();
+
+protected:
+	int  wait_for_char_ll(const short timeout) override;
+
+	void put_char_ll(const char c) override;
+
+public:
+	console_script(std::atomic_uint32_t *const stop_event, const std::string & script_file, const std::string & results_file, const std::string & transcript_file);
+	virtual ~console_script();
+
+	void begin() override;
+
+	void resize_terminal() override;
+
+	void put_string_lf(const std::string & what) override;
+
+	void refresh_virtual_terminal() override;
+
+	void panel_update_thread() override;
+};
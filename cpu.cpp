@@ -9,8 +9,13 @@
 #include "breakpoint.h"
 #include "bus.h"
 #include "cpu.h"
+#include "cpu_statistics.h"
 #include "gen.h"
+#include "hle.h"
+#include "journal.h"
 #include "log.h"
+#include "profiler.h"
+#include "trace_recorder.h"
 #include "utils.h"
 
 
@@ -35,6 +40,38 @@ cpu::cpu(bus *const b, std::atomic_uint32_t *const event) : b(b), event(event)
 
 cpu::~cpu()
 {
+	delete hle_;
+	delete tracer;
+	delete profiler_;
+	delete stats;
+}
+
+void cpu::set_hle(hle *const h)
+{
+	delete hle_;
+
+	hle_ = h;
+}
+
+void cpu::set_tracer(trace_recorder *const t)
+{
+	delete tracer;
+
+	tracer = t;
+}
+
+void cpu::set_profiler(profiler *const p)
+{
+	delete profiler_;
+
+	profiler_ = p;
+}
+
+void cpu::set_statistics(cpu_statistics *const s)
+{
+	delete stats;
+
+	stats = s;
 }
 
 void cpu::init_interrupt_queue()
@@ -55,8 +92,33 @@ void cpu::emulation_start()
 
 std::optional<std::string> cpu::check_breakpoint()
 {
-	for(auto & bp: breakpoints) {
-		auto rc = bp.second->is_triggered();
+	if (bp_pc_bitmap.empty() == false) {
+		uint16_t pc = getPC();
+
+		if (bp_pc_bitmap[pc >> 6] & (uint64_t(1) << (pc & 63))) {
+			for(auto & bp: bp_at_pc) {
+				auto rc = bp->is_triggered();
+				if (rc.has_value())
+					return rc;
+			}
+		}
+	}
+
+	if (bp_on_write.empty() == false && b->getRAM()->get_and_clear_watch_hit()) {
+		if (bp_has_virtual)
+			update_watched_addresses();
+
+		for(auto & bp: bp_on_write) {
+			auto rc = bp->is_triggered();
+			if (rc.has_value()) {
+				b->getRAM()->set_watch_hit();  // keep reporting it while it holds
+				return rc;
+			}
+		}
+	}
+
+	for(auto & bp: bp_always) {
+		auto rc = bp->is_triggered();
 		if (rc.has_value())
 			return rc;
 	}
@@ -64,10 +126,66 @@ std::optional<std::string> cpu::check_breakpoint()
 	return { };
 }
 
+void cpu::update_watched_addresses()
+{
+	std::set<uint32_t> addresses;
+
+	for(auto & bp: bp_on_write)
+		bp->get_watched_addresses(&addresses, &bp_has_virtual);
+
+	if (addresses != bp_watched) {
+		bp_watched = addresses;
+
+		b->getRAM()->set_watched_addresses(bp_watched);
+	}
+}
+
+// Instead of evaluating all breakpoints before each instruction, they are
+// grouped: those that can only trigger at specific PC values are looked up
+// in a bitmap, those that only depend on memory contents are evaluated
+// after a write to one of the addresses involved (the memory flags those
+// writes). Only what is left is evaluated for each instruction.
+void cpu::compile_breakpoints()
+{
+	bp_pc_bitmap.clear();
+	bp_at_pc.clear();
+	bp_on_write.clear();
+	bp_always.clear();
+	bp_has_virtual = false;
+
+	for(auto & bp: breakpoints) {
+		auto guard = bp.second->get_pc_guard();
+
+		if (guard.has_value()) {
+			if (bp_pc_bitmap.empty())
+				bp_pc_bitmap.resize(65536 / 64);
+
+			for(auto pc: guard.value())
+				bp_pc_bitmap[pc >> 6] |= uint64_t(1) << (pc & 63);
+
+			bp_at_pc.push_back(bp.second);
+		}
+		else if (bp.second->is_memory_only()) {
+			bp_on_write.push_back(bp.second);
+		}
+		else {
+			bp_always.push_back(bp.second);
+		}
+	}
+
+	update_watched_addresses();
+
+	b->set_watch_io_writes(bp_has_virtual);  // the MMU could be reconfigured
+
+	b->getRAM()->set_watch_hit();  // the conditions may hold already
+}
+
 int cpu::set_breakpoint(breakpoint *const bp)
 {
 	breakpoints.insert({ ++bp_nr, bp });
 
+	compile_breakpoints();
+
 	return bp_nr;
 }
 
@@ -79,7 +197,11 @@ bool cpu::remove_breakpoint(const int bp_id)
 
 	delete it->second;
 
-	return breakpoints.erase(bp_id) == 1;
+	bool rc = breakpoints.erase(bp_id) == 1;
+
+	compile_breakpoints();
+
+	return rc;
 }
 
 std::map<int, breakpoint *> cpu::list_breakpoints()
@@ -143,22 +265,6 @@ void cpu::reset()
 	init_interrupt_queue();
 }
 
-uint16_t cpu::get_register(const int nr) const
-{
-	if (nr < 6) {
-		int set = get_register_set();
-
-		return regs0_5[set][nr];
-	}
-
-	if (nr == 6)
-		return sp[getPSW_runmode()];
-
-	assert(nr == 7);
-
-	return pc;
-}
-
 void cpu::set_register(const int nr, const uint16_t value)
 {
 	if (nr < 6) {
@@ -335,9 +441,8 @@ void cpu::setPSW_flags_nzv(const uint16_t value, const word_mode_t word_mode)
 
 bool cpu::check_pending_interrupts() const
 {
-	if (trap_delay.has_value() && trap_delay.value() > 1)
-		return false;
-
+	// no check for 'trap_delay': it only counts down while instructions
+	// are executed so a WAIT would never return (e.g. "spl 0; wait")
 	uint8_t start_level = getPSW_spl() + 1;
 
 	for(uint8_t i=start_level; i < 8; i++) {
@@ -365,7 +470,7 @@ bool cpu::execute_any_pending_interrupt()
 	if (trap_delay.has_value()) {
 		trap_delay.value()--;
 
-		TRACE("Delayed trap: %d instructions left", trap_delay.value());
+		TRACE(tc_interrupts, "Delayed trap: %d instructions left", trap_delay.value());
 
 		if (trap_delay.value() > 0)
 			return false;
@@ -403,7 +508,10 @@ bool cpu::execute_any_pending_interrupt()
 
 			interrupts->second.erase(vector);
 
-			TRACE("Invoking interrupt vector %o (IPL %d, current: %d)", v, i, current_level);
+			TRACE(tc_interrupts, "Invoking interrupt vector %o (IPL %d, current: %d)", v, i, current_level);
+
+			if (stats)
+				stats->count_interrupt(i, v);
 
 			trap(v, i, true);
 
@@ -452,7 +560,39 @@ void cpu::queue_interrupt(const uint8_t level, const uint8_t vector)
 
 	any_queued_interrupts = true;
 
-	TRACE("Queueing interrupt vector %o (IPL %d, current: %d), n: %zu", vector, level, getPSW_spl(), it->second.size());
+	TRACE(tc_interrupts, "Queueing interrupt vector %o (IPL %d, current: %d), n: %zu", vector, level, getPSW_spl(), it->second.size());
+
+#if !defined(BUILD_FOR_RP2040)
+	lck.unlock();
+#endif
+
+	if (wakeup_handler)
+		wakeup_handler();
+}
+
+bool cpu::unpark()
+{
+#if defined(BUILD_FOR_RP2040)
+	xSemaphoreTake(qi_lock, portMAX_DELAY);
+#else
+	std::unique_lock<std::mutex> lck(qi_lock);
+#endif
+
+	bool rc = check_pending_interrupts();
+
+	if (rc) {
+		parked     = false;
+
+		wait_time += get_us() - parked_since;  // used for MIPS calculation
+
+		TRACE(tc_cpu, "WAIT returned (unparked)");
+	}
+
+#if defined(BUILD_FOR_RP2040)
+	xSemaphoreGive(qi_lock);
+#endif
+
+	return rc;
 }
 
 void cpu::addToMMR1(const gam_rc_t & g)
@@ -474,6 +614,9 @@ gam_rc_t cpu::getGAM(const uint8_t mode, const uint8_t reg, const word_mode_t wo
 
 	g.space     = isR7_space;
 
+	if (stats)
+		stats->count_operand(mode, reg);
+
 	uint16_t next_word = 0;
 
 	switch(mode) {
@@ -838,7 +981,7 @@ bool cpu::additional_double_operand_instructions(const uint16_t instr)
 			        addToMMR1(g_dst);
 				uint16_t shift = g_dst.value.value() & 077;
 
-				TRACE("shift %06o with %d", R, shift);
+				TRACE(tc_cpu, "shift %06o with %d", R, shift);
 
 				bool     sign  = SIGN(R, wm_word);
 
@@ -1646,7 +1789,7 @@ bool cpu::condition_code_operations(const uint16_t instr)
 void cpu::pushStack(const uint16_t v)
 {
 	if (get_register(6) == stackLimitRegister) {
-		TRACE("stackLimitRegister reached %06o while pushing %06o", stackLimitRegister, v);
+		TRACE(tc_cpu, "stackLimitRegister reached %06o while pushing %06o", stackLimitRegister, v);
 
 		trap(04, 7);
 	}
@@ -1671,8 +1814,11 @@ bool cpu::misc_operations(const uint16_t instr)
 {
 	switch(instr) {
 		case 0b0000000000000000: // HALT
-			if (getPSW_runmode() == 0)  // only in kernel mode
+			if (getPSW_runmode() == 0) {  // only in kernel mode
 				*event = EVENT_HALT;
+
+				fr.dump(format("HALT at %06o", instruction_start), this);
+			}
 			else
 				trap(4);
 			return true;
@@ -1687,6 +1833,49 @@ bool cpu::misc_operations(const uint16_t instr)
 #else
 				std::unique_lock<std::mutex> lck(qi_lock);
 
+				if (journal_) {
+					// the asynchronous input is applied by this thread
+					// (at a known instruction count), also while waiting
+					lck.unlock();
+
+					for(;;) {
+						{
+							std::unique_lock<std::mutex> lck_check(qi_lock);
+
+							if (check_pending_interrupts())
+								break;
+						}
+
+						if (*event != EVENT_NONE)
+							break;
+
+						if (journal_->idle(instruction_count) == false) {
+							DOLOG(info, true, "WAIT without interrupts after the end of the replay, stopping");
+							*event = EVENT_TERMINATE;
+							break;
+						}
+					}
+
+					wait_time += get_us() - start;  // used for MIPS calculation
+
+					TRACE(tc_cpu, "WAIT returned");
+
+					return true;
+				}
+
+				if (wakeup_handler) {
+					// do not block the (shared) thread: whoever runs
+					// this cpu calls unpark() after a wakeup
+					if (check_pending_interrupts() == false) {
+						parked       = true;
+						parked_since = start;
+
+						TRACE(tc_cpu, "WAIT: parked");
+					}
+
+					return true;
+				}
+
 				while (check_pending_interrupts() == false)
 					qi_cv.wait(lck);
 #endif
@@ -1695,7 +1884,7 @@ bool cpu::misc_operations(const uint16_t instr)
 				wait_time += end - start;  // used for MIPS calculation
 			}
 
-			TRACE("WAIT returned");
+			TRACE(tc_cpu, "WAIT returned");
 
 			return true;
 
@@ -1789,6 +1978,13 @@ bool cpu::misc_operations(const uint16_t instr)
 		// JMP dst
 		setPC(dst_value);
 
+		if (hle_ && link_reg == 7 && getPSW_runmode() == 0 && !it_is_a_trap && !debug_mode) {
+			auto n = hle_->invoke(dst_value);
+
+			if (n.has_value())
+				instruction_count += n.value();
+		}
+
 		return true;
 	}
 
@@ -1819,13 +2015,18 @@ bool cpu::misc_operations(const uint16_t instr)
 // 'is_interrupt' is not correct naming; it is true for mmu faults and interrupts
 void cpu::trap(uint16_t vector, const int new_ipl, const bool is_interrupt)
 {
-	TRACE("*** CPU::TRAP %o, new-ipl: %d, is-interrupt: %d, run mode: %d ***", vector, new_ipl, is_interrupt, getPSW_runmode());
+	TRACE(tc_interrupts, "*** CPU::TRAP %o, new-ipl: %d, is-interrupt: %d, run mode: %d ***", vector, new_ipl, is_interrupt, getPSW_runmode());
 
 	uint16_t before_psw = 0;
 	uint16_t before_pc  = 0;
 
 	it_is_a_trap = true;
 
+	fr.add_trap(instruction_count, vector, getPC(), psw, is_interrupt);
+
+	if (stats && !is_interrupt)
+		stats->count_trap(vector);
+
 	do {
 		try {
 			processing_trap_depth++;
@@ -1833,10 +2034,12 @@ void cpu::trap(uint16_t vector, const int new_ipl, const bool is_interrupt)
 			bool kernel_mode = !(psw >> 14);
 
 			if (processing_trap_depth >= 2) {
-				TRACE("Trap depth %d", processing_trap_depth);
+				TRACE(tc_interrupts, "Trap depth %d", processing_trap_depth);
 
 				if (processing_trap_depth >= 3) {
 					*event = EVENT_HALT;
+
+					fr.dump(format("double trap at %06o", instruction_start), this);
 					break;
 				}
 
@@ -1887,10 +2090,10 @@ void cpu::trap(uint16_t vector, const int new_ipl, const bool is_interrupt)
 
 			// if we reach this point then the trap was processed without causing
 			// another trap
-			TRACE("Trapping to %06o with PSW %06o", pc, psw);
+			TRACE(tc_interrupts, "Trapping to %06o with PSW %06o", pc, psw);
 		}
 		catch(const int exception) {
-			TRACE("trap during execution of trap (%d)", exception);
+			TRACE(tc_interrupts, "trap during execution of trap (%d)", exception);
 
 			setPSW(before_psw, false);
 		}
@@ -2487,9 +2690,16 @@ void cpu::step()
 	if (!b->getMMU()->isMMR1Locked())
 		b->getMMU()->clearMMR1();
 
+	if (journal_ && journal_->poll_needed(instruction_count))
+		journal_->poll(instruction_count);
+
+	bool interrupted = false;
+
 	if (any_queued_interrupts && execute_any_pending_interrupt()) {
 		if (!b->getMMU()->isMMR1Locked())
 			b->getMMU()->clearMMR1();
+
+		interrupted = true;
 	}
 
 	instruction_count++;
@@ -2502,27 +2712,34 @@ void cpu::step()
 
 		uint16_t instr = b->read_word(instruction_start);
 
-		add_register(7, 2);
+		fr.add_instruction(instruction_start, instr, psw);
 
-		if (double_operand_instructions(instr))
-			return;
+		if (profiler_)
+			profiler_->instruction(this, instruction_start);
 
-		if (conditional_branch_instructions(instr))
-			return;
+		if (stats)
+			stats->count_instruction(instr, getPSW_runmode());
 
-		if (condition_code_operations(instr))
-			return;
+		if (tracer)
+			tracer->start_instruction(this, instruction_start, instr, interrupted);
 
-		if (misc_operations(instr))
-			return;
+		add_register(7, 2);
 
-		DOLOG(warning, false, "UNHANDLED instruction %06o @ %06o", instr, instruction_start);
+		if (double_operand_instructions(instr) == false &&
+		    conditional_branch_instructions(instr) == false &&
+		    condition_code_operations(instr) == false &&
+		    misc_operations(instr) == false) {
+			DOLOG(warning, false, "UNHANDLED instruction %06o @ %06o", instr, instruction_start);
 
-		trap(010);  // floating point nog niet geimplementeerd
+			trap(010);  // floating point nog niet geimplementeerd
+		}
 	}
 	catch(const int exception_nr) {
-		TRACE("bus-trap during execution of command (%d)", exception_nr);
+		TRACE(tc_cpu, "bus-trap during execution of command (%d)", exception_nr);
 	}
+
+	if (tracer)
+		tracer->end_instruction(this);
 }
 
 JsonDocument cpu::serialize()
@@ -3,11 +3,13 @@
 
 #pragma once
 
+#include "flight_recorder.h"
 #include "gen.h"
 #include <ArduinoJson.h>
 #include <atomic>
 #include <cassert>
 #include <condition_variable>
+#include <functional>
 #include <map>
 #include <mutex>
 #include <optional>
@@ -18,6 +20,11 @@
 
 class breakpoint;
 class bus;
+class cpu_statistics;
+class hle;
+class journal;
+class profiler;
+class trace_recorder;
 
 constexpr const int initial_trap_delay   = 8;
 
@@ -73,11 +80,39 @@ private:
 	std::condition_variable qi_cv;
 #endif
 
+	// when set, WAIT does not block but "parks" the cpu; the handler
+	// is invoked whenever an interrupt gets queued (used by the farm)
+	std::function<void()> wakeup_handler;
+	bool                  parked       { false };
+	uint64_t              parked_since { 0     };
+
 	std::map<int, breakpoint *> breakpoints;
 	int                         bp_nr       { 0 };
+	// the breakpoints above, grouped by when they need to be evaluated
+	std::vector<uint64_t>       bp_pc_bitmap;    // bit per PC value, empty if none
+	std::vector<breakpoint *>   bp_at_pc;        // only when the PC is in the bitmap
+	std::vector<breakpoint *>   bp_on_write;     // only after a write to a watched address
+	std::vector<breakpoint *>   bp_always;
+	std::set<uint32_t>          bp_watched;
+	bool                        bp_has_virtual { false };
+
+	void compile_breakpoints();
+	void update_watched_addresses();
 
 	bus *const b { nullptr };
 
+	hle       *hle_ { nullptr };  // optional, high-level emulation of kernel routines
+
+	trace_recorder *tracer { nullptr };  // optional, binary execution trace
+
+	profiler  *profiler_ { nullptr };  // optional, PC sampling
+
+	cpu_statistics *stats { nullptr };  // optional, execution counters
+
+	journal   *journal_ { nullptr };  // optional, record/replay of asynchronous input
+
+	flight_recorder fr;  // always on
+
 	std::atomic_uint32_t *const event { nullptr };
 
 	bool     check_pending_interrupts() const;  // needs the 'qi_lock'-lock
@@ -128,6 +163,28 @@ public:
 
 	bus *getBus() { return b; }
 
+	// takes ownership
+	void set_hle(hle *const h);
+	hle *get_hle() { return hle_; }
+
+	// takes ownership
+	void set_tracer(trace_recorder *const t);
+	trace_recorder *get_tracer() { return tracer; }
+
+	// takes ownership
+	void set_profiler(profiler *const p);
+	profiler *get_profiler() { return profiler_; }
+
+	// takes ownership
+	void set_statistics(cpu_statistics *const s);
+	cpu_statistics *get_statistics() { return stats; }
+
+	// does not take ownership, must be set before the emulation starts
+	void set_journal(journal *const j) { journal_ = j; }
+	journal *get_journal() { return journal_; }
+
+	flight_recorder *get_flight_recorder() { return &fr; }
+
 	void emulation_start();
 	uint64_t get_instructions_executed_count() const;
 	uint64_t get_wait_time() const { return wait_time; }
@@ -152,6 +209,11 @@ public:
 	std::optional<int> get_interrupt_delay_left() const { return trap_delay; }
 	bool check_if_interrupts_pending() const { return any_queued_interrupts; }
 
+	void set_wakeup_handler(std::function<void()> handler) { wakeup_handler = handler; }
+	bool is_parked() const { return parked; }
+	// returns true when the WAIT that parked the cpu has been satisfied
+	bool unpark();
+
 	void trap(uint16_t vector, const int new_ipl = -1, const bool is_interrupt = false);
 	bool is_it_a_trap() const { return it_is_a_trap; }
 
@@ -194,7 +256,18 @@ public:
 	void setStackPointer(const int which, const uint16_t value) { assert(which >= 0 && which < 4); sp[which] = value; }
 	void setPC(const uint16_t value) { pc = value; }
 
-	uint16_t get_register(const int nr) const;
+	uint16_t get_register(const int nr) const
+	{
+		if (nr < 6)
+			return regs0_5[get_register_set()][nr];
+
+		if (nr == 6)
+			return sp[getPSW_runmode()];
+
+		assert(nr == 7);
+
+		return pc;
+	}
 
 	bool put_result(const gam_rc_t & g, const uint16_t value);
 };
@@ -0,0 +1,176 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <algorithm>
+#include <cinttypes>
+#include <string.h>
+#include <vector>
+
+#include "console.h"
+#include "cpu_statistics.h"
+#include "utils.h"
+
+
+static const char *const double_operand_names[16] = { nullptr, "MOV", "CMP", "BIT", "BIC", "BIS", "ADD", nullptr,
+	                                              nullptr, "MOVB", "CMPB", "BITB", "BICB", "BISB", "SUB", nullptr };
+static const char *const eis_names[8]             = { "MUL", "DIV", "ASH", "ASHC", "XOR", "FIS", "CIS", "SOB" };
+static const char *const branch_names[8]          = { nullptr, "BR", "BNE", "BEQ", "BGE", "BLT", "BGT", "BLE" };
+static const char *const branch_names_1[8]        = { "BPL", "BMI", "BHI", "BLOS", "BVC", "BVS", "BCC", "BCS" };
+static const char *const single_names[16]         = { "CLR", "COM", "INC", "DEC", "NEG", "ADC", "SBC", "TST",
+	                                              "ROR", "ROL", "ASR", "ASL", "MARK", "MFPI", "MTPI", "SXT" };
+static const char *const single_names_1[16]       = { "CLRB", "COMB", "INCB", "DECB", "NEGB", "ADCB", "SBCB", "TSTB",
+	                                              "RORB", "ROLB", "ASRB", "ASLB", "MTPS", "MFPD", "MTPD", "MFPS" };
+static const char *const mode_names[16]           = { "Rn", "(Rn)", "(Rn)+", "@(Rn)+", "-(Rn)", "@-(Rn)", "X(Rn)", "@X(Rn)",
+	                                              "PC", "(PC)", "#n", "@#a", "-(PC)", "@-(PC)", "a", "@a" };
+static const char *const run_mode_names[4]        = { "kernel", "supervisor", "invalid", "user" };
+
+const char *get_opcode_class(const uint16_t instr)
+{
+	int top = instr >> 12;
+
+	if (double_operand_names[top])
+		return double_operand_names[top];
+
+	if (top == 07)
+		return eis_names[(instr >> 9) & 7];
+
+	if (top == 017)
+		return "FP11";
+
+	int group = (instr >> 8) & 7;  // branches
+	int sub   = (instr >> 6) & 077;
+
+	if (top == 0) {
+		if (instr < 0100)
+			return "HALT/WAIT/RTI/BPT/IOT/RESET/RTT/MFPT";
+		if (sub == 001)
+			return "JMP";
+		if (sub == 002)
+			return "RTS/SPL/CCC/SCC";
+		if (sub == 003)
+			return "SWAB";
+		if (instr < 04000)
+			return branch_names[group];
+		if (sub >= 040 && sub < 050)
+			return "JSR";
+		if (sub >= 050 && sub < 070)
+			return single_names[sub - 050];
+
+		return "unknown";
+	}
+
+	// top == 010
+	if (instr < 0104000)
+		return branch_names_1[group];
+	if (instr < 0104400)
+		return "EMT";
+	if (instr < 0105000)
+		return "TRAP";
+	if (sub >= 050 && sub < 070)
+		return single_names_1[sub - 050];
+
+	return "unknown";
+}
+
+void cpu_statistics::reset()
+{
+	memset(opcodes,    0x00, sizeof opcodes);
+	memset(modes,      0x00, sizeof modes);
+	memset(traps,      0x00, sizeof traps);
+	memset(interrupts, 0x00, sizeof interrupts);
+	memset(run_modes,  0x00, sizeof run_modes);
+}
+
+std::map<std::string, uint64_t> cpu_statistics::get_opcode_classes() const
+{
+	std::map<std::string, uint64_t> out;
+
+	for(int i=0; i<1024; i++) {
+		if (opcodes[i])
+			out[get_opcode_class(i << 6)] += opcodes[i];
+	}
+
+	return out;
+}
+
+std::map<std::string, uint64_t> cpu_statistics::get_addressing_modes() const
+{
+	std::map<std::string, uint64_t> out;
+
+	for(int i=0; i<16; i++)
+		out[mode_names[i]] = modes[i];
+
+	return out;
+}
+
+std::map<uint16_t, uint64_t> cpu_statistics::get_traps() const
+{
+	std::map<uint16_t, uint64_t> out;
+
+	for(int i=0; i<128; i++) {
+		if (traps[i])
+			out[i * 4] = traps[i];
+	}
+
+	return out;
+}
+
+std::map<std::pair<int, uint16_t>, uint64_t> cpu_statistics::get_interrupts() const
+{
+	std::map<std::pair<int, uint16_t>, uint64_t> out;
+
+	for(int level=0; level<8; level++) {
+		for(int i=0; i<128; i++) {
+			if (interrupts[level][i])
+				out[{ level, i * 4 }] = interrupts[level][i];
+		}
+	}
+
+	return out;
+}
+
+std::map<std::string, uint64_t> cpu_statistics::get_run_modes() const
+{
+	std::map<std::string, uint64_t> out;
+
+	for(int i=0; i<4; i++) {
+		if (i != 2)
+			out[run_mode_names[i]] = run_modes[i];
+	}
+
+	return out;
+}
+
+void cpu_statistics::show_state(console *const cnsl) const
+{
+	uint64_t total = 0;
+	for(auto & e: run_modes)
+		total += e;
+
+	double divider = std::max(total, uint64_t(1)) / 100.;
+
+	for(auto & e: get_run_modes())
+		cnsl->put_string_lf(format("%-10s %12" PRIu64 " instructions (%.2f%%)", e.first.c_str(), e.second, e.second / divider));
+
+	auto classes = get_opcode_classes();
+	std::vector<std::pair<std::string, uint64_t> > sorted(classes.begin(), classes.end());
+	std::sort(sorted.begin(), sorted.end(), [](const auto & a, const auto & b) { return a.second > b.second; });
+
+	cnsl->put_string_lf("Opcode classes:");
+	for(auto & e: sorted)
+		cnsl->put_string_lf(format(" %-8s %12" PRIu64 " (%.2f%%)", e.first.c_str(), e.second, e.second / divider));
+
+	cnsl->put_string_lf("Addressing modes (operands):");
+	for(int i=0; i<16; i++) {
+		if (modes[i])
+			cnsl->put_string_lf(format(" %-8s %12" PRIu64, mode_names[i], modes[i]));
+	}
+
+	cnsl->put_string_lf("Traps:");
+	for(auto & e: get_traps())
+		cnsl->put_string_lf(format(" vector %03o %12" PRIu64, e.first, e.second));
+
+	cnsl->put_string_lf("Interrupts:");
+	for(auto & e: get_interrupts())
+		cnsl->put_string_lf(format(" IPL %d vector %03o %12" PRIu64, e.first.first, e.first.second, e.second));
+}
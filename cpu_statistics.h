@@ -0,0 +1,46 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+
+class console;
+
+// Execution counters: instructions per opcode class, operand addressing
+// modes, traps by vector, interrupts by IPL and vector and instructions
+// per run mode. They are plain counters that are only written by the
+// thread that runs the cpu; the grouping into opcode classes is done
+// when they are read. Used to find out which instructions to optimize.
+class cpu_statistics
+{
+private:
+	uint64_t opcodes   [1024]   { };  // by instruction >> 6
+	uint64_t modes     [16]     { };  // mode, + 8 for PC
+	uint64_t traps     [128]    { };  // by vector / 4
+	uint64_t interrupts[8][128] { };  // by IPL and vector / 4
+	uint64_t run_modes [4]      { };
+
+public:
+	void count_instruction(const uint16_t instr, const int run_mode) { opcodes[instr >> 6]++; run_modes[run_mode]++; }
+	void count_operand    (const int mode, const int reg)           { modes[mode | (reg == 7 ? 8 : 0)]++; }
+	void count_trap       (const uint16_t vector)                   { traps[(vector >> 2) & 127]++; }
+	void count_interrupt  (const int level, const uint16_t vector)  { interrupts[level & 7][(vector >> 2) & 127]++; }
+
+	void reset();
+
+	std::map<std::string, uint64_t>          get_opcode_classes()   const;
+	std::map<std::string, uint64_t>          get_addressing_modes() const;
+	std::map<uint16_t, uint64_t>             get_traps()            const;  // vector, count
+	std::map<std::pair<int, uint16_t>, uint64_t> get_interrupts()   const;  // (IPL, vector), count
+	std::map<std::string, uint64_t>          get_run_modes()        const;
+
+	void show_state(console *const cnsl) const;
+};
+
+// mnemonic (or group of mnemonics) of an instruction word
+const char *get_opcode_class(const uint16_t instr);
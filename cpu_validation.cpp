@@ -0,0 +1,475 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <algorithm>
+#include <ArduinoJson.h>
+#include <atomic>
+#include <condition_variable>
+#include <ctype.h>
+#include <deque>
+#include <errno.h>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "bus.h"
+#include "cpu.h"
+#include "cpu_validation.h"
+#include "error.h"
+#include "gen.h"
+#include "log.h"
+#include "memory.h"
+#include "mmu.h"
+#include "utils.h"
+
+
+constexpr const uint16_t validation_psw_mask = 0174037;  // ignore unused bits & priority(!)
+constexpr const size_t   tests_per_batch     = 256;
+constexpr const size_t   read_buffer_size    = 1024 * 1024;
+
+typedef struct {
+	size_t                   first_index;
+	std::vector<std::string> tests;  // JSON text of each test
+} validation_batch_t;
+
+typedef struct {
+	std::atomic_size_t n_ok      { 0 };
+	std::atomic_size_t n_failed  { 0 };
+	std::atomic_size_t n_invalid { 0 };
+
+	std::mutex         lock;
+	std::vector<std::pair<size_t, std::string> > failures;  // index, JSON report entry
+	std::map<std::string, size_t> failures_per_mnemonic;
+} validation_results_t;
+
+class validation_queue
+{
+private:
+	const size_t                   max_batches;
+	std::deque<validation_batch_t> batches;
+	bool                           finished { false };
+	std::mutex                     lock;
+	std::condition_variable        cv_space;
+	std::condition_variable        cv_work;
+
+public:
+	validation_queue(const size_t max_batches) : max_batches(max_batches) {
+	}
+
+	void push(validation_batch_t && batch) {
+		std::unique_lock<std::mutex> lck(lock);
+
+		while(batches.size() >= max_batches)
+			cv_space.wait(lck);
+
+		batches.push_back(std::move(batch));
+
+		cv_work.notify_one();
+	}
+
+	void finish() {
+		std::unique_lock<std::mutex> lck(lock);
+
+		finished = true;
+
+		cv_work.notify_all();
+	}
+
+	bool pop(validation_batch_t *const batch) {
+		std::unique_lock<std::mutex> lck(lock);
+
+		while(batches.empty() && !finished)
+			cv_work.wait(lck);
+
+		if (batches.empty())
+			return false;
+
+		*batch = std::move(batches.front());
+		batches.pop_front();
+
+		cv_space.notify_one();
+
+		return true;
+	}
+};
+
+static uint16_t json_to_word(const JsonVariantConst v)
+{
+	return uint16_t(v.as<long>());
+}
+
+// put the state from "registers-before" & "memory-before" in a fresh cpu
+static void setup_test(bus *const b, std::atomic_uint32_t *const event, const JsonVariantConst test)
+{
+	*event = 0;
+
+	cpu *c = new cpu(b, event);
+	b->add_cpu(c);
+
+	b->getMMU()->reset();
+
+	for(JsonPairConst kv: test["memory-before"].as<JsonObjectConst>())
+		b->write_physical(strtoul(kv.key().c_str(), nullptr, 10), json_to_word(kv.value()));
+
+	JsonVariantConst registers_before = test["registers-before"];
+
+	for(int set=0; set<2; set++) {
+		for(JsonPairConst kv: registers_before[set == 0 ? "0" : "1"].as<JsonObjectConst>())
+			c->lowlevel_register_set(set, atoi(kv.key().c_str()), json_to_word(kv.value()));
+	}
+
+	c->lowlevel_psw_set(json_to_word(registers_before["psw"]));
+	c->setPC(json_to_word(registers_before["pc"]));
+
+	JsonArrayConst sp = registers_before["sp"].as<JsonArrayConst>();
+	for(size_t i=0; i<sp.size(); i++)
+		c->lowlevel_register_sp_set(i, json_to_word(sp[i]));
+
+	if (test.containsKey("mmr0-before"))
+		b->getMMU()->setMMR0(json_to_word(test["mmr0-before"]));
+}
+
+static bool is_valid_test(const JsonVariantConst test)
+{
+	JsonVariantConst registers_before = test["registers-before"];
+	JsonVariantConst registers_after  = test["registers-after" ];
+
+	return test["memory-before"].is<JsonObjectConst>() && test["memory-after"].is<JsonObjectConst>() &&
+		registers_before.is<JsonObjectConst>() && registers_after.is<JsonObjectConst>() &&
+		registers_before["psw"].is<long>() && registers_before["pc"].is<long>() && registers_before["sp"].size() == 4 &&
+		registers_after ["psw"].is<long>() && registers_after ["pc"].is<long>() && registers_after ["sp"].size() == 4;
+}
+
+static void add_mismatch(JsonArray & mismatches, const std::string & what, const uint16_t is, const uint16_t should_be)
+{
+	JsonObject m = mismatches.add<JsonObject>();
+
+	m["what"]      = what;
+	m["is"]        = is;
+	m["should-be"] = should_be;
+}
+
+// returns false and fills in 'report' when the cpu emulation does not match the expected state
+static bool run_test(bus *const b, std::atomic_uint32_t *const event, const size_t index, const JsonVariantConst test, std::string *const report, std::string *const mnemonic)
+{
+	setup_test(b, event, test);
+
+	cpu     *c        = b->getCpu();
+	uint16_t start_pc = c->getPC();
+
+	c->step();
+
+	JsonDocument failure;
+	JsonArray    mismatches = failure["mismatches"].to<JsonArray>();
+
+	for(JsonPairConst kv: test["memory-after"].as<JsonObjectConst>()) {
+		uint32_t a = strtoul(kv.key().c_str(), nullptr, 10);
+
+		if (a >= b->getRAM()->get_memory_size() - 1) {
+			add_mismatch(mismatches, format("memory %06o (out of range)", a), 0, json_to_word(kv.value()));
+			continue;
+		}
+
+		uint16_t mem_contains = b->read_physical(a);
+		uint16_t should_be    = json_to_word(kv.value());
+
+		if (mem_contains != should_be)
+			add_mismatch(mismatches, format("memory %06o", a), mem_contains, should_be);
+	}
+
+	JsonVariantConst registers_after = test["registers-after"];
+
+	uint16_t psw    = c->getPSW();
+	int      set_nr = (psw >> 11) & 1;
+
+	for(JsonPairConst kv: registers_after[set_nr == 0 ? "0" : "1"].as<JsonObjectConst>()) {
+		int      reg         = atoi(kv.key().c_str());
+		uint16_t register_is = c->lowlevel_register_get(set_nr, reg);
+		uint16_t should_be   = json_to_word(kv.value());
+
+		if (register_is != should_be)
+			add_mismatch(mismatches, format("R%d (set %d)", reg, set_nr), register_is, should_be);
+	}
+
+	uint16_t should_be_pc = json_to_word(registers_after["pc"]);
+	if (c->getPC() != should_be_pc)
+		add_mismatch(mismatches, "PC", c->getPC(), should_be_pc);
+
+	JsonArrayConst a_sp = registers_after["sp"].as<JsonArrayConst>();
+	for(size_t i=0; i<a_sp.size(); i++) {
+		uint16_t sp        = c->lowlevel_register_sp_get(i);
+		uint16_t should_be = json_to_word(a_sp[i]);
+
+		if (sp != should_be)
+			add_mismatch(mismatches, format("SP[%zu]", i), sp, should_be);
+	}
+
+	uint16_t should_be_psw = json_to_word(registers_after["psw"]);
+	if ((should_be_psw & validation_psw_mask) != (psw & validation_psw_mask))
+		add_mismatch(mismatches, "PSW", psw, should_be_psw);
+
+	for(int r=0; r<4; r++) {
+		std::string key = format("mmr%d-after", r);
+
+		if (test.containsKey(key) == false)  // not all generators emit these
+			continue;
+
+		uint16_t should_be_mmr = json_to_word(test[key]);
+		uint16_t is_mmr        = b->getMMU()->getMMR(r);
+
+		if (should_be_mmr != is_mmr)
+			add_mismatch(mismatches, format("MMR%d", r), is_mmr, should_be_mmr);
+	}
+
+	if (mismatches.size() == 0)
+		return true;
+
+	bool is_trap = c->is_it_a_trap();
+
+	// restore the pre-test state to be able to disassemble what was executed
+	setup_test(b, event, test);
+
+	auto disas_data = b->getCpu()->disassemble(start_pc);
+
+	failure["index"]       = index;
+	failure["pc"]          = start_pc;
+	failure["instruction"] = disas_data["instruction-text"].at(0);
+	failure["words"]       = disas_data["instruction-values"].at(0);
+	failure["trap"]        = is_trap;
+	failure["test"]        = test;
+
+	serializeJson(failure, *report);
+
+	*mnemonic = disas_data["instruction-text"].at(0);
+	size_t space = mnemonic->find(' ');
+	if (space != std::string::npos)
+		mnemonic->resize(space);
+
+	return false;
+}
+
+static void validation_worker(const size_t nr, validation_queue *const queue, validation_results_t *const results)
+{
+	set_thread_name(format("kek:valid-%zu", nr));
+
+	std::atomic_uint32_t event { 0 };
+
+	bus *b = new bus();
+	b->set_memory_size(DEFAULT_N_PAGES);
+
+	validation_batch_t batch;
+	JsonDocument       test;
+
+	while(queue->pop(&batch)) {
+		for(size_t i=0; i<batch.tests.size(); i++) {
+			size_t index = batch.first_index + i;
+
+			DeserializationError error = deserializeJson(test, batch.tests.at(i));
+
+			if (error || is_valid_test(test) == false) {
+				std::string report = format("{\"index\":%zu,\"error\":\"%s\"}", index, error ? error.c_str() : "missing or malformed fields");
+
+				std::unique_lock<std::mutex> lck(results->lock);
+				results->failures.push_back({ index, report });
+				results->n_invalid++;
+
+				continue;
+			}
+
+			std::string report;
+			std::string mnemonic;
+			bool        ok = false;
+
+			try {
+				ok = run_test(b, &event, index, test, &report, &mnemonic);
+			}
+			catch(const int exception_nr) {  // e.g. memory-before outside of the emulated RAM
+				report   = format("{\"index\":%zu,\"error\":\"exception %d while setting up test\"}", index, exception_nr);
+				mnemonic = "?";
+			}
+
+			if (ok) {
+				results->n_ok++;
+
+				// clear only what this test touched, a full reset of memory is much more expensive
+				memory *m = b->getRAM();
+				for(JsonPairConst kv: test["memory-after"].as<JsonObjectConst>())
+					m->write_word(strtoul(kv.key().c_str(), nullptr, 10), 0);
+				for(JsonPairConst kv: test["memory-before"].as<JsonObjectConst>())
+					m->write_word(strtoul(kv.key().c_str(), nullptr, 10), 0);
+			}
+			else {
+				results->n_failed++;
+
+				// a failing instruction may have written anywhere
+				b->getRAM()->reset();
+
+				std::unique_lock<std::mutex> lck(results->lock);
+				results->failures.push_back({ index, report });
+				results->failures_per_mnemonic[mnemonic]++;
+			}
+		}
+	}
+
+	delete b;
+}
+
+// Splits the top-level JSON array into the text of its elements without
+// parsing them: the workers do the actual parsing, in parallel.
+static bool read_tests(FILE *const fh, validation_queue *const queue, size_t *const n_tests)
+{
+	std::vector<char>  buffer(read_buffer_size);
+	validation_batch_t batch { 0, { } };
+	std::string        current;
+
+	bool   array_started = false;
+	bool   array_ended   = false;
+	int    depth         = 0;
+	bool   in_string     = false;
+	bool   escape        = false;
+	size_t index         = 0;
+
+	while(!array_ended) {
+		size_t n = fread(buffer.data(), 1, buffer.size(), fh);
+		if (n == 0)
+			break;
+
+		for(size_t i=0; i<n && !array_ended; i++) {
+			char c = buffer[i];
+
+			if (depth == 0) {
+				if (isspace(c) || (c == ',' && array_started))
+					continue;
+
+				if (!array_started) {
+					if (c != '[') {
+						DOLOG(warning, true, "Validation: test file does not start with a JSON array");
+						return false;
+					}
+
+					array_started = true;
+					continue;
+				}
+
+				if (c == ']') {
+					array_ended = true;
+					continue;
+				}
+			}
+
+			current += c;
+
+			if (in_string) {
+				if (escape)
+					escape = false;
+				else if (c == '\\')
+					escape = true;
+				else if (c == '"')
+					in_string = false;
+
+				continue;
+			}
+
+			if (c == '"')
+				in_string = true;
+			else if (c == '{' || c == '[')
+				depth++;
+			else if (c == '}' || c == ']')
+				depth--;
+
+			if (depth == 0) {
+				batch.tests.push_back(std::move(current));
+				current.clear();
+				index++;
+
+				if (batch.tests.size() >= tests_per_batch) {
+					queue->push(std::move(batch));
+
+					batch = { index, { } };
+				}
+			}
+		}
+	}
+
+	if (batch.tests.empty() == false)
+		queue->push(std::move(batch));
+
+	*n_tests = index;
+
+	if (!array_ended)
+		DOLOG(warning, true, "Validation: test file is truncated (after %zu tests)", index);
+
+	return array_ended;
+}
+
+int run_cpu_validation(const std::string & filename, const std::string & report_file)
+{
+	FILE *fh = fopen(filename.c_str(), "rb");
+	if (!fh)
+		error_exit(true, "Cannot open %s", filename.c_str());
+
+	size_t n_workers = std::max(1u, std::thread::hardware_concurrency());
+
+	validation_queue     queue(n_workers * 4);
+	validation_results_t results;
+
+	uint64_t start_ts = get_ms();
+
+	std::vector<std::thread *> workers;
+	for(size_t i=0; i<n_workers; i++)
+		workers.push_back(new std::thread(validation_worker, i, &queue, &results));
+
+	size_t n_tests = 0;
+	bool   read_ok = read_tests(fh, &queue, &n_tests);
+
+	fclose(fh);
+
+	queue.finish();
+
+	for(auto & th: workers) {
+		th->join();
+		delete th;
+	}
+
+	uint64_t took = std::max(uint64_t(1), get_ms() - start_ts);
+
+	std::sort(results.failures.begin(), results.failures.end());
+
+	FILE *rfh = fopen(report_file.c_str(), "w");
+	if (rfh) {
+		fprintf(rfh, "[\n");
+		for(size_t i=0; i<results.failures.size(); i++)
+			fprintf(rfh, "%s%s\n", results.failures[i].second.c_str(), i + 1 < results.failures.size() ? "," : "");
+		fprintf(rfh, "]\n");
+
+		fclose(rfh);
+	}
+	else {
+		DOLOG(warning, true, "Cannot create %s: %s", report_file.c_str(), strerror(errno));
+	}
+
+	printf("# tests: %zu, ok: %zu, failed: %zu, invalid: %zu\n", n_tests, size_t(results.n_ok), size_t(results.n_failed), size_t(results.n_invalid));
+	printf("# took %.3f seconds on %zu threads, %.0f tests/second\n", took / 1000., n_workers, n_tests * 1000. / took);
+
+	if (results.failures_per_mnemonic.empty() == false) {
+		std::vector<std::pair<size_t, std::string> > sorted;
+		for(auto & kv: results.failures_per_mnemonic)
+			sorted.push_back({ kv.second, kv.first });
+		std::sort(sorted.rbegin(), sorted.rend());
+
+		printf("# failures per instruction:");
+		for(size_t i=0; i<std::min(sorted.size(), size_t(10)); i++)
+			printf(" %s: %zu", sorted[i].second.c_str(), sorted[i].first);
+		printf("\n");
+	}
+
+	if (results.failures.empty() == false)
+		printf("# failures are listed in %s\n", report_file.c_str());
+
+	return read_ok && results.failures.empty() ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <string>
+
+
+// Runs the test vectors (as produced by json/produce-json*.py) in 'filename'
+// against the CPU emulation, sharded over all host cores. Failing vectors are
+// written to 'report_file' (a JSON array). Returns 0 when all tests pass.
+int run_cpu_validation(const std::string & filename, const std::string & report_file);
@@ -16,6 +16,7 @@
 #include "bus.h"
 #include "cpu.h"
 #include "dc11.h"
+#include "journal.h"
 #include "log.h"
 #include "utils.h"
 
@@ -75,9 +76,10 @@ void dc11::show_state(console *const cnsl) const
 	}
 }
 
-bool dc11::begin()
+bool dc11::begin(const bool own_thread)
 {
-	th = new std::thread(std::ref(*this));
+	if (own_thread)
+		th = new std::thread(std::ref(*this));
 
 	return true;
 }
@@ -97,7 +99,7 @@ void dc11::test_ports(const std::string & txt) const
 
 void dc11::trigger_interrupt(const int line_nr, const bool is_tx)
 {
-	TRACE("DC11: interrupt for line %d, %s", line_nr, is_tx ? "TX" : "RX");
+	TRACE(tc_dc11, "DC11: interrupt for line %d, %s", line_nr, is_tx ? "TX" : "RX");
 
 	b->getCpu()->queue_interrupt(5, 0300 + line_nr * 010 + 4 * is_tx);
 }
@@ -111,49 +113,73 @@ void dc11::operator()()
 	while(!stop_flag) {
 		myusleep(10000);  // TODO replace polling
 
-		for(size_t line_nr=0; line_nr<comm_interfaces.size(); line_nr++) {
-			std::unique_lock<std::mutex> lck(input_lock[line_nr]);
+		poll();
+	}
+
+	DOLOG(info, true, "DC11 thread terminating");
+}
 
-			// (dis-)connected?
-			bool is_connected = comm_interfaces.at(line_nr)->is_connected();
+void dc11::poll()
+{
+	journal *j = b->getCpu()->get_journal();
+
+	for(size_t line_nr=0; line_nr<comm_interfaces.size(); line_nr++) {
+		// (dis-)connected?
+		bool is_connected = comm_interfaces.at(line_nr)->is_connected();
 
-			if (is_connected != connected[line_nr]) {
-				DOLOG(debug, false, "DC11 line %d state changed to %d", line_nr, is_connected);
+		if (is_connected != seen_connected[line_nr]) {
+			DOLOG(debug, false, "DC11 line %d state changed to %d", line_nr, is_connected);
 #if defined(ESP32)
-				Serial.printf("DC11 line %d state changed to %d\r\n", line_nr, is_connected);
+			Serial.printf("DC11 line %d state changed to %d\r\n", line_nr, is_connected);
 #endif
 
-				connected[line_nr] = is_connected;
+			seen_connected[line_nr] = is_connected;
 
-				if (is_connected)
-					registers[line_nr * 4 + 0] |= 0160000;  // "ERROR", RING INDICATOR, CARRIER TRANSITION
-				else
-					registers[line_nr * 4 + 0] |= 0120000;  // "ERROR", CARRIER TRANSITION
+			if (j)
+				j->submit(JE_DC11_CONNECT, line_nr, is_connected);
+			else
+				set_connected(line_nr, is_connected);
+		}
 
-				if (is_rx_interrupt_enabled(line_nr))
-					trigger_interrupt(line_nr, false);
-			}
+		// receive data
+		while(comm_interfaces.at(line_nr)->has_data()) {
+			uint8_t buffer = comm_interfaces.at(line_nr)->get_byte();
 
-			// receive data
-			bool have_data = false;
-			while(comm_interfaces.at(line_nr)->has_data()) {
-				uint8_t buffer = comm_interfaces.at(line_nr)->get_byte();
+			if (j)
+				j->submit(JE_DC11_DATA, line_nr, buffer);
+			else
+				receive_byte(line_nr, buffer);
+		}
+	}
+}
 
-				recv_buffers[line_nr].push_back(char(buffer));
+void dc11::set_connected(const int line_nr, const bool is_connected)
+{
+	std::unique_lock<std::mutex> lck(input_lock[line_nr]);
 
-				have_data = true;
-			}
+	connected[line_nr] = is_connected;
 
-			if (have_data) {
-				registers[line_nr * 4 + 0] |= 128;  // DONE: bit 7
+	if (is_connected)
+		registers[line_nr * 4 + 0] |= 0160000;  // "ERROR", RING INDICATOR, CARRIER TRANSITION
+	else
+		registers[line_nr * 4 + 0] |= 0120000;  // "ERROR", CARRIER TRANSITION
 
-				if (is_rx_interrupt_enabled(line_nr))
-					trigger_interrupt(line_nr, false);
-			}
-		}
-	}
+	if (is_rx_interrupt_enabled(line_nr))
+		trigger_interrupt(line_nr, false);
+}
 
-	DOLOG(info, true, "DC11 thread terminating");
+void dc11::receive_byte(const int line_nr, const uint8_t c)
+{
+	std::unique_lock<std::mutex> lck(input_lock[line_nr]);
+
+	recv_buffers[line_nr].push_back(char(c));
+	queue_depth[line_nr] = recv_buffers[line_nr].size();
+	n_bytes_in [line_nr]++;
+
+	registers[line_nr * 4 + 0] |= 128;  // DONE: bit 7
+
+	if (is_rx_interrupt_enabled(line_nr))
+		trigger_interrupt(line_nr, false);
 }
 
 void dc11::reset()
@@ -195,7 +221,7 @@ uint16_t dc11::read_word(const uint16_t addr)
 		registers[line_nr * 4 + 0] &= ~1;  // DTR: bit 0  [RCSR]
 		registers[line_nr * 4 + 0] &= ~4;  // CD : bit 2
 
-		if (comm_interfaces.at(line_nr)->is_connected()) {
+		if (connected[line_nr]) {
 			registers[line_nr * 4 + 0] |= 1;
 			registers[line_nr * 4 + 0] |= 4;
 		}
@@ -206,7 +232,7 @@ uint16_t dc11::read_word(const uint16_t addr)
 		registers[line_nr * 4 + 0] &= ~0160000;
 	}
 	else if (sub_reg == 1) {  // read data register
-		TRACE("DC11: %zu characters in buffer for line %d", recv_buffers[line_nr].size(), line_nr);
+		TRACE(tc_dc11, "DC11: %zu characters in buffer for line %d", recv_buffers[line_nr].size(), line_nr);
 
 		// get oldest byte in buffer
 		if (recv_buffers[line_nr].empty() == false) {
@@ -217,6 +243,7 @@ uint16_t dc11::read_word(const uint16_t addr)
 			registers[line_nr * 4 + 0] |= parity(vtemp) << 5;
 
 			recv_buffers[line_nr].erase(recv_buffers[line_nr].begin());
+			queue_depth[line_nr] = recv_buffers[line_nr].size();
 
 			// still data in buffer? generate interrupt
 			if (recv_buffers[line_nr].empty() == false) {
@@ -231,7 +258,7 @@ uint16_t dc11::read_word(const uint16_t addr)
 		registers[line_nr * 4 + 2] &= ~2;  // CTS: bit 1  [TSCR]
 		registers[line_nr * 4 + 2] &= ~128;  // READY: bit 7
 
-		if (comm_interfaces.at(line_nr)->is_connected()) {
+		if (connected[line_nr]) {
 			registers[line_nr * 4 + 2] |= 2;
 			registers[line_nr * 4 + 2] |= 128;
 		}
@@ -239,7 +266,7 @@ uint16_t dc11::read_word(const uint16_t addr)
 		vtemp = registers[line_nr * 4 + 2];
 	}
 
-	TRACE("DC11: read register %06o (\"%s\", %d line %d): %06o", addr, dc11_register_names[sub_reg], sub_reg, line_nr, vtemp);
+	TRACE(tc_dc11, "DC11: read register %06o (\"%s\", %d line %d): %06o", addr, dc11_register_names[sub_reg], sub_reg, line_nr, vtemp);
 
 	return vtemp;
 }
@@ -269,17 +296,18 @@ void dc11::write_word(const uint16_t addr, const uint16_t v)
 
 	std::unique_lock<std::mutex> lck(input_lock[line_nr]);
 
-	TRACE("DC11: write register %06o (\"%s\", %d line_nr %d) to %06o", addr, dc11_register_names[sub_reg], sub_reg, line_nr, v);
+	TRACE(tc_dc11, "DC11: write register %06o (\"%s\", %d line_nr %d) to %06o", addr, dc11_register_names[sub_reg], sub_reg, line_nr, v);
 
 	if (sub_reg == 3) {  // transmit buffer
 		char c = v & 127;  // strip parity
 
 		if (c <= 32 || c >= 127)
-			TRACE("DC11: transmit [%d] on line %d", c, line_nr);
+			TRACE(tc_dc11, "DC11: transmit [%d] on line %d", c, line_nr);
 		else
-			TRACE("DC11: transmit %c on line %d", c, line_nr);
+			TRACE(tc_dc11, "DC11: transmit %c on line %d", c, line_nr);
 
 		comm_interfaces.at(line_nr)->send_data(reinterpret_cast<const uint8_t *>(&c), 1);
+		n_bytes_out[line_nr]++;
 
 		if (is_tx_interrupt_enabled(line_nr))
 			trigger_interrupt(line_nr, true);
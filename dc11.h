@@ -34,10 +34,18 @@ private:
 
 	std::vector<comm *> comm_interfaces;
 	std::vector<bool  > connected;
+	// the state of the connections as seen by poll(); 'connected' is what
+	// the emulated machine sees
+	bool              seen_connected[dc11_n_lines] { };
 
 	std::vector<char>   recv_buffers[dc11_n_lines];
         mutable std::mutex  input_lock  [dc11_n_lines];
 
+	// for the metrics
+	std::atomic_uint64_t n_bytes_in [dc11_n_lines] { };
+	std::atomic_uint64_t n_bytes_out[dc11_n_lines] { };
+	std::atomic_uint32_t queue_depth[dc11_n_lines] { };
+
 	void trigger_interrupt(const int line_nr, const bool is_tx);
 	bool is_rx_interrupt_enabled(const int line_nr) const;
 	bool is_tx_interrupt_enabled(const int line_nr) const;
@@ -46,7 +54,8 @@ public:
 	dc11(bus *const b, const std::vector<comm *> & comm_interfaces);
 	virtual ~dc11();
 
-	bool begin();
+	// without 'own_thread' the owner invokes poll() every 10 ms
+	bool begin(const bool own_thread = true);
 
 	JsonDocument serialize() const;
 	static dc11 *deserialize(const JsonVariantConst j, bus *const b);
@@ -57,6 +66,14 @@ public:
 
 	void show_state(console *const cnsl) const override;
 
+	// input from the host side (the connection of a line changed, a byte came in)
+	void set_connected(const int line_nr, const bool is_connected);
+	void receive_byte (const int line_nr, const uint8_t c);
+
+	uint64_t get_bytes_in   (const int line_nr) const { return n_bytes_in [line_nr]; }
+	uint64_t get_bytes_out  (const int line_nr) const { return n_bytes_out[line_nr]; }
+	uint32_t get_queue_depth(const int line_nr) const { return queue_depth[line_nr]; }
+
 	void test_port(const size_t port_nr, const std::string & txt) const;
 	void test_ports(const std::string & txt) const;
 
@@ -67,4 +84,6 @@ public:
 	void write_word(const uint16_t addr, const uint16_t v) override;
 
 	void operator()();
+	// picks up (dis-)connects and received data of the comm interfaces
+	void poll();
 };
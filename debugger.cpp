@@ -1,6 +1,7 @@
 // (C) 2018-2024 by Folkert van Heusden
 // Released under MIT license
 
+#include <cinttypes>
 #include <optional>
 #include "gen.h"
 #if IS_POSIX || defined(_WIN32)
@@ -21,6 +22,7 @@
 #include "comm_tcp_socket_server.h"
 #include "console.h"
 #include "cpu.h"
+#include "cpu_statistics.h"
 #if defined(ESP32)
 #include "comm_esp32_hardwareserial.h"
 #endif
@@ -31,6 +33,7 @@
 #include "disk_backend_esp32.h"
 #endif
 #include "disk_backend_nbd.h"
+#include "hle.h"
 #include "kw11-l.h"
 #include "loaders.h"
 #include "log.h"
@@ -614,6 +617,43 @@ void show_queued_interrupts(console *const cnsl, cpu *const c)
 	}
 }
 
+void show_disk_statistics(console *const cnsl, bus *const b)
+{
+	std::vector<std::pair<std::string, disk_device *> > devices { { "RK05", b->getRK05() }, { "RL02", b->getRL02() }, { "RP06", b->getRP06() } };
+
+	for(auto & device: devices) {
+		if (!device.second)
+			continue;
+
+		auto backends = device.second->access_disk_backends();
+
+		for(size_t unit=0; unit<backends->size(); unit++) {
+			disk_backend *d = backends->at(unit);
+			if (!d)
+				continue;
+
+			const disk_io_statistics_t & st = d->get_io_statistics();
+
+			cnsl->put_string_lf(format("%s unit %zu: %s", device.first.c_str(), unit, d->get_identifier().c_str()));
+			cnsl->put_string_lf(format("  read : %" PRIu64 " transfers, %" PRIu64 " bytes, %" PRIu64 " errors", uint64_t(st.n_transfers[0]), uint64_t(st.n_bytes[0]), uint64_t(st.n_errors[0])));
+			cnsl->put_string_lf(format("  write: %" PRIu64 " transfers, %" PRIu64 " bytes, %" PRIu64 " errors", uint64_t(st.n_transfers[1]), uint64_t(st.n_bytes[1]), uint64_t(st.n_errors[1])));
+
+			const disk_cache_statistics_t *cs = d->get_cache_statistics();
+			if (cs) {
+				uint64_t hits   = cs->n_hits;
+				uint64_t misses = cs->n_misses;
+
+				cnsl->put_string_lf(format("  cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hits), %" PRIu64 " read ahead, %" PRIu64 " written back",
+							hits, misses, hits + misses ? hits * 100. / (hits + misses) : 0., uint64_t(cs->n_read_ahead), uint64_t(cs->n_write_backs)));
+			}
+
+			auto n_dirty = d->get_n_dirty_sectors();
+			if (n_dirty.has_value())
+				cnsl->put_string_lf(format("  dirty: %" PRIu64 " sectors not yet written to the file", n_dirty.value()));
+		}
+	}
+}
+
 struct state_writer {
 	FILE *fh = nullptr;
 
@@ -865,9 +905,19 @@ void debugger(console *const cnsl, bus *const b, std::atomic_uint32_t *const sto
 				continue;
 			}
 			else if (parts[0] == "trace" || parts[0] == "t") {
-				settrace(!gettrace());
+				if (parts.size() == 2) {
+					uint32_t mask = get_trace_mask();
+
+					if (parse_trace_categories(parts[1], &mask))
+						set_trace_mask(mask);
+					else
+						cnsl->put_string_lf("Unknown trace category");
+				}
+				else {
+					settrace(!gettrace());
+				}
 
-				cnsl->put_string_lf(format("Tracing set to %s", gettrace() ? "ON" : "OFF"));
+				cnsl->put_string_lf(format("Tracing set to %s", get_trace_categories(get_trace_mask()).c_str()));
 
 				continue;
 			}
@@ -1000,8 +1050,19 @@ void debugger(console *const cnsl, bus *const b, std::atomic_uint32_t *const sto
 				continue;
 			}
 #endif
-			else if (cmd == "stats") {
-				show_run_statistics(cnsl, c);
+			else if (parts[0] == "stats") {
+				cpu_statistics *cs = c->get_statistics();
+
+				if (parts.size() == 2 && parts[1] == "reset") {
+					if (cs)
+						cs->reset();
+				}
+				else {
+					show_run_statistics(cnsl, c);
+
+					if (cs)
+						cs->show_state(cnsl);
+				}
 
 				continue;
 			}
@@ -1110,11 +1171,30 @@ void debugger(console *const cnsl, bus *const b, std::atomic_uint32_t *const sto
 
 				continue;
 			}
+			else if (parts[0] == "hle") {
+				hle *h = c->get_hle();
+
+				if (!h)
+					cnsl->put_string_lf("High-level emulation not enabled (-H)");
+				else {
+					if (parts.size() == 2)
+						h->set_enabled(parts[1] == "on");
+
+					h->show_state(cnsl);
+				}
+
+				continue;
+			}
 			else if (cmd == "qi") {
 				show_queued_interrupts(cnsl, c);
 
 				continue;
 			}
+			else if (cmd == "disks") {
+				show_disk_statistics(cnsl, b);
+
+				continue;
+			}
 			else if (parts[0] == "log") {
 				DOLOG(info, true, cmd.c_str());
 
@@ -1187,6 +1267,12 @@ void debugger(console *const cnsl, bus *const b, std::atomic_uint32_t *const sto
 
 				continue;
 			}
+			else if (cmd == "fr") {
+				for(auto & line: c->get_flight_recorder()->get_text(c))
+					cnsl->put_string_lf(line);
+
+				continue;
+			}
 			else if (cmd == "quit" || cmd == "q") {
 #if defined(ESP32)
 				ESP.restart();
@@ -1208,19 +1294,23 @@ void debugger(console *const cnsl, bus *const b, std::atomic_uint32_t *const sto
 					"                values seperated by ',', char after mem is w/b (word/byte), then",
 					"                follows v/p (virtual/physical), all octal values, mmr0-3 and psw are",
 					"                registers",
-					"trace/t       - toggle tracing",
+					"trace/t       - toggle tracing (all categories)",
+					"trace/t x     - trace categories x, e.g. \"rl02,interrupts\", \"+mmu\", \"-cpu\", \"all\" or \"none\"",
 					"setll x,y     - set loglevel: terminal,file",
 					"setsl x,y     - set syslog target: requires a hostname and a loglevel",
 					"pts x         - enable (1) / disable (0) timestamps",
 					"turbo         - toggle turbo mode (cannot be interrupted)",
 					"debug         - enable CPU debug mode",
 					"bt            - show backtrace - need to enable debug first",
+					"fr            - show the flight recorder (last instructions and traps)",
 					"strace x      - start tracing from address - invoke without address to disable",
 					"trl x         - set trace run-level (0...3), empty for all",
 					"regdump       - dump register contents",
 					"state x       - dump state of a device: rl02, rk05, rp06, mmu, tm11, kw11l or dc11",
 					"mmures x      - resolve a virtual address",
 					"qi            - show queued interrupts",
+					"disks         - show the transfer and cache statistics (and dirty sectors) of the disks",
+					"hle [on|off]  - show high-level emulation statistics, enable/disable it",
 					"setpc x       - set PC to value",
 					"setmem ...    - set memory (a=) to value (v=), both in octal, one byte",
 					"toggle ...    - set switch (s=, 0...15 (decimal)) of the front panel to state (t=, 0 or 1)",
@@ -1230,7 +1320,7 @@ void debugger(console *const cnsl, bus *const b, std::atomic_uint32_t *const sto
 					"bic x         - run BIC/LDA file",
 					"lt x          - load tape (parameter is filename)",
 					"ult           - unload tape",
-					"stats         - show run statistics",
+					"stats [reset] - show run statistics (and the counters of -A), reset the counters",
 					"ramsize x     - set ram size (page (8 kB) count, decimal)",
 					"bl            - set bootloader (rl02, rk05 or rp06)",
 					"cdc11         - configure DC11 device",
@@ -1280,9 +1370,9 @@ void debugger(console *const cnsl, bus *const b, std::atomic_uint32_t *const sto
 					if (trace_start_addr != -1 && c->getPC() == trace_start_addr)
 						settrace(true);
 
-					if ((gettrace() || single_step) && (t_rl.has_value() == false || t_rl.value() == c->getPSW_runmode())) {
+					if ((TRACE_ENABLED(tc_cpu) || single_step) && (t_rl.has_value() == false || t_rl.value() == c->getPSW_runmode())) {
 						if (!single_step)
-							TRACE("---");
+							TRACE(tc_cpu, "---");
 
 						disassemble(c, single_step ? cnsl : nullptr, c->getPC(), false);
 					}
@@ -1326,7 +1416,7 @@ void run_bic(console *const cnsl, bus *const b, std::atomic_uint32_t *const stop
 	*cnsl->get_running_flag() = true;
 
 	while(*stop_event == EVENT_NONE) {
-		if (gettrace())
+		if (TRACE_ENABLED(tc_cpu))
 			disassemble(c, nullptr, c->getPC(), false);
 
 		c->step();
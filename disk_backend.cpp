@@ -4,10 +4,15 @@
 #include <cassert>
 
 #include "disk_backend.h"
+#include "disk_backend_cache.h"
 #include "gen.h"
 #include "utils.h"
 #if IS_POSIX
+#include "disk_backend_compressed.h"
 #include "disk_backend_file.h"
+#include "disk_backend_mmap.h"
+#include "disk_backend_ram.h"
+#include "disk_backend_uring.h"
 #else
 #include "disk_backend_esp32.h"
 #endif
@@ -22,28 +27,89 @@ disk_backend::~disk_backend()
 {
 }
 
-void disk_backend::store_object_in_overlay(const off_t id, const std::vector<uint8_t> & data)
+void disk_backend::account(const int direction, const size_t n, const uint64_t took_us, const bool ok)
 {
-	overlay.insert_or_assign(id, data);
+	io_statistics.n_transfers[direction].fetch_add(1, std::memory_order_relaxed);
+	io_statistics.n_bytes    [direction].fetch_add(n, std::memory_order_relaxed);
+
+	if (!ok)
+		io_statistics.n_errors[direction].fetch_add(1, std::memory_order_relaxed);
+
+	io_statistics.latency_sum_us[direction].fetch_add(took_us, std::memory_order_relaxed);
+
+	int bucket = 0;
+	while(bucket < disk_n_latency_buckets - 1 && took_us > disk_latency_bounds_us[bucket])
+		bucket++;
+
+	io_statistics.latency[direction][bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool disk_backend::accounted_read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size)
+{
+	uint64_t start = get_us();
+	bool     rc    = read(offset, n, target, sector_size);
+
+	account(0, n, get_us() - start, rc);
+
+	return rc;
 }
 
-std::optional<std::vector<uint8_t> > disk_backend::get_object_from_overlay(const off_t id)
+bool disk_backend::accounted_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size)
 {
-	auto it = overlay.find(id);
-	if (it != overlay.end())
-		return it->second;
+	uint64_t start = get_us();
+	bool     rc    = write(offset, n, from, sector_size);
 
-	return { };
+	account(1, n, get_us() - start, rc);
+
+	return rc;
 }
 
-std::optional<std::vector<uint8_t> > disk_backend::get_from_overlay(const off_t offset, const size_t sector_size)
+void disk_backend::submit_read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size, const completion_t & done)
+{
+	done(read(offset, n, target, sector_size));
+}
+
+void disk_backend::submit_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size, const completion_t & done)
+{
+	done(write(offset, n, from, sector_size));
+}
+
+void disk_backend::accounted_submit_read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size, const completion_t & done)
+{
+	uint64_t start = get_us();
+
+	submit_read(offset, n, target, sector_size, [this, n, start, done](const bool ok) {
+		account(0, n, get_us() - start, ok);
+		done(ok);
+	});
+}
+
+void disk_backend::accounted_submit_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size, const completion_t & done)
+{
+	uint64_t start = get_us();
+
+	submit_write(offset, n, from, sector_size, [this, n, start, done](const bool ok) {
+		account(1, n, get_us() - start, ok);
+		done(ok);
+	});
+}
+
+const uint8_t *disk_backend::get_from_overlay(const off_t offset, const size_t sector_size) const
 {
 	assert((offset % sector_size) == 0);
 
 	if (use_overlay)
-		return get_object_from_overlay(offset / sector_size);
+		return overlay.get(offset / sector_size);
 
-	return { };
+	return nullptr;
+}
+
+bool disk_backend::patch_from_overlay(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) const
+{
+	if (use_overlay && overlay.empty() == false)
+		return overlay.patch(offset, n, target, sector_size);
+
+	return true;
 }
 
 bool disk_backend::store_mem_range_in_overlay(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size)
@@ -52,8 +118,7 @@ bool disk_backend::store_mem_range_in_overlay(const off_t offset, const size_t n
 	assert((n % sector_size) == 0);
 
 	if (use_overlay) {
-		for(size_t o=0; o<n; o += sector_size)
-			store_object_in_overlay((offset + o) / sector_size, std::vector<uint8_t>(from + o, from + o + sector_size));
+		overlay.store(offset, n, from, sector_size);  // logs when it fails
 
 		return true;
 	}
@@ -65,14 +130,24 @@ JsonDocument disk_backend::serialize_overlay() const
 {
 	JsonDocument out;
 
-	for(auto & id: overlay) {
+	// only refer to it
+	if (overlay.is_file_backed()) {
+		out.set(overlay.get_filename());
+
+		return out;
+	}
+
+	size_t sector_size = overlay.get_sector_size();
+
+	for(auto id: overlay.get_sectors()) {
 		JsonDocument j_data;
 		JsonArray j_data_work = j_data.to<JsonArray>();
 
-		for(size_t i=0; i<id.second.size(); i++)
-			j_data_work.add(id.second.at(i));
+		const uint8_t *data = overlay.get(id);
+		for(size_t i=0; i<sector_size; i++)
+			j_data_work.add(data[i]);
 
-		out[format("%lu", id.first)] = j_data;
+		out[format("%lu", (unsigned long)id)] = j_data;
 	}
 
 	return out;
@@ -83,14 +158,21 @@ void disk_backend::deserialize_overlay(const JsonVariantConst j)
 	if (j.containsKey("overlay") == false)
 		return; // we can have state-dumps without overlay
 
-	for(auto kv : j.as<JsonObjectConst>()) {
+	if (j["overlay"].is<std::string>()) {  // the overlay is in a file (-O), logs when that fails
+		overlay.open_file(j["overlay"].as<std::string>());
+
+		return;
+	}
+
+	for(auto kv : j["overlay"].as<JsonObjectConst>()) {
 		uint32_t id = std::atoi(kv.key().c_str());
 
 		std::vector<uint8_t> data;
 		for(auto v: kv.value().as<JsonArrayConst>())
 			data.push_back(v);
 
-		store_object_in_overlay(id, data);
+		if (data.empty() == false)
+			overlay.put(id, data.data(), data.size());
 	}
 }
 
@@ -102,10 +184,20 @@ disk_backend *disk_backend::deserialize(const JsonVariantConst j)
 
 	if (type == "nbd")
 		d = disk_backend_nbd::deserialize(j);
+	else if (type == "cache")
+		d = disk_backend_cache::deserialize(j);
 
 #if IS_POSIX
 	else if (type == "file")
 		d = disk_backend_file::deserialize(j);
+	else if (type == "mmap")
+		d = disk_backend_mmap::deserialize(j);
+	else if (type == "uring")
+		d = disk_backend_uring::deserialize(j);
+	else if (type == "compressed")
+		d = disk_backend_compressed::deserialize(j);
+	else if (type == "ram")
+		d = disk_backend_ram::deserialize(j);
 #else
 	else if (type == "esp32")
 		d = disk_backend_esp32::deserialize(j);
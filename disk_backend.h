@@ -5,24 +5,53 @@
 
 #include "gen.h"
 #include <ArduinoJson.h>
-#include <map>
+#include <atomic>
+#include <functional>
 #include <optional>
 #include <stdint.h>
 #include <string>
 #include <vector>
 #include <sys/types.h>
 
+#include "disk_overlay.h"
+
+
+constexpr const int      disk_n_latency_buckets = 6;  // the last one is for everything above the last bound
+constexpr const uint32_t disk_latency_bounds_us[disk_n_latency_buckets - 1] = { 100, 1000, 10000, 100000, 1000000 };
+
+// updated by the thread that does the transfers, read by the metrics
+typedef struct {
+	std::atomic_uint64_t n_transfers  [2] { };  // read, write
+	std::atomic_uint64_t n_bytes      [2] { };
+	std::atomic_uint64_t n_errors     [2] { };
+	std::atomic_uint64_t latency_sum_us[2] { };
+	std::atomic_uint64_t latency      [2][disk_n_latency_buckets] { };  // not cumulative
+} disk_io_statistics_t;
+
+// for backends that cache (disk_backend_cache)
+typedef struct {
+	std::atomic_uint64_t n_hits        { 0 };  // blocks
+	std::atomic_uint64_t n_misses      { 0 };
+	std::atomic_uint64_t n_read_ahead  { 0 };
+	std::atomic_uint64_t n_write_backs { 0 };
+} disk_cache_statistics_t;
 
 class disk_backend
 {
+private:
+	disk_io_statistics_t io_statistics;
+
+	void account(const int direction, const size_t n, const uint64_t took_us, const bool ok);
+
 protected:
 	bool use_overlay { false };
-	std::map<off_t, std::vector<uint8_t> > overlay;
+	disk_overlay overlay;
 
-	void store_object_in_overlay(const off_t id, const std::vector<uint8_t> & data);
 	bool store_mem_range_in_overlay(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size);
-	std::optional<std::vector<uint8_t> > get_object_from_overlay(const off_t id);
-	std::optional<std::vector<uint8_t> > get_from_overlay(const off_t offset, const size_t sector_size);
+	// nullptr when the sector is not in the overlay
+	const uint8_t *get_from_overlay(const off_t offset, const size_t sector_size) const;
+	// copies the sectors of a transfer that are in the overlay over 'target'
+	bool patch_from_overlay(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) const;
 
 	JsonDocument serialize_overlay() const;
 	void deserialize_overlay(const JsonVariantConst j);
@@ -38,7 +67,32 @@ public:
 
 	virtual bool begin(const bool disk_snapshots) = 0;
 
+	// keep the snapshot overlay in a file instead of in memory and the state dump
+	virtual bool set_overlay_file(const std::string & filename) { return overlay.open_file(filename); }
+
 	virtual bool read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) = 0;
 
 	virtual bool write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size) = 0;
+
+	// read()/write() with the transfer counted in the I/O statistics; used by the disk devices
+	bool accounted_read (const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size);
+	bool accounted_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size);
+
+	typedef std::function<void(const bool ok)> completion_t;
+
+	// Starts a transfer; 'done' is invoked when it has finished, possibly
+	// from another thread (or before these return). Here the transfer is
+	// done right away with read()/write().
+	virtual bool is_asynchronous() const { return false; }
+	virtual void submit_read (const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size, const completion_t & done);
+	virtual void submit_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size, const completion_t & done);
+
+	// submit_read()/submit_write() with the transfer counted in the I/O statistics
+	void accounted_submit_read (const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size, const completion_t & done);
+	void accounted_submit_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size, const completion_t & done);
+
+	const disk_io_statistics_t & get_io_statistics() const { return io_statistics; }
+	virtual const disk_cache_statistics_t *get_cache_statistics() const { return nullptr; }
+	// for backends that keep changes in memory before writing them to the file (disk_backend_ram)
+	virtual std::optional<uint64_t> get_n_dirty_sectors() const { return { }; }
 };
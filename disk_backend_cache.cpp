@@ -0,0 +1,298 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <algorithm>
+#include <cassert>
+#include <string.h>
+
+#include "disk_backend_cache.h"
+#include "gen.h"
+#include "log.h"
+#include "utils.h"
+
+
+disk_backend_cache::disk_backend_cache(disk_backend *const inner, const size_t size, const write_mode_t write_mode) :
+	inner(inner),
+	n_blocks(std::max(size / disk_cache_block_size, size_t(1))),
+	write_mode(write_mode)
+{
+}
+
+disk_backend_cache::~disk_backend_cache()
+{
+	flush();
+
+	delete inner;
+}
+
+std::optional<std::pair<size_t, disk_backend_cache::write_mode_t> > disk_backend_cache::parse_settings(const std::string & in)
+{
+	auto parts = split(in, ",");
+	if (parts.empty() || parts.size() > 2)
+		return { };
+
+	int size_kb = std::atoi(parts[0].c_str());
+	if (size_kb < 1)
+		return { };
+
+	write_mode_t mode = wm_through;
+
+	if (parts.size() == 2) {
+		if (parts[1] == "back")
+			mode = wm_back;
+		else if (parts[1] != "through")
+			return { };
+	}
+
+	return { { size_t(size_kb) * 1024, mode } };
+}
+
+JsonDocument disk_backend_cache::serialize() const
+{
+	JsonDocument j;
+
+	j["disk-backend-type"] = "cache";
+
+	j["inner"]      = inner->serialize();
+	j["size"]       = n_blocks * disk_cache_block_size;
+	j["write-mode"] = write_mode == wm_back ? "back" : "through";
+
+	// blocks not yet written to the inner backend
+	JsonDocument j_dirty;
+	for(auto & b: blocks) {
+		if (b.second.dirty == false)
+			continue;
+
+		JsonDocument j_block;
+		j_block["sector-size"] = b.second.sector_size;
+
+		JsonArray j_data = j_block["data"].to<JsonArray>();
+		for(auto & byte: b.second.data)
+			j_data.add(byte);
+
+		j_dirty[format("%ld", long(b.first))] = j_block;
+	}
+	j["dirty"] = j_dirty;
+
+	return j;
+}
+
+disk_backend_cache *disk_backend_cache::deserialize(const JsonVariantConst j)
+{
+	disk_backend       *inner = disk_backend::deserialize(j["inner"]);  // also does begin() of it
+	disk_backend_cache *d     = new disk_backend_cache(inner, j["size"].as<size_t>(), j["write-mode"].as<std::string>() == "back" ? wm_back : wm_through);
+
+	d->inner_started = true;
+
+	for(auto kv : j["dirty"].as<JsonObjectConst>()) {
+		block_t *b = d->add_block(std::atol(kv.key().c_str()), kv.value()["sector-size"].as<size_t>());
+
+		size_t o = 0;
+		for(auto v: kv.value()["data"].as<JsonArrayConst>()) {
+			if (o < disk_cache_block_size)
+				b->data[o++] = v.as<uint8_t>();
+		}
+
+		b->dirty = true;
+	}
+
+	return d;
+}
+
+bool disk_backend_cache::begin(const bool snapshots)
+{
+	// with snapshots the inner backend keeps the overlay
+	if (inner_started)
+		return true;
+
+	inner_started = true;
+
+	return inner->begin(snapshots);
+}
+
+disk_backend_cache::block_t *disk_backend_cache::find_block(const off_t nr)
+{
+	auto it = blocks.find(nr);
+	if (it == blocks.end())
+		return nullptr;
+
+	lru.splice(lru.begin(), lru, it->second.lru_it);
+
+	return &it->second;
+}
+
+// evicts the least recently used block when the cache is full
+disk_backend_cache::block_t *disk_backend_cache::add_block(const off_t nr, const size_t sector_size)
+{
+	while(blocks.size() >= n_blocks) {
+		off_t victim = lru.back();
+		auto  it     = blocks.find(victim);
+
+		if (it->second.dirty)
+			write_block(victim, it->second);
+
+		blocks.erase(it);
+		lru.pop_back();
+	}
+
+	lru.push_front(nr);
+
+	block_t & b = blocks[nr];
+	b.data.resize(disk_cache_block_size);
+	b.sector_size = sector_size;
+	b.dirty       = false;
+	b.lru_it      = lru.begin();
+
+	return &b;
+}
+
+// returns nullptr when the block cannot be read, e.g. when the image ends halfway
+disk_backend_cache::block_t *disk_backend_cache::get_block(const off_t nr, const size_t sector_size)
+{
+	block_t *b = find_block(nr);
+	if (b) {
+		cache_statistics.n_hits.fetch_add(1, std::memory_order_relaxed);
+
+		last_block = nr;
+
+		return b;
+	}
+
+	cache_statistics.n_misses.fetch_add(1, std::memory_order_relaxed);
+
+	// sequential access: also fetch the blocks that follow
+	int n = 1;
+	if (nr == last_block + 1) {
+		while(n < 1 + disk_cache_read_ahead && blocks.find(nr + n) == blocks.end())
+			n++;
+	}
+
+	last_block = nr;
+
+	std::vector<uint8_t> buffer(n * disk_cache_block_size);
+
+	bool ok = inner->read(nr * disk_cache_block_size, buffer.size(), buffer.data(), sector_size);
+	if (!ok && n > 1) {  // read-ahead beyond the end of the image?
+		n  = 1;
+		ok = inner->read(nr * disk_cache_block_size, disk_cache_block_size, buffer.data(), sector_size);
+	}
+
+	if (!ok)
+		return nullptr;
+
+	cache_statistics.n_read_ahead.fetch_add(n - 1, std::memory_order_relaxed);
+
+	// the requested block is added last so that it is the most recently used
+	for(int i=n - 1; i>=0; i--) {
+		b = add_block(nr + i, sector_size);
+
+		memcpy(b->data.data(), &buffer[i * disk_cache_block_size], disk_cache_block_size);
+	}
+
+	return b;
+}
+
+bool disk_backend_cache::write_block(const off_t nr, const block_t & b)
+{
+	cache_statistics.n_write_backs.fetch_add(1, std::memory_order_relaxed);
+
+	if (inner->write(nr * disk_cache_block_size, disk_cache_block_size, b.data.data(), b.sector_size))
+		return true;
+
+	DOLOG(ll_error, true, "disk_backend_cache: cannot write back block %ld of \"%s\"", long(nr), inner->get_identifier().c_str());
+
+	return false;
+}
+
+void disk_backend_cache::flush()
+{
+	std::vector<off_t> dirty;
+
+	for(auto & b: blocks) {
+		if (b.second.dirty)
+			dirty.push_back(b.first);
+	}
+
+	std::sort(dirty.begin(), dirty.end());
+
+	for(auto nr: dirty) {
+		block_t & b = blocks.find(nr)->second;
+
+		write_block(nr, b);
+
+		b.dirty = false;
+	}
+}
+
+bool disk_backend_cache::read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size)
+{
+	TRACE(tc_disk, "disk_backend_cache::read: read %zu bytes from offset %zu", n, size_t(offset));
+
+	assert((offset % sector_size) == 0);
+	assert((n % sector_size) == 0);
+
+	if (disk_cache_block_size % sector_size)
+		return inner->read(offset, n, target, sector_size);
+
+	for(size_t o=0; o<n;) {
+		off_t    cur      = offset + o;
+		off_t    nr       = cur / disk_cache_block_size;
+		size_t   in_block = cur % disk_cache_block_size;
+		size_t   len      = std::min(n - o, disk_cache_block_size - in_block);
+
+		block_t *b        = get_block(nr, sector_size);
+
+		if (b)
+			memcpy(&target[o], &b->data[in_block], len);
+		else if (inner->read(cur, len, &target[o], sector_size) == false)
+			return false;
+
+		o += len;
+	}
+
+	return true;
+}
+
+bool disk_backend_cache::write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size)
+{
+	TRACE(tc_disk, "disk_backend_cache::write: write %zu bytes to offset %zu", n, size_t(offset));
+
+	assert((offset % sector_size) == 0);
+	assert((n % sector_size) == 0);
+
+	if (disk_cache_block_size % sector_size)
+		return inner->write(offset, n, from, sector_size);
+
+	if (write_mode == wm_through && inner->write(offset, n, from, sector_size) == false)
+		return false;
+
+	for(size_t o=0; o<n;) {
+		off_t    cur      = offset + o;
+		off_t    nr       = cur / disk_cache_block_size;
+		size_t   in_block = cur % disk_cache_block_size;
+		size_t   len      = std::min(n - o, disk_cache_block_size - in_block);
+
+		block_t *b        = find_block(nr);
+
+		if (write_mode == wm_back) {
+			// a block that is overwritten completely is not read first
+			if (b == nullptr)
+				b = len == disk_cache_block_size ? add_block(nr, sector_size) : get_block(nr, sector_size);
+
+			if (b == nullptr) {
+				if (inner->write(cur, len, &from[o], sector_size) == false)
+					return false;
+			}
+			else {
+				b->dirty = true;
+			}
+		}
+
+		if (b)
+			memcpy(&b->data[in_block], &from[o], len);
+
+		o += len;
+	}
+
+	return true;
+}
@@ -0,0 +1,75 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include "gen.h"
+#include <ArduinoJson.h>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "disk_backend.h"
+
+
+constexpr const size_t disk_cache_block_size = 4096;  // a multiple of all sector sizes
+constexpr const int    disk_cache_read_ahead = 4;     // blocks, about a track
+
+// Keeps the most recently used blocks of another backend in memory. On a
+// miss that follows the previous block, the blocks after it are fetched in
+// the same request. Every disk has a cache (and size limit) of its own, a
+// busy disk does not evict the blocks of another one.
+class disk_backend_cache : public disk_backend
+{
+public:
+	enum write_mode_t { wm_through, wm_back };
+
+private:
+	struct block_t {
+		std::vector<uint8_t>       data;
+		size_t                     sector_size { 0 };
+		bool                       dirty       { false };
+		std::list<off_t>::iterator lru_it;
+	};
+
+	disk_backend *const  inner         { nullptr };
+	const size_t         n_blocks      { 0 };
+	const write_mode_t   write_mode    { wm_through };
+	bool                 inner_started { false };
+
+	std::unordered_map<off_t, block_t> blocks;  // by block number
+	std::list<off_t>     lru;  // most recently used first
+	off_t                last_block    { -2 };
+
+	disk_cache_statistics_t cache_statistics;
+
+	block_t *find_block(const off_t nr);
+	block_t *add_block(const off_t nr, const size_t sector_size);
+	block_t *get_block(const off_t nr, const size_t sector_size);
+	bool     write_block(const off_t nr, const block_t & b);
+	void     flush();
+
+public:
+	disk_backend_cache(disk_backend *const inner, const size_t size, const write_mode_t write_mode);
+	virtual ~disk_backend_cache();
+
+	// "size-in-kB[,through|back]"
+	static std::optional<std::pair<size_t, write_mode_t> > parse_settings(const std::string & in);
+
+	JsonDocument serialize() const override;
+	static disk_backend_cache *deserialize(const JsonVariantConst j);
+
+	std::string get_identifier() const override { return inner->get_identifier(); }
+
+	bool begin(const bool snapshots) override;
+
+	bool set_overlay_file(const std::string & filename) override { return inner->set_overlay_file(filename); }
+
+	bool read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) override;
+
+	bool write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size) override;
+
+	const disk_cache_statistics_t *get_cache_statistics() const override { return &cache_statistics; }
+};
@@ -0,0 +1,212 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/stat.h>
+
+#include "disk_backend_compressed.h"
+#include "gen.h"
+#include "log.h"
+
+
+disk_backend_compressed::disk_backend_compressed(const std::string & filename) :
+	filename(filename)
+{
+}
+
+disk_backend_compressed::~disk_backend_compressed()
+{
+	if (fd != -1)
+		close(fd);
+}
+
+bool disk_backend_compressed::is_compressed_image(const std::string & filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	char magic[sizeof compressed_image_magic] { };
+	bool rc = ::read(fd, magic, sizeof magic) == sizeof magic && memcmp(magic, compressed_image_magic, sizeof magic) == 0;
+
+	close(fd);
+
+	return rc;
+}
+
+JsonDocument disk_backend_compressed::serialize() const
+{
+	JsonDocument j;
+
+	j["disk-backend-type"] = "compressed";
+
+	j["overlay"] = serialize_overlay();
+
+	j["filename"] = filename;
+
+	return j;
+}
+
+disk_backend_compressed *disk_backend_compressed::deserialize(const JsonVariantConst j)
+{
+	return new disk_backend_compressed(j["filename"].as<std::string>());
+}
+
+bool disk_backend_compressed::begin(const bool snapshots)
+{
+	// the image itself is never changed
+	use_overlay = true;
+
+	if (snapshots == false)
+		DOLOG(info, false, "disk_backend_compressed: \"%s\" is read-only, writes to it are kept in memory only", filename.c_str());
+
+	fd = open(filename.c_str(), O_RDONLY);
+
+	if (fd == -1) {
+		DOLOG(ll_error, true, "disk_backend_compressed: cannot open \"%s\": %s", filename.c_str(), strerror(errno));
+
+		return false;
+	}
+
+	struct stat st { };
+	if (fstat(fd, &st) == -1) {
+		DOLOG(ll_error, true, "disk_backend_compressed: cannot stat \"%s\": %s", filename.c_str(), strerror(errno));
+
+		return false;
+	}
+
+	if (pread(fd, &header, sizeof header, 0) != sizeof header || memcmp(header.magic, compressed_image_magic, sizeof compressed_image_magic) != 0) {
+		DOLOG(ll_error, true, "disk_backend_compressed: \"%s\" is not a compressed image", filename.c_str());
+
+		return false;
+	}
+
+	size_t index_size = (size_t(header.n_chunks) + 1) * sizeof(uint64_t);
+
+	if (header.chunk_size == 0 || header.index_offset + index_size > uint64_t(st.st_size) ||
+		uint64_t(header.n_chunks) * header.chunk_size < header.image_size) {
+		DOLOG(ll_error, true, "disk_backend_compressed: header of \"%s\" is not valid", filename.c_str());
+
+		return false;
+	}
+
+	index.resize(header.n_chunks + 1);
+
+	if (pread(fd, index.data(), index_size, header.index_offset) != ssize_t(index_size)) {
+		DOLOG(ll_error, true, "disk_backend_compressed: cannot read the index of \"%s\": %s", filename.c_str(), strerror(errno));
+
+		return false;
+	}
+
+	for(uint32_t i=0; i<header.n_chunks; i++) {
+		if (index[i] > index[i + 1] || index[i + 1] > header.index_offset) {
+			DOLOG(ll_error, true, "disk_backend_compressed: index of \"%s\" is not valid", filename.c_str());
+
+			return false;
+		}
+	}
+
+	DOLOG(info, false, "disk_backend_compressed: \"%s\" is %" PRIu64 " bytes in %u chunks of %u bytes", filename.c_str(), header.image_size, header.n_chunks, header.chunk_size);
+
+	return true;
+}
+
+// nullptr when the chunk cannot be read or is corrupt
+const disk_backend_compressed::chunk_t *disk_backend_compressed::get_chunk(const uint32_t nr)
+{
+	chunk_t *victim = &chunks[0];
+
+	for(auto & c: chunks) {
+		if (c.last_use && c.nr == nr) {
+			c.last_use = ++use_counter;
+
+			return &c;
+		}
+
+		if (c.last_use < victim->last_use)
+			victim = &c;
+	}
+
+	size_t   in_size  = index[nr + 1] - index[nr];
+	uLongf   out_size = std::min(uint64_t(header.chunk_size), header.image_size - uint64_t(nr) * header.chunk_size);
+
+	victim->last_use = 0;
+	victim->data.resize(header.chunk_size);
+
+	if (in_size == header.chunk_size) {  // stored as is
+		if (pread(fd, victim->data.data(), in_size, index[nr]) != ssize_t(in_size)) {
+			DOLOG(warning, false, "disk_backend_compressed: cannot read chunk %u of \"%s\": %s", nr, filename.c_str(), strerror(errno));
+
+			return nullptr;
+		}
+	}
+	else {
+		compressed.resize(in_size);
+
+		if (pread(fd, compressed.data(), in_size, index[nr]) != ssize_t(in_size)) {
+			DOLOG(warning, false, "disk_backend_compressed: cannot read chunk %u of \"%s\": %s", nr, filename.c_str(), strerror(errno));
+
+			return nullptr;
+		}
+
+		uLongf expected = out_size;
+		if (uncompress(victim->data.data(), &out_size, compressed.data(), in_size) != Z_OK || out_size != expected) {
+			DOLOG(warning, false, "disk_backend_compressed: chunk %u of \"%s\" is corrupt", nr, filename.c_str());
+
+			return nullptr;
+		}
+	}
+
+	victim->nr       = nr;
+	victim->last_use = ++use_counter;
+
+	return victim;
+}
+
+bool disk_backend_compressed::read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size)
+{
+	TRACE(tc_disk, "disk_backend_compressed::read: read %zu bytes from offset %zu", n, offset);
+
+	assert((offset % sector_size) == 0);
+	assert((n % sector_size) == 0);
+
+	if (offset < 0 || offset + n > header.image_size) {
+		DOLOG(warning, false, "disk_backend_compressed::read: %zu bytes at offset %zu are beyond the end of \"%s\"", n, offset, filename.c_str());
+		return false;
+	}
+
+	for(size_t o=0; o<n;) {
+		uint64_t cur      = offset + o;
+		uint32_t nr       = cur / header.chunk_size;
+		size_t   in_chunk = cur % header.chunk_size;
+		size_t   len      = std::min(n - o, size_t(header.chunk_size) - in_chunk);
+
+		const chunk_t *c = get_chunk(nr);
+		if (c == nullptr)
+			return false;
+
+		memcpy(&target[o], &c->data[in_chunk], len);
+
+		o += len;
+	}
+
+	return patch_from_overlay(offset, n, target, sector_size);
+}
+
+bool disk_backend_compressed::write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size)
+{
+	TRACE(tc_disk, "disk_backend_compressed::write: write %zu bytes to offset %zu", n, offset);
+
+	if (offset < 0 || offset + n > header.image_size) {
+		DOLOG(warning, false, "disk_backend_compressed::write: %zu bytes at offset %zu are beyond the end of \"%s\"", n, offset, filename.c_str());
+		return false;
+	}
+
+	return store_mem_range_in_overlay(offset, n, from, sector_size);
+}
@@ -0,0 +1,57 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include "gen.h"
+#include <ArduinoJson.h>
+#include <string>
+#include <vector>
+
+#include "compressed_image.h"
+#include "disk_backend.h"
+
+
+constexpr const int disk_compressed_cache_chunks = 8;
+
+// A read-only image made with kek-mkcimg (see compressed_image.h). Chunks
+// are decompressed when they are accessed, the last few are kept. Writes
+// always go to the overlay; without -P/-O they are lost when kek stops.
+class disk_backend_compressed : public disk_backend
+{
+private:
+	struct chunk_t {
+		uint32_t             nr       { 0 };
+		uint64_t             last_use { 0 };  // 0: not used yet
+		std::vector<uint8_t> data;
+	};
+
+	const std::string         filename;
+
+	int                       fd        { -1 };
+	compressed_image_header_t header    { };
+	std::vector<uint64_t>     index;
+	std::vector<uint8_t>      compressed;  // buffer for the chunk that is read
+	chunk_t                   chunks[disk_compressed_cache_chunks];
+	uint64_t                  use_counter { 0 };
+
+	const chunk_t *get_chunk(const uint32_t nr);
+
+public:
+	disk_backend_compressed(const std::string & filename);
+	virtual ~disk_backend_compressed();
+
+	// true when 'filename' starts with the magic of a compressed image
+	static bool is_compressed_image(const std::string & filename);
+
+	JsonDocument serialize() const override;
+	static disk_backend_compressed *deserialize(const JsonVariantConst j);
+
+	std::string get_identifier() const override { return filename; }
+
+	bool begin(const bool snapshots) override;
+
+	bool read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) override;
+
+	bool write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size) override;
+};
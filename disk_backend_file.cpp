@@ -60,44 +60,50 @@ bool disk_backend_file::begin(const bool snapshots)
 	return true;
 }
 
-bool disk_backend_file::read(const off_t offset_in, const size_t n, uint8_t *const target, const size_t sector_size)
+bool disk_backend_file::read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size)
 {
-	TRACE("disk_backend_file::read: read %zu bytes from offset %zu", n, offset_in);
+	TRACE(tc_disk, "disk_backend_file::read: read %zu bytes from offset %zu", n, offset);
 
-	assert((offset_in % sector_size) == 0);
+	assert((offset % sector_size) == 0);
 	assert((n % sector_size) == 0);
 
-	for(off_t o=0; o<off_t(n); o+=sector_size) {
-		off_t offset = offset_in + o;
-#if IS_POSIX
-		auto o_rc = get_from_overlay(offset, sector_size);
-		if (o_rc.has_value()) {
-			memcpy(&target[o], o_rc.value().data(), sector_size);
+	// one read per run of sectors that are not in the overlay (usually that
+	// is the whole transfer), the others are copied in by patch_from_overlay()
+	auto in_overlay = [&](const size_t o) { return use_overlay && overlay.is_present((offset + o) / sector_size); };
+
+	for(size_t o=0; o<n;) {
+		if (in_overlay(o)) {
+			o += sector_size;
 			continue;
 		}
-#endif
+
+		size_t len = sector_size;
+		while(o + len < n && in_overlay(o + len) == false)
+			len += sector_size;
 
 #if defined(_WIN32) // hope for the best
-		if (lseek(fd, offset, SEEK_SET) == -1)
+		if (lseek(fd, offset + o, SEEK_SET) == -1)
 			return false;
 
-		 if (::read(fd, target, n) != ssize_t(n))
+		 if (::read(fd, &target[o], len) != ssize_t(len))
 			 return false;
 #else
-		ssize_t rc = pread(fd, target, n, offset);
-		if (rc != ssize_t(n)) {
-			DOLOG(warning, false, "disk_backend_file::read: read failure. expected %zu bytes, got %zd", n, rc);
+		ssize_t rc = pread(fd, &target[o], len, offset + o);
+		if (rc != ssize_t(len)) {
+			DOLOG(warning, false, "disk_backend_file::read: read failure. expected %zu bytes, got %zd", len, rc);
 			return false;
 		}
 #endif
+
+		o += len;
 	}
 
-	return true;
+	return patch_from_overlay(offset, n, target, sector_size);
 }
 
 bool disk_backend_file::write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size)
 {
-	TRACE("disk_backend_file::write: write %zu bytes to offset %zu", n, offset);
+	TRACE(tc_disk, "disk_backend_file::write: write %zu bytes to offset %zu", n, offset);
 
 #if IS_POSIX
 	if (store_mem_range_in_overlay(offset, n, from, sector_size))
@@ -1,6 +1,8 @@
 // (C) 2018-2024 by Folkert van Heusden
 // Released under MIT license
 
+#pragma once
+
 #include "gen.h"
 #include <ArduinoJson.h>
 #include <string>
@@ -10,7 +12,7 @@
 
 class disk_backend_file : public disk_backend
 {
-private:
+protected:
 	const std::string filename;
 
 	int fd { -1 };
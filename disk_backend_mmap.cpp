@@ -0,0 +1,192 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <cassert>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "disk_backend_mmap.h"
+#include "gen.h"
+#include "log.h"
+#include "utils.h"
+
+
+constexpr const uint64_t mmap_idle_ms = 500;  // sm_idle: sync when no writes for this long
+
+static const char *const sync_mode_names[] = { "idle", "periodic", "shutdown" };
+
+disk_backend_mmap::disk_backend_mmap(const std::string & filename, const sync_mode_t sync_mode, const int interval) :
+	filename(filename),
+	sync_mode(sync_mode),
+	interval(interval)
+{
+}
+
+disk_backend_mmap::~disk_backend_mmap()
+{
+	stop_flag = true;
+
+	if (th) {
+		th->join();
+		delete th;
+	}
+
+	if (map) {
+		sync();
+
+		munmap(map, map_size);
+	}
+
+	if (fd != -1)
+		close(fd);
+}
+
+std::optional<std::pair<disk_backend_mmap::sync_mode_t, int> > disk_backend_mmap::parse_sync_mode(const std::string & in)
+{
+	auto parts = split(in, ",");
+
+	if (parts.size() == 1 && parts[0] == "idle")
+		return { { sm_idle, 0 } };
+
+	if (parts.size() == 1 && parts[0] == "shutdown")
+		return { { sm_shutdown, 0 } };
+
+	if (parts.size() >= 1 && parts.size() <= 2 && parts[0] == "periodic") {
+		int interval = parts.size() == 2 ? std::atoi(parts[1].c_str()) : 5;
+		if (interval < 1)
+			return { };
+
+		return { { sm_periodic, interval } };
+	}
+
+	return { };
+}
+
+JsonDocument disk_backend_mmap::serialize() const
+{
+	JsonDocument j;
+
+	j["disk-backend-type"] = "mmap";
+
+	j["overlay"] = serialize_overlay();
+
+	j["filename"]  = filename;
+	j["sync-mode"] = sync_mode_names[sync_mode];
+	j["interval"]  = interval;
+
+	return j;
+}
+
+disk_backend_mmap *disk_backend_mmap::deserialize(const JsonVariantConst j)
+{
+	auto mode = parse_sync_mode(j["sync-mode"].as<std::string>());
+
+	return new disk_backend_mmap(j["filename"].as<std::string>(), mode.has_value() ? mode.value().first : sm_shutdown, j["interval"].as<int>());
+}
+
+bool disk_backend_mmap::begin(const bool snapshots)
+{
+	use_overlay = snapshots;
+
+	// with snapshots, writes go to the overlay: the file is never changed
+	fd = open(filename.c_str(), snapshots ? O_RDONLY : O_RDWR);
+
+	if (fd == -1) {
+		DOLOG(ll_error, true, "disk_backend_mmap: cannot open \"%s\": %s", filename.c_str(), strerror(errno));
+
+		return false;
+	}
+
+	struct stat st { };
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		DOLOG(ll_error, true, "disk_backend_mmap: cannot determine the size of \"%s\" (or it is empty)", filename.c_str());
+
+		return false;
+	}
+
+	map_size = st.st_size;
+
+	void *p = mmap(nullptr, map_size, snapshots ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		DOLOG(ll_error, true, "disk_backend_mmap: cannot map \"%s\": %s", filename.c_str(), strerror(errno));
+
+		return false;
+	}
+
+	map = reinterpret_cast<uint8_t *>(p);
+
+	if (sync_mode != sm_shutdown && snapshots == false)
+		th = new std::thread(std::ref(*this));
+
+	return true;
+}
+
+bool disk_backend_mmap::read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size)
+{
+	TRACE(tc_disk, "disk_backend_mmap::read: read %zu bytes from offset %zu", n, offset);
+
+	assert((offset % sector_size) == 0);
+	assert((n % sector_size) == 0);
+
+	if (offset < 0 || offset + n > map_size) {
+		DOLOG(warning, false, "disk_backend_mmap::read: %zu bytes at offset %zu are beyond the end of \"%s\"", n, offset, filename.c_str());
+		return false;
+	}
+
+	memcpy(target, &map[offset], n);
+
+	return patch_from_overlay(offset, n, target, sector_size);
+}
+
+bool disk_backend_mmap::write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size)
+{
+	TRACE(tc_disk, "disk_backend_mmap::write: write %zu bytes to offset %zu", n, offset);
+
+	if (store_mem_range_in_overlay(offset, n, from, sector_size))
+		return true;
+
+	if (offset < 0 || offset + n > map_size) {
+		DOLOG(warning, false, "disk_backend_mmap::write: %zu bytes at offset %zu are beyond the end of \"%s\"", n, offset, filename.c_str());
+		return false;
+	}
+
+	memcpy(&map[offset], from, n);
+
+	last_write = get_ms();
+	dirty      = true;
+
+	return true;
+}
+
+void disk_backend_mmap::sync()
+{
+	if (dirty.exchange(false) == false)
+		return;
+
+	if (msync(map, map_size, MS_SYNC) == -1)
+		DOLOG(warning, false, "disk_backend_mmap: msync of \"%s\" failed: %s", filename.c_str(), strerror(errno));
+}
+
+void disk_backend_mmap::operator()()
+{
+	set_thread_name("kek:mmap-sync");
+
+	uint64_t last_sync = get_ms();
+
+	while(!stop_flag) {
+		myusleep(100000);
+
+		uint64_t now = get_ms();
+
+		if (sync_mode == sm_idle && now - last_write >= mmap_idle_ms)
+			sync();
+		else if (sync_mode == sm_periodic && now - last_sync >= uint64_t(interval) * 1000) {
+			sync();
+
+			last_sync = now;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include "gen.h"
+#include <ArduinoJson.h>
+#include <atomic>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "disk_backend.h"
+
+
+// The image file is mapped into memory: transfers are memcpy()s between
+// the mapping and (guest) memory. When the changes are forced to the
+// file (msync) is selected with the sync mode.
+class disk_backend_mmap : public disk_backend
+{
+public:
+	enum sync_mode_t { sm_idle, sm_periodic, sm_shutdown };
+
+private:
+	const std::string  filename;
+	const sync_mode_t  sync_mode  { sm_shutdown };
+	const int          interval   { 0 };  // seconds, for sm_periodic
+
+	int                fd         { -1      };
+	uint8_t           *map        { nullptr };
+	size_t             map_size   { 0       };
+
+	std::atomic_bool   dirty      { false };
+	std::atomic_uint64_t last_write { 0 };  // ms
+	std::atomic_bool   stop_flag  { false };
+	std::thread       *th         { nullptr };
+
+	void sync();
+
+public:
+	disk_backend_mmap(const std::string & filename, const sync_mode_t sync_mode, const int interval);
+	virtual ~disk_backend_mmap();
+
+	// "idle", "periodic[,seconds]" or "shutdown"
+	static std::optional<std::pair<sync_mode_t, int> > parse_sync_mode(const std::string & in);
+
+	JsonDocument serialize() const override;
+	static disk_backend_mmap *deserialize(const JsonVariantConst j);
+
+	std::string get_identifier() const override { return filename; }
+
+	bool begin(const bool snapshots) override;
+
+	bool read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) override;
+
+	bool write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size) override;
+
+	void operator()();
+};
@@ -1,7 +1,10 @@
 // (C) 2018-2024 by Folkert van Heusden
 // Released under MIT license
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cinttypes>
 #include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
@@ -37,15 +40,100 @@
 #define NTOHLL(x) ((1==ntohl(1)) ? (x) : (((uint64_t)ntohl((x) & 0xFFFFFFFFUL)) << 32) | ntohl((uint32_t)((x) >> 32)))
 
 
-disk_backend_nbd::disk_backend_nbd(const std::string & host, const unsigned port) :
+// handshake
+constexpr const uint64_t nbd_oldstyle_magic         = 0x00420281861253ll;
+constexpr const uint64_t nbd_ihaveopt               = 0x49484156454F5054ll;  // "IHAVEOPT"
+constexpr const uint64_t nbd_option_reply_magic     = 0x3e889045565a9ll;
+constexpr const uint16_t nbd_flag_fixed_newstyle    = 1;
+constexpr const uint16_t nbd_flag_no_zeroes         = 2;
+constexpr const uint32_t nbd_opt_export_name        = 1;
+constexpr const uint32_t nbd_opt_go                 = 7;
+constexpr const uint32_t nbd_opt_structured_reply   = 8;
+constexpr const uint32_t nbd_rep_ack                = 1;
+constexpr const uint32_t nbd_rep_info               = 3;
+constexpr const uint32_t nbd_rep_err_unsup          = 0x80000001;
+constexpr const uint16_t nbd_info_export            = 0;
+constexpr const uint32_t nbd_max_option_reply       = 65536;
+
+// transmission
+constexpr const uint32_t nbd_request_magic          = 0x25609513;
+constexpr const uint32_t nbd_simple_reply_magic     = 0x67446698;
+constexpr const uint32_t nbd_structured_reply_magic = 0x668e33ef;
+constexpr const uint16_t nbd_cmd_read               = 0;
+constexpr const uint16_t nbd_cmd_write              = 1;
+constexpr const uint16_t nbd_reply_flag_done        = 1;
+constexpr const uint16_t nbd_reply_type_none        = 0;
+constexpr const uint16_t nbd_reply_type_offset_data = 1;
+constexpr const uint16_t nbd_reply_type_offset_hole = 2;
+constexpr const uint16_t nbd_reply_type_error_bit   = 0x8000;
+
+constexpr const uint32_t nbd_max_request_size       = 32 * 1024 * 1024;  // what servers accept at least
+constexpr const size_t   nbd_max_in_flight          = 16;  // per connection
+constexpr const uint32_t nbd_stripe_size            = 32 * 1024;  // spread over the connections
+constexpr const size_t   nbd_max_read_ahead         = 256 * 1024;
+constexpr const uint64_t nbd_min_backoff            = 100;    // ms
+constexpr const uint64_t nbd_max_backoff            = 30000;  // ms
+
+struct __attribute__ ((packed)) nbd_request_t {
+	uint32_t magic;
+	uint16_t flags;
+	uint16_t type;
+	uint64_t handle;
+	uint64_t offset;
+	uint32_t length;
+};
+
+struct __attribute__ ((packed)) nbd_simple_reply_t {
+	uint32_t magic;
+	uint32_t error;
+	uint64_t handle;
+};
+
+// the magic has been read already
+struct __attribute__ ((packed)) nbd_structured_reply_t {
+	uint16_t flags;
+	uint16_t type;
+	uint64_t handle;
+	uint32_t length;
+};
+
+disk_backend_nbd::disk_backend_nbd(const std::string & host, const unsigned port, const unsigned n_connections, const bool asynchronous) :
 	host(host),
-	port(port)
+	port(port),
+	asynchronous(asynchronous),
+	connections(std::max(n_connections, 1u))
 {
 }
 
 disk_backend_nbd::~disk_backend_nbd()
 {
-	close(fd);
+	if (worker) {
+		{
+			std::unique_lock<std::mutex> lck(jobs_lock);
+
+			jobs_cv.wait(lck, [this] { return jobs.empty(); });
+		}
+
+		stop_flag = true;
+		jobs_cv.notify_all();
+
+		worker->join();
+		delete worker;
+	}
+
+	stop_flag = true;
+
+	if (reconnector) {
+		pool_cv.notify_all();
+
+		reconnector->join();
+		delete reconnector;
+	}
+
+	for(auto & c: connections) {
+		if (c.fd != -1)
+			close(c.fd);
+	}
 }
 
 JsonDocument disk_backend_nbd::serialize() const
@@ -59,6 +147,8 @@ JsonDocument disk_backend_nbd::serialize() const
 	// TODO store checksum of backend
 	j["host"] = host.c_str();
 	j["port"] = port;
+	j["connections"]  = connections.size();
+	j["asynchronous"] = asynchronous;
 
 	return j;
 }
@@ -66,7 +156,10 @@ JsonDocument disk_backend_nbd::serialize() const
 disk_backend_nbd *disk_backend_nbd::deserialize(const JsonVariantConst j)
 {
 	// TODO verify checksum of backend
-	return new disk_backend_nbd(j["host"], j["port"]);
+	unsigned n_connections = j.containsKey("connections")  ? j["connections"].as<unsigned>() : 1;
+	bool     asynchronous  = j.containsKey("asynchronous") ? j["asynchronous"].as<bool>()    : false;
+
+	return new disk_backend_nbd(j["host"], j["port"], n_connections, asynchronous);
 }
 
 bool disk_backend_nbd::begin(const bool snapshots)
@@ -75,186 +168,658 @@ bool disk_backend_nbd::begin(const bool snapshots)
 	use_overlay = snapshots;
 #endif
 
-	if (!connect(false)) {
+	// the first attempt is done here, the reconnect thread does the others
+	size_t n_connected = 0;
+
+	for(auto & c: connections) {
+		c.fd = connect(&c.structured_replies, &export_size);
+
+		if (c.fd != -1)
+			n_connected++;
+	}
+
+	if (n_connected == 0) {
 		DOLOG(ll_error, true, "disk_backend_nbd: cannot connect to NBD server");
 		return false;
 	}
 
-	DOLOG(info, true, "disk_backend_nbd: connected to NBD server");
+	DOLOG(info, true, "disk_backend_nbd: connected to NBD server (%zu of %zu connections), size: %" PRIu64, n_connected, connections.size(), export_size);
+
+	reconnector = new std::thread(&disk_backend_nbd::reconnect, this);
+
+	if (asynchronous)
+		worker = new std::thread(&disk_backend_nbd::work, this);
 
 	return true;
 }
 
-bool disk_backend_nbd::connect(const bool retry)
+// returns the socket, -1 when the connection or the handshake failed
+int disk_backend_nbd::connect(bool *const structured_replies, uint64_t *const size)
 {
-	do {
-		// LOOP until connected, logging message, exponential backoff?
-		addrinfo *res     = nullptr;
+	addrinfo *res     = nullptr;
 
-		addrinfo hints { };
-		hints.ai_family   = AF_INET;
-		hints.ai_socktype = SOCK_STREAM;
+	addrinfo hints { };
+	hints.ai_family   = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
 
-		char port_str[8] { 0 };
-		snprintf(port_str, sizeof port_str, "%u", port);
+	char port_str[8] { 0 };
+	snprintf(port_str, sizeof port_str, "%u", port);
 
-		int rc = getaddrinfo(host.c_str(), port_str, &hints, &res);
+	int rc = getaddrinfo(host.c_str(), port_str, &hints, &res);
 
-		if (rc != 0) {
+	if (rc != 0) {
 #ifdef ESP32
-			DOLOG(ll_error, true, "disk_backend_nbd: cannot resolve \"%s\":%s", host.c_str(), port_str);
+		DOLOG(ll_error, true, "disk_backend_nbd: cannot resolve \"%s\":%s", host.c_str(), port_str);
 #else
-			DOLOG(ll_error, true, "disk_backend_nbd: cannot resolve \"%s\":%s: %s", host.c_str(), port_str, gai_strerror(rc));
+		DOLOG(ll_error, true, "disk_backend_nbd: cannot resolve \"%s\":%s: %s", host.c_str(), port_str, gai_strerror(rc));
 #endif
 
-			sleep(1);
+		return -1;
+	}
+
+	int fd = -1;
 
+	for(addrinfo *p = res; p != NULL; p = p->ai_next) {
+		if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
 			continue;
 		}
 
-		for(addrinfo *p = res; p != NULL; p = p->ai_next) {
-			if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
+		if (::connect(fd, p->ai_addr, p->ai_addrlen) == -1) {
+			close(fd);
+			fd = -1;
+			DOLOG(ll_error, true, "disk_backend_nbd: cannot connect");
+			continue;
+		}
+
+		break;
+	}
+
+	freeaddrinfo(res);
+
+	if (fd != -1) {
+		set_nodelay(fd);
+
+		if (handshake(fd, structured_replies, size))
+			DOLOG(debug, false, "disk_backend_nbd: connected to %s:%u, structured replies: %s", host.c_str(), port, *structured_replies ? "yes" : "no");
+		else {
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	return fd;
+}
+
+// connects the connections that failed, waiting longer after each attempt that fails
+void disk_backend_nbd::reconnect()
+{
+	set_thread_name("kek:nbd");
+
+	std::unique_lock<std::mutex> lck(pool_lock);
+
+	while(!stop_flag) {
+		uint64_t next_attempt = get_ms() + 1000;
+
+		for(size_t i=0; i<connections.size(); i++) {
+			if (connections[i].fd != -1)
 				continue;
-			}
 
-			if (::connect(fd, p->ai_addr, p->ai_addrlen) == -1) {
-				close(fd);
-				fd = -1;
-				DOLOG(ll_error, true, "disk_backend_nbd: cannot connect");
+			if (connections[i].retry_at > get_ms()) {
+				next_attempt = std::min(next_attempt, connections[i].retry_at);
 				continue;
 			}
 
-			break;
+			lck.unlock();
+
+			bool     structured_replies = false;
+			uint64_t size               = 0;
+			int      fd                 = connect(&structured_replies, &size);
+
+			lck.lock();
+
+			connection_t & c = connections[i];
+
+			if (fd == -1) {
+				c.backoff  = c.backoff ? std::min(c.backoff * 2, nbd_max_backoff) : nbd_min_backoff;
+				c.retry_at = get_ms() + c.backoff;
+
+				DOLOG(warning, false, "disk_backend_nbd: cannot reconnect to %s:%u, next attempt in %" PRIu64 " ms", host.c_str(), port, c.backoff);
+
+				next_attempt = std::min(next_attempt, c.retry_at);
+			}
+			else {
+				c.fd                 = fd;
+				c.structured_replies = structured_replies;
+
+				DOLOG(info, false, "disk_backend_nbd: reconnected to %s:%u", host.c_str(), port);
+
+				pool_cv.notify_all();
+			}
 		}
 
-		freeaddrinfo(res);
+		uint64_t now = get_ms();
+		if (next_attempt > now)
+			pool_cv.wait_for(lck, std::chrono::milliseconds(next_attempt - now));
+	}
+}
+
+bool disk_backend_nbd::handshake(const int fd, bool *const structured_replies, uint64_t *const size)
+{
+	*structured_replies = false;
+
+	uint8_t hello[16] { };
+	if (READ(fd, reinterpret_cast<char *>(hello), sizeof hello) != sizeof hello) {
+		DOLOG(warning, true, "disk_backend_nbd::handshake: short read");
+		return false;
+	}
+
+	uint64_t style = 0;
+	memcpy(&style, &hello[8], sizeof style);
+	style = NTOHLL(style);
 
+	if (memcmp(hello, "NBDMAGIC", 8) != 0 || (style != nbd_oldstyle_magic && style != nbd_ihaveopt)) {
+		DOLOG(warning, true, "disk_backend_nbd::handshake: magic invalid");
+		return false;
+	}
+
+	if (style == nbd_oldstyle_magic) {
 		struct __attribute__ ((packed)) {
-			uint8_t  magic1[8];
-			uint8_t  magic2[8];
 			uint64_t size;
 			uint32_t flags;
 			uint8_t  padding[124];
 		} nbd_hello { };
 
-		if (fd != -1) {
-			if (READ(fd, reinterpret_cast<char *>(&nbd_hello), sizeof nbd_hello) != sizeof nbd_hello) {
-				close(fd);
-				fd = -1;
-				DOLOG(warning, true, "disk_backend_nbd::connect: connect short read");
+		if (READ(fd, reinterpret_cast<char *>(&nbd_hello), sizeof nbd_hello) != sizeof nbd_hello) {
+			DOLOG(warning, true, "disk_backend_nbd::handshake: short read");
+			return false;
+		}
+
+		*size = NTOHLL(nbd_hello.size);
+
+		return true;
+	}
+
+	// newstyle
+	uint16_t server_flags = 0;
+	if (READ(fd, reinterpret_cast<char *>(&server_flags), sizeof server_flags) != sizeof server_flags) {
+		DOLOG(warning, true, "disk_backend_nbd::handshake: short read");
+		return false;
+	}
+
+	server_flags          = ntohs(server_flags);
+	uint32_t client_flags = htonl(server_flags & (nbd_flag_fixed_newstyle | nbd_flag_no_zeroes));
+
+	if (WRITE(fd, reinterpret_cast<const char *>(&client_flags), sizeof client_flags) != sizeof client_flags) {
+		DOLOG(warning, true, "disk_backend_nbd::handshake: problem sending flags");
+		return false;
+	}
+
+	// without fixed newstyle, the server may not understand other options
+	if (server_flags & nbd_flag_fixed_newstyle) {
+		uint32_t             type  = 0;
+		std::vector<uint8_t> reply;
+
+		if (!send_option(fd, nbd_opt_structured_reply, { }) || !receive_option_reply(fd, nbd_opt_structured_reply, &type, &reply))
+			return false;
+
+		*structured_replies = type == nbd_rep_ack;
+
+		// the default export, no information requests
+		if (!send_option(fd, nbd_opt_go, { 0, 0, 0, 0, 0, 0 }))
+			return false;
+
+		for(;;) {
+			if (!receive_option_reply(fd, nbd_opt_go, &type, &reply))
+				return false;
+
+			if (type == nbd_rep_ack)
+				return true;
+
+			if (type == nbd_rep_err_unsup)  // fall back to NBD_OPT_EXPORT_NAME
+				break;
+
+			if (type != nbd_rep_info) {
+				DOLOG(warning, true, "disk_backend_nbd::handshake: export not available (%08x)", type);
+				return false;
+			}
+
+			if (reply.size() >= 12 && reply[0] == 0 && reply[1] == nbd_info_export) {
+				memcpy(size, &reply[2], sizeof *size);
+				*size = NTOHLL(*size);
 			}
 		}
+	}
 
-		if (fd != -1 && memcmp(nbd_hello.magic1, "NBDMAGIC", 8) != 0) {
-			close(fd);
-			fd = -1;
-			DOLOG(warning, true, "disk_backend_nbd::connect: magic invalid");
+	if (!send_option(fd, nbd_opt_export_name, { }))
+		return false;
+
+	struct __attribute__ ((packed)) {
+		uint64_t size;
+		uint16_t flags;
+		uint8_t  padding[124];
+	} nbd_export { };
+
+	size_t export_len = sizeof nbd_export - (server_flags & nbd_flag_no_zeroes ? sizeof nbd_export.padding : 0);
+
+	if (READ(fd, reinterpret_cast<char *>(&nbd_export), export_len) != ssize_t(export_len)) {
+		DOLOG(warning, true, "disk_backend_nbd::handshake: export not available");
+		return false;
+	}
+
+	*size = NTOHLL(nbd_export.size);
+
+	return true;
+}
+
+bool disk_backend_nbd::send_option(const int fd, const uint32_t option, const std::vector<uint8_t> & data)
+{
+	struct __attribute__ ((packed)) {
+		uint64_t magic;
+		uint32_t option;
+		uint32_t length;
+	} nbd_option { };
+
+	nbd_option.magic  = HTONLL(nbd_ihaveopt);
+	nbd_option.option = htonl(option);
+	nbd_option.length = htonl(data.size());
+
+	if (WRITE(fd, reinterpret_cast<const char *>(&nbd_option), sizeof nbd_option) != sizeof nbd_option ||
+		(data.empty() == false && WRITE(fd, reinterpret_cast<const char *>(data.data()), data.size()) != ssize_t(data.size()))) {
+		DOLOG(warning, true, "disk_backend_nbd::send_option: problem sending option %u", option);
+		return false;
+	}
+
+	return true;
+}
+
+bool disk_backend_nbd::receive_option_reply(const int fd, const uint32_t option, uint32_t *const type, std::vector<uint8_t> *const data)
+{
+	struct __attribute__ ((packed)) {
+		uint64_t magic;
+		uint32_t option;
+		uint32_t type;
+		uint32_t length;
+	} nbd_option_reply { };
+
+	if (READ(fd, reinterpret_cast<char *>(&nbd_option_reply), sizeof nbd_option_reply) != sizeof nbd_option_reply) {
+		DOLOG(warning, true, "disk_backend_nbd::receive_option_reply: problem receiving reply");
+		return false;
+	}
+
+	uint32_t length = ntohl(nbd_option_reply.length);
+
+	if (NTOHLL(nbd_option_reply.magic) != nbd_option_reply_magic || ntohl(nbd_option_reply.option) != option || length > nbd_max_option_reply) {
+		DOLOG(warning, true, "disk_backend_nbd::receive_option_reply: invalid reply to option %u", option);
+		return false;
+	}
+
+	*type = ntohl(nbd_option_reply.type);
+
+	data->resize(length);
+	if (length > 0 && READ(fd, reinterpret_cast<char *>(data->data()), length) != ssize_t(length)) {
+		DOLOG(warning, true, "disk_backend_nbd::receive_option_reply: problem receiving reply");
+		return false;
+	}
+
+	return true;
+}
+
+// blocks until at least one connection is up; empty when stopping
+std::vector<size_t> disk_backend_nbd::wait_for_connections()
+{
+	std::vector<size_t> out;
+
+	std::unique_lock<std::mutex> lck(pool_lock);
+
+	for(;;) {
+		for(size_t i=0; i<connections.size(); i++) {
+			if (connections[i].fd != -1)
+				out.push_back(i);
 		}
 
-		if (fd != -1) {
-			DOLOG(info, false, "NBD size: %u", NTOHLL(nbd_hello.size));
-			set_nodelay(fd);
+		if (out.empty() == false || stop_flag)
+			break;
+
+		pool_cv.wait(lck);
+	}
+
+	return out;
+}
+
+// the requests that were on it will go over another connection
+void disk_backend_nbd::drop_connection(const size_t nr, std::vector<request_t> & requests)
+{
+	for(auto & r: requests) {
+		if (r.assigned && r.connection == nr && r.done == false) {
+			r.assigned = false;
+			r.sent     = false;
 		}
 	}
-	while(fd == -1 && retry);
 
-	return fd != -1;
+	std::unique_lock<std::mutex> lck(pool_lock);
+
+	close(connections[nr].fd);
+
+	connections[nr].fd       = -1;
+	connections[nr].retry_at = 0;
+	connections[nr].backoff  = 0;
+
+	pool_cv.notify_all();  // wake up the reconnect thread
 }
 
-bool disk_backend_nbd::read(const off_t offset_in, const size_t n, uint8_t *const target, const size_t sector_size)
+bool disk_backend_nbd::send_request(const int fd, const request_t & r)
 {
-	TRACE("disk_backend_nbd::read: read %zu bytes from offset %zu", n, offset_in);
+	nbd_request_t nbd_request { };
+	nbd_request.magic  = htonl(nbd_request_magic);
+	nbd_request.type   = htons(r.type);
+	nbd_request.handle = r.handle;  // only compared by us
+	nbd_request.offset = HTONLL(uint64_t(r.offset));
+	nbd_request.length = htonl(r.length);
+
+	if (WRITE(fd, reinterpret_cast<const char *>(&nbd_request), sizeof nbd_request) != sizeof nbd_request) {
+		DOLOG(warning, true, "disk_backend_nbd::send_request: problem sending request");
+		return false;
+	}
+
+	if (r.type == nbd_cmd_write && WRITE(fd, reinterpret_cast<const char *>(r.from), r.length) != ssize_t(r.length)) {
+		DOLOG(warning, true, "disk_backend_nbd::send_request: problem sending payload");
+		return false;
+	}
+
+	return true;
+}
+
+// receives one reply (or chunk of one) from connection 'nr' and updates the request it belongs to
+bool disk_backend_nbd::receive_reply(const size_t nr, std::vector<request_t> & requests)
+{
+	int fd = connections[nr].fd;
+
+	auto find_request = [&](const uint64_t handle) -> request_t * {
+		for(auto & r: requests) {
+			if (r.sent && r.done == false && r.connection == nr && r.handle == handle)
+				return &r;
+		}
+
+		DOLOG(warning, true, "disk_backend_nbd::receive_reply: reply for unknown handle");
+
+		return nullptr;
+	};
+
+	uint32_t magic = 0;
+	if (READ(fd, reinterpret_cast<char *>(&magic), sizeof magic) != sizeof magic) {
+		DOLOG(warning, true, "disk_backend_nbd::receive_reply: problem receiving reply header");
+		return false;
+	}
+
+	magic = ntohl(magic);
+
+	if (magic == nbd_simple_reply_magic) {
+		nbd_simple_reply_t nbd_reply { };
+		if (READ(fd, reinterpret_cast<char *>(&nbd_reply.error), sizeof nbd_reply - sizeof magic) != sizeof nbd_reply - sizeof magic) {
+			DOLOG(warning, true, "disk_backend_nbd::receive_reply: problem receiving reply header");
+			return false;
+		}
+
+		request_t *r = find_request(nbd_reply.handle);
+		if (!r)
+			return false;
+
+		r->done  = true;
+		r->error = ntohl(nbd_reply.error);
+
+		if (r->error == 0 && r->type == nbd_cmd_read && READ(fd, reinterpret_cast<char *>(r->target), r->length) != ssize_t(r->length)) {
+			DOLOG(warning, true, "disk_backend_nbd::receive_reply: problem receiving payload");
+			return false;
+		}
 
-	if (n == 0)
 		return true;
+	}
+
+	if (magic != nbd_structured_reply_magic || connections[nr].structured_replies == false) {
+		DOLOG(warning, true, "disk_backend_nbd::receive_reply: bad reply header %08x", magic);
+		return false;
+	}
 
-	size_t o      = 0;
-	off_t  offset = offset_in;
+	nbd_structured_reply_t nbd_reply { };
+	if (READ(fd, reinterpret_cast<char *>(&nbd_reply), sizeof nbd_reply) != sizeof nbd_reply) {
+		DOLOG(warning, true, "disk_backend_nbd::receive_reply: problem receiving reply header");
+		return false;
+	}
 
-	while(offset < offset_in + off_t(n)) {
-#if IS_POSIX
-		auto o_rc = get_from_overlay(offset, sector_size);
-		if (o_rc.has_value()) {
-			memcpy(&target[o], o_rc.value().data(), sector_size);
-			offset += sector_size;
-			o      += sector_size;
-			continue;
+	request_t *r = find_request(nbd_reply.handle);
+	if (!r)
+		return false;
+
+	uint16_t type   = ntohs(nbd_reply.type);
+	uint32_t length = ntohl(nbd_reply.length);
+
+	if (type == nbd_reply_type_offset_data || type == nbd_reply_type_offset_hole) {
+		uint64_t offset = 0;
+		if (length < sizeof offset || READ(fd, reinterpret_cast<char *>(&offset), sizeof offset) != sizeof offset) {
+			DOLOG(warning, true, "disk_backend_nbd::receive_reply: problem receiving chunk");
+			return false;
 		}
-#endif
 
-		if (fd == -1 && !connect(true)) {
-			DOLOG(warning, true, "disk_backend_nbd::read: (re-)connect");
-			sleep(1);
-			continue;
+		offset = NTOHLL(offset);
+
+		uint32_t chunk_len = length - sizeof offset;
+		if (type == nbd_reply_type_offset_hole) {
+			if (chunk_len != sizeof chunk_len || READ(fd, reinterpret_cast<char *>(&chunk_len), sizeof chunk_len) != sizeof chunk_len) {
+				DOLOG(warning, true, "disk_backend_nbd::receive_reply: problem receiving chunk");
+				return false;
+			}
+
+			chunk_len = ntohl(chunk_len);
 		}
 
-		struct __attribute__ ((packed)) {
-			uint32_t magic;
-			uint32_t type;
-			uint64_t handle;
-			uint64_t offset;
-			uint32_t length;
-		} nbd_request { };
-
-		nbd_request.magic  = ntohl(0x25609513);
-		nbd_request.type   = 0;  // READ
-		nbd_request.offset = HTONLL(uint64_t(offset));
-		nbd_request.length = htonl(sector_size);
-
-		if (WRITE(fd, reinterpret_cast<const char *>(&nbd_request), sizeof nbd_request) != sizeof nbd_request) {
-			DOLOG(warning, true, "disk_backend_nbd::read: problem sending request");
-			close(fd);
-			fd = -1;
-			sleep(1);
-			continue;
+		if (r->type != nbd_cmd_read || offset < uint64_t(r->offset) || offset + chunk_len > uint64_t(r->offset) + r->length) {
+			DOLOG(warning, true, "disk_backend_nbd::receive_reply: chunk outside of request");
+			return false;
 		}
 
-		struct __attribute__ ((packed)) {
-			uint32_t magic;
-			uint32_t error;
-			uint64_t handle;
-		} nbd_reply;
+		uint8_t *to = &r->target[offset - r->offset];
 
-		if (READ(fd, reinterpret_cast<char *>(&nbd_reply), sizeof nbd_reply) != sizeof nbd_reply) {
-			DOLOG(warning, true, "disk_backend_nbd::read: problem receiving reply header");
-			close(fd);
-			fd = -1;
-			sleep(1);
-			continue;
+		if (type == nbd_reply_type_offset_hole)
+			memset(to, 0x00, chunk_len);
+		else if (READ(fd, reinterpret_cast<char *>(to), chunk_len) != ssize_t(chunk_len)) {
+			DOLOG(warning, true, "disk_backend_nbd::receive_reply: problem receiving payload");
+			return false;
+		}
+	}
+	else if (type != nbd_reply_type_none) {
+		std::vector<uint8_t> payload(length);
+		if (length > 0 && READ(fd, reinterpret_cast<char *>(payload.data()), length) != ssize_t(length)) {
+			DOLOG(warning, true, "disk_backend_nbd::receive_reply: problem receiving payload");
+			return false;
 		}
 
-		if (ntohl(nbd_reply.magic) != 0x67446698) {
-			DOLOG(warning, true, "disk_backend_nbd::read: bad reply header %08x", nbd_reply.magic);
-			close(fd);
-			fd = -1;
-			sleep(1);
+		if (type & nbd_reply_type_error_bit) {
+			r->error = 1;
+
+			if (length >= sizeof r->error) {
+				memcpy(&r->error, payload.data(), sizeof r->error);
+				r->error = ntohl(r->error);
+			}
+		}
+	}
+
+	if (ntohs(nbd_reply.flags) & nbd_reply_flag_done)
+		r->done = true;
+
+	return true;
+}
+
+// does the requests over the connections that are up; requests on a
+// connection that fails are sent again over another one. false when the
+// server reported an error (or when stopping).
+bool disk_backend_nbd::transfer(std::vector<request_t> & requests)
+{
+	for(;;) {
+		bool all_done = true;
+		bool assign   = false;
+
+		for(auto & r: requests) {
+			all_done &= r.done;
+			assign   |= r.done == false && r.assigned == false;
+		}
+
+		if (all_done)
+			break;
+
+		// spread the requests over the connections
+		if (assign) {
+			auto alive = wait_for_connections();
+			if (alive.empty())
+				return false;
+
+			size_t i = 0;
+			for(auto & r: requests) {
+				if (r.done == false && r.assigned == false) {
+					r.connection = alive[i++ % alive.size()];
+					r.assigned   = true;
+				}
+			}
+		}
+
+		// send what fits in the window of each connection
+		std::vector<size_t> in_flight(connections.size());
+
+		for(auto & r: requests) {
+			if (r.sent && r.done == false)
+				in_flight[r.connection]++;
+		}
+
+		for(auto & r: requests) {
+			if (r.assigned == false || r.sent || r.done || in_flight[r.connection] >= nbd_max_in_flight)
+				continue;
+
+			r.handle = next_handle++;
+
+			if (send_request(connections[r.connection].fd, r) == false) {
+				drop_connection(r.connection, requests);
+				continue;
+			}
+
+			r.sent = true;
+			in_flight[r.connection]++;
+		}
+
+		// receive a reply from each connection that has one waiting
+		fd_set rfds;
+		FD_ZERO(&rfds);
+
+		int max_fd = -1;
+		for(size_t i=0; i<connections.size(); i++) {
+			if (in_flight[i] && connections[i].fd != -1) {
+				FD_SET(connections[i].fd, &rfds);
+				max_fd = std::max(max_fd, connections[i].fd);
+			}
+		}
+
+		if (max_fd == -1)
 			continue;
+
+		if (select(max_fd + 1, &rfds, nullptr, nullptr, nullptr) == -1) {
+			if (errno == EINTR)
+				continue;
+
+			DOLOG(warning, true, "disk_backend_nbd::transfer: select failed: %s", strerror(errno));
+			return false;
 		}
 
-		int error = ntohl(nbd_reply.error);
-		if (error) {
-			DOLOG(warning, true, "disk_backend_nbd::read: NBD server indicated error: %d", error);
+		for(size_t i=0; i<connections.size(); i++) {
+			if (in_flight[i] && connections[i].fd != -1 && FD_ISSET(connections[i].fd, &rfds) && receive_reply(i, requests) == false)
+				drop_connection(i, requests);
+		}
+	}
+
+	for(auto & r: requests) {
+		if (r.error) {
+			DOLOG(warning, true, "disk_backend_nbd::transfer: NBD server indicated error: %u", r.error);
 			return false;
 		}
+	}
 
-		if (READ(fd, reinterpret_cast<char *>(target), sector_size) != ssize_t(sector_size)) {
-			DOLOG(warning, true, "disk_backend_nbd::read: problem receiving payload");
-			close(fd);
-			fd = -1;
-			sleep(1);
+	return true;
+}
+
+// with more than one connection, large runs are split so that they go over all
+void disk_backend_nbd::add_requests(std::vector<request_t> & requests, const uint16_t type, const off_t offset, const size_t n, uint8_t *const target, const uint8_t *const from)
+{
+	size_t max_size = connections.size() > 1 ? nbd_stripe_size : nbd_max_request_size;
+
+	for(size_t o=0; o<n; o += max_size) {
+		request_t r;
+		r.type   = type;
+		r.offset = offset + o;
+		r.length = std::min(n - o, max_size);
+		r.target = target ? &target[o] : nullptr;
+		r.from   = from   ? &from  [o] : nullptr;
+		requests.push_back(r);
+	}
+}
+
+bool disk_backend_nbd::read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size)
+{
+	TRACE(tc_nbd, "disk_backend_nbd::read: read %zu bytes from offset %zu", n, offset);
+
+	if (n == 0)
+		return true;
+
+	bool sequential = offset == last_read_end;
+	last_read_end   = offset + n;
+
+	if (offset >= ra_offset && offset + n <= ra_offset + ra_data.size()) {
+		memcpy(target, &ra_data[offset - ra_offset], n);
+
+		return patch_from_overlay(offset, n, target, sector_size);
+	}
+
+	// the read-ahead grows while the reads are sequential
+	ra_size = sequential ? std::min(std::max(ra_size * 2, n), nbd_max_read_ahead) : 0;
+
+	// one request per run of sectors that are not in the overlay
+	auto in_overlay = [&](const size_t o) { return use_overlay && overlay.is_present((offset + o) / sector_size); };
+
+	std::vector<request_t> requests;
+
+	for(size_t o=0; o<n;) {
+		if (in_overlay(o)) {
+			o += sector_size;
 			continue;
 		}
 
-		offset += sector_size;
-		o      += sector_size;
+		size_t len = sector_size;
+		while(o + len < n && in_overlay(o + len) == false)
+			len += sector_size;
+
+		add_requests(requests, nbd_cmd_read, offset + o, len, &target[o], nullptr);
+
+		o += len;
 	}
 
-	return true;
+	ra_offset = offset + n;
+
+	size_t ra_len = 0;
+	if (uint64_t(ra_offset) < export_size)
+		ra_len = std::min(uint64_t(ra_size), export_size - ra_offset) / sector_size * sector_size;
+
+	ra_data.resize(ra_len);
+	if (ra_len)
+		add_requests(requests, nbd_cmd_read, ra_offset, ra_len, ra_data.data(), nullptr);
+
+	if (requests.empty() == false && transfer(requests) == false) {
+		ra_data.clear();
+
+		return false;
+	}
+
+	return patch_from_overlay(offset, n, target, sector_size);
 }
 
 bool disk_backend_nbd::write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size)
 {
-	TRACE("disk_backend_nbd::write: write %zu bytes to offset %zu", n, offset);
+	TRACE(tc_nbd, "disk_backend_nbd::write: write %zu bytes to offset %zu", n, offset);
 
 	if (n == 0)
 		return true;
@@ -264,71 +829,75 @@ bool disk_backend_nbd::write(const off_t offset, const size_t n, const uint8_t *
 		return true;
 #endif
 
-	do {
-		if (!connect(true)) {
-			DOLOG(warning, true, "disk_backend_nbd::write: (re-)connect");
-			sleep(1);
-			continue;
-		}
+	if (offset < off_t(ra_offset + ra_data.size()) && offset + off_t(n) > ra_offset)
+		ra_data.clear();
 
-		struct __attribute__ ((packed)) {
-			uint32_t magic;
-			uint32_t type;
-			uint64_t handle;
-			uint64_t offset;
-			uint32_t length;
-		} nbd_request { };
-
-		nbd_request.magic  = ntohl(0x25609513);
-		nbd_request.type   = htonl(1);  // WRITE
-		nbd_request.offset = HTONLL(uint64_t(offset));
-		nbd_request.length = htonl(n);
-
-		if (WRITE(fd, reinterpret_cast<const char *>(&nbd_request), sizeof nbd_request) != sizeof nbd_request) {
-			DOLOG(warning, true, "disk_backend_nbd::write: problem sending request");
-			close(fd);
-			fd = -1;
-			sleep(1);
-			continue;
-		}
+	std::vector<request_t> requests;
+	add_requests(requests, nbd_cmd_write, offset, n, nullptr, from);
 
-		if (WRITE(fd, reinterpret_cast<const char *>(from), n) != ssize_t(n)) {
-			DOLOG(warning, true, "disk_backend_nbd::write: problem sending payload");
-			close(fd);
-			fd = -1;
-			sleep(1);
-			continue;
-		}
+	return transfer(requests);
+}
 
-		struct __attribute__ ((packed)) {
-			uint32_t magic;
-			uint32_t error;
-			uint64_t handle;
-		} nbd_reply;
+void disk_backend_nbd::work()
+{
+	set_thread_name("kek:nbd-io");
 
-		if (READ(fd, reinterpret_cast<char *>(&nbd_reply), sizeof nbd_reply) != sizeof nbd_reply) {
-			DOLOG(warning, true, "disk_backend_nbd::write: problem receiving reply header");
-			close(fd);
-			fd = -1;
-			sleep(1);
-			continue;
-		}
+	for(;;) {
+		job_t job;
 
-		if (ntohl(nbd_reply.magic) != 0x67446698) {
-			DOLOG(warning, true, "disk_backend_nbd::write: bad reply header %08x", nbd_reply.magic);
-			close(fd);
-			fd = -1;
-			sleep(1);
-			continue;
+		{
+			std::unique_lock<std::mutex> lck(jobs_lock);
+
+			jobs_cv.wait(lck, [this] { return jobs.empty() == false || stop_flag; });
+
+			if (jobs.empty())
+				break;
+
+			job = jobs.front();
 		}
 
-		int error = ntohl(nbd_reply.error);
-		if (error) {
-			DOLOG(warning, true, "disk_backend_nbd::write: NBD server indicated error: %d", error);
-			return false;
+		bool ok = job.is_write ? write(job.offset, job.n, job.from, job.sector_size) : read(job.offset, job.n, job.target, job.sector_size);
+
+		{
+			std::unique_lock<std::mutex> lck(jobs_lock);
+
+			jobs.pop_front();
+
+			jobs_cv.notify_all();
 		}
+
+		job.done(ok);
 	}
-	while(fd == -1);
+}
 
-	return true;
+void disk_backend_nbd::submit_read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size, const completion_t & done)
+{
+	TRACE(tc_nbd, "disk_backend_nbd::submit_read: read %zu bytes from offset %zu", n, offset);
+
+	if (worker == nullptr) {
+		done(read(offset, n, target, sector_size));
+		return;
+	}
+
+	std::unique_lock<std::mutex> lck(jobs_lock);
+
+	jobs.push_back({ false, offset, n, target, nullptr, sector_size, done });
+
+	jobs_cv.notify_all();
+}
+
+void disk_backend_nbd::submit_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size, const completion_t & done)
+{
+	TRACE(tc_nbd, "disk_backend_nbd::submit_write: write %zu bytes to offset %zu", n, offset);
+
+	if (worker == nullptr) {
+		done(write(offset, n, from, sector_size));
+		return;
+	}
+
+	std::unique_lock<std::mutex> lck(jobs_lock);
+
+	jobs.push_back({ true, offset, n, nullptr, from, sector_size, done });
+
+	jobs_cv.notify_all();
 }
@@ -1,7 +1,13 @@
 // (C) 2018-2024 by Folkert van Heusden
 // Released under MIT license
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <sys/types.h>
 
 #include "disk_backend.h"
@@ -9,17 +15,92 @@
 #include "utils.h"
 
 
+// An NBD client. The server can use the oldstyle or the (fixed) newstyle
+// handshake; with the latter, structured replies are used when the server
+// supports them. The requests of a transfer are sent without waiting for
+// the replies in between, these are matched by their handle.
+//
+// It can use a pool of connections to the server: the requests of a
+// transfer are spread over them. A connection that fails is reconnected
+// in the background with an increasing delay and its requests are sent
+// again over one of the others. Sequential reads make it read ahead.
 class disk_backend_nbd : public disk_backend
 {
 private:
+	struct connection_t {
+		int      fd                 { -1    };
+		bool     structured_replies { false };
+		uint64_t retry_at           {  0    };  // ms
+		uint64_t backoff            {  0    };  // ms
+	};
+
+	struct request_t {
+		uint16_t       type       { 0       };
+		off_t          offset     { 0       };
+		uint32_t       length     { 0       };
+		uint8_t       *target     { nullptr };  // reads
+		const uint8_t *from       { nullptr };  // writes
+		size_t         connection { 0       };
+		bool           assigned   { false   };
+		uint64_t       handle     { 0       };
+		bool           sent       { false   };
+		bool           done       { false   };
+		uint32_t       error      { 0       };
+	};
+
+	struct job_t {
+		bool           is_write    { false   };
+		off_t          offset      { 0       };
+		size_t         n           { 0       };
+		uint8_t       *target      { nullptr };
+		const uint8_t *from        { nullptr };
+		size_t         sector_size { 0       };
+		completion_t   done;
+	};
+
 	const std::string host;
-	const unsigned    port {  0 };
-	int               fd   { -1 };
+	const unsigned    port            {  0    };
+	const bool        asynchronous    { false };
+	uint64_t          export_size     {  0    };
+	uint64_t          next_handle     {  1    };
+
+	// a connection is only (re)connected by the reconnect thread and only
+	// closed by the thread doing the transfers
+	std::vector<connection_t> connections;
+	std::mutex               pool_lock;
+	std::condition_variable  pool_cv;
+	std::atomic_bool         stop_flag    { false   };
+	std::thread             *reconnector  { nullptr };
+
+	// read-ahead
+	off_t                    last_read_end { -1 };
+	size_t                   ra_size       {  0 };
+	off_t                    ra_offset     {  0 };
+	std::vector<uint8_t>     ra_data;
 
-	bool connect(const bool retry);
+	// asynchronous: the transfers are done by a thread of their own
+	std::deque<job_t>        jobs;
+	std::mutex               jobs_lock;
+	std::condition_variable  jobs_cv;
+	std::thread             *worker       { nullptr };
+
+	int  connect(bool *const structured_replies, uint64_t *const size);
+	bool handshake(const int fd, bool *const structured_replies, uint64_t *const size);
+	bool send_option(const int fd, const uint32_t option, const std::vector<uint8_t> & data);
+	bool receive_option_reply(const int fd, const uint32_t option, uint32_t *const type, std::vector<uint8_t> *const data);
+	void reconnect();
+
+	std::vector<size_t> wait_for_connections();
+	void drop_connection(const size_t nr, std::vector<request_t> & requests);
+	bool send_request(const int fd, const request_t & r);
+	bool receive_reply(const size_t nr, std::vector<request_t> & requests);
+	bool transfer(std::vector<request_t> & requests);
+	void add_requests(std::vector<request_t> & requests, const uint16_t type, const off_t offset, const size_t n, uint8_t *const target, const uint8_t *const from);
+
+	void work();
 
 public:
-	disk_backend_nbd(const std::string & host, const unsigned port);
+	disk_backend_nbd(const std::string & host, const unsigned port, const unsigned n_connections = 1, const bool asynchronous = false);
 	virtual ~disk_backend_nbd();
 
 	JsonDocument serialize() const override;
@@ -32,4 +113,8 @@ public:
 	bool read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) override;
 
 	bool write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size) override;
+
+	bool is_asynchronous() const override { return asynchronous; }
+	void submit_read (const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size, const completion_t & done) override;
+	void submit_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size, const completion_t & done) override;
 };
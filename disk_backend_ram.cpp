@@ -0,0 +1,223 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <algorithm>
+#include <cassert>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "disk_backend_ram.h"
+#include "gen.h"
+#include "log.h"
+#include "utils.h"
+
+
+disk_backend_ram::disk_backend_ram(const std::string & filename, const int interval) :
+	filename(filename),
+	interval(interval)
+{
+}
+
+disk_backend_ram::~disk_backend_ram()
+{
+	stop_flag = true;
+
+	if (th) {
+		th->join();
+		delete th;
+	}
+
+	if (fd != -1) {
+		flush();
+
+		close(fd);
+	}
+}
+
+JsonDocument disk_backend_ram::serialize() const
+{
+	// the state dump refers to the file: it must be up to date
+	flush();
+
+	JsonDocument j;
+
+	j["disk-backend-type"] = "ram";
+
+	j["overlay"] = serialize_overlay();
+
+	j["filename"] = filename;
+	j["interval"] = interval;
+
+	return j;
+}
+
+disk_backend_ram *disk_backend_ram::deserialize(const JsonVariantConst j)
+{
+	return new disk_backend_ram(j["filename"].as<std::string>(), j["interval"].as<int>());
+}
+
+bool disk_backend_ram::begin(const bool snapshots)
+{
+	use_overlay = snapshots;
+
+	// with snapshots, writes go to the overlay: the file is never changed
+	fd = open(filename.c_str(), snapshots ? O_RDONLY : O_RDWR);
+
+	if (fd == -1) {
+		DOLOG(ll_error, true, "disk_backend_ram: cannot open \"%s\": %s", filename.c_str(), strerror(errno));
+
+		return false;
+	}
+
+	struct stat st { };
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		DOLOG(ll_error, true, "disk_backend_ram: cannot determine the size of \"%s\" (or it is empty)", filename.c_str());
+
+		return false;
+	}
+
+	data.resize(st.st_size);
+
+	for(size_t o=0; o<data.size();) {
+		ssize_t rc = pread(fd, &data[o], data.size() - o, o);
+
+		if (rc <= 0) {
+			DOLOG(ll_error, true, "disk_backend_ram: cannot read \"%s\": %s", filename.c_str(), rc == 0 ? "short read" : strerror(errno));
+
+			return false;
+		}
+
+		o += rc;
+	}
+
+	dirty.resize((data.size() + ram_disk_sector_size - 1) / ram_disk_sector_size);
+
+	DOLOG(info, false, "disk_backend_ram: \"%s\" loaded (%zu bytes)", filename.c_str(), data.size());
+
+	if (interval > 0 && snapshots == false)
+		th = new std::thread(std::ref(*this));
+
+	return true;
+}
+
+bool disk_backend_ram::read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size)
+{
+	TRACE(tc_disk, "disk_backend_ram::read: read %zu bytes from offset %zu", n, offset);
+
+	assert((offset % sector_size) == 0);
+	assert((n % sector_size) == 0);
+
+	if (offset < 0 || offset + n > data.size()) {
+		DOLOG(warning, false, "disk_backend_ram::read: %zu bytes at offset %zu are beyond the end of \"%s\"", n, offset, filename.c_str());
+		return false;
+	}
+
+	// the flush thread only reads 'data', no need to lock
+	memcpy(target, &data[offset], n);
+
+	return patch_from_overlay(offset, n, target, sector_size);
+}
+
+bool disk_backend_ram::write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size)
+{
+	TRACE(tc_disk, "disk_backend_ram::write: write %zu bytes to offset %zu", n, offset);
+
+	if (store_mem_range_in_overlay(offset, n, from, sector_size))
+		return true;
+
+	if (offset < 0 || offset + n > data.size()) {
+		DOLOG(warning, false, "disk_backend_ram::write: %zu bytes at offset %zu are beyond the end of \"%s\"", n, offset, filename.c_str());
+		return false;
+	}
+
+	if (n == 0)
+		return true;
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	memcpy(&data[offset], from, n);
+
+	for(size_t nr=offset / ram_disk_sector_size; nr<=(offset + n - 1) / ram_disk_sector_size; nr++) {
+		if (dirty[nr] == false) {
+			dirty[nr] = true;
+			n_dirty++;
+		}
+	}
+
+	return true;
+}
+
+// writes the changed sectors to the file, a run at a time so that write()
+// is not held up for long
+bool disk_backend_ram::flush() const
+{
+	std::unique_lock<std::mutex> flck(flush_lock);
+
+	std::vector<uint8_t> buffer;
+
+	for(size_t nr=0;;) {
+		size_t first = 0;
+		size_t len   = 0;
+
+		{
+			std::unique_lock<std::mutex> lck(lock);
+
+			while(nr < dirty.size() && dirty[nr] == false)
+				nr++;
+
+			if (nr == dirty.size())
+				break;
+
+			first = nr;
+
+			while(nr < dirty.size() && dirty[nr] && nr - first < ram_disk_max_flush_sectors) {
+				dirty[nr] = false;
+				nr++;
+			}
+
+			n_dirty -= nr - first;
+
+			len = std::min((nr - first) * ram_disk_sector_size, data.size() - first * ram_disk_sector_size);
+			buffer.assign(&data[first * ram_disk_sector_size], &data[first * ram_disk_sector_size + len]);
+		}
+
+		if (pwrite(fd, buffer.data(), len, first * ram_disk_sector_size) != ssize_t(len)) {
+			DOLOG(warning, false, "disk_backend_ram: cannot write to \"%s\": %s", filename.c_str(), strerror(errno));
+
+			// retried by the next flush
+			std::unique_lock<std::mutex> lck(lock);
+
+			for(size_t i=first; i<nr; i++) {
+				if (dirty[i] == false) {
+					dirty[i] = true;
+					n_dirty++;
+				}
+			}
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void disk_backend_ram::operator()()
+{
+	set_thread_name("kek:ram-flush");
+
+	uint64_t last_flush = get_ms();
+
+	while(!stop_flag) {
+		myusleep(100000);
+
+		uint64_t now = get_ms();
+
+		if (now - last_flush >= uint64_t(interval) * 1000) {
+			flush();
+
+			last_flush = now;
+		}
+	}
+}
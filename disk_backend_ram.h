@@ -0,0 +1,59 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include "gen.h"
+#include <ArduinoJson.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "disk_backend.h"
+
+
+constexpr const size_t ram_disk_sector_size       = 512;  // unit of the dirty-administration
+constexpr const size_t ram_disk_max_flush_sectors = 128;  // per pwrite
+
+// The whole image is read into memory by begin(), transfers are memcpy()s.
+// Changed sectors are written back to the file by a thread (every
+// 'interval' seconds, if not 0), when the state is serialized and at exit.
+class disk_backend_ram : public disk_backend
+{
+private:
+	const std::string    filename;
+	const int            interval  { 0 };  // seconds
+
+	int                  fd        { -1 };
+	std::vector<uint8_t> data;
+
+	// a flush (also from serialize()) only changes the administration
+	mutable std::mutex   lock;        // dirty vs. write()
+	mutable std::mutex   flush_lock;  // one flush at a time
+	mutable std::vector<bool> dirty;
+	mutable std::atomic_uint64_t n_dirty { 0 };
+
+	std::atomic_bool     stop_flag { false   };
+	std::thread         *th        { nullptr };
+
+	bool flush() const;
+
+public:
+	disk_backend_ram(const std::string & filename, const int interval);
+	virtual ~disk_backend_ram();
+
+	JsonDocument serialize() const override;
+	static disk_backend_ram *deserialize(const JsonVariantConst j);
+
+	std::string get_identifier() const override { return filename; }
+
+	bool begin(const bool snapshots) override;
+
+	bool read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) override;
+
+	bool write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size) override;
+
+	std::optional<uint64_t> get_n_dirty_sectors() const override { return n_dirty; }
+
+	void operator()();
+};
@@ -0,0 +1,421 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <cassert>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "disk_backend_uring.h"
+#include "log.h"
+#include "utils.h"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define USE_IO_URING 1
+#endif
+
+constexpr const unsigned uring_max_workers = 8;
+
+#if defined(USE_IO_URING)
+// no liburing: the two system calls are all that is needed
+static int sys_io_uring_setup(const unsigned entries, io_uring_params *const p)
+{
+	return int(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int sys_io_uring_enter(const int fd, const unsigned to_submit, const unsigned min_complete, const unsigned flags)
+{
+	return int(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+#endif
+
+disk_backend_uring::disk_backend_uring(const std::string & filename, const unsigned depth) :
+	disk_backend_file(filename),
+	depth(std::max(depth, 1u))
+{
+}
+
+disk_backend_uring::~disk_backend_uring()
+{
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		cv.wait(lck, [this] { return in_flight == 0; });
+
+		// under the lock: a worker checks it before waiting on queue_cv
+		stop_flag = true;
+	}
+
+#if defined(USE_IO_URING)
+	if (ring_fd != -1) {
+		submit({ nullptr });  // a NOP stops the reaper
+
+		reaper->join();
+		delete reaper;
+
+		munmap(sqes, sqes_size);
+		if (cq_ptr != sq_ptr)
+			munmap(cq_ptr, cq_size);
+		munmap(sq_ptr, sq_size);
+
+		close(ring_fd);
+	}
+#endif
+
+	queue_cv.notify_all();
+
+	for(auto & th: workers) {
+		th->join();
+		delete th;
+	}
+}
+
+JsonDocument disk_backend_uring::serialize() const
+{
+	JsonDocument j;
+
+	j["disk-backend-type"] = "uring";
+
+	j["overlay"] = serialize_overlay();
+
+	j["filename"] = filename;
+	j["depth"]    = depth;
+
+	return j;
+}
+
+disk_backend_uring *disk_backend_uring::deserialize(const JsonVariantConst j)
+{
+	return new disk_backend_uring(j["filename"].as<std::string>(), j["depth"].as<unsigned>());
+}
+
+bool disk_backend_uring::setup_uring()
+{
+#if defined(USE_IO_URING)
+	io_uring_params p { };
+
+	ring_fd = sys_io_uring_setup(depth, &p);
+	if (ring_fd == -1) {
+		DOLOG(info, true, "disk_backend_uring: io_uring not available (%s), using threads", strerror(errno));
+		return false;
+	}
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size = p.cq_off.cqes  + p.cq_entries * sizeof(io_uring_cqe);
+
+	bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap)
+		sq_size = cq_size = std::max(sq_size, cq_size);
+
+	sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	cq_ptr = single_mmap ? sq_ptr : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+
+	sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+	sqes   = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+
+	if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+		DOLOG(warning, true, "disk_backend_uring: cannot map the io_uring rings (%s), using threads", strerror(errno));
+
+		if (sqes != MAP_FAILED)
+			munmap(sqes, sqes_size);
+		if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+			munmap(cq_ptr, cq_size);
+		if (sq_ptr != MAP_FAILED)
+			munmap(sq_ptr, sq_size);
+
+		close(ring_fd);
+		ring_fd = -1;
+
+		return false;
+	}
+
+	uint8_t *sq = reinterpret_cast<uint8_t *>(sq_ptr);
+	uint8_t *cq = reinterpret_cast<uint8_t *>(cq_ptr);
+
+	sq_tail    = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+	sq_mask    = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+	sq_array   = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+	cq_head    = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+	cq_tail    = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+	cq_mask    = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+	cqes       = cq + p.cq_off.cqes;
+
+	// the completion queue has twice as many entries: it cannot overflow
+	// as long as no more than 'depth' requests are in flight
+	assert(p.sq_entries >= depth);
+
+	reaper = new std::thread(&disk_backend_uring::reap, this);
+
+	DOLOG(debug, false, "disk_backend_uring: io_uring with %u entries for \"%s\"", p.sq_entries, filename.c_str());
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool disk_backend_uring::begin(const bool snapshots)
+{
+	if (disk_backend_file::begin(snapshots) == false)
+		return false;
+
+	if (setup_uring() == false) {
+		for(unsigned i=0; i<std::min(depth, uring_max_workers); i++)
+			workers.push_back(new std::thread(&disk_backend_uring::work, this));
+	}
+
+	return true;
+}
+
+// waits while 'depth' requests are in flight; nullptr is a NOP (io_uring only)
+void disk_backend_uring::submit(const std::vector<request_t *> & requests)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	size_t i = 0;
+
+	while(i < requests.size()) {
+		cv.wait(lck, [this] { return in_flight < depth; });
+
+#if defined(USE_IO_URING)
+		if (ring_fd != -1) {
+			unsigned tail  = *sq_tail;
+			unsigned batch = 0;
+
+			while(i < requests.size() && in_flight < depth) {
+				request_t    *r   = requests[i++];
+				unsigned      idx = tail & *sq_mask;
+				io_uring_sqe *sqe = &reinterpret_cast<io_uring_sqe *>(sqes)[idx];
+
+				memset(sqe, 0x00, sizeof *sqe);
+
+				if (r) {
+					sqe->opcode    = r->is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+					sqe->fd        = fd;
+					sqe->addr      = reinterpret_cast<uint64_t>(&r->iov);
+					sqe->len       = 1;
+					sqe->off       = r->offset;
+				}
+				else {
+					sqe->opcode    = IORING_OP_NOP;
+				}
+
+				sqe->user_data = reinterpret_cast<uint64_t>(r);
+
+				sq_array[idx] = idx;
+
+				tail++;
+				batch++;
+
+				if (r)
+					in_flight++;
+			}
+
+			__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+			while(batch > 0) {
+				int rc = sys_io_uring_enter(ring_fd, batch, 0, 0);
+
+				if (rc >= 0)
+					batch -= rc;
+				else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+					DOLOG(ll_error, true, "disk_backend_uring: io_uring_enter failed: %s", strerror(errno));
+
+					// the kernel takes the entries in order: the last 'batch'
+					// are still in the ring, take them back and fail them
+					std::vector<request_t *> failed;
+
+					for(unsigned k=batch; k>0; k--) {
+						request_t *r = reinterpret_cast<request_t *>(reinterpret_cast<io_uring_sqe *>(sqes)[(tail - k) & *sq_mask].user_data);
+
+						if (r)
+							failed.push_back(r);
+					}
+
+					__atomic_store_n(sq_tail, tail - batch, __ATOMIC_RELEASE);
+
+					// finish() locks and updates in_flight
+					lck.unlock();
+
+					for(auto r: failed)
+						finish(r, false);
+
+					lck.lock();
+
+					break;
+				}
+			}
+
+			continue;
+		}
+#endif
+
+		request_t *r = requests[i++];
+
+		queue.push_back(r);
+		in_flight++;
+
+		queue_cv.notify_one();
+	}
+}
+
+void disk_backend_uring::finish(request_t *const r, const bool ok)
+{
+	job_t *job = r->job;
+
+	if (!ok) {
+		DOLOG(warning, false, "disk_backend_uring: %s of %zu bytes at offset %zu failed", r->is_write ? "write" : "read", r->iov.iov_len, size_t(r->offset));
+
+		job->ok = false;
+	}
+
+	delete r;
+
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		in_flight--;
+	}
+
+	cv.notify_all();
+
+	if (--job->left == 0) {
+		job->done(job->ok);
+
+		delete job;
+	}
+}
+
+void disk_backend_uring::reap()
+{
+#if defined(USE_IO_URING)
+	set_thread_name("kek:uring");
+
+	for(;;) {
+		if (sys_io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR) {
+			DOLOG(ll_error, true, "disk_backend_uring: io_uring_enter (wait) failed: %s", strerror(errno));
+
+			// do not wait for the NOP of the destructor forever
+			if (stop_flag)
+				break;
+
+			myusleep(100000);
+		}
+
+		unsigned head = *cq_head;
+		bool     stop = false;
+
+		while(head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+			io_uring_cqe *cqe = &reinterpret_cast<io_uring_cqe *>(cqes)[head & *cq_mask];
+			request_t    *r   = reinterpret_cast<request_t *>(cqe->user_data);
+			int           res = cqe->res;  // bytes transferred or -errno
+
+			__atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+
+			if (r)
+				finish(r, res == int(r->iov.iov_len));
+			else
+				stop = true;
+		}
+
+		if (stop)
+			break;
+	}
+#endif
+}
+
+void disk_backend_uring::work()
+{
+	set_thread_name("kek:disk-io");
+
+	for(;;) {
+		request_t *r = nullptr;
+
+		{
+			std::unique_lock<std::mutex> lck(lock);
+
+			queue_cv.wait(lck, [this] { return queue.empty() == false || stop_flag; });
+
+			if (queue.empty())
+				break;
+
+			r = queue.front();
+			queue.pop_front();
+		}
+
+		ssize_t rc = 0;
+
+		if (r->is_write)
+			rc = pwrite(fd, r->iov.iov_base, r->iov.iov_len, r->offset);
+		else
+			rc = pread (fd, r->iov.iov_base, r->iov.iov_len, r->offset);
+
+		finish(r, rc == ssize_t(r->iov.iov_len));
+	}
+}
+
+void disk_backend_uring::submit_read(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size, const completion_t & done)
+{
+	TRACE(tc_disk, "disk_backend_uring::submit_read: read %zu bytes from offset %zu", n, size_t(offset));
+
+	assert((offset % sector_size) == 0);
+	assert((n % sector_size) == 0);
+
+	job_t *job = new job_t;
+	job->done  = done;
+
+	// sectors from the overlay are copied right away, each run of sectors
+	// in between is one request
+	std::vector<request_t *> requests;
+	std::optional<size_t>    run_start;
+
+	for(size_t o=0; o<=n; o += sector_size) {
+		const uint8_t *o_rc = o < n ? get_from_overlay(offset + o, sector_size) : nullptr;
+
+		if (o < n && o_rc == nullptr) {
+			if (run_start.has_value() == false)
+				run_start = o;
+
+			continue;
+		}
+
+		if (run_start.has_value()) {
+			requests.push_back(new request_t { job, false, off_t(offset + run_start.value()), { target + run_start.value(), o - run_start.value() } });
+			run_start.reset();
+		}
+
+		if (o_rc)
+			memcpy(&target[o], o_rc, sector_size);
+	}
+
+	if (requests.empty()) {
+		delete job;
+		done(true);
+		return;
+	}
+
+	job->left = requests.size();
+
+	submit(requests);
+}
+
+void disk_backend_uring::submit_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size, const completion_t & done)
+{
+	TRACE(tc_disk, "disk_backend_uring::submit_write: write %zu bytes to offset %zu", n, size_t(offset));
+
+	if (store_mem_range_in_overlay(offset, n, from, sector_size)) {
+		done(true);
+		return;
+	}
+
+	job_t *job = new job_t;
+	job->done  = done;
+	job->left  = 1;
+
+	submit({ new request_t { job, true, offset, { const_cast<uint8_t *>(from), n } } });
+}
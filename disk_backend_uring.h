@@ -0,0 +1,86 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include "gen.h"
+#include <ArduinoJson.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/uio.h>
+
+#include "disk_backend_file.h"
+
+
+// Like disk_backend_file, but transfers can be asynchronous: they are
+// queued to io_uring (Linux) or, when that is not available, to a pool
+// of threads doing pread/pwrite. Up to 'depth' requests are in flight.
+class disk_backend_uring : public disk_backend_file
+{
+private:
+	struct job_t {
+		std::atomic_int  left { 0    };
+		std::atomic_bool ok   { true };
+		completion_t     done;
+	};
+
+	struct request_t {
+		job_t *job;
+		bool   is_write;
+		off_t  offset;
+		iovec  iov;
+	};
+
+	const unsigned           depth     { 0 };
+
+	std::mutex               lock;
+	std::condition_variable  cv;  // a request finished
+	unsigned                 in_flight { 0 };
+	std::atomic_bool         stop_flag { false };
+
+	// io_uring
+	int                      ring_fd   { -1      };
+	void                    *sq_ptr    { nullptr };
+	size_t                   sq_size   { 0       };
+	void                    *cq_ptr    { nullptr };
+	size_t                   cq_size   { 0       };
+	void                    *sqes      { nullptr };
+	size_t                   sqes_size { 0       };
+	unsigned                *sq_tail   { nullptr };
+	unsigned                *sq_mask   { nullptr };
+	unsigned                *sq_array  { nullptr };
+	unsigned                *cq_head   { nullptr };
+	unsigned                *cq_tail   { nullptr };
+	unsigned                *cq_mask   { nullptr };
+	void                    *cqes      { nullptr };
+	std::thread             *reaper    { nullptr };
+
+	// fallback
+	std::deque<request_t *>  queue;
+	std::condition_variable  queue_cv;
+	std::vector<std::thread *> workers;
+
+	bool setup_uring();
+	void submit(const std::vector<request_t *> & requests);
+	void finish(request_t *const r, const bool ok);
+	void reap();
+	void work();
+
+public:
+	disk_backend_uring(const std::string & filename, const unsigned depth);
+	virtual ~disk_backend_uring();
+
+	JsonDocument serialize() const override;
+	static disk_backend_uring *deserialize(const JsonVariantConst j);
+
+	bool begin(const bool snapshots) override;
+
+	bool is_asynchronous() const override { return true; }
+	void submit_read (const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size, const completion_t & done) override;
+	void submit_write(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size, const completion_t & done) override;
+};
@@ -0,0 +1,316 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <errno.h>
+#include <string.h>
+#include "gen.h"
+#if IS_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "disk_overlay.h"
+#include "log.h"
+
+
+static const char overlay_file_magic[8] = { 'K', 'E', 'K', 'O', 'V', 'L', '1', 0 };
+
+typedef struct {
+	char     magic[8];
+	uint32_t sector_size;  // 0 until the first sector is stored
+	uint32_t reserved;
+} overlay_file_header_t;
+
+disk_overlay::disk_overlay()
+{
+}
+
+disk_overlay::~disk_overlay()
+{
+#if IS_POSIX
+	if (fd != -1)
+		close(fd);
+#endif
+}
+
+bool disk_overlay::open_file(const std::string & filename)
+{
+#if IS_POSIX
+	assert(empty());
+
+	this->filename = filename;
+
+	fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd == -1) {
+		DOLOG(ll_error, true, "disk_overlay: cannot open \"%s\": %s", filename.c_str(), strerror(errno));
+		return false;
+	}
+
+	struct stat st { };
+	if (fstat(fd, &st) == -1) {
+		DOLOG(ll_error, true, "disk_overlay: cannot stat \"%s\": %s", filename.c_str(), strerror(errno));
+		return false;
+	}
+
+	if (st.st_size == 0)
+		return write_header();
+
+	overlay_file_header_t header { };
+	if (pread(fd, &header, sizeof header, 0) != sizeof header || memcmp(header.magic, overlay_file_magic, sizeof overlay_file_magic) != 0) {
+		DOLOG(ll_error, true, "disk_overlay: \"%s\" is not an overlay file", filename.c_str());
+		return false;
+	}
+
+	if (header.sector_size == 0)
+		return true;
+
+	sector_size = header.sector_size;
+
+	// a slot that was not written completely (crash) is ignored
+	uint64_t n_slots = (st.st_size - sizeof header) / (sizeof(uint64_t) + sector_size);
+
+	for(uint64_t slot=0; slot<n_slots; slot++) {
+		uint64_t sector = 0;
+
+		if (pread(fd, &sector, sizeof sector, get_slot_offset(slot)) != sizeof sector) {
+			DOLOG(ll_error, true, "disk_overlay: cannot read \"%s\": %s", filename.c_str(), strerror(errno));
+			return false;
+		}
+
+		if (add_slot(sector, sector_size) != slot) {
+			DOLOG(ll_error, true, "disk_overlay: sector %" PRIu64 " is in \"%s\" more than once", sector, filename.c_str());
+			return false;
+		}
+	}
+
+	DOLOG(info, false, "disk_overlay: %" PRIu64 " sectors in \"%s\"", n_slots, filename.c_str());
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool disk_overlay::write_header()
+{
+#if IS_POSIX
+	overlay_file_header_t header { };
+	memcpy(header.magic, overlay_file_magic, sizeof overlay_file_magic);
+	header.sector_size = sector_size;
+
+	if (pwrite(fd, &header, sizeof header, 0) == sizeof header)
+		return true;
+
+	DOLOG(ll_error, true, "disk_overlay: cannot write to \"%s\": %s", filename.c_str(), strerror(errno));
+#endif
+	return false;
+}
+
+off_t disk_overlay::get_slot_offset(const uint32_t slot) const
+{
+	return sizeof(overlay_file_header_t) + off_t(slot) * (sizeof(uint64_t) + sector_size);
+}
+
+bool disk_overlay::is_present(const uint64_t sector) const
+{
+	uint64_t word = sector / 64;
+
+	return word < present.size() && (present[word] & (uint64_t(1) << (sector % 64)));
+}
+
+bool disk_overlay::any_present(const uint64_t sector, const uint64_t n) const
+{
+	uint64_t s   = sector;
+	uint64_t end = sector + n;
+
+	while(s < end) {
+		uint64_t word = s / 64;
+		if (word >= present.size())
+			return false;
+
+		unsigned bit  = s % 64;
+		unsigned bits = unsigned(std::min(uint64_t(64 - bit), end - s));
+		uint64_t mask = (bits == 64 ? ~uint64_t(0) : ((uint64_t(1) << bits) - 1)) << bit;
+
+		if (present[word] & mask)
+			return true;
+
+		s += bits;
+	}
+
+	return false;
+}
+
+// returns the slot of a sector that was not present yet
+uint32_t disk_overlay::add_slot(const uint64_t sector, const size_t sector_size)
+{
+	if (n_used == 0)
+		this->sector_size = sector_size;
+
+	// a disk is only used with one controller
+	assert(this->sector_size == sector_size);
+
+	if (is_present(sector))
+		return slot_of.find(sector)->second;
+
+	uint32_t slot = n_used++;
+	if (fd == -1 && slot / sectors_per_slab >= slabs.size())
+		slabs.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[sectors_per_slab * sector_size]));
+
+	slot_of.insert({ sector, slot });
+
+	uint64_t word = sector / 64;
+	if (word >= present.size())
+		present.resize(word + 1);
+
+	present[word] |= uint64_t(1) << (sector % 64);
+
+	return slot;
+}
+
+const uint8_t *disk_overlay::get(const uint64_t sector) const
+{
+	if (is_present(sector) == false)
+		return nullptr;
+
+	uint32_t slot = slot_of.find(sector)->second;
+
+	if (fd == -1)
+		return get_slot(slot);
+
+#if IS_POSIX
+	scratch.resize(sector_size);
+
+	if (pread(fd, scratch.data(), sector_size, get_slot_offset(slot) + sizeof(uint64_t)) == ssize_t(sector_size))
+		return scratch.data();
+
+	DOLOG(ll_error, true, "disk_overlay: cannot read sector %" PRIu64 " from \"%s\": %s", sector, filename.c_str(), strerror(errno));
+#endif
+
+	return nullptr;
+}
+
+bool disk_overlay::put(const uint64_t sector, const uint8_t *const data, const size_t sector_size)
+{
+	return store(sector * sector_size, sector_size, data, sector_size);
+}
+
+bool disk_overlay::store(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size)
+{
+	assert((offset % sector_size) == 0);
+	assert((n % sector_size) == 0);
+
+	if (fd == -1) {
+		for(size_t o=0; o<n; o += sector_size)
+			memcpy(get_slot(add_slot((offset + o) / sector_size, sector_size)), from + o, sector_size);
+
+		return true;
+	}
+
+#if IS_POSIX
+	if (this->sector_size == 0) {
+		this->sector_size = sector_size;
+
+		if (write_header() == false)
+			return false;
+	}
+
+	// sectors already present are overwritten in place, new ones are
+	// appended with one write and only then added (a failed write must
+	// not leave sectors marked present that are not in the file)
+	std::vector<uint8_t>  append;
+	std::vector<uint64_t> new_sectors;
+	uint32_t              first_new_slot = n_used;
+
+	for(size_t o=0; o<n; o += sector_size) {
+		uint64_t sector = (offset + o) / sector_size;
+
+		if (is_present(sector)) {
+			if (pwrite(fd, from + o, sector_size, get_slot_offset(slot_of.find(sector)->second) + sizeof(uint64_t)) != ssize_t(sector_size)) {
+				DOLOG(ll_error, true, "disk_overlay: cannot write to \"%s\": %s", filename.c_str(), strerror(errno));
+				return false;
+			}
+
+			continue;
+		}
+
+		new_sectors.push_back(sector);
+
+		const uint8_t *p = reinterpret_cast<const uint8_t *>(&sector);
+		append.insert(append.end(), p, p + sizeof sector);
+		append.insert(append.end(), from + o, from + o + sector_size);
+	}
+
+	if (append.empty() == false && pwrite(fd, append.data(), append.size(), get_slot_offset(first_new_slot)) != ssize_t(append.size())) {
+		DOLOG(ll_error, true, "disk_overlay: cannot write to \"%s\": %s", filename.c_str(), strerror(errno));
+
+		// a partial slot would be loaded by open_file()
+		if (ftruncate(fd, get_slot_offset(first_new_slot)) == -1)
+			DOLOG(ll_error, true, "disk_overlay: cannot truncate \"%s\": %s", filename.c_str(), strerror(errno));
+
+		return false;
+	}
+
+	for(auto sector: new_sectors)
+		add_slot(sector, sector_size);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool disk_overlay::patch(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) const
+{
+	assert((offset % sector_size) == 0);
+	assert((n % sector_size) == 0);
+
+	uint64_t first = offset / sector_size;
+	uint64_t count = n / sector_size;
+
+	if (any_present(first, count) == false)
+		return true;
+
+	for(uint64_t i=0; i<count; i++) {
+		if (is_present(first + i) == false)
+			continue;
+
+		uint32_t slot = slot_of.find(first + i)->second;
+
+		if (fd == -1) {
+			memcpy(&target[i * sector_size], get_slot(slot), sector_size);
+			continue;
+		}
+
+#if IS_POSIX
+		if (pread(fd, &target[i * sector_size], sector_size, get_slot_offset(slot) + sizeof(uint64_t)) != ssize_t(sector_size)) {
+			DOLOG(ll_error, true, "disk_overlay: cannot read sector %" PRIu64 " from \"%s\": %s", first + i, filename.c_str(), strerror(errno));
+			return false;
+		}
+#endif
+	}
+
+	return true;
+}
+
+std::vector<uint64_t> disk_overlay::get_sectors() const
+{
+	std::vector<uint64_t> out;
+	out.reserve(n_used);
+
+	for(size_t word=0; word<present.size(); word++) {
+		if (present[word] == 0)
+			continue;
+
+		for(unsigned bit=0; bit<64; bit++) {
+			if (present[word] & (uint64_t(1) << bit))
+				out.push_back(word * 64 + bit);
+		}
+	}
+
+	return out;
+}
@@ -0,0 +1,72 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include "gen.h"
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+
+// The sectors written while running with snapshots (-P). Which sectors
+// are present is kept in a bitmap; their data lives in slabs of fixed
+// size buffers. Storing a sector only allocates when a slab is full, and
+// reading one gives a pointer into the slab instead of a copy.
+//
+// With open_file() the data lives in a file instead: a header followed by
+// slots of the sector number and its data. A sector that is written again
+// is overwritten in its slot, new sectors are appended. Only the bitmap
+// and the slot numbers are kept in memory.
+class disk_overlay
+{
+private:
+	static constexpr const uint32_t sectors_per_slab = 64;
+
+	size_t                 sector_size { 0 };
+	std::vector<uint64_t>  present;  // a bit per sector
+	std::unordered_map<uint64_t, uint32_t> slot_of;  // sector to buffer
+	std::vector<std::unique_ptr<uint8_t[]> > slabs;
+	uint32_t               n_used      { 0 };
+
+	int                    fd          { -1 };
+	std::string            filename;
+	mutable std::vector<uint8_t> scratch;  // for get() when file backed
+
+	uint8_t *get_slot(const uint32_t slot) const { return &slabs[slot / sectors_per_slab][(slot % sectors_per_slab) * sector_size]; }
+	off_t    get_slot_offset(const uint32_t slot) const;
+	uint32_t add_slot(const uint64_t sector, const size_t sector_size);
+	bool     write_header();
+
+public:
+	disk_overlay();
+	virtual ~disk_overlay();
+
+	// keep the data in 'filename'; an existing overlay file is continued
+	bool open_file(const std::string & filename);
+	bool is_file_backed() const { return fd != -1; }
+	const std::string & get_filename() const { return filename; }
+
+	bool   empty() const { return n_used == 0; }
+	size_t size()  const { return n_used; }
+	size_t get_sector_size() const { return sector_size; }
+
+	bool is_present (const uint64_t sector) const;
+	bool any_present(const uint64_t sector, const uint64_t n) const;
+
+	// nullptr when the sector is not in the overlay; when file backed, the
+	// pointer is valid until the next get()
+	const uint8_t *get(const uint64_t sector) const;
+	bool put(const uint64_t sector, const uint8_t *const data, const size_t sector_size);
+
+	// the sectors of a transfer; patch() copies those that are present
+	// over the data read from the image
+	bool store(const off_t offset, const size_t n, const uint8_t *const from, const size_t sector_size);
+	bool patch(const off_t offset, const size_t n, uint8_t *const target, const size_t sector_size) const;
+
+	// the sectors in ascending order
+	std::vector<uint64_t> get_sectors() const;
+};
@@ -0,0 +1,306 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <cinttypes>
+
+#include "bus.h"
+#include "comm_tcp_socket_server.h"
+#include "console_headless.h"
+#include "cpu.h"
+#include "dc11.h"
+#include "disk_backend.h"
+#include "farm.h"
+#include "kw11-l.h"
+#include "loaders.h"
+#include "log.h"
+#include "tm-11.h"
+#include "tty.h"
+#include "utils.h"
+
+
+farm::farm(const farm_settings_t & settings, std::atomic_uint32_t *const event):
+	settings(settings),
+	event(event)
+{
+}
+
+farm::~farm()
+{
+	{
+		std::unique_lock<std::mutex> lck(lock);
+		stop_flag = true;
+		cv.notify_all();
+	}
+
+	for(auto & th: workers) {
+		th->join();
+		delete th;
+	}
+
+	if (io_thread) {
+		io_thread->join();
+		delete io_thread;
+	}
+
+	for(auto & m: machines) {
+		m->cnsl->stop_thread();
+
+		delete m->b;
+		delete m->cnsl;
+		delete m;
+	}
+}
+
+bool farm::create_machine(const size_t nr)
+{
+	machine *m = new machine;
+	m->nr      = nr;
+	m->cnsl    = new console_headless(&m->event, format("kek-farm-%02zu.txt", nr));
+
+	bus *b     = new bus();
+	m->b       = b;
+
+	b->set_memory_size(settings.ram_size.has_value() ? settings.ram_size.value() : DEFAULT_N_PAGES);
+	b->set_console_switches(settings.console_switches);
+
+	cpu *c = new cpu(b, &m->event);
+	b->add_cpu(c);
+
+	auto rk05_dev = new rk05(b, m->cnsl->get_disk_read_activity_flag(), m->cnsl->get_disk_write_activity_flag());
+	rk05_dev->begin();
+	b->add_rk05(rk05_dev);
+
+	auto rl02_dev = new rl02(b, m->cnsl->get_disk_read_activity_flag(), m->cnsl->get_disk_write_activity_flag());
+	rl02_dev->begin();
+	b->add_rl02(rl02_dev);
+
+	auto rp06_dev = new rp06(b, m->cnsl->get_disk_read_activity_flag(), m->cnsl->get_disk_write_activity_flag());
+	rp06_dev->begin();
+	b->add_RP06(rp06_dev);
+
+	std::vector<disk_backend *> *backends   = nullptr;
+	bootloader_t                 bootloader = BL_NONE;
+
+	if (settings.disk_type == "rk05") {
+		backends   = rk05_dev->access_disk_backends();
+		bootloader = BL_RK05;
+	}
+	else if (settings.disk_type == "rl02") {
+		backends   = rl02_dev->access_disk_backends();
+		bootloader = BL_RL02;
+	}
+	else if (settings.disk_type == "rp06") {
+		backends   = rp06_dev->access_disk_backends();
+		bootloader = BL_RP06;
+	}
+
+	machines.push_back(m);  // from here on the farm cleans up
+
+	if (!backends) {
+		DOLOG(ll_error, true, "Farm: disk-type %s not understood", settings.disk_type.c_str());
+		return false;
+	}
+
+	// every machine gets its own copy of the backend with snapshots
+	// enabled: the disk-images are shared and must not be written to
+	for(auto & t: settings.disk_templates)
+		backends->push_back(disk_backend::deserialize(t->serialize()));
+
+	if (settings.enable_bootloader)
+		set_boot_loader(b, bootloader);
+
+	b->add_tty(new tty(m->cnsl, b, false));
+
+	m->cnsl->set_bus(b);
+	m->cnsl->begin();
+
+	std::vector<comm *> comm_interfaces;
+	for(int i=0; i<dc11_n_lines; i++) {
+		int port = settings.dc11_port_base + nr * dc11_n_lines + i;
+
+		auto listener = new comm_tcp_socket_server(port, false);
+		if (listener->begin() == false)
+			DOLOG(warning, false, "Farm: machine %zu failed to configure %s", nr, listener->get_identifier().c_str());
+
+		comm_interfaces.push_back(listener);
+		m->listeners.push_back(listener);
+	}
+
+	m->dc11_ = new dc11(b, comm_interfaces);
+	m->dc11_->begin(false);
+	b->add_DC11(m->dc11_);
+
+	b->add_tm11(new tm_11(b));
+
+	if (settings.tape.empty() == false) {
+		auto start = load_tape(b, settings.tape);
+		if (start.has_value() == false)
+			return false;
+
+		c->set_register(7, start.value());
+	}
+
+	if (settings.start_addr.has_value())
+		c->set_register(7, settings.start_addr.value());
+
+	c->set_wakeup_handler([this, m] { wakeup(m); });
+
+	// the kw11-l only ticks when the console says the machine is running
+	*m->cnsl->get_running_flag() = true;
+	b->getKW11_L()->begin(m->cnsl, false);
+
+	c->emulation_start();  // for statistics
+
+	return true;
+}
+
+bool farm::begin()
+{
+	for(size_t i=0; i<settings.n_machines; i++) {
+		if (create_machine(i) == false)
+			return false;
+	}
+
+	size_t n_workers = settings.n_workers ? settings.n_workers : std::max(1u, std::thread::hardware_concurrency());
+
+	DOLOG(info, true, "Farm: %zu machines on %zu worker threads, %u instructions per slice", settings.n_machines, n_workers, settings.slice_instructions);
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	for(auto & m: machines)
+		runnable.push_back(m);
+
+	for(size_t i=0; i<n_workers; i++)
+		workers.push_back(new std::thread(&farm::worker, this, i));
+
+	io_thread = new std::thread(&farm::poll_devices, this);
+
+	return true;
+}
+
+// instead of tty, kw11-l, DC-11 and listener threads per machine
+void farm::poll_devices()
+{
+	set_thread_name("kek:farm-io");
+
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> lck(lock);
+
+			if (stop_flag)
+				break;
+		}
+
+		myusleep(10000);
+
+		for(auto & m: machines) {
+			for(auto & listener: m->listeners)
+				listener->poll();
+
+			m->b->getTty()->poll();
+
+			m->dc11_->poll();
+
+			// only ticks while the machine is running
+			m->b->getKW11_L()->poll();
+		}
+	}
+}
+
+void farm::wakeup(machine *const m)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	if (m->state == MS_PARKED) {
+		m->state = MS_RUNNABLE;
+		runnable.push_back(m);
+
+		cv.notify_one();
+	}
+	else if (m->state == MS_RUNNING) {
+		m->wakeup_pending = true;  // it may be parking right now
+	}
+}
+
+void farm::worker(const size_t nr)
+{
+	set_thread_name(format("kek:farm-%zu", nr));
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	for(;;) {
+		while(runnable.empty() && !stop_flag)
+			cv.wait(lck);
+
+		if (stop_flag)
+			break;
+
+		machine *m = runnable.front();
+		runnable.pop_front();
+
+		m->state          = MS_RUNNING;
+		m->wakeup_pending = false;
+		m->n_slices++;
+
+		lck.unlock();
+
+		set_log_context(format("machine %zu", m->nr));
+
+		cpu *c = m->b->getCpu();
+
+		if (c->is_parked() == false || c->unpark()) {
+			for(uint32_t i=0; i<settings.slice_instructions && m->event == EVENT_NONE; i++) {
+				c->step();
+
+				if (c->is_parked()) {
+					m->n_parks++;
+					break;
+				}
+			}
+		}
+
+		set_log_context("");
+
+		lck.lock();
+
+		uint32_t stop_event = m->event;
+
+		if (stop_event != EVENT_NONE) {
+			m->state = MS_STOPPED;
+			n_stopped++;
+
+			*m->cnsl->get_running_flag() = false;
+
+			DOLOG(info, true, "Farm: machine %zu stopped (event %u) after %" PRIu64 " instructions", m->nr, stop_event, c->get_instructions_executed_count());
+
+			cv.notify_all();
+		}
+		else if (c->is_parked() && m->wakeup_pending == false) {
+			m->state = MS_PARKED;
+		}
+		else {
+			m->state = MS_RUNNABLE;
+			runnable.push_back(m);
+		}
+	}
+}
+
+void farm::run()
+{
+	using namespace std::chrono_literals;
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	while(n_stopped < machines.size() && *event == EVENT_NONE)
+		cv.wait_for(lck, 100ms);
+}
+
+void farm::show_state() const
+{
+	for(auto & m: machines) {
+		auto stats = m->b->getCpu()->get_mips_rel_speed({ }, { });
+
+		printf("machine %2zu: MIPS: %.2f, relative speed: %.2f%%, instructions executed: %" PRIu64 ", slices: %" PRIu64 ", parked %" PRIu64 " times\n",
+				m->nr, std::get<0>(stats), std::get<1>(stats), std::get<2>(stats), m->n_slices, m->n_parks);
+	}
+}
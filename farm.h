@@ -0,0 +1,90 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gen.h"
+
+
+class bus;
+class comm_tcp_socket_server;
+class console;
+class dc11;
+class disk_backend;
+
+typedef struct {
+	size_t       n_machines;
+	size_t       n_workers;           // 0: one per host core
+	uint32_t     slice_instructions;  // instructions per turn on a worker
+	std::optional<int> ram_size;      // in 8 kB pages
+	std::string  disk_type;
+	std::vector<disk_backend *> disk_templates;  // cloned for each machine
+	bool         enable_bootloader;
+	std::string  tape;
+	std::optional<uint16_t> start_addr;
+	uint16_t     console_switches;
+	int          dc11_port_base;      // each machine gets 4 consecutive ports
+} farm_settings_t;
+
+// runs many independent machines in one process: the cpus are scheduled
+// over a fixed pool of worker threads, a machine sitting in WAIT is
+// parked and does not occupy a worker until an interrupt arrives. the
+// consoles, clocks and DC-11 lines of all machines are serviced by one
+// thread.
+class farm
+{
+private:
+	typedef enum { MS_RUNNABLE, MS_RUNNING, MS_PARKED, MS_STOPPED } machine_state_t;
+
+	struct machine {
+		size_t               nr             { 0           };
+		std::atomic_uint32_t event          { EVENT_NONE  };
+		console             *cnsl           { nullptr     };
+		bus                 *b              { nullptr     };
+		machine_state_t      state          { MS_RUNNABLE };
+		bool                 wakeup_pending { false       };  // interrupt while running
+		uint64_t             n_slices       { 0           };
+		uint64_t             n_parks        { 0           };
+		// serviced by io_thread (as are the tty and kw11-l)
+		dc11                *dc11_          { nullptr     };
+		std::vector<comm_tcp_socket_server *> listeners;
+	};
+
+	const farm_settings_t  settings;
+	std::atomic_uint32_t  *const event  { nullptr };
+
+	std::vector<machine *> machines;
+	std::deque<machine *>  runnable;
+	size_t                 n_stopped    { 0 };
+	bool                   stop_flag    { false };
+	std::mutex             lock;
+	std::condition_variable cv;
+	std::vector<std::thread *> workers;
+	std::thread           *io_thread    { nullptr };
+
+	bool create_machine(const size_t nr);
+	void wakeup(machine *const m);
+	void worker(const size_t nr);
+	void poll_devices();
+
+public:
+	farm(const farm_settings_t & settings, std::atomic_uint32_t *const event);
+	virtual ~farm();
+
+	bool begin();
+
+	// returns when all machines stopped or when 'event' is set
+	void run();
+
+	void show_state() const;
+};
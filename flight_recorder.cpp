@@ -0,0 +1,184 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <algorithm>
+#include <cinttypes>
+#include <errno.h>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "cpu.h"
+#include "flight_recorder.h"
+#include "log.h"
+#include "utils.h"
+
+
+std::vector<std::string> flight_recorder::get_text(cpu *const c) const
+{
+	std::vector<std::string> out;
+
+	uint64_t n_traps_stored = std::min(n_traps, uint64_t(fr_n_traps));
+
+	out.push_back(format("last %" PRIu64 " traps/interrupts:", n_traps_stored));
+
+	for(uint64_t i=n_traps - n_traps_stored; i<n_traps; i++) {
+		const trap_t & t = traps[i & (fr_n_traps - 1)];
+
+		out.push_back(format(" %12" PRIu64 " %s vector %03o, PC %06o, PSW %06o", t.count, t.is_interrupt ? "interrupt" : "trap     ", t.vector, t.pc, t.psw));
+	}
+
+	uint64_t n_instructions_stored = std::min(n_instructions, uint64_t(fr_n_instructions));
+
+	out.push_back(format("last %" PRIu64 " instructions:", n_instructions_stored));
+
+	for(uint64_t i=n_instructions - n_instructions_stored; i<n_instructions; i++) {
+		const instruction_t & e = instructions[i & (fr_n_instructions - 1)];
+
+		std::string line = format(" %4d PC %06o, PSW %06o: %06o", int(i - n_instructions), e.pc, e.psw, e.instruction);
+
+		if (c) {
+			// memory may have changed since, only show what still matches
+			auto data = c->disassemble(e.pc);
+
+			if (data.empty() == false && data["instruction-values"].at(0) == format("%06o", e.instruction))
+				line += "  " + data["instruction-text"].at(0);
+		}
+
+		out.push_back(line);
+	}
+
+	return out;
+}
+
+void flight_recorder::dump(const std::string & reason, cpu *const c) const
+{
+	auto lines = get_text(c);
+
+#if defined(ESP32) || defined(BUILD_FOR_RP2040)
+	DOLOG(warning, true, "flight recorder (%s):", reason.c_str());
+
+	for(auto & line: lines)
+		DOLOG(warning, true, "%s", line.c_str());
+#else
+	time_t now = time(nullptr);
+	char   now_str[32] { };
+#if defined(_WIN32)
+	ctime_s(now_str, sizeof now_str, &now);
+#else
+	ctime_r(&now, now_str);
+#endif
+
+	// one write under a lock: farm and BIC workers share the file
+	std::string out = "--- " + reason + " at " + now_str;
+
+	for(auto & line: lines)
+		out += line + "\n";
+
+	static std::mutex file_lock;
+	std::unique_lock<std::mutex> lck(file_lock);
+
+	FILE *fh = fopen(flight_recorder_file, "a");
+	if (!fh) {
+		DOLOG(warning, true, "Cannot write the flight recorder to %s: %s", flight_recorder_file, strerror(errno));
+		return;
+	}
+
+	fwrite(out.c_str(), 1, out.size(), fh);
+
+	fclose(fh);
+
+	lck.unlock();
+
+	DOLOG(warning, true, "%s: flight recorder written to %s", reason.c_str(), flight_recorder_file);
+#endif
+}
+
+#if !defined(ESP32) && !defined(BUILD_FOR_RP2040)
+// snprintf() is not async-signal-safe, dump_to_fd() builds its lines with these
+static void append_string(char *const buffer, size_t *const len, const char *const s)
+{
+	for(size_t i=0; s[i]; i++)
+		buffer[(*len)++] = s[i];
+}
+
+// 'base' 8 is padded with zeros, 10 with spaces (like %06o and %12d)
+static void append_number(char *const buffer, size_t *const len, const int64_t v, const int base, const int width)
+{
+	char     digits[24];
+	int      n = 0;
+	uint64_t u = v < 0 ? -uint64_t(v) : uint64_t(v);
+
+	do {
+		digits[n++] = char('0' + u % base);
+		u /= base;
+	}
+	while(u);
+
+	if (v < 0)
+		digits[n++] = '-';
+
+	for(int i=n; i<width; i++)
+		buffer[(*len)++] = base == 8 ? '0' : ' ';
+
+	while(n > 0)
+		buffer[(*len)++] = digits[--n];
+}
+
+static bool write_line(const int fd, const char *const buffer, const size_t len)
+{
+	return write(fd, buffer, len) == ssize_t(len);
+}
+#endif
+
+void flight_recorder::dump_to_fd(const int fd, const char *const reason) const
+{
+#if !defined(ESP32) && !defined(BUILD_FOR_RP2040)
+	char   buffer[128];
+	size_t len = 0;
+
+	append_string(buffer, &len, "--- ");
+	if (!write_line(fd, buffer, len) || !write_line(fd, reason, strlen(reason)) || !write_line(fd, "\n", 1))
+		return;
+
+	for(uint64_t i=n_traps - std::min(n_traps, uint64_t(fr_n_traps)); i<n_traps; i++) {
+		const trap_t & t = traps[i & (fr_n_traps - 1)];
+
+		len = 0;
+		append_string(buffer, &len, " ");
+		append_number(buffer, &len, t.count, 10, 12);
+		append_string(buffer, &len, t.is_interrupt ? " interrupt vector " : " trap      vector ");
+		append_number(buffer, &len, t.vector, 8, 3);
+		append_string(buffer, &len, ", PC ");
+		append_number(buffer, &len, t.pc, 8, 6);
+		append_string(buffer, &len, ", PSW ");
+		append_number(buffer, &len, t.psw, 8, 6);
+		append_string(buffer, &len, "\n");
+
+		if (!write_line(fd, buffer, len))
+			return;
+	}
+
+	for(uint64_t i=n_instructions - std::min(n_instructions, uint64_t(fr_n_instructions)); i<n_instructions; i++) {
+		const instruction_t & e = instructions[i & (fr_n_instructions - 1)];
+
+		len = 0;
+		append_string(buffer, &len, " ");
+		append_number(buffer, &len, int64_t(i - n_instructions), 10, 4);
+		append_string(buffer, &len, " PC ");
+		append_number(buffer, &len, e.pc, 8, 6);
+		append_string(buffer, &len, ", PSW ");
+		append_number(buffer, &len, e.psw, 8, 6);
+		append_string(buffer, &len, ": ");
+		append_number(buffer, &len, e.instruction, 8, 6);
+		append_string(buffer, &len, "\n");
+
+		if (!write_line(fd, buffer, len))
+			return;
+	}
+#endif
+}
@@ -0,0 +1,68 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+class cpu;
+
+constexpr const size_t fr_n_instructions = 256;  // must be a power of 2
+constexpr const size_t fr_n_traps        = 32;   // idem
+
+constexpr const char   flight_recorder_file[] = "kek-flight-recorder.txt";
+
+// Always-on record of the last executed instructions and the last traps
+// and interrupts, cheap enough to leave enabled. It is written out on a
+// HALT, on a double trap, on a crash of the emulator and on request (the
+// debugger), so that a hang can be analyzed without the (slow) tracing.
+class flight_recorder
+{
+private:
+	struct instruction_t {
+		uint16_t pc;
+		uint16_t instruction;
+		uint16_t psw;
+	};
+
+	struct trap_t {
+		uint64_t count;  // instruction count
+		uint16_t vector;
+		uint16_t pc;
+		uint16_t psw;
+		bool     is_interrupt;
+	};
+
+	instruction_t instructions[fr_n_instructions] { };
+	trap_t        traps[fr_n_traps]               { };
+	uint64_t      n_instructions                  { 0 };
+	uint64_t      n_traps                         { 0 };
+
+public:
+	void add_instruction(const uint16_t pc, const uint16_t instruction, const uint16_t psw)
+	{
+		instruction_t & e = instructions[n_instructions++ & (fr_n_instructions - 1)];
+		e.pc          = pc;
+		e.instruction = instruction;
+		e.psw         = psw;
+	}
+
+	void add_trap(const uint64_t count, const uint16_t vector, const uint16_t pc, const uint16_t psw, const bool is_interrupt)
+	{
+		traps[n_traps++ & (fr_n_traps - 1)] = { count, vector, pc, psw, is_interrupt };
+	}
+
+	void reset() { n_instructions = n_traps = 0; }
+
+	// oldest first; with 'c' the instructions are disassembled (from the current memory contents)
+	std::vector<std::string> get_text(cpu *const c) const;
+
+	// appends to flight_recorder_file (or to the log on microcontrollers)
+	void dump(const std::string & reason, cpu *const c) const;
+
+	// for use in a signal handler: no allocations, no disassembly
+	void dump_to_fd(const int fd, const char *const reason) const;
+};
@@ -0,0 +1,725 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <cinttypes>
+
+#include "bus.h"
+#include "console.h"
+#include "cpu.h"
+#include "hle.h"
+#include "log.h"
+#include "memory.h"
+#include "mmu.h"
+#include "utils.h"
+
+
+// PS value used by copyseg/clearseg: previous mode supervisor, IPL 7
+constexpr const uint16_t seg_psw = 010340;
+
+hle::hle(bus *const b): b(b)
+{
+	// UNIX v7, mch.s
+	//	mov PS,-(sp); mov 4(sp),SISA0; mov 6(sp),SISA1; mov $10340,PS
+	//	mov r2,-(sp); clr r0; mov $8192.,r1; mov $32.,r2
+	// 1:	mfpd (r0)+; mtpd (r1)+; sob r2,1b
+	//	mov (sp)+,r2; mov (sp)+,PS; rts pc
+	routines.push_back({ "copyseg", {
+			{ 016746, false }, { ADDR_PSW, true },
+			{ 016667, false }, { 4, false }, { ADDR_PAR_SV_START, true },
+			{ 016667, false }, { 6, false }, { ADDR_PAR_SV_START + 2, true },
+			{ 012767, false }, { seg_psw, false }, { ADDR_PSW, true },
+			{ 010246, false },
+			{ 005000, false },
+			{ 012701, false }, { 020000, false },
+			{ 012702, false }, { 040, false },
+			{ 0106520, false }, { 0106621, false }, { 077203, false },
+			{ 012602, false },
+			{ 012667, false }, { ADDR_PSW, true },
+			{ 000207, false } },
+			0, &hle::do_copyseg, 0, 0, 0 });
+
+	//	mov PS,-(sp); mov 4(sp),SISA0; mov $10340,PS; clr r0; mov $32.,r1
+	// 1:	clr -(sp); mtpd (r0)+; sob r1,1b
+	//	mov (sp)+,PS; rts pc
+	routines.push_back({ "clearseg", {
+			{ 016746, false }, { ADDR_PSW, true },
+			{ 016667, false }, { 4, false }, { ADDR_PAR_SV_START, true },
+			{ 012767, false }, { seg_psw, false }, { ADDR_PSW, true },
+			{ 005000, false },
+			{ 012701, false }, { 040, false },
+			{ 005046, false }, { 0106620, false }, { 077103, false },
+			{ 012667, false }, { ADDR_PSW, true },
+			{ 000207, false } },
+			0, &hle::do_clearseg, 0, 0, 0 });
+
+	// The routines below are C (cc -O), with the csv/cret frame. The
+	// addresses of csv, cret, the spl-routines and cfreelist are captured.
+
+	// bcopy(from, to, count): do *to++ = *from++; while(--count);
+	routines.push_back({ "bcopy", {
+			{ 004567, false }, { 0, true, 0 },  // jsr r5,csv
+			{ 016504, false }, { 010, false },
+			{ 016503, false }, { 4, false },
+			{ 016502, false }, { 6, false },
+			{ 0112322, false }, { 077402, false },
+			{ 000167, false }, { 0, true, 1 } },  // jmp cret
+			2, &hle::do_bcopy, 0, 0, 0 });
+
+	// getc(p): the first character of clist p (-1 when empty), a cblock
+	// that becomes empty is put on cfreelist
+	routines.push_back({ "getc", {
+			{ 004567, false }, { 0, true, 0 },
+			{ 016504, false }, { 4, false },
+			{ 005746, false },
+			{ 004767, false }, { 0, true, 1 },  // jsr pc,spl6
+			{ 010065, false }, { 0177770, false },
+			{ 005714, false },
+			{ 003011, false },
+			{ 012702, false }, { 0177777, false },
+			{ 005014, false },
+			{ 005000, false },
+			{ 010064, false }, { 4, false },
+			{ 010064, false }, { 2, false },
+			{ 000443, false },
+			{ 0117402, false }, { 2, false },
+			{ 005264, false }, { 2, false },
+			{ 042702, false }, { 0177400, false },
+			{ 005314, false },
+			{ 003012, false },
+			{ 016403, false }, { 2, false },
+			{ 005303, false },
+			{ 042703, false }, { 017, false },
+			{ 005064, false }, { 2, false },
+			{ 005064, false }, { 4, false },
+			{ 000415, false },
+			{ 032764, false }, { 017, false }, { 2, false },
+			{ 001015, false },
+			{ 016403, false }, { 2, false },
+			{ 0162703, false }, { 020, false },
+			{ 011300, false },
+			{ 062700, false }, { 2, false },
+			{ 010064, false }, { 2, false },
+			{ 016713, false }, { 0, true, 2 },  // cfreelist
+			{ 010367, false }, { 0, true, 3 },  // cfreelist
+			{ 016516, false }, { 0177770, false },
+			{ 004737, false }, { 0, false, 4 },  // jsr pc,*$splx
+			{ 010200, false },
+			{ 000167, false }, { 0, true, 5 } },
+			6, &hle::do_getc, 0, 0, 0 });
+
+	// putc(c, p): append c to clist p, taking a cblock from cfreelist
+	// when needed; returns -1 when there is none
+	routines.push_back({ "putc", {
+			{ 004567, false }, { 0, true, 0 },
+			{ 016504, false }, { 6, false },
+			{ 005746, false },
+			{ 004767, false }, { 0, true, 1 },
+			{ 010065, false }, { 0177770, false },
+			{ 016402, false }, { 4, false },
+			{ 001402, false },
+			{ 005714, false },
+			{ 002023, false },
+			{ 016703, false }, { 0, true, 2 },
+			{ 001007, false },
+			{ 016516, false }, { 0177770, false },
+			{ 004737, false }, { 0, false, 3 },
+			{ 012700, false }, { 0177777, false },
+			{ 000443, false },
+			{ 011367, false }, { 0, true, 4 },
+			{ 005013, false },
+			{ 010302, false },
+			{ 062702, false }, { 2, false },
+			{ 010264, false }, { 2, false },
+			{ 000420, false },
+			{ 032702, false }, { 017, false },
+			{ 001015, false },
+			{ 010203, false },
+			{ 0162703, false }, { 020, false },
+			{ 016713, false }, { 0, true, 5 },
+			{ 001747, false },
+			{ 011303, false },
+			{ 011367, false }, { 0, true, 6 },
+			{ 005013, false },
+			{ 010302, false },
+			{ 062702, false }, { 2, false },
+			{ 0116522, false }, { 4, false },
+			{ 005214, false },
+			{ 010264, false }, { 4, false },
+			{ 016516, false }, { 0177770, false },
+			{ 004737, false }, { 0, false, 7 },
+			{ 005000, false },
+			{ 000167, false }, { 0, true, 8 } },
+			9, &hle::do_putc, 0, 0, 0 });
+
+	// csv: mov r5,r0; mov sp,r5; mov r4,-(sp); mov r3,-(sp); mov r2,-(sp); jsr pc,(r0)
+	csv_signature  = { { 010500, false }, { 010605, false }, { 010446, false }, { 010346, false }, { 010246, false }, { 004710, false } };
+	// cret: mov r5,r2; mov -(r2),r4; mov -(r2),r3; mov -(r2),r2; mov r5,sp; mov (sp)+,r5; rts pc
+	cret_signature = { { 010502, false }, { 014204, false }, { 014203, false }, { 014202, false }, { 010506, false }, { 012605, false }, { 000207, false } };
+	// spl6: mov PS,r0; spl 6; rts pc
+	spl6_signature = { { 016700, false }, { ADDR_PSW, true }, { 000236, false }, { 000207, false } };
+	// splx: mov 2(sp),PS; rts pc
+	splx_signature = { { 016667, false }, { 2, false }, { ADDR_PSW, true }, { 000207, false } };
+}
+
+hle::~hle()
+{
+}
+
+bool hle::verify_signature(const uint16_t entry, const std::vector<signature_word> & signature, std::vector<uint16_t> *const captured) const
+{
+	mmu    *const mmu_ = b->getMMU();
+	memory *const m    = b->getRAM();
+
+	uint16_t a = entry;
+
+	for(auto & element: signature) {
+		uint32_t phys = mmu_->calculate_physical_address(0, a).physical_instruction;
+		if (phys + 1 >= m->get_memory_size())
+			return false;
+
+		uint16_t v    = m->read_word(phys);
+
+		a += 2;
+
+		if (element.pc_relative)
+			v += a;
+
+		if (element.capture >= 0)
+			(*captured)[element.capture] = v;
+		else if (v != element.value)
+			return false;
+	}
+
+	return true;
+}
+
+std::optional<uint32_t> hle::invoke(const uint16_t entry)
+{
+	if (!enabled)
+		return { };
+
+	memory *const m = b->getRAM();
+
+	uint32_t phys = b->getMMU()->calculate_physical_address(0, entry).physical_instruction;
+	if (phys + 1 >= m->get_memory_size())
+		return { };
+
+	// the assembly routines start with "mov PS,-(sp)", the C routines with "jsr r5,csv"
+	uint16_t first = m->read_word(phys);
+	if (first != 016746 && first != 004567)
+		return { };
+
+	for(auto & r: routines) {
+		cpu *const c = b->getCpu();
+
+		call_t call { entry, c->get_register(6), std::vector<uint16_t>(r.n_captures), 0 };
+
+		if (verify_signature(entry, r.signature, &call.captured) == false)
+			continue;
+
+		// an interrupt might be serviced while the routine is still
+		// at IPL 0, the trace bit traps after each instruction
+		bool ok = c->check_if_interrupts_pending() == false && (c->getPSW() & 020) == 0 &&
+			b->getMMU()->is_enabled() && b->getMMU()->isMMR1Locked() == false;
+
+		try {
+			if (ok && (this->*r.handler)(call)) {
+				r.n_hits++;
+				r.n_instructions += call.n_instructions;
+
+				TRACE(tc_cpu, "HLE: %s handled", r.name.c_str());
+
+				return call.n_instructions;
+			}
+		}
+		catch(const int exception_nr) {
+			// should not happen: all accesses were verified; the trap
+			// has been initiated (like the interpreted code would do)
+			DOLOG(warning, false, "HLE: %s: unexpected bus-trap (%d)", r.name.c_str(), exception_nr);
+
+			return 0;
+		}
+
+		r.n_fallbacks++;
+
+		TRACE(tc_cpu, "HLE: %s preconditions failed", r.name.c_str());
+
+		return { };
+	}
+
+	return { };
+}
+
+bool hle::do_copyseg(call_t & call)
+{
+	mmu *const mmu_ = b->getMMU();
+	cpu *const c    = b->getCpu();
+	uint16_t   sp   = call.sp;
+
+	// kernel stack: arguments, return address and 3 scratch words
+	for(int o=-6; o<=4; o += 2) {
+		if (!mmu_->is_access_valid(0, sp + o, o < 0, d_space))
+			return false;
+	}
+
+	// mfpd pushes via the stack-limit check
+	if (uint16_t(sp - 4) == c->getStackLimitRegister())
+		return false;
+
+	if (!mmu_->is_access_valid(0, ADDR_PSW, true, d_space) || !mmu_->is_access_valid(0, ADDR_PAR_SV_START, true, d_space) || !mmu_->is_access_valid(0, ADDR_PAR_SV_START + 2, true, d_space))
+		return false;
+
+	if (mmu_->get_use_data_space(1))
+		return false;
+
+	uint16_t src = b->read_word(sp + 2, d_space);
+	uint16_t dst = b->read_word(sp + 4, d_space);
+
+	if (!mmu_->is_access_valid(1, 0, false, d_space, src) || !mmu_->is_access_valid(1, 077, false, d_space, src) ||
+	    !mmu_->is_access_valid(1, 020000, true, d_space, dst) || !mmu_->is_access_valid(1, 020077, true, d_space, dst))
+		return false;
+
+	// everything done via the bus so that side effects (W-bits in the
+	// PDRs, PAR-writes resetting them, etc) are identical
+	uint16_t old_psw = b->read_word(ADDR_PSW, d_space);
+	b->write_word(sp - 2, old_psw, d_space);
+
+	b->write_word(ADDR_PAR_SV_START,     src, d_space);
+	b->write_word(ADDR_PAR_SV_START + 2, dst, d_space);
+
+	b->write_word(ADDR_PSW, seg_psw, d_space);  // register set 0 from here on
+
+	b->write_word(sp - 4, c->lowlevel_register_get(0, 2), d_space);
+
+	uint16_t v = 0;
+	for(uint16_t o=0; o<64; o += 2) {
+		v = b->read (o,          wm_word,    rm_prev, d_space);
+		(void)b->write(020000 + o, wm_word, v, rm_prev, d_space);
+	}
+
+	b->write_word(sp - 6, v, d_space);  // left behind by the last mfpd/mtpd
+
+	c->lowlevel_register_set(0, 0, 64);
+	c->lowlevel_register_set(0, 1, 020000 + 64);
+
+	b->write_word(ADDR_PSW, old_psw, d_space);
+
+	// rts pc
+	c->setPC(b->read_word(sp, d_space));
+	c->set_register(6, sp + 2);
+
+	call.n_instructions = 4 + 4 + 32 * 3 + 3;
+
+	return true;
+}
+
+bool hle::do_clearseg(call_t & call)
+{
+	mmu *const mmu_ = b->getMMU();
+	cpu *const c    = b->getCpu();
+	uint16_t   sp   = call.sp;
+
+	for(int o=-4; o<=2; o += 2) {
+		if (!mmu_->is_access_valid(0, sp + o, o < 0, d_space))
+			return false;
+	}
+
+	if (!mmu_->is_access_valid(0, ADDR_PSW, true, d_space) || !mmu_->is_access_valid(0, ADDR_PAR_SV_START, true, d_space))
+		return false;
+
+	if (mmu_->get_use_data_space(1))
+		return false;
+
+	uint16_t dst = b->read_word(sp + 2, d_space);
+
+	if (!mmu_->is_access_valid(1, 0, true, d_space, dst) || !mmu_->is_access_valid(1, 077, true, d_space, dst))
+		return false;
+
+	uint16_t old_psw = b->read_word(ADDR_PSW, d_space);
+	b->write_word(sp - 2, old_psw, d_space);
+
+	b->write_word(ADDR_PAR_SV_START, dst, d_space);
+
+	b->write_word(ADDR_PSW, seg_psw, d_space);
+
+	for(uint16_t o=0; o<64; o += 2)
+		(void)b->write(o, wm_word, 0, rm_prev, d_space);
+
+	b->write_word(sp - 4, 0, d_space);  // left behind by the last clr -(sp)/mtpd
+
+	c->lowlevel_register_set(0, 0, 64);
+	c->lowlevel_register_set(0, 1, 0);
+
+	b->write_word(ADDR_PSW, old_psw, d_space);
+
+	c->setPC(b->read_word(sp, d_space));
+	c->set_register(6, sp + 2);
+
+	call.n_instructions = 5 + 32 * 3 + 2;
+
+	return true;
+}
+
+// a kernel data access that does not trap and goes to RAM (not to the I/O page)
+bool hle::is_access_valid(const uint16_t a, const bool is_write, const bool is_byte) const
+{
+	if (is_byte == false && (a & 1))
+		return false;
+
+	mmu *const mmu_ = b->getMMU();
+
+	if (mmu_->is_access_valid(0, a, is_write, d_space) == false)
+		return false;
+
+	return mmu_->calculate_physical_address(0, a).physical_data + 1 < b->getRAM()->get_memory_size();
+}
+
+// "jsr r5,csv" and the "jsr pc,(r0)" in csv push via the stack limit
+// check, csv saves r5...r2 and its return address (cret) below the return
+// address of the routine; 'lowest_push' is the lowest scratch word used
+bool hle::csv_preconditions(const call_t & call, const uint16_t csv, const uint16_t cret, const int lowest_push) const
+{
+	if (verify_signature(csv, csv_signature, nullptr) == false || verify_signature(cret, cret_signature, nullptr) == false)
+		return false;
+
+	uint16_t sp    = call.sp;
+	uint16_t limit = b->getCpu()->getStackLimitRegister();
+
+	if (sp == limit || uint16_t(sp - 8) == limit)
+		return false;
+
+	for(int o=lowest_push; o<=0; o += 2) {
+		if (!is_access_valid(sp + o, o < 0))
+			return false;
+	}
+
+	return true;
+}
+
+void hle::csv_enter(const call_t & call, const uint16_t csv)
+{
+	cpu *const c  = b->getCpu();
+	uint16_t   sp = call.sp;
+
+	b->write_word(sp -  2, c->get_register(5), d_space);
+	b->write_word(sp -  4, c->get_register(4), d_space);
+	b->write_word(sp -  6, c->get_register(3), d_space);
+	b->write_word(sp -  8, c->get_register(2), d_space);
+	b->write_word(sp - 10, csv + 12, d_space);  // pushed by "jsr pc,(r0)"
+
+	c->set_register(0, call.entry + 4);
+	c->set_register(5, sp - 2);
+}
+
+void hle::cret_leave(const call_t & call)
+{
+	cpu *const c  = b->getCpu();
+	uint16_t   sp = call.sp;
+
+	uint16_t   r5 = b->read_word(sp - 2, d_space);
+
+	c->set_register(4, b->read_word(sp - 4, d_space));
+	c->set_register(3, b->read_word(sp - 6, d_space));
+	c->set_register(2, b->read_word(sp - 8, d_space));
+	c->set_register(5, r5);
+	c->setPSW_flags_nzv(r5, wm_word);  // mov (sp)+,r5, the C-flag is not changed
+
+	// rts pc
+	c->setPC(b->read_word(sp, d_space));
+	c->set_register(6, sp + 2);
+}
+
+bool hle::do_bcopy(call_t & call)
+{
+	uint16_t sp = call.sp;
+
+	if (!csv_preconditions(call, call.captured[0], call.captured[1], -10))
+		return false;
+
+	for(int o=2; o<=6; o += 2) {
+		if (!is_access_valid(sp + o, false))
+			return false;
+	}
+
+	uint16_t from  = b->read_word(sp + 2, d_space);
+	uint16_t to    = b->read_word(sp + 4, d_space);
+	uint32_t count = b->read_word(sp + 6, d_space);
+
+	if (count == 0)  // sob
+		count = 65536;
+
+	// whether an access traps is the same for all of a 64 byte block
+	for(uint32_t i=0; i<count; i++) {
+		if ((i == 0 || ((from + i) & 077) == 0) && !is_access_valid(from + i, false, true))
+			return false;
+
+		if ((i == 0 || ((to + i) & 077) == 0) && !is_access_valid(to + i, true, true))
+			return false;
+	}
+
+	csv_enter(call, call.captured[0]);
+
+	for(uint32_t i=0; i<count; i++)
+		(void)b->write(to + i, wm_byte, b->read(from + i, wm_byte, rm_cur, d_space), rm_cur, d_space);
+
+	cret_leave(call);
+
+	call.n_instructions = 1 + 6 + 3 + 2 * count + 1 + 7;
+
+	return true;
+}
+
+bool hle::do_getc(call_t & call)
+{
+	cpu *const c  = b->getCpu();
+	uint16_t   sp = call.sp;
+
+	const uint16_t cfreelist = call.captured[2];
+
+	if (call.captured[3] != cfreelist ||
+		verify_signature(call.captured[1], spl6_signature, nullptr) == false || verify_signature(call.captured[4], splx_signature, nullptr) == false)
+		return false;
+
+	// jsr pc,spl6 and jsr pc,splx
+	if (!csv_preconditions(call, call.captured[0], call.captured[5], -14) || uint16_t(sp - 12) == c->getStackLimitRegister())
+		return false;
+
+	if (!is_access_valid(sp + 2, false))
+		return false;
+
+	// the addresses used, which must not overlap the stack frame
+	auto is_usable = [sp, this](const uint16_t a, const bool is_write, const bool is_byte) {
+		return uint16_t(a - (sp - 14)) >= 20 && uint16_t(a + 1 - (sp - 14)) >= 20 && is_access_valid(a, is_write, is_byte);
+	};
+
+	uint16_t p = b->read_word(sp + 2, d_space);
+
+	if (!is_usable(p, true, false) || !is_usable(p + 2, true, false) || !is_usable(p + 4, true, false) || !is_usable(cfreelist, true, false))
+		return false;
+
+	int16_t  cc = b->read_word(p,     d_space);
+	uint16_t cf = b->read_word(p + 2, d_space);
+
+	if (cc > 0) {
+		if (!is_usable(cf, false, true))
+			return false;
+
+		if (cc == 1) {
+			if (!is_usable(cf & ~017, true, false))
+				return false;
+		}
+		else if (((cf + 1) & 017) == 0) {
+			if (!is_usable(cf + 1 - 020, true, false))
+				return false;
+		}
+	}
+
+	csv_enter(call, call.captured[0]);
+
+	// tst -(sp); jsr pc,spl6: the PS as it is then
+	c->setPSW_flags_nzv(b->read_word(sp - 12, d_space), wm_word);
+	c->setPSW_c(false);
+
+	uint16_t s = b->read_word(ADDR_PSW, d_space);
+
+	b->write_word(sp - 14, call.entry + 016, d_space);
+	b->write_word(sp - 10, s, d_space);
+
+	uint16_t r2 = 0177777;
+
+	call.n_instructions = 16 + 13;
+
+	if (cc <= 0) {
+		b->write_word(p,     0, d_space);
+		b->write_word(p + 4, 0, d_space);
+		b->write_word(p + 2, 0, d_space);
+
+		call.n_instructions += 6;
+	}
+	else {
+		r2 = b->read(cf, wm_byte, rm_cur, d_space) & 0377;
+
+		b->write_word(p + 2, cf + 1, d_space);
+		b->write_word(p,     cc - 1, d_space);
+
+		call.n_instructions += 5;
+
+		std::optional<uint16_t> bp;
+
+		if (cc == 1) {
+			bp = cf & ~017;
+
+			b->write_word(p + 2, 0, d_space);
+			b->write_word(p + 4, 0, d_space);
+
+			call.n_instructions += 8;
+		}
+		else if (((cf + 1) & 017) == 0) {
+			bp = cf + 1 - 020;
+
+			b->write_word(p + 2, b->read_word(bp.value(), d_space) + 2, d_space);
+
+			call.n_instructions += 2 + 7;
+		}
+		else {
+			call.n_instructions += 2;
+		}
+
+		// put the cblock on the freelist
+		if (bp.has_value()) {
+			b->write_word(bp.value(), b->read_word(cfreelist, d_space), d_space);
+			b->write_word(cfreelist, bp.value(), d_space);
+		}
+	}
+
+	// splx(s)
+	b->write_word(sp - 12, s, d_space);
+	b->write_word(sp - 14, call.entry + 0166, d_space);
+	b->write_word(ADDR_PSW, s, d_space);
+
+	c->set_register(0, r2);
+
+	cret_leave(call);
+
+	return true;
+}
+
+bool hle::do_putc(call_t & call)
+{
+	cpu *const c  = b->getCpu();
+	uint16_t   sp = call.sp;
+
+	const uint16_t cfreelist = call.captured[2];
+	const uint16_t splx      = call.captured[3];
+
+	if (call.captured[4] != cfreelist || call.captured[5] != cfreelist || call.captured[6] != cfreelist || call.captured[7] != splx ||
+		verify_signature(call.captured[1], spl6_signature, nullptr) == false || verify_signature(splx, splx_signature, nullptr) == false)
+		return false;
+
+	if (!csv_preconditions(call, call.captured[0], call.captured[8], -14) || uint16_t(sp - 12) == c->getStackLimitRegister())
+		return false;
+
+	if (!is_access_valid(sp + 2, false) || !is_access_valid(sp + 4, false))
+		return false;
+
+	auto is_usable = [sp, this](const uint16_t a, const bool is_write, const bool is_byte) {
+		return uint16_t(a - (sp - 14)) >= 20 && uint16_t(a + 1 - (sp - 14)) >= 20 && is_access_valid(a, is_write, is_byte);
+	};
+
+	uint16_t p = b->read_word(sp + 4, d_space);
+
+	if (!is_usable(p, true, false) || !is_usable(p + 2, true, false) || !is_usable(p + 4, true, false) || !is_usable(cfreelist, true, false))
+		return false;
+
+	int16_t  cc = b->read_word(p,     d_space);
+	uint16_t cl = b->read_word(p + 4, d_space);
+
+	// predict the path to verify the addresses it uses
+	bool new_block = cl == 0 || cc < 0;
+
+	if (new_block) {
+		uint16_t bp = b->read_word(cfreelist, d_space);
+
+		if (bp && (!is_usable(bp, true, false) || !is_usable(bp + 2, true, true)))
+			return false;
+	}
+	else if ((cl & 017) == 0) {
+		uint16_t prev = cl - 020;
+		uint16_t bp   = b->read_word(cfreelist, d_space);
+
+		if (!is_usable(prev, true, false) || (bp && (!is_usable(bp, true, false) || !is_usable(bp + 2, true, true))))
+			return false;
+	}
+	else if (!is_usable(cl, true, true)) {
+		return false;
+	}
+
+	csv_enter(call, call.captured[0]);
+
+	// tst -(sp); jsr pc,spl6
+	c->setPSW_flags_nzv(b->read_word(sp - 12, d_space), wm_word);
+	c->setPSW_c(false);
+
+	uint16_t s = b->read_word(ADDR_PSW, d_space);
+
+	b->write_word(sp - 14, call.entry + 016, d_space);
+	b->write_word(sp - 10, s, d_space);
+
+	call.n_instructions = 16;
+
+	uint16_t r2 = cl;
+	bool     ok = true;
+
+	if (new_block) {
+		call.n_instructions += cl == 0 ? 2 : 4;
+
+		uint16_t bp = b->read_word(cfreelist, d_space);
+
+		if (bp == 0)
+			ok = false;
+		else {
+			b->write_word(cfreelist, b->read_word(bp, d_space), d_space);
+			b->write_word(bp, 0, d_space);
+
+			r2 = bp + 2;
+			b->write_word(p + 2, r2, d_space);
+
+			call.n_instructions += 6;
+		}
+	}
+	else {
+		call.n_instructions += 4;
+
+		if ((cl & 017) == 0) {
+			call.n_instructions += 4;
+
+			uint16_t prev = cl - 020;
+			uint16_t bp   = b->read_word(cfreelist, d_space);
+
+			b->write_word(prev, bp, d_space);  // also when it is 0
+
+			if (bp == 0)
+				ok = false;
+			else {
+				bp = b->read_word(prev, d_space);
+
+				b->write_word(cfreelist, b->read_word(bp, d_space), d_space);
+				b->write_word(bp, 0, d_space);
+
+				r2 = bp + 2;
+
+				call.n_instructions += 5;
+			}
+		}
+	}
+
+	if (ok) {
+		(void)b->write(r2, wm_byte, b->read(sp + 2, wm_byte, rm_cur, d_space), rm_cur, d_space);
+
+		b->write_word(p,     b->read_word(p, d_space) + 1, d_space);
+		b->write_word(p + 4, r2 + 1, d_space);
+	}
+
+	// splx(s)
+	b->write_word(sp - 12, s, d_space);
+	b->write_word(sp - 14, call.entry + (ok ? 0164 : 052), d_space);
+	b->write_word(ADDR_PSW, s, d_space);
+
+	c->set_register(0, ok ? 0 : 0177777);
+
+	call.n_instructions += ok ? 16 : 14;
+
+	cret_leave(call);
+
+	return true;
+}
+
+void hle::show_state(console *const cnsl) const
+{
+	cnsl->put_string_lf(format("High-level emulation: %s", enabled ? "enabled" : "disabled"));
+
+	for(auto & r: routines) {
+		cnsl->put_string_lf(format("%-10s hits: %" PRIu64 ", fallbacks: %" PRIu64 ", instructions not interpreted: %" PRIu64,
+					r.name.c_str(), r.n_hits, r.n_fallbacks, r.n_instructions));
+	}
+}
@@ -0,0 +1,85 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+class bus;
+class console;
+
+// High-level emulation of hot UNIX (v7) kernel routines. A routine is
+// recognized by its code (verified on every call, so nothing depends on
+// the addresses in a particular kernel) and replaced by a native version
+// with the exact same effects on memory, registers and the PSW. When a
+// precondition does not hold (an interrupt is pending, a memory access
+// would trap, etc.), the routine is interpreted as usual.
+class hle
+{
+private:
+	struct signature_word {
+		uint16_t value;
+		bool     pc_relative;    // value is the absolute address
+		int      capture { -1 }; // >= 0: any value (an address that differs per kernel), stored in call_t::captured
+	};
+
+	struct call_t {
+		uint16_t              entry;
+		uint16_t              sp;              // at entry: points to the return address
+		std::vector<uint16_t> captured;
+		uint32_t              n_instructions;  // when interpreted, set by the handler
+	};
+
+	struct routine {
+		std::string                 name;
+		std::vector<signature_word> signature;
+		size_t                      n_captures;
+		bool (hle::*handler)(call_t & call);
+		uint64_t                    n_hits;
+		uint64_t                    n_fallbacks;
+		uint64_t                    n_instructions;  // not interpreted, in total
+	};
+
+	bus *const b { nullptr };
+
+	bool enabled { true };
+
+	std::vector<routine> routines;
+
+	// C runtime (csv.s) and priority routines called by the C routines
+	std::vector<signature_word> csv_signature;
+	std::vector<signature_word> cret_signature;
+	std::vector<signature_word> spl6_signature;
+	std::vector<signature_word> splx_signature;
+
+	bool verify_signature(const uint16_t entry, const std::vector<signature_word> & signature, std::vector<uint16_t> *const captured) const;
+
+	bool is_access_valid(const uint16_t a, const bool is_write, const bool is_byte = false) const;
+	bool csv_preconditions(const call_t & call, const uint16_t csv, const uint16_t cret, const int lowest_push) const;
+	void csv_enter(const call_t & call, const uint16_t csv);
+	void cret_leave(const call_t & call);
+
+	bool do_copyseg (call_t & call);
+	bool do_clearseg(call_t & call);
+	bool do_bcopy   (call_t & call);
+	bool do_getc    (call_t & call);
+	bool do_putc    (call_t & call);
+
+public:
+	hle(bus *const b);
+	virtual ~hle();
+
+	void set_enabled(const bool state) { enabled = state; }
+	bool get_enabled() const { return enabled; }
+
+	// invoked by JSR PC in kernel mode, after the return address has
+	// been pushed; returns the number of instructions that were not
+	// interpreted when the routine was handled (including its RTS)
+	std::optional<uint32_t> invoke(const uint16_t entry);
+
+	void show_state(console *const cnsl) const;
+};
@@ -0,0 +1,162 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <cinttypes>
+#include <errno.h>
+#include <string.h>
+
+#include "bus.h"
+#include "dc11.h"
+#include "journal.h"
+#include "kw11-l.h"
+#include "log.h"
+#include "tty.h"
+#include "utils.h"
+
+
+static const char *const event_names[] = { "kw11", "tty", "dc11-connect", "dc11-data" };
+
+journal::journal(bus *const b, const std::string & file, const bool replay):
+	b(b),
+	replay(replay)
+{
+	fh = fopen(file.c_str(), replay ? "r" : "w");
+
+	if (!fh) {
+		DOLOG(warning, true, "journal: cannot %s \"%s\": %s", replay ? "open" : "create", file.c_str(), strerror(errno));
+		return;
+	}
+
+	if (replay)
+		read_next();
+}
+
+journal::~journal()
+{
+	if (fh)
+		fclose(fh);
+
+	DOLOG(info, false, "journal: %" PRIu64 " events %s", n_events, replay ? "replayed" : "recorded");
+}
+
+void journal::read_next()
+{
+	char     name[32] { };
+	unsigned line     { 0 };
+	unsigned value    { 0 };
+
+	next_count = UINT64_MAX;
+
+	if (fscanf(fh, "%" SCNu64 " %31s %u %u", &next.count, name, &line, &value) != 4) {
+		DOLOG(info, true, "journal: end of replay after %" PRIu64 " events", n_events);
+		return;
+	}
+
+	line_nr++;
+
+	for(size_t i=0; i<sizeof(event_names) / sizeof(event_names[0]); i++) {
+		if (strcmp(name, event_names[i]) == 0) {
+			next.type  = journal_event_type_t(i);
+			next.line  = line;
+			next.value = value;
+			next_count = next.count;
+
+			return;
+		}
+	}
+
+	DOLOG(warning, true, "journal: event \"%s\" on line %" PRIu64 " not understood, replay stopped", name, line_nr);
+}
+
+void journal::record(const journal_event_t & e)
+{
+	fprintf(fh, "%" PRIu64 " %s %u %u\n", e.count, event_names[e.type], e.line, e.value);
+	fflush(fh);  // a recording of a session that crashed is the interesting one
+}
+
+void journal::apply(const journal_event_t & e)
+{
+	n_events++;
+
+	if (e.type == JE_KW11_TICK)
+		b->getKW11_L()->do_interrupt();
+	else if (e.type == JE_TTY_CHAR)
+		b->getTty()->add_char(e.value);
+	else if (e.type == JE_DC11_CONNECT) {
+		if (b->getDC11())
+			b->getDC11()->set_connected(e.line, e.value);
+	}
+	else if (e.type == JE_DC11_DATA) {
+		if (b->getDC11())
+			b->getDC11()->receive_byte(e.line, e.value);
+	}
+}
+
+void journal::submit(const journal_event_type_t type, const uint8_t line, const uint8_t value)
+{
+	if (replay)
+		return;
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	pending.push_back({ 0, type, line, value });
+
+	any_pending = true;
+}
+
+void journal::apply_due(const uint64_t count)
+{
+	while(next_count <= count) {
+		apply(next);
+
+		read_next();
+	}
+}
+
+void journal::poll(const uint64_t count)
+{
+	if (replay) {
+		apply_due(count);
+		return;
+	}
+
+	std::vector<journal_event_t> events;
+
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		events.swap(pending);
+
+		any_pending = false;
+	}
+
+	for(auto & e: events) {
+		e.count = count;
+
+		record(e);
+		apply(e);
+	}
+}
+
+bool journal::idle(const uint64_t count)
+{
+	if (replay) {
+		if (next_count == UINT64_MAX)
+			return false;
+
+		// when recording, WAIT only ended by events applied at this count
+		if (next_count != count)
+			DOLOG(warning, false, "journal: replay diverged, in WAIT at %" PRIu64 " while the next event is at %" PRIu64, count, next_count);
+
+		apply_due(next_count);
+
+		return true;
+	}
+
+	if (!any_pending)
+		myusleep(1000);
+
+	poll(count);
+
+	return true;
+}
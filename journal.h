@@ -0,0 +1,75 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+
+class bus;
+
+typedef enum { JE_KW11_TICK, JE_TTY_CHAR, JE_DC11_CONNECT, JE_DC11_DATA } journal_event_type_t;
+
+typedef struct {
+	uint64_t             count;  // instruction count at which it was applied
+	journal_event_type_t type;
+	uint8_t              line;   // DC11
+	uint8_t              value;  // character, connected-state
+} journal_event_t;
+
+// Makes a session reproducible. The devices that receive input from host
+// threads (KW11-L ticks, console characters, DC11 bytes and connection
+// changes) hand it to the journal instead of changing their state. The
+// cpu applies it at an instruction boundary. When recording, that moment
+// (the instruction count) is written to a file. When replaying, the
+// input from the host threads is ignored and the events from the file
+// are applied at exactly the same counts, without any real-time pacing.
+// Disk transfers complete synchronously and need no journal entries.
+class journal
+{
+private:
+	bus               *const b      { nullptr };
+	const bool         replay       { false   };
+	FILE              *fh           { nullptr };
+
+	// recording: filled by the host threads
+	std::mutex         lock;
+	std::vector<journal_event_t> pending;
+	std::atomic_bool   any_pending  { false };
+
+	// replaying
+	journal_event_t    next         { };
+	uint64_t           next_count   { UINT64_MAX };  // UINT64_MAX: nothing (more) to replay
+	uint64_t           line_nr      { 0 };
+
+	uint64_t           n_events     { 0 };
+
+	void apply(const journal_event_t & e);
+	void record(const journal_event_t & e);
+	void read_next();
+	void apply_due(const uint64_t count);
+
+public:
+	journal(bus *const b, const std::string & file, const bool replay);
+	virtual ~journal();
+
+	bool is_open()   const { return fh != nullptr; }
+	bool is_replay() const { return replay; }
+
+	// from the device threads; ignored when replaying
+	void submit(const journal_event_type_t type, const uint8_t line, const uint8_t value);
+
+	// invoked by the cpu before each instruction
+	bool poll_needed(const uint64_t count) const { return any_pending || count >= next_count; }
+	void poll(const uint64_t count);
+
+	// invoked by the cpu while in WAIT; returns false when a replay ran out of events
+	bool idle(const uint64_t count);
+
+	uint64_t get_event_count() const { return n_events; }
+};
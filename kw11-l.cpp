@@ -5,6 +5,7 @@
 
 #include "console.h"
 #include "cpu.h"
+#include "journal.h"
 #include "kw11-l.h"
 #include "log.h"
 #include "utils.h"
@@ -50,10 +51,17 @@ void kw11_l::show_state(console *const cnsl) const
 		cnsl->put_string_lf(format("Average tick interrupt interval: %.3f ms", double(t_diff_sum) / n_t_diff));
 }
 
-void kw11_l::begin(console *const cnsl)
+void kw11_l::begin(console *const cnsl, const bool own_thread)
 {
 	this->cnsl = cnsl;
 
+	prev_cycle_count          = b->getCpu()->get_instructions_executed_count();
+	interval_prev_cycle_count = prev_cycle_count;
+	prev_tick                 = get_ms();
+
+	if (!own_thread)
+		return;
+
 #if defined(ESP32) || defined(BUILD_FOR_RP2040)
 	xTaskCreate(&thread_wrapper_kw11, "kw11-l", 2048, this, 1, nullptr);
 
@@ -87,65 +95,74 @@ void kw11_l::operator()()
 {
 	set_thread_name("kek:kw-11l");
 
-	TRACE("Starting KW11-L thread");
-
-	uint64_t prev_cycle_count          = b->getCpu()->get_instructions_executed_count();
-	uint64_t interval_prev_cycle_count = prev_cycle_count;
-	auto     prev_tick                 = get_ms();
+	TRACE(tc_kw11, "Starting KW11-L thread");
 
 	while(!stop_flag) {
 		if (*cnsl->get_running_flag()) {
 			myusleep(1000000 / 100);  // 100 Hz
 
-			int cur_int_freq = 1;
+			poll();
+		}
+		else {
+			myusleep(1000000 / 10);  // 10 Hz
+		}
+	}
+
+	TRACE(tc_kw11, "KW11-L thread terminating");
+}
+
+void kw11_l::poll()
+{
+	if (*cnsl->get_running_flag() == false)
+		return;
+
+	int cur_int_freq = 1;
 
-			{
+	{
 #if defined(BUILD_FOR_RP2040)
-				xSemaphoreTake(lf_csr_lock, portMAX_DELAY);
+		xSemaphoreTake(lf_csr_lock, portMAX_DELAY);
 #else
-				std::unique_lock<std::mutex> lck(lf_csr_lock);
+		std::unique_lock<std::mutex> lck(lf_csr_lock);
 #endif
 
-				cur_int_freq = int_frequency;
+		cur_int_freq = int_frequency;
 
 #if defined(BUILD_FOR_RP2040)
-				xSemaphoreGive(lf_csr_lock);
+		xSemaphoreGive(lf_csr_lock);
 #endif
-			}
+	}
 
-			uint64_t current_cycle_count = b->getCpu()->get_instructions_executed_count();
-			uint32_t took_ms = b->getCpu()->get_effective_run_time(current_cycle_count - prev_cycle_count);
-			auto     now     = get_ms();
+	uint64_t current_cycle_count = b->getCpu()->get_instructions_executed_count();
+	uint32_t took_ms = b->getCpu()->get_effective_run_time(current_cycle_count - prev_cycle_count);
+	auto     now     = get_ms();
 
-			// - 50 Hz depending on instruction count ('cur_int_freq')
-			// - nothing executed in interval
-			// - 2 Hz minimum
-			auto t_diff = now - prev_tick;
-			if (took_ms >= 1000 / cur_int_freq || current_cycle_count - interval_prev_cycle_count == 0 || t_diff >= 500) {
-				do_interrupt();
+	// - 50 Hz depending on instruction count ('cur_int_freq')
+	// - nothing executed in interval
+	// - 2 Hz minimum
+	auto t_diff = now - prev_tick;
+	if (took_ms >= 1000 / cur_int_freq || current_cycle_count - interval_prev_cycle_count == 0 || t_diff >= 500) {
+		journal *j = b->getCpu()->get_journal();
 
-				prev_cycle_count = current_cycle_count;
+		if (j)
+			j->submit(JE_KW11_TICK, 0, 0);
+		else
+			do_interrupt();
 
-				t_diff_sum      += t_diff;
-				n_t_diff++;
+		prev_cycle_count = current_cycle_count;
 
-				prev_tick        = now;
-			}
+		t_diff_sum      += t_diff;
+		n_t_diff++;
 
-			interval_prev_cycle_count = current_cycle_count;
-		}
-		else {
-			myusleep(1000000 / 10);  // 10 Hz
-		}
+		prev_tick        = now;
 	}
 
-	TRACE("KW11-L thread terminating");
+	interval_prev_cycle_count = current_cycle_count;
 }
 
 uint16_t kw11_l::read_word(const uint16_t a)
 {
 	if (a != ADDR_LFC) {
-		TRACE("KW11-L read_word not for us (%06o)", a);
+		TRACE(tc_kw11, "KW11-L read_word not for us (%06o)", a);
 		return 0;
 	}
 
@@ -182,7 +199,7 @@ void kw11_l::set_interrupt_frequency(const int Hz)
 void kw11_l::write_byte(const uint16_t addr, const uint8_t value)
 {
 	if (addr != ADDR_LFC) {
-		TRACE("KW11-L write_byte not for us (%06o to %06o)", value, addr);
+		TRACE(tc_kw11, "KW11-L write_byte not for us (%06o to %06o)", value, addr);
 		return;
 	}
 
@@ -208,7 +225,7 @@ void kw11_l::write_byte(const uint16_t addr, const uint8_t value)
 void kw11_l::write_word(const uint16_t a, const uint16_t value)
 {
 	if (a != ADDR_LFC) {
-		TRACE("KW11-L write_word not for us (%06o to %06o)", value, a);
+		TRACE(tc_kw11, "KW11-L write_word not for us (%06o to %06o)", value, a);
 		return;
 	}
 
@@ -218,7 +235,7 @@ void kw11_l::write_word(const uint16_t a, const uint16_t value)
 	std::unique_lock<std::mutex> lck(lf_csr_lock);
 #endif
 
-	TRACE("WRITE-I/O set line frequency clock/status register: %06o", value);
+	TRACE(tc_kw11, "WRITE-I/O set line frequency clock/status register: %06o", value);
 	lf_csr = value;
 #if defined(BUILD_FOR_RP2040)
 	xSemaphoreGive(lf_csr_lock);
@@ -29,13 +29,16 @@ private:
 	int64_t            t_diff_sum { 0       };
 	uint64_t           n_t_diff   { 0       };
 
+	// state of poll()
+	uint64_t           prev_cycle_count          { 0 };
+	uint64_t           interval_prev_cycle_count { 0 };
+	unsigned long      prev_tick                 { 0 };
+
 	std::atomic_bool   stop_flag  { false   };
 
 	uint8_t  get_lf_crs();
 	void     set_lf_crs_b7();
 
-	void     do_interrupt();
-
 public:
 	kw11_l(bus *const b);
 	virtual ~kw11_l();
@@ -46,11 +49,17 @@ public:
 
 	void     set_interrupt_frequency(const int Hz);
 
+	// a tick: sets the monitor bit and interrupts when enabled
+	void     do_interrupt();
+
 	JsonDocument serialize();
 	static kw11_l *deserialize(const JsonVariantConst j, bus *const b, console *const cnsl);
 
-	void     begin(console *const cnsl);
+	// without 'own_thread' the owner invokes poll() every 10 ms
+	void     begin(console *const cnsl, const bool own_thread = true);
 	void     operator()();
+	// ticks when due, only while the console says the machine is running
+	void     poll();
 
 	uint16_t read_word(const uint16_t a) override;
 
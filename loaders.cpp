@@ -206,7 +206,7 @@ std::optional<uint16_t> load_tape(bus *const b, const std::string & file)
 		}
 
 #if !defined(ESP32)
-		TRACE("%ld] reading %d (dec) bytes to %o (oct)", ftell(fh), count - 6, p);
+		TRACE(tc_misc, "%ld] reading %d (dec) bytes to %o (oct)", ftell(fh), count - 6, p);
 #endif
 
 		for(int i=0; i<count - 6; i++) {
@@ -2,10 +2,16 @@
 // Released under MIT license
 
 #include "gen.h"
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <condition_variable>
 #include <fcntl.h>
+#include <mutex>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <thread>
 #include <time.h>
 #include <unistd.h>
 #if defined(_WIN32)
@@ -41,11 +47,48 @@ static int         lf_gid            = -1;
 static bool        l_timestamp       = true;
 static thread_local int   log_buffer_size = 128;
 static thread_local char *log_buffer = reinterpret_cast<char *>(malloc(log_buffer_size));
-bool               log_trace_enabled = false;
+static thread_local std::string log_context;  // e.g. which machine in a farm
+uint32_t           log_trace_mask    = 0;  // bit per trace_category_t
 #if defined(ESP32)
 static ntp        *ntp_clock         = nullptr;
 #endif
 static console    *log_cnsl          = nullptr;
+static std::atomic_uint64_t log_line_counts[none + 1] { };  // for the metrics
+
+#if IS_POSIX && !defined(ESP32) && !defined(BUILD_FOR_RP2040)
+#define LOG_ASYNC 1
+#endif
+
+#if defined(LOG_ASYNC)
+// The messages are formatted by the thread that logs them into a slot of a
+// bounded ring (multi-producer, single-consumer, lock-free). A writer
+// thread does the (slow) output to the file, syslog and the terminal.
+// When the ring is full, the message is dropped and counted (unless
+// tracing is enabled).
+constexpr const size_t log_ring_size      = 2048;  // must be a power of 2
+constexpr const size_t log_slot_text_size = 480;   // longer messages are truncated
+
+struct log_slot {
+	std::atomic_uint64_t seq;
+	uint64_t             ts;
+	log_level_t          ll;
+	char                 thread_name[16];
+	char                 text[log_slot_text_size];
+};
+
+static log_slot                log_ring[log_ring_size];
+static std::atomic_uint64_t    log_enqueue_pos { 0 };
+static std::atomic_uint64_t    log_dequeue_pos { 0 };  // only changed by the writer
+static std::atomic_uint64_t    log_dropped     { 0 };
+static uint64_t                log_dropped_reported { 0 };
+static std::once_flag          log_writer_started;
+static std::thread            *log_writer_th   { nullptr };
+static std::atomic_bool        log_writer_stop { false };
+static std::mutex              log_writer_lock;
+static std::condition_variable log_writer_cv;
+static std::recursive_mutex    log_fh_lock;  // the writer versus setlogfile/closelog
+static thread_local bool       log_is_writer   { false };
+#endif
 
 #if defined(ESP32)
 int gettid()
@@ -63,24 +106,104 @@ void set_clock_reference(ntp *const ntp_)
 
 void set_terminal(console *const cnsl)
 {
+	log_flush();
+
 	log_cnsl = cnsl;
 }
 
+static const char *const trace_category_names[tc_n_categories] = { "cpu", "mmu", "bus-io", "rk05", "rl02", "rp06", "tm11", "tty", "dc11", "kw11", "nbd", "interrupts", "disk", "misc" };
+
 void settrace(const bool on)
 {
-	log_trace_enabled = on;
+	log_trace_mask = on ? (1u << tc_n_categories) - 1 : 0;
 }
 
 bool gettrace()
 {
-	return log_trace_enabled;
+	return log_trace_mask != 0;
+}
+
+void set_trace_mask(const uint32_t mask)
+{
+	log_trace_mask = mask;
+}
+
+uint32_t get_trace_mask()
+{
+	return log_trace_mask;
+}
+
+// "rl02,rk05" selects these, "+mmu" or "-cpu" changes the current selection,
+// "all" and "none" do what they say
+bool parse_trace_categories(const std::string & in, uint32_t *const mask)
+{
+	uint32_t new_mask = *mask;
+	bool     first    = true;
+
+	for(auto & part: split(in, ",")) {
+		char        op   = part[0] == '+' || part[0] == '-' ? part[0] : 0;
+		std::string name = op ? part.substr(1) : part;
+
+		if (op == 0 && first)
+			new_mask = 0;
+		first = false;
+
+		uint32_t bits = 0;
+
+		if (name == "all")
+			bits = (1u << tc_n_categories) - 1;
+		else if (name != "none") {
+			for(int i=0; i<tc_n_categories; i++) {
+				if (name == trace_category_names[i])
+					bits = 1u << i;
+			}
+
+			if (bits == 0)
+				return false;
+		}
+
+		if (op == '-')
+			new_mask &= ~bits;
+		else
+			new_mask |= bits;
+	}
+
+	*mask = new_mask;
+
+	return true;
+}
+
+std::string get_trace_categories(const uint32_t mask)
+{
+	std::string out;
+
+	for(int i=0; i<tc_n_categories; i++) {
+		if (mask & (1u << i))
+			out += (out.empty() ? "" : ",") + std::string(trace_category_names[i]);
+	}
+
+	return out.empty() ? "none" : out;
+}
+
+void set_log_context(const std::string & context)
+{
+	log_context = context;
 }
 
 void setlogfile(const char *const lf, const log_level_t ll_file, const log_level_t ll_screen, const bool timestamp)
 {
-	if (log_fh)
+	log_flush();
+
+#if defined(LOG_ASYNC)
+	std::unique_lock<std::recursive_mutex> lck(log_fh_lock);
+#endif
+
+	if (log_fh) {
 		fclose(log_fh);
 
+		log_fh = nullptr;
+	}
+
 	free((void *)logfile);
 
 	is_file = true;
@@ -97,6 +220,8 @@ void setlogfile(const char *const lf, const log_level_t ll_file, const log_level
 
 bool setloghost(const char *const host, const log_level_t ll)
 {
+	log_flush();
+
 	syslog_ip_addr.sin_family = AF_INET;
 	bool ok = inet_pton(AF_INET, host, &syslog_ip_addr.sin_addr) == 1;
 	syslog_ip_addr.sin_port   = htons(514);
@@ -133,17 +258,27 @@ void send_syslog(const int ll, const std::string & what)
 	}
 }
 
-void closelog()
+uint64_t get_log_line_count(const log_level_t ll)
 {
-	if (log_fh) {
-		fclose(log_fh);
+	return log_line_counts[ll];
+}
 
-		log_fh = nullptr;
-	}
+uint64_t get_log_dropped_count()
+{
+#if defined(LOG_ASYNC)
+	return log_dropped;
+#else
+	return 0;
+#endif
 }
 
-void dolog(const log_level_t ll, const char *fmt, ...)
+// the actual output of a (formatted) message
+static void emit(const log_level_t ll, const uint64_t now, const char *const thread_name, const char *const text)
 {
+#if defined(LOG_ASYNC)
+	std::unique_lock<std::recursive_mutex> lck(log_fh_lock);
+#endif
+
 #if !defined(BUILD_FOR_RP2040)
 	if (!log_fh && logfile != nullptr) {
 #if !defined(ESP32)
@@ -160,31 +295,7 @@ void dolog(const log_level_t ll, const char *fmt, ...)
 #endif
 	}
 
-	for(;;) {
-		va_list ap;
-		va_start(ap, fmt);
-		int needed_length = vsnprintf(log_buffer, log_buffer_size, fmt, ap);
-		va_end(ap);
-
-		if (needed_length < log_buffer_size)
-			break;
-
-		log_buffer_size *= 2;
-		log_buffer = reinterpret_cast<char *>(realloc(log_buffer, log_buffer_size));
-	}
-
 	if (l_timestamp) {
-#if defined(ESP32)
-		uint64_t now   = 0;
-
-		if (ntp_clock) {
-			auto temp = ntp_clock->get_unix_epoch_us();
-			if (temp.has_value())
-				now = temp.value();
-		}
-#else
-		uint64_t now   = get_us();
-#endif
 		time_t   t_now = now / 1000000;
 
 		tm tm { };
@@ -200,41 +311,251 @@ void dolog(const log_level_t ll, const char *fmt, ...)
 
 		snprintf(ts_str, sizeof ts_str, "%04d-%02d-%02d %02d:%02d:%02d.%06d %s|%s] ",
 				tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, int(now % 1000000),
-				ll_names[ll], get_thread_name().c_str());
+				ll_names[ll], thread_name);
 
 		if (ll <= log_level_file && is_file == false)
-			send_syslog(ll, log_buffer);
+			send_syslog(ll, text);
 #if !defined(ESP32)
 		if (ll <= log_level_file && log_fh != nullptr)
-			fprintf(log_fh, "%s%s\n", ts_str, log_buffer);
+			fprintf(log_fh, "%s%s\n", ts_str, text);
 #endif
 
 		if (ll <= log_level_screen) {
 			if (log_cnsl) {
 				log_cnsl->put_string(ts_str);
-				log_cnsl->put_string_lf(log_buffer);
+				log_cnsl->put_string_lf(text);
 			}
 			else {
-				printf("%s%s\r\n", ts_str, log_buffer);
+				printf("%s%s\r\n", ts_str, text);
 			}
 		}
 	}
 	else {
 		if (ll <= log_level_file && is_file == false)
-			send_syslog(ll, log_buffer);
+			send_syslog(ll, text);
 #if !defined(ESP32)
 		if (ll <= log_level_file && log_fh != nullptr)
-			fprintf(log_fh, "%s\n", log_buffer);
+			fprintf(log_fh, "%s\n", text);
 #endif
 
 		if (ll <= log_level_screen) {
 			if (log_cnsl)
-				log_cnsl->put_string_lf(log_buffer);
+				log_cnsl->put_string_lf(text);
 			else
-				printf("%s\r\n", log_buffer);
+				printf("%s\r\n", text);
+		}
+	}
+#endif
+}
+
+#if defined(LOG_ASYNC)
+// returns false when there was nothing to do
+static bool log_writer_drain()
+{
+	bool any = false;
+
+	for(;;) {
+		uint64_t  pos  = log_dequeue_pos.load(std::memory_order_relaxed);
+		log_slot &slot = log_ring[pos & (log_ring_size - 1)];
+
+		if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+			break;
+
+		emit(slot.ll, slot.ts, slot.thread_name, slot.text);
+
+		slot.seq.store(pos + log_ring_size, std::memory_order_release);
+
+		log_dequeue_pos.store(pos + 1, std::memory_order_release);
+
+		any = true;
+	}
+
+	uint64_t dropped = log_dropped;
+	if (dropped != log_dropped_reported) {
+		std::string msg = format("%" PRIu64 " log messages dropped (log buffer full)", dropped - log_dropped_reported);
+		emit(warning, get_us(), "kek:log", msg.c_str());
+
+		log_dropped_reported = dropped;
+	}
+
+	return any;
+}
+
+static void log_writer()
+{
+	set_thread_name("kek:log");
+
+	log_is_writer = true;
+
+	while(!log_writer_stop) {
+		if (log_writer_drain() == false) {
+			std::unique_lock<std::mutex> lck(log_writer_lock);
+
+			// the producers do not take the lock: the timeout covers a missed notify
+			log_writer_cv.wait_for(lck, std::chrono::milliseconds(10));
+		}
+	}
+
+	log_writer_drain();
+}
+
+static void log_writer_start()
+{
+	for(size_t i=0; i<log_ring_size; i++)
+		log_ring[i].seq.store(i, std::memory_order_relaxed);
+
+	log_writer_th = new std::thread(log_writer);
+}
+#endif
+
+// wait until the messages logged so far are written
+void log_flush()
+{
+#if defined(LOG_ASYNC)
+	if (log_writer_th == nullptr || log_writer_th->get_id() == std::this_thread::get_id())
+		return;
+
+	uint64_t target = log_enqueue_pos;
+
+	while(log_dequeue_pos < target && !log_writer_stop) {
+		log_writer_cv.notify_one();
+		myusleep(1000);
+	}
+#endif
+}
+
+void closelog()
+{
+#if defined(LOG_ASYNC)
+	if (log_writer_th && log_writer_th->get_id() != std::this_thread::get_id()) {
+		log_writer_stop = true;
+		log_writer_cv.notify_one();
+
+		log_writer_th->join();
+		delete log_writer_th;
+		log_writer_th = nullptr;
+	}
+
+	std::unique_lock<std::recursive_mutex> lck(log_fh_lock);
+#endif
+
+	if (log_fh) {
+		fclose(log_fh);
+
+		log_fh = nullptr;
+	}
+}
+
+void dolog(const log_level_t ll, const char *fmt, ...)
+{
+	log_line_counts[ll].fetch_add(1, std::memory_order_relaxed);
+
+#if defined(LOG_ASYNC)
+	std::call_once(log_writer_started, log_writer_start);
+
+	if (log_writer_th && !log_writer_stop) {
+		uint64_t pos = log_enqueue_pos.load(std::memory_order_relaxed);
+		log_slot *slot = nullptr;
+
+		for(;;) {
+			slot = &log_ring[pos & (log_ring_size - 1)];
+
+			int64_t diff = int64_t(slot->seq.load(std::memory_order_acquire)) - int64_t(pos);
+
+			if (diff == 0) {
+				if (log_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0) {  // full
+				// a trace with holes is of no use: then wait for the writer
+				if (log_trace_mask == 0) {
+					log_dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+
+				// e.g. an error inside emit(): the writer cannot wait for itself, it writes directly
+				if (log_is_writer) {
+					slot = nullptr;
+					break;
+				}
+
+				log_writer_cv.notify_one();
+				std::this_thread::yield();
+
+				pos = log_enqueue_pos.load(std::memory_order_relaxed);
+			}
+			else {
+				pos = log_enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		if (slot) {
+			slot->ts = get_us();
+			slot->ll = ll;
+
+			if (l_timestamp) {
+				std::string name = get_thread_name();
+				snprintf(slot->thread_name, sizeof slot->thread_name, "%s", name.c_str());
+			}
+			else {
+				slot->thread_name[0] = 0x00;
+			}
+
+			size_t offset = 0;
+			if (log_context.empty() == false)
+				offset = std::min(size_t(snprintf(slot->text, log_slot_text_size, "%s: ", log_context.c_str())), log_slot_text_size - 1);
+
+			va_list ap;
+			va_start(ap, fmt);
+			(void)vsnprintf(slot->text + offset, log_slot_text_size - offset, fmt, ap);
+			va_end(ap);
+
+			slot->seq.store(pos + 1, std::memory_order_release);
+
+			log_writer_cv.notify_one();
+
+			return;
+		}
+	}
+#endif
+
+	for(;;) {
+		va_list ap;
+		va_start(ap, fmt);
+		int needed_length = vsnprintf(log_buffer, log_buffer_size, fmt, ap);
+		va_end(ap);
+
+		if (needed_length < log_buffer_size)
+			break;
+
+		log_buffer_size *= 2;
+		log_buffer = reinterpret_cast<char *>(realloc(log_buffer, log_buffer_size));
+	}
+
+	if (log_context.empty() == false) {
+		std::string temp = log_context + ": " + log_buffer;
+
+		if (temp.size() >= size_t(log_buffer_size)) {
+			log_buffer_size = temp.size() + 1;
+			log_buffer = reinterpret_cast<char *>(realloc(log_buffer, log_buffer_size));
 		}
+
+		memcpy(log_buffer, temp.c_str(), temp.size() + 1);
 	}
+
+#if defined(ESP32)
+	uint64_t now = 0;
+
+	if (ntp_clock) {
+		auto temp = ntp_clock->get_unix_epoch_us();
+		if (temp.has_value())
+			now = temp.value();
+	}
+#else
+	uint64_t now = get_us();
 #endif
+
+	emit(ll, now, l_timestamp ? get_thread_name().c_str() : "", log_buffer);
 }
 
 log_level_t parse_ll(const std::string & str)
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <string>
 
 #include "gen.h"
@@ -15,6 +16,9 @@ class console;
 
 typedef enum { ll_emerg = 0, ll_alert, ll_critical, ll_error, warning, notice, info, debug, none } log_level_t;  // TODO ll_ prefix
 
+// TRACE output is enabled per category; tc_cpu also selects the disassembly in the debugger
+typedef enum { tc_cpu = 0, tc_mmu, tc_bus_io, tc_rk05, tc_rl02, tc_rp06, tc_tm11, tc_tty, tc_dc11, tc_kw11, tc_nbd, tc_interrupts, tc_disk, tc_misc, tc_n_categories } trace_category_t;
+
 log_level_t parse_ll(const std::string & str);
 void setlogfile(const char *const lf, const log_level_t ll_file, const log_level_t ll_screen, const bool l_timestamp);
 bool setloghost(const char *const host, const log_level_t ll);
@@ -22,9 +26,17 @@ void setll(const log_level_t ll_screen, const log_level_t ll_file);
 void setloguid(const int uid, const int gid);
 void send_syslog(const int ll, const std::string & what);
 void closelog();
+void log_flush();
 void dolog(const log_level_t ll, const char *fmt, ...);
-void settrace(const bool on);
-bool gettrace();
+uint64_t get_log_line_count(const log_level_t ll);
+uint64_t get_log_dropped_count();
+void settrace(const bool on);  // all categories
+bool gettrace();  // any category
+void set_trace_mask(const uint32_t mask);
+uint32_t get_trace_mask();
+bool parse_trace_categories(const std::string & in, uint32_t *const mask);
+std::string get_trace_categories(const uint32_t mask);
+void set_log_context(const std::string & context);
 #if defined(ESP32)
 void set_clock_reference(ntp *const ntp_);
 #endif
@@ -50,12 +62,21 @@ void set_terminal(console *const cnsl);
 #endif
 #endif
 
+extern uint32_t log_trace_mask;
+
+#define TRACE_ENABLED(cat) (log_trace_mask & (1u << (cat)))
+
 #ifdef TURBO
-#define TRACE(fmt, ...) do { } while(0)
+#define TRACE(cat, fmt, ...) do { } while(0)
+#elif defined(ESP32)
+#define TRACE(cat, fmt, ...) do {		\
+	if (TRACE_ENABLED(cat)) {		\
+		dolog(debug, fmt, ##__VA_ARGS__);	\
+	}					\
+} while(0)
 #else
-#define TRACE(fmt, ...) do {			\
-	extern bool log_trace_enabled;		\
-	if (log_trace_enabled) {		\
+#define TRACE(cat, fmt, ...) do {		\
+	if (TRACE_ENABLED(cat)) [[unlikely]] {	\
 		dolog(debug, fmt, ##__VA_ARGS__);	\
 	}					\
 } while(0)
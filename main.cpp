@@ -1,9 +1,11 @@
 // (C) 2018-2024 by Folkert van Heusden
 // Released under MIT license
 
+#include <algorithm>
 #include <assert.h>
 #include <atomic>
 #include <cinttypes>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string>
@@ -18,20 +20,42 @@
 #include "console_ncurses.h"
 #endif
 #include "console_posix.h"
+#if !defined(_WIN32)
+#include "console_script.h"
+#endif
+#include "bic_runner.h"
 #include "cpu.h"
+#include "cpu_statistics.h"
+#include "cpu_validation.h"
 #include "debugger.h"
 #include "disk_backend.h"
+#include "disk_backend_compressed.h"
 #include "disk_backend_file.h"
+#include "disk_backend_cache.h"
+#include "disk_backend_mmap.h"
+#include "disk_backend_uring.h"
 #include "disk_backend_nbd.h"
+#include "disk_backend_ram.h"
 #include "dc11.h"
+#include "farm.h"
+#include "flight_recorder.h"
 #include "gen.h"
+#include "hle.h"
+#include "journal.h"
 #include "kw11-l.h"
 #include "loaders.h"
 #include "log.h"
 #include "memory.h"
+#include "metrics.h"
+#include "mmu.h"
+#include "profiler.h"
+#include "rk05.h"
+#include "rl02.h"
+#include "rp06.h"
 #if !defined(_WIN32)
 #include "terminal.h"
 #endif
+#include "trace_recorder.h"
 #include "tty.h"
 #include "utils.h"
 
@@ -42,7 +66,7 @@ std::atomic_bool *running      { nullptr };
 
 std::atomic_bool  sigw_event   { false };
 
-constexpr const uint16_t validation_psw_mask = 0174037;  // ignore unused bits & priority(!)
+cpu              *crash_cpu    { nullptr };
 
 #if !defined(_WIN32)
 void sw_handler(int s)
@@ -56,249 +80,141 @@ void sw_handler(int s)
 	}
 }
 
-int run_cpu_validation(const std::string & filename)
+void crash_handler(int s)
 {
-#if 0
-	json_error_t error;
-	json_t *json = json_load_file(filename.c_str(), JSON_REJECT_DUPLICATES, &error);
-	if (!json)
-		error_exit(false, "%s", error.text);
-
-	size_t n_ok = 0;
-	size_t array_size = json_array_size(json);
-	for(size_t i=0; i<array_size; i++) {
-		json_t *test = json_array_get(json, i);
-
-		// create environment
-		event = 0;
-		bus *b = new bus();
-		b->set_memory_size(DEFAULT_N_PAGES * 8192l);
-		cpu *c = new cpu(b, &event);
-		b->add_cpu(c);
+	int fd = open(flight_recorder_file, O_WRONLY | O_APPEND | O_CREAT, 0644);
 
-		uint16_t start_pc = 0;
+	if (fd != -1) {
+		crash_cpu->get_flight_recorder()->dump_to_fd(fd, s == SIGSEGV ? "SIGSEGV" : (s == SIGBUS ? "SIGBUS" : "SIGABRT"));
+		close(fd);
+	}
 
-		{
-			// initialize
-			json_t *memory_before = json_object_get(test, "memory-before");
-			const char *key   = nullptr;
-			json_t     *value = nullptr;
-			json_object_foreach(memory_before, key, value) {
-				b->write_physical(atoi(key), json_integer_value(value));
-			}
-		}
+	raise(s);  // SA_RESETHAND: the default action (core dump) follows
+}
+#endif
 
-		json_t *const registers_before = json_object_get(test, "registers-before");
+void add_metrics_collectors(metrics_server *const ms, bus *const b)
+{
+	cpu *c = b->getCpu();
 
-		{
-			const char *key   = nullptr;
-			json_t     *value = nullptr;
-			json_t *set0 = json_object_get(registers_before, "0");
-			json_object_foreach(set0, key, value) {
-				c->lowlevel_register_set(0, atoi(key), json_integer_value(value));
-			}
-			json_t *set1 = json_object_get(registers_before, "1");
-			json_object_foreach(set1, key, value) {
-				c->lowlevel_register_set(1, atoi(key), json_integer_value(value));
-			}
-		}
-		{
-			json_t *psw_reg = json_object_get(registers_before, "psw");
-			assert(psw_reg);
-			c->lowlevel_psw_set(json_integer_value(psw_reg));
-		}
-		{
-			json_t *b_pc = json_object_get(registers_before, "pc");
-			assert(b_pc);
-			start_pc = json_integer_value(b_pc);
-			c->setPC(start_pc);
-		}
-		{
-			json_t *b_sp = json_object_get(registers_before, "sp");
-			size_t sp_array_size = json_array_size(b_sp);
-			assert(sp_array_size == 4);
-			for(size_t i=0; i<sp_array_size; i++) {
-				json_t *temp = json_array_get(b_sp, i);
-				c->lowlevel_register_sp_set(i, json_integer_value(temp));
-			}
-		}
+	// MIPS since the previous scrape
+	uint64_t previous_instruction_count = c->get_instructions_executed_count();
+	uint64_t previous_ts                = get_us();
+	uint64_t previous_idle_time         = c->get_wait_time();
 
-		{
-			json_t *a_mmr0 = json_object_get(test, "mmr0-before");
-			assert(a_mmr0);
-			b->getMMU()->setMMR0(json_integer_value(a_mmr0));
-		}
+	ms->add_collector([=](metrics_writer *const w) mutable {
+		uint64_t ts                        = get_us();
+		uint64_t idle_time                 = c->get_wait_time();
+		uint64_t current_instruction_count = c->get_instructions_executed_count();
+		uint64_t current_idle_duration     = idle_time - previous_idle_time;
 
-		disassemble(c, nullptr, start_pc, false);
-		auto disas_data = c->disassemble(start_pc);
-		c->step();
-
-		uint16_t new_pc = c->getPC();
-
-		// validate
-		{
-			bool err = false;
-			{
-				json_t *memory_after = json_object_get(test, "memory-after");
-				const char *key   = nullptr;
-				json_t     *value = nullptr;
-				json_object_foreach(memory_after, key, value) {
-					int      key_v        = atoi(key);
-					uint16_t mem_contains = b->read_physical(key_v);
-					uint16_t should_be    = json_integer_value(value);
-
-					if (mem_contains != should_be) {
-						DOLOG(warning, true, "memory address %06o (%d) mismatch (is: %06o (%d), should be: %06o (%d))", key_v, key_v, mem_contains, mem_contains, should_be, should_be);
-						err = true;
-					}
-				}
-			}
+		auto stats = c->get_mips_rel_speed(current_instruction_count - previous_instruction_count, std::max(ts - previous_ts - current_idle_duration, uint64_t(1)));
 
-			uint16_t psw = c->getPSW();
+		previous_idle_time         = idle_time;
+		previous_instruction_count = current_instruction_count;
+		previous_ts                = ts;
 
-			json_t *const registers_after = json_object_get(test, "registers-after");
-			{
-				int set_nr = (psw >> 11) & 1;
-				char set[] = { char('0' + set_nr), 0x00 };
+		w->add_counter("kek_cpu_instructions_total",    "Instructions executed", { }, current_instruction_count);
+		w->add_counter("kek_cpu_idle_microseconds_total", "Time spent in WAIT", { }, idle_time);
+		w->add_gauge  ("kek_cpu_mips",                  "Million instructions per second (not idle) since the previous scrape", { }, std::get<0>(stats));
+		w->add_gauge  ("kek_cpu_relative_speed_percent", "Speed relative to a real PDP-11/70 since the previous scrape", { }, std::get<1>(stats));
 
-				json_t *a_set = json_object_get(registers_after, set);
-				const char *key   = nullptr;
-				json_t     *value = nullptr;
-				json_object_foreach(a_set, key, value) {
-					uint16_t register_is = c->lowlevel_register_get(set_nr, atoi(key));
-					uint16_t should_be   = json_integer_value(value);
+		cpu_statistics *cs = c->get_statistics();
+		if (cs) {
+			for(auto & e: cs->get_run_modes())
+				w->add_counter("kek_cpu_run_mode_instructions_total", "Instructions executed per run mode", { { "mode", e.first } }, e.second);
 
-					if (register_is != should_be) {
-						DOLOG(warning, true, "set %d register %s mismatch (is: %06o (%d), should be: %06o (%d))", set_nr, key, register_is, register_is, should_be, should_be);
-						err = true;
-					}
-				}
-			}
+			for(auto & e: cs->get_opcode_classes())
+				w->add_counter("kek_cpu_opcode_class_total", "Instructions executed per opcode class", { { "class", e.first } }, e.second);
 
-			{
-				json_t *a_pc = json_object_get(registers_after, "pc");
-				assert(a_pc);
-				uint16_t should_be_pc = json_integer_value(a_pc);
-				if (new_pc != should_be_pc) {
-					DOLOG(warning, true, "PC register mismatch (is: %06o (%d), should be: %06o (%d))", new_pc, new_pc, should_be_pc, should_be_pc);
-					err = true;
-				}
-			}
+			for(auto & e: cs->get_addressing_modes())
+				w->add_counter("kek_cpu_addressing_mode_total", "Operands per addressing mode", { { "mode", e.first } }, e.second);
 
-			{
-				json_t *a_sp = json_object_get(registers_after, "sp");
-				size_t sp_array_size = json_array_size(a_sp);
-				assert(sp_array_size == 4);
-				for(size_t i=0; i<sp_array_size; i++) {
-					json_t *temp = json_array_get(a_sp, i);
-					uint16_t sp = c->lowlevel_register_sp_get(i);
-					if (json_integer_value(temp) != sp) {
-						DOLOG(warning, true, "SP[%d] register mismatch (is: %06o (%d), should be: %06o (%d)) for %06o", i, sp, sp, json_integer_value(temp), json_integer_value(temp), b->read_physical(start_pc));
-						err = true;
-					}
-				}
-			}
+			for(auto & e: cs->get_traps())
+				w->add_counter("kek_cpu_traps_total", "Traps per vector", { { "vector", format("%03o", e.first) } }, e.second);
 
-			{
-				json_t *a_psw = json_object_get(registers_after, "psw");
-				assert(a_psw);
-				uint16_t should_be_psw = json_integer_value(a_psw);
-				if ((should_be_psw & validation_psw_mask) != (psw & validation_psw_mask)) {
-					DOLOG(warning, true, "PSW register mismatch (is: %06o (%d), w/m %06o, should be: %06o (%d), w/m %06o)", psw, psw, psw & validation_psw_mask, should_be_psw, should_be_psw, should_be_psw & validation_psw_mask);
-					err = true;
-				}
-			}
+			for(auto & e: cs->get_interrupts())
+				w->add_counter("kek_cpu_interrupts_total", "Interrupts per IPL and vector", { { "ipl", format("%d", e.first.first) }, { "vector", format("%03o", e.first.second) } }, e.second);
+		}
 
-			for(int r=0; r<4; r++) {
-				json_t *a_mmr = json_object_get(test, format("mmr%d-after", r).c_str());
-				assert(a_mmr);
-				uint16_t should_be_mmr = json_integer_value(a_mmr);
-				uint16_t is_mmr = b->getMMU()->getMMR(r);
-				if (should_be_mmr != is_mmr) {
-					int is_d1 = is_mmr >> 11;
-					if (is_d1 & 16)
-						is_d1 = -(32 - is_d1);
-					int is_r1 = (is_mmr >> 8) & 7;
-					int is_d2 = (is_mmr >> 3) & 31;
-					if (is_d2 & 16)
-						is_d2 = -(32 - is_d2);
-					int is_r2 = is_mmr & 7;
-
-					int sb_d1 = should_be_mmr >> 11;
-					if (sb_d1 & 16)
-						sb_d1 = -(32 - sb_d1);
-					int sb_r1 = (should_be_mmr >> 8) & 7;
-					int sb_d2 = (should_be_mmr >> 3) & 31;
-					if (sb_d2 & 16)
-						sb_d2 = -(32 - sb_d2);
-					int sb_r2 = should_be_mmr & 7;
-					DOLOG(warning, true, "MMR%d register mismatch (is: %06o (%d / %02d,%02d - %02d,%02d), should be: %06o (%d / %02d,%02d - %02d,%02d))%s %s", r, is_mmr, is_mmr, is_d1, is_r1, is_d2, is_r2, should_be_mmr, should_be_mmr, sb_d1, sb_r1, sb_d2, sb_r2, c->is_it_a_trap() ? " TRAP": "", disas_data["instruction-text"].at(0).c_str());
-					err = true;
-				}
-			}
+		mmu *m = b->getMMU();
+		w->add_counter("kek_mmu_translations_total", "Virtual to physical address translations with the MMU enabled", { }, m->get_translation_count());
+		w->add_counter("kek_mmu_aborts_total",       "Memory management aborts and traps", { }, m->get_abort_count());
+	});
 
-			if (err) {
-				if (c->is_it_a_trap())
-					DOLOG(warning, true, "Error by TRAP %s", disas_data["instruction-text"].at(0).c_str());
-				else {
-					DOLOG(warning, true, "Error by instruction %s", disas_data["instruction-text"].at(0).c_str());
-				}
+	ms->add_collector([b](metrics_writer *const w) {
+		std::vector<std::pair<std::string, disk_device *> > devices { { "rk05", b->getRK05() }, { "rl02", b->getRL02() }, { "rp06", b->getRP06() } };
+		const char *const directions[] { "read", "write" };
 
-				char *js = json_dumps(test, 0);
-				DOLOG(warning, true, "%s\n", js);  // also emit empty line(!)
-				free(js);
-			}
-			else {
-				DOLOG(info, true, "\n");  // \n!
-				n_ok++;
-			}
-		}
+		std::vector<double> bounds;
+		for(auto & bound: disk_latency_bounds_us)
+			bounds.push_back(bound / 1000000.);
 
-		// clean-up
-		delete b;
-	}
+		for(auto & device: devices) {
+			if (!device.second)
+				continue;
 
-	json_decref(json);
+			auto backends = device.second->access_disk_backends();
 
-	printf("# ok: %zu out of %zu\n", n_ok, array_size);
-#endif
+			for(size_t unit=0; unit<backends->size(); unit++) {
+				const disk_io_statistics_t & st = backends->at(unit)->get_io_statistics();
 
-	return 0;
-}
-#endif
+				for(int d=0; d<2; d++) {
+					metrics_writer::labels_t labels { { "controller", device.first }, { "unit", format("%zu", unit) }, { "backend", backends->at(unit)->get_identifier() }, { "direction", directions[d] } };
 
-void get_metrics(cpu *const c)
-{
-	set_thread_name("kek:metrics");
+					w->add_counter("kek_disk_transfers_total", "Disk transfers",         labels, st.n_transfers[d]);
+					w->add_counter("kek_disk_bytes_total",     "Bytes transferred",      labels, st.n_bytes[d]);
+					w->add_counter("kek_disk_errors_total",    "Failed disk transfers",  labels, st.n_errors[d]);
 
-	uint64_t previous_instruction_count = c->get_instructions_executed_count();
-	uint64_t previous_ts                = get_us();
-	uint64_t previous_idle_time         = c->get_wait_time();
+					std::vector<uint64_t> counts;
+					for(auto & count: st.latency[d])
+						counts.push_back(count);
 
-	while(event != EVENT_TERMINATE) {
-		sleep(1);
+					w->add_histogram("kek_disk_latency_seconds", "Time taken by the backend per transfer", labels, bounds, counts, st.latency_sum_us[d] / 1000000.);
+				}
 
-		uint64_t ts        = get_us();
-		uint64_t idle_time = c->get_wait_time();
-		uint64_t current_instruction_count = c->get_instructions_executed_count();
+				const disk_cache_statistics_t *cs = backends->at(unit)->get_cache_statistics();
+				if (cs) {
+					metrics_writer::labels_t labels { { "controller", device.first }, { "unit", format("%zu", unit) }, { "backend", backends->at(unit)->get_identifier() } };
 
-		uint64_t current_idle_duration = idle_time - previous_idle_time;
+					w->add_counter("kek_disk_cache_hits_total",        "Blocks found in the disk cache",         labels, cs->n_hits);
+					w->add_counter("kek_disk_cache_misses_total",      "Blocks read from the backend",           labels, cs->n_misses);
+					w->add_counter("kek_disk_cache_read_ahead_total",  "Blocks read ahead on sequential access", labels, cs->n_read_ahead);
+					w->add_counter("kek_disk_cache_write_backs_total", "Dirty blocks written to the backend",    labels, cs->n_write_backs);
+				}
 
-		auto stats = c->get_mips_rel_speed(current_instruction_count - previous_instruction_count, ts - previous_ts - current_idle_duration);
+				auto n_dirty = backends->at(unit)->get_n_dirty_sectors();
+				if (n_dirty.has_value())
+					w->add_gauge("kek_disk_dirty_sectors", "Changed sectors not yet written to the file", { { "controller", device.first }, { "unit", format("%zu", unit) }, { "backend", backends->at(unit)->get_identifier() } }, n_dirty.value());
+			}
+		}
 
-		FILE *fh = fopen("kek-metrics.csv", "a+");
-		if (fh) {
-			fseek(fh, 0, SEEK_END);
-			if (ftell(fh) == 0)
-				fprintf(fh, "timestamp,MIPS,relative speed in %%,instructions executed count,idle time\n");
-			fprintf(fh, "%.06f, %.2f, %.2f%%, %" PRIu64 ", %.3f\n", ts / 1000., std::get<0>(stats), std::get<1>(stats), std::get<2>(stats), current_idle_duration / 1000000.);
-			fclose(fh);
+		tty *t = b->getTty();
+		if (t) {
+			w->add_counter("kek_tty_bytes_total", "Console bytes", { { "direction", "in"  } }, t->get_bytes_in());
+			w->add_counter("kek_tty_bytes_total", "Console bytes", { { "direction", "out" } }, t->get_bytes_out());
+			w->add_gauge  ("kek_tty_queue_depth", "Console input waiting to be read by the emulated system", { }, t->get_queue_depth());
 		}
 
-		previous_idle_time         = idle_time;
-		previous_instruction_count = current_instruction_count;
-		previous_ts                = ts;
-	}
+		dc11 *d = b->getDC11();
+		if (d) {
+			for(int line=0; line<dc11_n_lines; line++) {
+				std::string line_nr = format("%d", line);
+
+				w->add_counter("kek_dc11_bytes_total", "DC-11 bytes", { { "line", line_nr }, { "direction", "in"  } }, d->get_bytes_in(line));
+				w->add_counter("kek_dc11_bytes_total", "DC-11 bytes", { { "line", line_nr }, { "direction", "out" } }, d->get_bytes_out(line));
+				w->add_gauge  ("kek_dc11_queue_depth", "DC-11 input waiting to be read by the emulated system", { { "line", line_nr } }, d->get_queue_depth(line));
+			}
+		}
+
+		const std::pair<log_level_t, const char *> levels[] { { ll_emerg, "emergency" }, { ll_alert, "alert" }, { ll_critical, "critical" }, { ll_error, "error" },
+			{ warning, "warning" }, { notice, "notice" }, { info, "info" }, { debug, "debug" } };
+
+		for(auto & level: levels)
+			w->add_counter("kek_log_lines_total", "Lines logged per level", { { "level", level.second } }, get_log_line_count(level.first));
+
+		w->add_counter("kek_log_dropped_total", "Log messages dropped because the log buffer was full", { }, get_log_dropped_count());
+	});
 }
 
 void start_disk_devices(const std::vector<disk_backend *> & backends, const bool enable_snapshots)
@@ -314,10 +230,21 @@ void help()
 	printf("-h       this help\n");
 	printf("-D x     deserialize state from file\n");
 	printf("-P       when serializing state to file (in the debugger), include an overlay: changes to disk-files are then non-persistent, they only exist in the state-dump\n");
+	printf("-O d     like -P, but the changes are kept in an overlay file per disk in directory d; state dumps refer to these files\n");
 	printf("-T t.bin load file as a binary tape file (like simh \"load\" command), also for .BIC files\n");
 	printf("-B       run tape file as a unit test (for .BIC files)\n");
+	printf("-U n[,t[,r]]  run all tape files given with -T (which can be repeated) as diagnostics, concurrently (one per core): each must print \"END PASS\" n times\n");
+	printf("              within t seconds (default: 60) without reporting an error or halting, write the results as JSON to r\n");
 	printf("-r d.img load file as a disk device\n");
-	printf("-N host:port  use NBD-server as disk device (like -r)\n");
+	printf("         an image made with kek-mkcimg is read-only: writes go to the overlay (see -P, -O)\n");
+	printf("-m x     map the disk files of the -r options that follow into memory; x selects when changes are synced\n");
+	printf("         to the file: idle (no writes for 0.5s), periodic[,seconds] (default 5) or shutdown\n");
+	printf("-W x     load the disk files of the -r options that follow into memory; changes are written back to the file\n");
+	printf("         every x seconds (0: only at exit and when the state is dumped)\n");
+	printf("-q n     the disk files of the -r options that follow do asynchronous I/O (io_uring) with up to n requests in flight\n");
+	printf("         the NBD disks of the -N options that follow are then accessed by a thread of their own\n");
+	printf("-N host:port[:n]  use NBD-server as disk device (like -r), over n connections (default 1)\n");
+	printf("-c x[,y] cache the disks of the -r and -N options that follow in memory, x kB per disk (each has its own cache), y is the write mode: through (default) or back\n");
 	printf("-R x     select disk type (rk05, rl02 or rp06)\n");
 	printf("-p 123   set CPU start pointer to decimal(!) value\n");
 	printf("-b       enable bootloader (builtin)\n");
@@ -326,12 +253,23 @@ void help()
 	printf("-S x     set ram size (in number of 8 kB pages)\n");
 	printf("-s x,y   set console switche state: set bit x (0...15) to y (0/1)\n");
 	printf("-t       enable tracing (disassemble to stderr, requires -d as well)\n");
+	printf("-K x     trace only categories x (comma separated): cpu, mmu, bus-io, rk05, rl02, rp06, tm11, tty,\n");
+	printf("         dc11, kw11, nbd, interrupts, disk, misc\n");
 	printf("-l x     log to file x\n");
 	printf("-L x,y   set log level for screen (x) and file (y)\n");
 	printf("-X       do not include timestamp in logging\n");
-	printf("-J x     run validation suite x against the CPU emulation\n");
-	printf("-M       log metrics\n");
+	printf("-J x[,y] run validation suite x against the CPU emulation (on all cores), write failing tests to y (default: x.failures.json)\n");
+	printf("-M x     serve metrics (Prometheus text format) on TCP port x of localhost, or on Unix domain socket x when it contains a '/'\n");
+	printf("-A       count instructions per opcode class, addressing modes, traps and interrupts (see 'stats' in the debugger and -M)\n");
 	printf("-1 x     use x as device for DC-11\n");
+	printf("-E x[,y[,z]]  drive the console with script x (expect/send/mark/timeout/sleep), write the timings as JSON to y (default: stdout), console output to z\n");
+	printf("-Y x     record a compact binary execution trace to file x (decode it with kek-trace)\n");
+	printf("-g x[,n[,i]]  sample the PC every i (default: %u) instructions, resolve with the namelist (a.out, e.g. /unix) n, write x.flat, x.folded and x.hist\n", profiler_default_interval);
+	printf("-j x,f   record (x = record) the asynchronous input (clock ticks, console and DC-11 input) with the instruction count at which it arrived in\n");
+	printf("         file f, or play it back (x = replay) at exactly the same instruction counts as fast as possible. use -P to not change the disk images (not with -q)\n");
+	printf("-H       enable high-level emulation of hot UNIX kernel routines (copyseg, clearseg, bcopy, getc, putc)\n");
+	printf("-F n[,w[,s]]  farm: run n copies of the configured machine on w worker threads (default: one per core), s instructions per time slice\n");
+	printf("              the console output of each machine goes to kek-farm-<nr>.txt, the DC-11 of machine nr listens on port 1100 + 4 * nr\n");
 }
 
 int main(int argc, char *argv[])
@@ -339,6 +277,16 @@ int main(int argc, char *argv[])
 	//setlocale(LC_ALL, "");
 
 	std::vector<disk_backend *> disk_files;
+	std::optional<std::pair<disk_backend_mmap::sync_mode_t, int> > mmap_sync;
+	std::optional<int> ram_flush_interval;
+	unsigned     queue_depth = 0;
+	std::optional<std::pair<size_t, disk_backend_cache::write_mode_t> > cache_settings;
+	auto add_disk_file = [&disk_files, &cache_settings](disk_backend *const d) {
+		if (cache_settings.has_value())
+			disk_files.push_back(new disk_backend_cache(d, cache_settings.value().first, cache_settings.value().second));
+		else
+			disk_files.push_back(d);
+	};
 	std::string  disk_type = "rk05";
 
 	bool run_debugger = false;
@@ -357,24 +305,48 @@ int main(int argc, char *argv[])
 	std::string  tape;
 	bool         is_bic    = false;
 
+	std::optional<bic_batch_settings_t> bic_batch;
+	std::vector<std::string> tapes;
+
 	uint16_t     console_switches = 0;
 
 	std::string  test;
 
 	bool         disk_snapshots = false;
+	std::optional<std::string> overlay_dir;
 
 	std::optional<int> set_ram_size;
 
 	std::string  validate_json;
+	std::string  validation_report;
 
-	bool         metrics = false;
+	std::string  metrics_listen_on;
 
 	std::string  deserialize;
 
 	std::optional<std::string> dc11_device;
 
+	std::optional<farm_settings_t> farm_mode;
+
+	std::string  script_file;
+	std::string  script_results;
+	std::string  script_transcript;
+
+	bool         enable_hle = false;
+
+	bool         enable_statistics = false;
+
+	std::string  binary_trace;
+
+	std::string  profile_prefix;
+	std::string  profile_namelist;
+	uint32_t     profile_interval = profiler_default_interval;
+
+	std::string  journal_file;
+	bool         journal_replay = false;
+
 	int  opt          = -1;
-	while((opt = getopt(argc, argv, "hD:MT:Br:R:p:ndtL:bl:s:Q:N:J:XS:P1:")) != -1)
+	while((opt = getopt(argc, argv, "hD:M:T:Br:m:W:q:c:O:R:p:ndtK:L:bl:s:Q:N:J:XS:P1:F:HE:U:Y:j:g:A")) != -1)
 	{
 		switch(opt) {
 			case 'h':
@@ -389,16 +361,89 @@ int main(int argc, char *argv[])
 				deserialize = optarg;
 				break;
 
+			case 'F': {
+					auto parts = split(optarg, ",");
+
+					auto n_machines = parse_number(parts.at(0));
+					auto n_workers  = parts.size() >= 2 ? parse_number(parts.at(1)) : 0l;
+					auto slice      = parts.size() >= 3 ? parse_number(parts.at(2)) : 10000l;
+
+					if (n_machines.value_or(0) <= 0 || n_workers.value_or(-1) < 0 || slice.value_or(0) <= 0)
+						error_exit(false, "-F: expecting n[,w[,s]]");
+
+					farm_settings_t fs { };
+					fs.n_machines         = n_machines.value();
+					fs.n_workers          = n_workers.value();
+					fs.slice_instructions = slice.value();
+					fs.dc11_port_base     = 1100;
+
+					farm_mode = fs;
+				  }
+				break;
+
 			case 'M':
-				metrics = true;
+				metrics_listen_on = optarg;
+				break;
+
+			case 'E': {
+					auto parts = split(optarg, ",");
+					script_file       = parts.at(0);
+					script_results    = parts.size() >= 2 ? parts.at(1) : "";
+					script_transcript = parts.size() >= 3 ? parts.at(2) : "";
+				}
+				break;
+
+			case 'H':
+				enable_hle = true;
+				break;
+
+			case 'A':
+				enable_statistics = true;
+				break;
+
+			case 'Y':
+				binary_trace = optarg;
+				break;
+
+			case 'g': {
+					auto parts = split(optarg, ",");
+
+					profile_prefix = parts.at(0);
+
+					if (parts.size() >= 2)
+						profile_namelist = parts.at(1);
+
+					if (parts.size() >= 3)
+						profile_interval = std::max(parse_number(parts.at(2)).value_or(0), 0l);
+
+					if (profile_prefix.empty() || profile_interval == 0)
+						error_exit(false, "-g: expecting prefix[,namelist[,interval]]");
+				  }
+				break;
+
+			case 'j': {
+					auto parts = split(optarg, ",");
+
+					if (parts.size() != 2 || (parts.at(0) != "record" && parts.at(0) != "replay"))
+						error_exit(false, "-j: expecting record,file or replay,file");
+
+					journal_replay = parts.at(0) == "replay";
+					journal_file   = parts.at(1);
+				  }
 				break;
 
 			case 'X':
 				timestamp = false;
 				break;
 
-			case 'J':
-				validate_json = optarg;
+			case 'J': {
+					auto parts = split(optarg, ",");
+					validate_json = parts[0];
+					if (parts.size() == 2)
+						validation_report = parts[1];
+					else
+						validation_report = validate_json + ".failures.json";
+				}
 				break;
 
 			case 'Q':
@@ -430,18 +475,45 @@ int main(int argc, char *argv[])
 				settrace(true);
 				break;
 
+			case 'K': {
+				uint32_t mask = get_trace_mask();
+				if (!parse_trace_categories(optarg, &mask))
+					error_exit(false, "-K: unknown trace category in \"%s\"", optarg);
+				set_trace_mask(mask);
+				break;
+			}
+
 			case 'n':
 				withUI = true;
 				break;
 
 			case 'T':
 				tape = optarg;
+				tapes.push_back(optarg);
 				break;
 
 			case 'B':
 				is_bic = true;
 				break;
 
+			case 'U': {
+					auto parts = split(optarg, ",");
+
+					auto n_passes  = parse_number(parts.at(0));
+					auto timeout_s = parts.size() >= 2 ? parse_number(parts.at(1)) : 60l;
+
+					if (n_passes.value_or(0) <= 0 || timeout_s.value_or(0) <= 0)
+						error_exit(false, "-U: expecting passes[,timeout[,report]] (passes and timeout greater than 0)");
+
+					bic_batch_settings_t bs { };
+					bs.n_passes    = n_passes.value();
+					bs.timeout_s   = timeout_s.value();
+					bs.report_file = parts.size() >= 3 ? parts.at(2) : "";
+
+					bic_batch = bs;
+				  }
+				break;
+
 			case 'R':
 				disk_type = optarg;
 				if (disk_type != "rk05" && disk_type != "rl02" && disk_type != "rp06")
@@ -449,15 +521,56 @@ int main(int argc, char *argv[])
 				break;
 
 			case 'r':
-				disk_files.push_back(new disk_backend_file(optarg));
+				if (disk_backend_compressed::is_compressed_image(optarg))
+					add_disk_file(new disk_backend_compressed(optarg));
+				else if (ram_flush_interval.has_value())
+					add_disk_file(new disk_backend_ram(optarg, ram_flush_interval.value()));
+				else if (mmap_sync.has_value())
+					add_disk_file(new disk_backend_mmap(optarg, mmap_sync.value().first, mmap_sync.value().second));
+				else if (queue_depth > 0)
+					add_disk_file(new disk_backend_uring(optarg, queue_depth));
+				else
+					add_disk_file(new disk_backend_file(optarg));
+				break;
+
+			case 'c':
+				cache_settings = disk_backend_cache::parse_settings(optarg);
+				if (cache_settings.has_value() == false)
+					error_exit(false, "-c: expecting a size in kB, optionally followed by \",through\" or \",back\"");
+				break;
+
+			case 'm':
+				mmap_sync = disk_backend_mmap::parse_sync_mode(optarg);
+				if (mmap_sync.has_value() == false)
+					error_exit(false, "-m: expecting idle, periodic[,seconds] or shutdown");
+				break;
+
+			case 'W':
+				ram_flush_interval = parse_number(optarg).value_or(-1);
+				if (ram_flush_interval.value() < 0)
+					error_exit(false, "-W: interval must be 0 or more seconds");
+				break;
+
+			case 'q':
+				queue_depth = std::clamp(parse_number(optarg).value_or(0), 0l, 4097l);
+				if (queue_depth < 1 || queue_depth > 4096)
+					error_exit(false, "-q: queue depth must be between 1 and 4096");
 				break;
 
 			case 'N': {
 					  auto parts = split(optarg, ":");
-					  if (parts.size() != 2)
+					  if (parts.size() != 2 && parts.size() != 3)
 						  error_exit(false, "-N: parameter missing");
 
-					  disk_files.push_back(new disk_backend_nbd(parts.at(0), std::stoi(parts.at(1))));
+					  auto port = parse_number(parts.at(1));
+					  if (port.value_or(0) < 1 || port.value() > 65535)
+						  error_exit(false, "-N: expecting host:port[:connections]");
+
+					  long n_connections = parts.size() == 3 ? parse_number(parts.at(2)).value_or(0) : 1;
+					  if (n_connections < 1 || n_connections > 16)
+						  error_exit(false, "-N: number of connections must be between 1 and 16");
+
+					  add_disk_file(new disk_backend_nbd(parts.at(0), port.value(), n_connections, queue_depth > 0));
 				  }
 				  break;
 
@@ -482,7 +595,14 @@ int main(int argc, char *argv[])
 				break;
 
 			case 'S':
-				set_ram_size = std::stoi(optarg);
+				set_ram_size = parse_number(optarg).value_or(0);
+				if (set_ram_size.value() <= 0)
+					error_exit(false, "-S: expecting a number of 8 kB pages");
+				break;
+
+			case 'O':
+				overlay_dir    = optarg;
+				disk_snapshots = true;
 				break;
 
 			case 'P':
@@ -495,25 +615,105 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	// the completions of asynchronous transfers are not in the journal
+	if (journal_file.empty() == false && queue_depth > 0)
+		error_exit(false, "-j cannot be combined with -q");
+
 	console *cnsl = nullptr;
 
 	setlogfile(logfile, ll_file, ll_screen, timestamp);
 
 #if !defined(_WIN32)
 	if (validate_json.empty() == false)
-		return run_cpu_validation(validate_json);
+		return run_cpu_validation(validate_json, validation_report);
 #endif
 
 	DOLOG(info, true, "PDP11 emulator, by Folkert van Heusden");
 
 	DOLOG(info, true, "Built on: " __DATE__ " " __TIME__);
 
+	if (bic_batch.has_value()) {
+		bic_batch_settings_t & bs = bic_batch.value();
+		bs.files            = tapes;
+		bs.ram_size         = set_ram_size;
+		bs.console_switches = console_switches;
+
+		if (bs.files.empty())
+			error_exit(false, "-U requires one or more tape files (-T)");
+
+#if !defined(_WIN32)
+		struct sigaction sa { };
+		sa.sa_handler = sw_handler;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = SA_RESTART;
+
+		sigaction(SIGTERM, &sa, nullptr);
+		sigaction(SIGINT , &sa, nullptr);
+#endif
+
+		return run_bic_batch(bs, &event);
+	}
+
+	if (overlay_dir.has_value()) {
+		if (farm_mode.has_value())
+			error_exit(false, "-O cannot be combined with -F: the machines would share the overlay files");
+
+		for(auto & d: disk_files) {
+			std::string name = d->get_identifier();
+			std::replace_if(name.begin(), name.end(), [](const char c) { return c == '/' || c == ':'; }, '_');
+
+			std::string filename = overlay_dir.value() + "/" + name + ".overlay";
+
+			if (d->set_overlay_file(filename) == false)
+				error_exit(false, "Cannot use \"%s\" as overlay file", filename.c_str());
+		}
+	}
+
 	start_disk_devices(disk_files, disk_snapshots);
 
+	if (farm_mode.has_value()) {
+		farm_settings_t & fs = farm_mode.value();
+		fs.ram_size          = set_ram_size;
+		fs.disk_type         = disk_type;
+		fs.disk_templates    = disk_files;
+		fs.enable_bootloader = enable_bootloader;
+		fs.tape              = tape;
+		fs.console_switches  = console_switches;
+		if (sa_set)
+			fs.start_addr = start_addr;
+
+#if !defined(_WIN32)
+		struct sigaction sa { };
+		sa.sa_handler = sw_handler;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = SA_RESTART;
+
+		sigaction(SIGTERM, &sa, nullptr);
+		sigaction(SIGINT , &sa, nullptr);
+#endif
+
+		farm *f = new farm(fs, &event);
+
+		if (f->begin())
+			f->run();
+
+		f->show_state();
+
+		delete f;
+
+		for(auto & file: disk_files)
+			delete file;
+
+		return 0;
+	}
+
 #if defined(_WIN32)
 	cnsl = new console_posix(&event);
 #else
-	if (withUI) {
+	if (script_file.empty() == false) {
+		cnsl = new console_script(&event, script_file, script_results, script_transcript);
+	}
+	else if (withUI) {
 		cnsl = new console_ncurses(&event);
 		set_terminal(cnsl);
 	}
@@ -530,7 +730,7 @@ int main(int argc, char *argv[])
 		if (set_ram_size.has_value())
 			b->set_memory_size(set_ram_size.value());
 		else
-			b->set_memory_size(DEFAULT_N_PAGES * 8192l);
+			b->set_memory_size(DEFAULT_N_PAGES);
 
 		b->set_console_switches(console_switches);
 
@@ -584,6 +784,39 @@ int main(int argc, char *argv[])
 		myusleep(251000);
 	}
 
+	if (enable_hle)
+		b->getCpu()->set_hle(new hle(b));
+
+	if (enable_statistics)
+		b->getCpu()->set_statistics(new cpu_statistics());
+
+	if (binary_trace.empty() == false) {
+		trace_recorder *tr = new trace_recorder(binary_trace);
+		if (tr->is_open() == false)
+			error_exit(false, "Cannot record the trace to %s", binary_trace.c_str());
+
+		b->getCpu()->set_tracer(tr);
+	}
+
+	if (profile_prefix.empty() == false) {
+		profiler *p = new profiler(b, profile_prefix, profile_interval);
+
+		if (profile_namelist.empty() == false && p->load_namelist(profile_namelist) == false)
+			error_exit(false, "Cannot use %s as namelist", profile_namelist.c_str());
+
+		b->getCpu()->set_profiler(p);
+	}
+
+	journal *j = nullptr;
+
+	if (journal_file.empty() == false) {
+		j = new journal(b, journal_file, journal_replay);
+		if (j->is_open() == false)
+			error_exit(false, "Cannot use %s as journal", journal_file.c_str());
+
+		b->getCpu()->set_journal(j);
+	}
+
 	if (b->getTty() == nullptr) {
 		tty *tty_ = new tty(cnsl, b);
 
@@ -652,14 +885,36 @@ int main(int argc, char *argv[])
 
 	sigaction(SIGTERM, &sa, nullptr);
 	sigaction(SIGINT , &sa, nullptr);
+
+	crash_cpu = b->getCpu();
+
+	struct sigaction sa_crash { };
+	sa_crash.sa_handler = crash_handler;
+	sigemptyset(&sa_crash.sa_mask);
+	sa_crash.sa_flags = SA_RESETHAND;
+
+	sigaction(SIGSEGV, &sa_crash, nullptr);
+	sigaction(SIGBUS , &sa_crash, nullptr);
+	sigaction(SIGABRT, &sa_crash, nullptr);
 #endif
 
 	if (test.empty() == false)
 		load_p11_x11(b, test);
 
-	std::thread *metrics_thread = nullptr;
-	if (metrics)
-		metrics_thread = new std::thread(get_metrics, b->getCpu());
+	metrics_server *ms = nullptr;
+
+	if (metrics_listen_on.empty() == false) {
+		// traps and interrupts are counted by the statistics
+		if (b->getCpu()->get_statistics() == nullptr)
+			b->getCpu()->set_statistics(new cpu_statistics());
+
+		ms = new metrics_server(metrics_listen_on);
+
+		add_metrics_collectors(ms, b);
+
+		if (ms->begin() == false)
+			error_exit(false, "Cannot serve metrics on %s", metrics_listen_on.c_str());
+	}
 
 	cnsl->start_thread();
 
@@ -692,15 +947,16 @@ int main(int argc, char *argv[])
 
 	event = EVENT_TERMINATE;
 
-	if (metrics_thread) {
-		metrics_thread->join();
-		delete metrics_thread;
-	}
+	delete ms;
 
 	cnsl->stop_thread();
 
 	delete b;
 
+	delete j;
+
+	set_terminal(nullptr);
+
 	delete cnsl;
 
 	return 0;
@@ -32,12 +32,52 @@ memory::memory(const uint32_t size): size(size)
 
 memory::~memory()
 {
+	delete [] watched;
 	free(m);
 }
 
 void memory::reset()
 {
 	memset(m, 0x00, size);
+
+	watch_hit = true;
+}
+
+void memory::set_watched_addresses(const std::set<uint32_t> & addresses)
+{
+	watching = false;
+
+	if (addresses.empty() == false) {
+		const uint32_t n = (size + 15) / 16;
+
+		if (!watched)
+			watched = new std::atomic_uint8_t[n]();
+
+		for(uint32_t i=0; i<n; i++)
+			watched[i].store(0, std::memory_order_relaxed);
+
+		for(auto a: addresses) {
+			if (a < size)
+				watched[a >> 4].fetch_or(1 << ((a >> 1) & 7), std::memory_order_relaxed);
+		}
+
+		watching = true;
+	}
+
+	watch_hit = true;  // (re-)evaluate the conditions at least once
+}
+
+uint8_t *memory::get_dma_pointer(const uint32_t a, const uint32_t n, const bool is_write)
+{
+	if (uint64_t(a) + n > size)
+		return nullptr;
+
+	if (is_write && watching) {
+		for(uint32_t o=a & ~1; o<a + n; o += 2)
+			check_watch(o);
+	}
+
+	return &m[a];
 }
 
 JsonDocument memory::serialize() const
@@ -5,7 +5,9 @@
 
 #include "gen.h"
 #include <ArduinoJson.h>
+#include <atomic>
 #include <cstdint>
+#include <set>
 
 
 class memory
@@ -13,6 +15,13 @@ class memory
 private:
 	const uint32_t size     { 0       };
 	uint8_t       *m        { nullptr };
+	// bit per word, for the breakpoints of the cpu; allocated once and
+	// never replaced as DMA transfers (other threads) may be checking it
+	std::atomic_uint8_t *watched  { nullptr };
+	std::atomic_bool     watching { false   };
+	std::atomic_bool watch_hit { false };
+
+	void check_watch(const uint32_t a) { if (watched[a >> 4].load(std::memory_order_relaxed) & (1 << ((a >> 1) & 7))) watch_hit = true; }
 
 public:
 	memory(const uint32_t size);
@@ -25,9 +34,17 @@ public:
 	JsonDocument serialize() const;
 	static memory *deserialize(const JsonVariantConst j);
 
+	// writes to these (physical) addresses set the watch-hit flag; an empty set disables it
+	void set_watched_addresses(const std::set<uint32_t> & addresses);
+	bool get_and_clear_watch_hit() { return watch_hit.load(std::memory_order_relaxed) && watch_hit.exchange(false); }
+	void set_watch_hit() { watch_hit = true; }
+
+	// for DMA: the 'n' bytes at 'a' or nullptr when they are not all in memory
+	uint8_t *get_dma_pointer(const uint32_t a, const uint32_t n, const bool is_write);
+
 	uint16_t read_byte(const uint32_t a) const { return m[a]; }
-	void write_byte(const uint32_t a, const uint16_t v) { m[a] = v; }
+	void write_byte(const uint32_t a, const uint16_t v) { if (watching) check_watch(a); m[a] = v; }
 
 	uint16_t read_word(const uint32_t a) const { return m[a] | (m[a + 1] << 8); }
-	void write_word(const uint32_t a, const uint16_t v) { m[a] = v; m[a + 1] = v >> 8; }
+	void write_word(const uint32_t a, const uint16_t v) { if (watching) check_watch(a); m[a] = v; m[a + 1] = v >> 8; }
 };
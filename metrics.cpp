@@ -0,0 +1,265 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include "gen.h"
+#include <cinttypes>
+#include <errno.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "log.h"
+#include "metrics.h"
+#include "utils.h"
+
+
+static std::string escape_label_value(const std::string & in)
+{
+	std::string out;
+
+	for(char c: in) {
+		if (c == '\\' || c == '"')
+			out += '\\', out += c;
+		else if (c == '\n')
+			out += "\\n";
+		else
+			out += c;
+	}
+
+	return out;
+}
+
+static std::string format_labels(const metrics_writer::labels_t & labels, const std::string & extra = "")
+{
+	std::string out;
+
+	for(auto & l: labels)
+		out += (out.empty() ? "" : ",") + l.first + "=\"" + escape_label_value(l.second) + "\"";
+
+	if (extra.empty() == false)
+		out += (out.empty() ? "" : ",") + extra;
+
+	return out.empty() ? "" : "{" + out + "}";
+}
+
+metrics_writer::family & metrics_writer::get_family(const std::string & name, const char *const type, const std::string & help)
+{
+	auto it = families.find(name);
+	if (it != families.end())
+		return it->second;
+
+	order.push_back(name);
+
+	return families.insert({ name, { type, help, { } } }).first->second;
+}
+
+void metrics_writer::add_counter(const std::string & name, const std::string & help, const labels_t & labels, const uint64_t value)
+{
+	get_family(name, "counter", help).samples.push_back(format("%s%s %" PRIu64, name.c_str(), format_labels(labels).c_str(), value));
+}
+
+void metrics_writer::add_gauge(const std::string & name, const std::string & help, const labels_t & labels, const double value)
+{
+	get_family(name, "gauge", help).samples.push_back(format("%s%s %.9g", name.c_str(), format_labels(labels).c_str(), value));
+}
+
+void metrics_writer::add_histogram(const std::string & name, const std::string & help, const labels_t & labels, const std::vector<double> & bounds, const std::vector<uint64_t> & counts, const double sum)
+{
+	family & f = get_family(name, "histogram", help);
+
+	uint64_t cumulative = 0;
+
+	for(size_t i=0; i<counts.size(); i++) {
+		cumulative += counts.at(i);
+
+		std::string le = i < bounds.size() ? format("le=\"%g\"", bounds.at(i)) : "le=\"+Inf\"";
+
+		f.samples.push_back(format("%s_bucket%s %" PRIu64, name.c_str(), format_labels(labels, le).c_str(), cumulative));
+	}
+
+	f.samples.push_back(format("%s_sum%s %.9g",          name.c_str(), format_labels(labels).c_str(), sum));
+	f.samples.push_back(format("%s_count%s %" PRIu64, name.c_str(), format_labels(labels).c_str(), cumulative));
+}
+
+std::string metrics_writer::get() const
+{
+	std::string out;
+
+	for(auto & name: order) {
+		const family & f = families.at(name);
+
+		out += "# HELP " + name + " " + f.help + "\n";
+		out += "# TYPE " + name + " " + f.type + "\n";
+
+		for(auto & s: f.samples)
+			out += s + "\n";
+	}
+
+	return out;
+}
+
+metrics_server::metrics_server(const std::string & listen_on): listen_on(listen_on)
+{
+}
+
+metrics_server::~metrics_server()
+{
+	stop_flag = true;
+
+	if (th) {
+		th->join();
+		delete th;
+	}
+
+#if !defined(_WIN32)
+	if (fd != -1) {
+		close(fd);
+
+		if (listen_on.find('/') != std::string::npos)
+			unlink(listen_on.c_str());
+	}
+#endif
+}
+
+bool metrics_server::begin()
+{
+#if defined(_WIN32)
+	DOLOG(warning, true, "metrics: not supported on this platform");
+
+	return false;
+#else
+	if (listen_on.find('/') != std::string::npos) {
+		sockaddr_un addr { };
+		addr.sun_family = AF_UNIX;
+
+		if (listen_on.size() >= sizeof addr.sun_path) {
+			DOLOG(warning, true, "metrics: path \"%s\" is too long", listen_on.c_str());
+			return false;
+		}
+
+		strcpy(addr.sun_path, listen_on.c_str());
+
+		unlink(listen_on.c_str());  // left over from a previous run
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if (fd == -1 || bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == -1) {
+			DOLOG(warning, true, "metrics: cannot bind to %s: %s", listen_on.c_str(), strerror(errno));
+			return false;
+		}
+	}
+	else {
+		auto port = parse_number(listen_on);
+		if (port.value_or(0) < 1 || port.value() > 65535) {
+			DOLOG(warning, true, "metrics: \"%s\" is not a port number or a unix socket path", listen_on.c_str());
+			return false;
+		}
+
+		sockaddr_in addr { };
+		addr.sin_family      = AF_INET;
+		addr.sin_port        = htons(port.value());
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+
+		int reuse_addr = 1;
+		if (fd != -1 && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof reuse_addr) == -1)
+			DOLOG(warning, false, "metrics: cannot set SO_REUSEADDR: %s", strerror(errno));
+
+		if (fd == -1 || bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == -1) {
+			DOLOG(warning, true, "metrics: cannot bind to port %s: %s", listen_on.c_str(), strerror(errno));
+			return false;
+		}
+	}
+
+	if (listen(fd, 5) == -1) {
+		DOLOG(warning, true, "metrics: cannot listen on %s: %s", listen_on.c_str(), strerror(errno));
+		return false;
+	}
+
+	th = new std::thread(std::ref(*this));
+
+	DOLOG(info, true, "metrics: serving on %s", listen_on.c_str());
+
+	return true;
+#endif
+}
+
+void metrics_server::add_collector(const collector_t & c)
+{
+	std::unique_lock<std::mutex> lck(collectors_lock);
+
+	collectors.push_back(c);
+}
+
+std::string metrics_server::get_metrics()
+{
+	metrics_writer w;
+
+	{
+		std::unique_lock<std::mutex> lck(collectors_lock);
+
+		for(auto & c: collectors)
+			c(&w);
+	}
+
+	w.add_counter("kek_metrics_scrapes_total", "Number of times the metrics were retrieved", { }, ++n_scrapes);
+
+	return w.get();
+}
+
+void metrics_server::handle_client(const int cfd)
+{
+#if !defined(_WIN32)
+	// the request itself is not relevant: read the headers (or until a timeout)
+	std::string request;
+	uint64_t    start = get_ms();
+
+	while(request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos && request.size() < 8192 && get_ms() - start < 1000) {
+		pollfd fds[] { { cfd, POLLIN, 0 } };
+		if (poll(fds, 1, 100) != 1)
+			continue;
+
+		char    buffer[512];
+		ssize_t rc = read(cfd, buffer, sizeof buffer);
+		if (rc <= 0)
+			break;
+
+		request.append(buffer, rc);
+	}
+
+	std::string body     = get_metrics();
+	std::string response = format("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", body.size()) + body;
+
+	if (WRITE(cfd, response.c_str(), response.size()) != ssize_t(response.size()))
+		DOLOG(debug, false, "metrics: short write to client");
+#endif
+}
+
+void metrics_server::operator()()
+{
+	set_thread_name("kek:metrics");
+
+#if !defined(_WIN32)
+	while(!stop_flag) {
+		pollfd fds[] { { fd, POLLIN, 0 } };
+
+		if (poll(fds, 1, 100) != 1)
+			continue;
+
+		int cfd = accept(fd, nullptr, nullptr);
+		if (cfd == -1)
+			continue;
+
+		handle_client(cfd);
+
+		close(cfd);
+	}
+#endif
+}
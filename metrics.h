@@ -0,0 +1,78 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Collects the samples of one scrape in the Prometheus text format
+// (version 0.0.4). Samples of the same metric are grouped, whatever
+// the order in which they are added.
+class metrics_writer
+{
+private:
+	struct family {
+		std::string type;
+		std::string help;
+		std::vector<std::string> samples;
+	};
+
+	std::vector<std::string>      order;
+	std::map<std::string, family> families;
+
+	family & get_family(const std::string & name, const char *const type, const std::string & help);
+
+public:
+	// labels are "name=value" pairs; values are escaped here
+	typedef std::vector<std::pair<std::string, std::string> > labels_t;
+
+	void add_counter(const std::string & name, const std::string & help, const labels_t & labels, const uint64_t value);
+	void add_gauge  (const std::string & name, const std::string & help, const labels_t & labels, const double   value);
+	// 'counts' per bucket (not cumulative); one more than 'bounds' (for +Inf)
+	void add_histogram(const std::string & name, const std::string & help, const labels_t & labels, const std::vector<double> & bounds, const std::vector<uint64_t> & counts, const double sum);
+
+	std::string get() const;
+};
+
+// Serves the metrics over HTTP on a TCP port of the loopback interface or
+// on a Unix domain socket. The values are gathered by the collectors when
+// a scrape comes in, in the thread of the server: they only read counters
+// (plain or atomic), so the cpu thread is never held up by a scrape.
+class metrics_server
+{
+public:
+	typedef std::function<void(metrics_writer *const w)> collector_t;
+
+private:
+	const std::string        listen_on;  // port or path
+	int                      fd        { -1 };
+	std::atomic_bool         stop_flag { false };
+	std::thread             *th        { nullptr };
+
+	std::mutex               collectors_lock;
+	std::vector<collector_t> collectors;
+
+	uint64_t                 n_scrapes { 0 };
+
+	void handle_client(const int cfd);
+
+public:
+	metrics_server(const std::string & listen_on);
+	virtual ~metrics_server();
+
+	bool begin();
+
+	void add_collector(const collector_t & c);
+
+	std::string get_metrics();
+
+	void operator()();
+};
@@ -0,0 +1,143 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+// Converts a disk image to a compressed image (see compressed_image.h)
+// that kek can use directly (-r). The input can be a pipe, e.g.:
+//   xz -dc unix_v7m_rl0.dsk.xz | kek-mkcimg - unix_v7m_rl0.kci
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+
+#include "compressed_image.h"
+
+
+static bool read_fully(FILE *const fh, uint8_t *const to, const size_t n, size_t *const got)
+{
+	*got = 0;
+
+	while(*got < n) {
+		size_t rc = fread(&to[*got], 1, n - *got, fh);
+		if (rc == 0)
+			return ferror(fh) == 0;
+
+		*got += rc;
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3 || argc > 5) {
+		fprintf(stderr, "Usage: %s file_in|- file_out [chunk_size [level]]\n", argv[0]);
+		fprintf(stderr, "chunk_size defaults to %u bytes, level (1...9) to 9\n", compressed_image_default_chunk_size);
+
+		return 1;
+	}
+
+	const char *file_in    = argv[1];
+	const char *file_out   = argv[2];
+	uint32_t    chunk_size = argc >= 4 ? atoi(argv[3]) : compressed_image_default_chunk_size;
+	int         level      = argc >= 5 ? atoi(argv[4]) : 9;
+
+	if (chunk_size < 512 || chunk_size % 512) {
+		fprintf(stderr, "chunk_size must be a multiple of 512\n");
+
+		return 1;
+	}
+
+	if (level < 1 || level > 9) {
+		fprintf(stderr, "level must be between 1 and 9\n");
+
+		return 1;
+	}
+
+	FILE *fh_in  = strcmp(file_in, "-") == 0 ? stdin : fopen(file_in, "rb");
+	if (!fh_in) {
+		fprintf(stderr, "Cannot open %s: %s\n", file_in, strerror(errno));
+
+		return 1;
+	}
+
+	FILE *fh_out = fopen(file_out, "wb");
+	if (!fh_out) {
+		fprintf(stderr, "Cannot create %s: %s\n", file_out, strerror(errno));
+
+		return 1;
+	}
+
+	compressed_image_header_t header { };
+	memcpy(header.magic, compressed_image_magic, sizeof compressed_image_magic);
+	header.chunk_size = chunk_size;
+
+	// the header is written again when the sizes are known
+	if (fwrite(&header, sizeof header, 1, fh_out) != 1) {
+		fprintf(stderr, "Cannot write to %s: %s\n", file_out, strerror(errno));
+
+		return 1;
+	}
+
+	std::vector<uint64_t> index { sizeof header };
+	std::vector<uint8_t>  in (chunk_size);
+	std::vector<uint8_t>  out(compressBound(chunk_size));
+
+	for(;;) {
+		size_t got = 0;
+		if (read_fully(fh_in, in.data(), chunk_size, &got) == false) {
+			fprintf(stderr, "Cannot read from %s: %s\n", file_in, strerror(errno));
+
+			return 1;
+		}
+
+		if (got == 0)
+			break;
+
+		header.image_size += got;
+
+		uLongf out_size = out.size();
+		if (compress2(out.data(), &out_size, in.data(), got, level) != Z_OK) {
+			fprintf(stderr, "Cannot compress chunk %zu\n", index.size() - 1);
+
+			return 1;
+		}
+
+		// a chunk of chunk_size bytes is taken to be stored as is
+		const uint8_t *data = out.data();
+		if (out_size >= chunk_size) {
+			memset(&in[got], 0x00, chunk_size - got);  // pad the last one
+
+			data     = in.data();
+			out_size = chunk_size;
+		}
+
+		if (fwrite(data, 1, out_size, fh_out) != out_size) {
+			fprintf(stderr, "Cannot write to %s: %s\n", file_out, strerror(errno));
+
+			return 1;
+		}
+
+		index.push_back(index.back() + out_size);
+	}
+
+	header.n_chunks     = index.size() - 1;
+	header.index_offset = index.back();
+
+	if (fwrite(index.data(), sizeof(uint64_t), index.size(), fh_out) != index.size() ||
+		fseek(fh_out, 0, SEEK_SET) == -1 || fwrite(&header, sizeof header, 1, fh_out) != 1 || fclose(fh_out) != 0) {
+		fprintf(stderr, "Cannot write to %s: %s\n", file_out, strerror(errno));
+
+		return 1;
+	}
+
+	if (fh_in != stdin)
+		fclose(fh_in);
+
+	printf("%s: %llu bytes in %u chunks, %llu bytes compressed\n", file_out, (unsigned long long)header.image_size, header.n_chunks, (unsigned long long)(header.index_offset - sizeof header));
+
+	return 0;
+}
@@ -177,7 +177,7 @@ void mmu::write_pdr(const uint32_t a, const int run_mode, const uint16_t value,
 
 	pages[run_mode][is_d][page].pdr &= ~(32768 + 128 /*A*/ + 64 /*W*/ + 32 + 16);  // set bit 4, 5 & 15 to 0 as they are unused and A/W are set to 0 by writes
 
-	TRACE("mmu WRITE-I/O PDR run-mode %d: %c for %d: %o [%d]", run_mode, is_d ? 'D' : 'I', page, value, word_mode);
+	TRACE(tc_mmu, "mmu WRITE-I/O PDR run-mode %d: %c for %d: %o [%d]", run_mode, is_d ? 'D' : 'I', page, value, word_mode);
 }
 
 void mmu::write_par(const uint32_t a, const int run_mode, const uint16_t value, const word_mode_t word_mode)
@@ -192,7 +192,7 @@ void mmu::write_par(const uint32_t a, const int run_mode, const uint16_t value,
 
 	pages[run_mode][is_d][page].pdr &= ~(128 /*A*/ + 64 /*W*/);  // reset PDR A/W when PAR is written to
 
-	TRACE("mmu WRITE-I/O PAR run-mode %d: %c for %d: %o (%07o)", run_mode, is_d ? 'D' : 'I', page, word_mode == wm_byte ? value & 0xff : value, pages[run_mode][is_d][page].par * 64);
+	TRACE(tc_mmu, "mmu WRITE-I/O PAR run-mode %d: %c for %d: %o (%07o)", run_mode, is_d ? 'D' : 'I', page, word_mode == wm_byte ? value & 0xff : value, pages[run_mode][is_d][page].par * 64);
 }
 
 uint16_t mmu::read_word(const uint16_t a)
@@ -352,7 +352,7 @@ void mmu::mmudebug(const uint16_t a)
 	for(int rm=0; rm<4; rm++) {
 		auto ma = calculate_physical_address(rm, a);
 
-		TRACE("RM %d, a: %06o, apf: %d, PI: %08o (PSW: %d), PD: %08o (PSW: %d)", rm, ma.virtual_address, ma.apf, ma.physical_instruction, ma.physical_instruction_is_psw, ma.physical_data, ma.physical_data_is_psw);
+		TRACE(tc_mmu, "RM %d, a: %06o, apf: %d, PI: %08o (PSW: %d), PD: %08o (PSW: %d)", rm, ma.virtual_address, ma.apf, ma.physical_instruction, ma.physical_instruction_is_psw, ma.physical_data, ma.physical_data_is_psw);
 	}
 #endif
 }
@@ -387,18 +387,22 @@ void mmu::verify_page_access(const uint16_t virt_addr, const int run_mode, const
 
 		setMMR0_as_is(temp);
 
-		TRACE("MMR0: %06o", temp);
+		TRACE(tc_mmu, "MMR0: %06o", temp);
 	}
 
 	if (trap_action == T_TRAP_250) {
-		TRACE("Page access %d (for virtual address %06o): trap 0250", access_control, virt_addr);
+		TRACE(tc_mmu, "Page access %d (for virtual address %06o): trap 0250", access_control, virt_addr);
+
+		n_aborts++;
 
 		c->trap(0250);  // trap
 
 		throw 5;
 	}
 	else {  // T_ABORT_4
-		TRACE("Page access %d (for virtual address %06o): trap 004", access_control, virt_addr);
+		TRACE(tc_mmu, "Page access %d (for virtual address %06o): trap 004", access_control, virt_addr);
+
+		n_aborts++;
 
 		c->trap(004);  // abort
 
@@ -409,7 +413,7 @@ void mmu::verify_page_access(const uint16_t virt_addr, const int run_mode, const
 void mmu::verify_access_valid(const uint32_t m_offset, const int run_mode, const bool d, const int apf, const bool is_io, const bool is_write)
 {
 	if (m_offset >= m->get_memory_size() && !is_io) [[unlikely]] {
-		TRACE("TRAP(04) (throw 6) on address %08o", m_offset);
+		TRACE(tc_mmu, "TRAP(04) (throw 6) on address %08o", m_offset);
 
 		if (is_locked() == false) {
 			uint16_t temp = getMMR0();
@@ -429,6 +433,8 @@ void mmu::verify_access_valid(const uint32_t m_offset, const int run_mode, const
 		if (is_write)
 			set_page_trapped(run_mode, d, apf);
 
+		n_aborts++;
+
 		c->trap(04);
 
 		throw 6;
@@ -446,8 +452,10 @@ void mmu::verify_page_length(const uint16_t virt_addr, const int run_mode, const
 	bool direction   = get_pdr_direction(run_mode, d, apf);
 
 	if (direction == false ? pdr_cmp > pdr_len : pdr_cmp < pdr_len) [[unlikely]] {
-		TRACE("mmu::calculate_physical_address::p_offset %o versus %o direction %d", pdr_cmp, pdr_len, direction);
-		TRACE("TRAP(0250) (throw 7) on address %06o", virt_addr);
+		TRACE(tc_mmu, "mmu::calculate_physical_address::p_offset %o versus %o direction %d", pdr_cmp, pdr_len, direction);
+		TRACE(tc_mmu, "TRAP(0250) (throw 7) on address %06o", virt_addr);
+
+		n_aborts++;
 
 		c->trap(0250);  // invalid access
 
@@ -481,6 +489,8 @@ uint32_t mmu::calculate_physical_address(const int run_mode, const uint16_t a, c
 	uint32_t m_offset = a;
 
 	if (is_enabled() || (is_write && (getMMR0() & (1 << 8 /* maintenance check */)))) {
+		n_translations++;
+
 		bool     d        = space == d_space && get_use_data_space(run_mode);
 
 		uint16_t p_offset = a & 8191;  // page offset
@@ -507,6 +517,34 @@ uint32_t mmu::calculate_physical_address(const int run_mode, const uint16_t a, c
 	return m_offset;
 }
 
+bool mmu::is_access_valid(const int run_mode, const uint16_t a, const bool is_write, const d_i_space_t space, const std::optional<uint16_t> par)
+{
+	if (is_enabled() == false)
+		return a < m->get_memory_size() || a >= 0160000;
+
+	bool     d        = space == d_space && get_use_data_space(run_mode);
+	uint8_t  apf      = a >> 13;
+
+	if (get_trap_action(run_mode, d, apf, is_write).first != T_PROCEED)
+		return false;
+
+	uint32_t m_offset = (par.has_value() ? par.value() * 64 : get_physical_memory_offset(run_mode, d, apf)) + (a & 8191);
+
+	if ((getMMR3() & 16) == 0)  // off is 18bit
+		m_offset &= 0x3ffff;
+
+	if (m_offset >= m->get_memory_size() && m_offset < get_io_base())
+		return false;
+
+	uint16_t pdr_len  = get_pdr_len(run_mode, d, apf);
+	if (pdr_len == 127)
+		return true;
+
+	uint16_t pdr_cmp  = (a >> 6) & 127;
+
+	return get_pdr_direction(run_mode, d, apf) == false ? pdr_cmp <= pdr_len : pdr_cmp >= pdr_len;
+}
+
 JsonDocument mmu::add_par_pdr(const int run_mode, const bool is_d) const
 {
 	JsonDocument j;
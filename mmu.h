@@ -3,6 +3,7 @@
 #include "gen.h"
 #include <ArduinoJson.h>
 #include <cstdint>
+#include <optional>
 #include <string>
 #include "cpu.h"
 #include "device.h"
@@ -58,6 +59,10 @@ private:
 	memory  *m { nullptr };
 	cpu     *c { nullptr };
 
+	// for the metrics, only updated by the cpu thread
+	uint64_t n_translations { 0 };
+	uint64_t n_aborts       { 0 };
+
 	JsonDocument add_par_pdr(const int run_mode, const bool is_d) const;
 	void set_par_pdr(const JsonVariantConst j_in, const int run_mode, const bool is_d);
 
@@ -76,6 +81,9 @@ public:
 
 	void     mmudebug(const uint16_t a);
 
+	uint64_t get_translation_count() const { return n_translations; }
+	uint64_t get_abort_count()       const { return n_aborts;       }
+
 	void     reset() override;
 
 	void     dump_par_pdr(console *const cnsl, const int run_mode, const bool d, const std::string & name, const int state, const std::optional<int> & selection) const;
@@ -96,6 +104,8 @@ public:
 	memory_addresses_t            calculate_physical_address(const int run_mode, const uint16_t a) const;
 	std::pair<trap_action_t, int> get_trap_action(const int run_mode, const bool d, const int apf, const bool is_write);
 	uint32_t                      calculate_physical_address(const int run_mode, const uint16_t a, const bool is_write, const d_i_space_t space);
+	// would an access go through without a trap or an abort? ('par' overrides the page address register)
+	bool                          is_access_valid(const int run_mode, const uint16_t a, const bool is_write, const d_i_space_t space, const std::optional<uint16_t> par = { });
 
 	uint16_t getMMR0() const { return MMR0; }
 	uint16_t getMMR1() const { return MMR1; }
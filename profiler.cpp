@@ -0,0 +1,263 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <algorithm>
+#include <cinttypes>
+#include <errno.h>
+#include <set>
+#include <stdio.h>
+#include <string.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "log.h"
+#include "memory.h"
+#include "mmu.h"
+#include "profiler.h"
+#include "utils.h"
+
+
+// a.out: header of 8 words, text, data, relocation (when a_flag is 0), symbols
+constexpr const int aout_header_size = 16;
+constexpr const int aout_symbol_size = 12;  // name (8), type, value
+constexpr const int aout_n_text      = 02;  // symbol type (without N_EXT)
+
+static const char *const run_mode_names[] = { "kernel", "supervisor", "invalid", "user" };
+
+profiler::profiler(bus *const b, const std::string & prefix, const uint32_t interval):
+	b(b),
+	prefix(prefix),
+	interval(interval),
+	countdown(interval)
+{
+}
+
+profiler::~profiler()
+{
+	DOLOG(info, true, "profiler: %" PRIu64 " samples, written to %s.flat, %s.folded and %s.hist", n_samples, prefix.c_str(), prefix.c_str(), prefix.c_str());
+
+	write_flat();
+	write_folded();
+	write_histogram();
+}
+
+bool profiler::load_namelist(const std::string & file)
+{
+	FILE *fh = fopen(file.c_str(), "rb");
+	if (!fh) {
+		DOLOG(warning, true, "profiler: cannot open \"%s\": %s", file.c_str(), strerror(errno));
+		return false;
+	}
+
+	uint8_t header[aout_header_size] { };
+	if (fread(header, 1, aout_header_size, fh) != aout_header_size) {
+		DOLOG(warning, true, "profiler: \"%s\" is too short", file.c_str());
+		fclose(fh);
+		return false;
+	}
+
+	auto get_header_word = [&header](const int nr) { return uint16_t(header[nr * 2] | (header[nr * 2 + 1] << 8)); };
+
+	uint16_t magic  = get_header_word(0);
+	uint32_t a_text = get_header_word(1);
+	uint32_t a_data = get_header_word(2);
+	uint32_t a_syms = get_header_word(4);
+	uint16_t a_flag = get_header_word(7);
+
+	if (magic != 0407 && magic != 0410 && magic != 0411) {
+		DOLOG(warning, true, "profiler: \"%s\" is not a PDP-11 a.out file (magic %06o)", file.c_str(), magic);
+		fclose(fh);
+		return false;
+	}
+
+	long offset = aout_header_size + a_text + a_data;
+	if (a_flag == 0)  // relocation information present
+		offset += a_text + a_data;
+
+	if (fseek(fh, offset, SEEK_SET) == -1) {
+		DOLOG(warning, true, "profiler: cannot seek to the symbols in \"%s\": %s", file.c_str(), strerror(errno));
+		fclose(fh);
+		return false;
+	}
+
+	symbols.clear();
+
+	text_end = a_text;
+
+	for(uint32_t i=0; i<a_syms / aout_symbol_size; i++) {
+		uint8_t entry[aout_symbol_size];
+		if (fread(entry, 1, aout_symbol_size, fh) != aout_symbol_size)
+			break;
+
+		uint16_t type  = entry[8] | (entry[9] << 8);
+		uint16_t value = entry[10] | (entry[11] << 8);
+
+		if ((type & 037) != aout_n_text)
+			continue;
+
+		symbols.push_back({ value, std::string(reinterpret_cast<const char *>(entry), strnlen(reinterpret_cast<const char *>(entry), 8)) });
+	}
+
+	fclose(fh);
+
+	std::sort(symbols.begin(), symbols.end(), [](const symbol_t & a, const symbol_t & b) { return a.value < b.value; });
+
+	DOLOG(info, true, "profiler: %zu text symbols loaded from \"%s\"", symbols.size(), file.c_str());
+
+	return symbols.empty() == false;
+}
+
+void profiler::sample(cpu *const c, const uint16_t pc)
+{
+	n_samples++;
+
+	int      run_mode = c->getPSW_runmode();
+	mmu     *m        = b->getMMU();
+	memory  *ram      = b->getRAM();
+
+	histogram[{ run_mode, pc, m->calculate_physical_address(run_mode, pc).physical_instruction }]++;
+
+	std::vector<uint16_t> stack { uint16_t(run_mode) };
+
+	if (run_mode == 0) {
+		std::vector<uint16_t> chain { pc };
+
+		// csv: (R5) is the R5 of the caller, 2(R5) the return address into it
+		uint16_t r5       = c->get_register(5);
+		uint32_t io_base  = m->get_io_base();
+		uint32_t mem_size = ram->get_memory_size();
+
+		while(chain.size() < profiler_max_depth && r5 != 0 && (r5 & 1) == 0 && r5 < 0177774) {
+			uint32_t frame = m->calculate_physical_address(0, r5).physical_data;
+			if (frame >= io_base || frame + 4 > mem_size)
+				break;
+
+			uint16_t next_r5 = ram->read_word(frame);
+			uint16_t ret     = ram->read_word(frame + 2);
+
+			chain.push_back(ret - 2);  // inside the jsr, not after it
+
+			if (next_r5 <= r5)  // the stack grows downwards
+				break;
+
+			r5 = next_r5;
+		}
+
+		stack.insert(stack.end(), chain.rbegin(), chain.rend());
+	}
+
+	stacks[stack]++;
+}
+
+std::string profiler::resolve(const uint16_t a) const
+{
+	auto it = std::upper_bound(symbols.begin(), symbols.end(), a, [](const uint16_t v, const symbol_t & s) { return v < s.value; });
+
+	if (it == symbols.begin() || a >= text_end)
+		return format("%06o", a);
+
+	return std::prev(it)->name;
+}
+
+std::string profiler::get_stack_name(const std::vector<uint16_t> & stack) const
+{
+	std::string out = run_mode_names[stack.at(0) & 3];
+
+	for(size_t i=1; i<stack.size(); i++)
+		out += ";" + resolve(stack.at(i));
+
+	return out;
+}
+
+void profiler::write_flat() const
+{
+	std::map<std::string, uint64_t> self;
+	std::map<std::string, uint64_t> inclusive;
+
+	for(auto & e: stacks) {
+		const std::vector<uint16_t> & stack = e.first;
+
+		if (stack.size() == 1) {
+			self[format("[%s]", run_mode_names[stack.at(0) & 3])] += e.second;
+			continue;
+		}
+
+		self[resolve(stack.back())] += e.second;
+
+		std::set<std::string> seen;  // recursion: count a function once per stack
+		for(size_t i=1; i<stack.size(); i++)
+			seen.insert(resolve(stack.at(i)));
+
+		for(auto & name: seen)
+			inclusive[name] += e.second;
+	}
+
+	std::vector<std::pair<std::string, uint64_t> > sorted(self.begin(), self.end());
+	std::sort(sorted.begin(), sorted.end(), [](const auto & a, const auto & b) { return a.second > b.second; });
+
+	FILE *fh = fopen((prefix + ".flat").c_str(), "w");
+	if (!fh) {
+		DOLOG(warning, true, "profiler: cannot create %s.flat: %s", prefix.c_str(), strerror(errno));
+		return;
+	}
+
+	fprintf(fh, "%" PRIu64 " samples, one per %u instructions\n", n_samples, interval);
+	fprintf(fh, "%12s %7s %7s %12s  %s\n", "self", "self%", "cumul%", "inclusive", "function");
+
+	uint64_t cumulative = 0;
+	double   total      = std::max(n_samples, uint64_t(1));
+
+	for(auto & e: sorted) {
+		cumulative += e.second;
+
+		auto it = inclusive.find(e.first);
+		uint64_t incl = it != inclusive.end() ? it->second : e.second;
+
+		fprintf(fh, "%12" PRIu64 " %6.2f%% %6.2f%% %12" PRIu64 "  %s\n", e.second, e.second * 100. / total, cumulative * 100. / total, incl, e.first.c_str());
+	}
+
+	fclose(fh);
+}
+
+void profiler::write_folded() const
+{
+	// different addresses can resolve to the same function
+	std::map<std::string, uint64_t> folded;
+
+	for(auto & e: stacks)
+		folded[get_stack_name(e.first)] += e.second;
+
+	FILE *fh = fopen((prefix + ".folded").c_str(), "w");
+	if (!fh) {
+		DOLOG(warning, true, "profiler: cannot create %s.folded: %s", prefix.c_str(), strerror(errno));
+		return;
+	}
+
+	for(auto & e: folded)
+		fprintf(fh, "%s %" PRIu64 "\n", e.first.c_str(), e.second);
+
+	fclose(fh);
+}
+
+void profiler::write_histogram() const
+{
+	std::vector<std::pair<std::tuple<int, uint16_t, uint32_t>, uint64_t> > sorted(histogram.begin(), histogram.end());
+	std::sort(sorted.begin(), sorted.end(), [](const auto & a, const auto & b) { return a.second > b.second; });
+
+	FILE *fh = fopen((prefix + ".hist").c_str(), "w");
+	if (!fh) {
+		DOLOG(warning, true, "profiler: cannot create %s.hist: %s", prefix.c_str(), strerror(errno));
+		return;
+	}
+
+	fprintf(fh, "# run-mode PC physical-PC samples function\n");
+
+	for(auto & e: sorted) {
+		int      run_mode = std::get<0>(e.first);
+		uint16_t pc       = std::get<1>(e.first);
+
+		fprintf(fh, "%s %06o %08o %" PRIu64 " %s\n", run_mode_names[run_mode & 3], pc, std::get<2>(e.first), e.second, run_mode == 0 ? resolve(pc).c_str() : "-");
+	}
+
+	fclose(fh);
+}
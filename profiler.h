@@ -0,0 +1,74 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+class bus;
+class cpu;
+
+constexpr const int      profiler_max_depth        = 32;
+constexpr const uint32_t profiler_default_interval = 997;  // instructions; prime so that it does not run in step with loops
+
+// Samples the PC of the emulated machine every 'interval' instructions,
+// from the cpu thread (so nothing needs to be stopped or locked). In
+// kernel mode the R5 frame chain of the C calling convention (csv/cret)
+// is followed for the call stack. Addresses are resolved with the
+// namelist of a PDP-11 a.out file, e.g. /unix of UNIX 7. When the
+// emulation ends, three files are written:
+//   <prefix>.flat    flat profile by function
+//   <prefix>.folded  folded stacks, for flamegraph.pl and the like
+//   <prefix>.hist    raw histogram of run mode, virtual PC and physical PC
+class profiler
+{
+private:
+	typedef struct {
+		uint16_t    value;
+		std::string name;
+	} symbol_t;
+
+	bus        *const b        { nullptr };
+	const std::string prefix;
+	const uint32_t    interval { profiler_default_interval };
+	uint32_t          countdown{ profiler_default_interval };
+
+	std::vector<symbol_t> symbols;  // text symbols, sorted by address
+	uint32_t          text_end { 0 };  // addresses beyond the text segment are not resolved
+
+	std::map<std::tuple<int, uint16_t, uint32_t>, uint64_t> histogram;  // run mode, PC, physical PC
+	std::map<std::vector<uint16_t>, uint64_t>                stacks;     // run mode, then (kernel) the call chain, outermost first
+	uint64_t          n_samples{ 0 };
+
+	void        sample(cpu *const c, const uint16_t pc);
+	std::string resolve(const uint16_t a) const;
+	std::string get_stack_name(const std::vector<uint16_t> & stack) const;
+
+	void write_flat  () const;
+	void write_folded() const;
+	void write_histogram() const;
+
+public:
+	profiler(bus *const b, const std::string & prefix, const uint32_t interval);
+	virtual ~profiler();
+
+	// PDP-11 a.out (0407, 0410 and 0411)
+	bool load_namelist(const std::string & file);
+
+	// invoked by the cpu before each instruction
+	void instruction(cpu *const c, const uint16_t pc)
+	{
+		if (--countdown == 0) {
+			countdown = interval;
+
+			sample(c, pc);
+		}
+	}
+
+	uint64_t get_sample_count() const { return n_samples; }
+};
@@ -32,6 +32,8 @@ rk05::rk05(bus *const b, std::atomic_bool *const disk_read_acitivity, std::atomi
 
 rk05::~rk05()
 {
+	wait_for_transfer();
+
 	for(auto fh : fhs)
 		delete fh;
 }
@@ -43,6 +45,10 @@ void rk05::begin()
 
 void rk05::reset()
 {
+	wait_for_transfer();
+
+	xfer_failed = false;
+
 	memset(registers, 0x00, sizeof registers);
 }
 
@@ -71,6 +77,11 @@ uint16_t rk05::read_word(const uint16_t addr)
 {
 	const int reg = (addr - RK05_BASE) / 2;
 
+	if (xfer_failed.exchange(false)) {
+		registers[(RK05_ERROR - RK05_BASE) / 2] |= 32;  // non existing sector
+		registers[(RK05_CS - RK05_BASE) / 2] |= 3 << 14;  // an error occured
+	}
+
 	if (addr == RK05_DS) {		// 0177400
 		setBit(registers[reg], 11, true); // disk on-line
 		setBit(registers[reg],  8, true); // sector ok
@@ -83,7 +94,7 @@ uint16_t rk05::read_word(const uint16_t addr)
 	else if (addr == RK05_CS) {	// 0177404
 		setBit(registers[reg], 15, false); // clear error
 		setBit(registers[reg], 14, false); // clear hard error
-		setBit(registers[reg],  7, true); // controller ready
+		setBit(registers[reg],  7, !xfer_busy); // controller ready
 	}
 
 	uint16_t vtemp = registers[reg];
@@ -91,7 +102,7 @@ uint16_t rk05::read_word(const uint16_t addr)
 	if (addr == RK05_CS)
 		setBit(registers[reg], 0, false); // clear go
 
-	TRACE("RK05 read %s/%o: %06o", reg[regnames], addr, vtemp);
+	TRACE(tc_rk05, "RK05 read %s/%o: %06o", reg[regnames], addr, vtemp);
 
 	return vtemp;
 }
@@ -113,6 +124,65 @@ void rk05::update_bus_address(const uint16_t v)
 	registers[(RK05_CS - RK05_BASE) / 2] |= ((org_v >> 16) & 3) << 4;
 }
 
+// Hands a transfer of whole sectors to an asynchronous backend; the
+// interrupt is triggered when it has finished. Returns false when the
+// transfer must be done synchronously.
+bool rk05::async_transfer(const uint16_t device, const bool is_write, const uint32_t memoff, const uint32_t diskoffb, const uint32_t reclen, const bool int_enable)
+{
+	if (device >= fhs.size() || fhs.at(device)->is_asynchronous() == false)
+		return false;
+
+	if (reclen == 0 || reclen % 512)
+		return false;
+
+	uint8_t *ram = b->getRAM()->get_dma_pointer(memoff, reclen, !is_write);
+	if (ram == nullptr)
+		return false;
+
+	std::atomic_bool *activity = is_write ? disk_write_acitivity : disk_read_acitivity;
+
+	auto done = [this, device, is_write, diskoffb, reclen, int_enable, activity](const bool ok) {
+		if (!ok) {
+			DOLOG(ll_error, true, "RK05(%d) %s error at %u len %u", device, is_write ? "write" : "read", diskoffb, reclen);
+			xfer_failed = true;
+		}
+
+		if (activity)
+			*activity = false;
+
+		{
+			// notify under the lock: the controller may be deleted right after the wait
+			std::unique_lock<std::mutex> lck(xfer_lock);
+
+			xfer_busy = false;
+
+			xfer_cv.notify_all();
+		}
+
+		if (int_enable)
+			b->getCpu()->queue_interrupt(5, 0220);
+	};
+
+	if (activity)
+		*activity = true;
+
+	xfer_busy = true;
+
+	if (is_write)
+		fhs.at(device)->accounted_submit_write(diskoffb, reclen, ram, 512, done);
+	else
+		fhs.at(device)->accounted_submit_read (diskoffb, reclen, ram, 512, done);
+
+	return true;
+}
+
+void rk05::wait_for_transfer() const
+{
+	std::unique_lock<std::mutex> lck(xfer_lock);
+
+	xfer_cv.wait(lck, [this] { return xfer_busy == false; });
+}
+
 void rk05::write_byte(const uint16_t addr, const uint8_t v)
 {
 	uint16_t vtemp = registers[(addr - RK05_BASE) / 2];
@@ -126,6 +196,9 @@ void rk05::write_word(const uint16_t addr, const uint16_t v)
 {
 	const int reg = (addr - RK05_BASE) / 2;
 
+	if (addr == RK05_CS)
+		wait_for_transfer();
+
 	registers[reg] = v;
 
 	if (addr == RK05_CS) {
@@ -148,14 +221,40 @@ void rk05::write_word(const uint16_t addr, const uint16_t v)
 
 			registers[(RK05_CS - RK05_BASE) / 2] &= ~(1 << 13); // reset search complete
 
-			if (func == 0) { // controller reset
-				TRACE("RK05 invoke %d (controller reset)", func);
+			bool is_async = false;
+
+			if ((func == 1 || func == 2) && async_transfer(device, func == 1, memoff, diskoffb, reclen, v & 64)) {
+				TRACE(tc_rk05, "RK05 drive %d position sec %d surf %d cyl %d, reclen %zo, asynchronous %s %o, mem: %o", device, sector, surface, cylinder, reclen, func == 1 ? "WRITE to" : "READ from", diskoffb, memoff);
+
+				is_async = true;
+
+				// the registers as the synchronous transfer leaves them
+				for(uint32_t i=0; i<reclen / 512; i++) {
+					if (v & 2048)
+						TRACE(tc_rk05, "RK05 inhibit BA increase");
+					else
+						update_bus_address(func == 1 ? 512 : 1024);  // a read adds 2 per byte
+
+					if (++sector >= 12) {
+						sector = 0;
+
+						if (++surface >= 2) {
+							surface = 0;
+							cylinder++;
+						}
+					}
+				}
+
+				registers[(RK05_DA - RK05_BASE) / 2] = sector | (surface << 4) | (cylinder << 5);
+			}
+			else if (func == 0) { // controller reset
+				TRACE(tc_rk05, "RK05 invoke %d (controller reset)", func);
 				registers[(RK05_ERROR - RK05_BASE) / 2] = 0;
 			}
 			else if (func == 1) { // write
 				*disk_write_acitivity = true;
 
-				TRACE("RK05 drive %d position sec %d surf %d cyl %d, reclen %zo, WRITE to %o, mem: %o", device, sector, surface, cylinder, reclen, diskoffb, memoff);
+				TRACE(tc_rk05, "RK05 drive %d position sec %d surf %d cyl %d, reclen %zo, WRITE to %o, mem: %o", device, sector, surface, cylinder, reclen, diskoffb, memoff);
 
 				if (device >= fhs.size()) {
 					registers[(RK05_ERROR - RK05_BASE) / 2] |= 128;  // non existing disk
@@ -175,7 +274,7 @@ void rk05::write_word(const uint16_t addr, const uint16_t v)
 						for(size_t i=0; i<cur; i++)
 							xfer_buffer[i] = b->read_unibus_byte(work_memoff++);
 
-						if (!fhs.at(device)->write(work_diskoffb, cur, xfer_buffer, 512)) {
+						if (!fhs.at(device)->accounted_write(work_diskoffb, cur, xfer_buffer, 512)) {
 							DOLOG(ll_error, true, "RK05(%d) write error %s to %u len %u", device, strerror(errno), work_diskoffb, cur);
 							registers[(RK05_ERROR - RK05_BASE) / 2] |= 32;  // non existing sector
 							registers[(RK05_CS - RK05_BASE) / 2] |= 3 << 14;  // an error occured
@@ -185,7 +284,7 @@ void rk05::write_word(const uint16_t addr, const uint16_t v)
 						work_diskoffb += cur;
 
 						if (v & 2048)
-							TRACE("RK05 inhibit BA increase");
+							TRACE(tc_rk05, "RK05 inhibit BA increase");
 						else
 							update_bus_address(cur);
 
@@ -206,7 +305,7 @@ void rk05::write_word(const uint16_t addr, const uint16_t v)
 			else if (func == 2) { // read
 				*disk_read_acitivity = true;
 
-				TRACE("RK05 drive %d position sec %d surf %d cyl %d, reclen %zo, READ from %o, mem: %o", device, sector, surface, cylinder, reclen, diskoffb, memoff);
+				TRACE(tc_rk05, "RK05 drive %d position sec %d surf %d cyl %d, reclen %zo, READ from %o, mem: %o", device, sector, surface, cylinder, reclen, diskoffb, memoff);
 
 				if (device >= fhs.size()) {
 					registers[(RK05_ERROR - RK05_BASE) / 2] |= 128;  // non existing disk
@@ -220,7 +319,7 @@ void rk05::write_word(const uint16_t addr, const uint16_t v)
 					while(temp_reclen > 0) {
 						uint32_t cur = std::min(uint32_t(sizeof xfer_buffer), temp_reclen);
 
-						if (!fhs.at(device)->read(temp_diskoffb, cur, xfer_buffer, 512)) {
+						if (!fhs.at(device)->accounted_read(temp_diskoffb, cur, xfer_buffer, 512)) {
 							DOLOG(ll_error, true, "RK05 read error %s from %u len %u", strerror(errno), temp_diskoffb, cur);
 							registers[(RK05_ERROR - RK05_BASE) / 2] |= 32;  // non existing sector
 							registers[(RK05_CS - RK05_BASE) / 2] |= 3 << 14;  // an error occured
@@ -254,15 +353,15 @@ void rk05::write_word(const uint16_t addr, const uint16_t v)
 				*disk_read_acitivity = false;
 			}
 			else if (func == 4) {
-				TRACE("RK05 invoke %d (seek) to %o", func, diskoffb);
+				TRACE(tc_rk05, "RK05 invoke %d (seek) to %o", func, diskoffb);
 
 				registers[(RK05_CS - RK05_BASE) / 2] |= 1 << 13; // search complete
 			}
 			else if (func == 7) {
-				TRACE("RK05 invoke %d (write lock)", func);
+				TRACE(tc_rk05, "RK05 invoke %d (write lock)", func);
 			}
 			else {
-				TRACE("RK05 command %d UNHANDLED", func);
+				TRACE(tc_rk05, "RK05 command %d UNHANDLED", func);
 			}
 
 			registers[(RK05_WC - RK05_BASE) / 2] = 0;
@@ -275,7 +374,8 @@ void rk05::write_word(const uint16_t addr, const uint16_t v)
 				registers[(RK05_DS - RK05_BASE) / 2] &= ~(7l << 13);  // store id of the device that caused the interrupt
 				registers[(RK05_DS - RK05_BASE) / 2] |= device << 13;
 
-				b->getCpu()->queue_interrupt(5, 0220);
+				if (!is_async)  // else it is triggered when the backend is done
+					b->getCpu()->queue_interrupt(5, 0220);
 			}
 		}
 	}
@@ -283,6 +383,8 @@ void rk05::write_word(const uint16_t addr, const uint16_t v)
 
 JsonDocument rk05::serialize() const
 {
+	wait_for_transfer();
+
 	JsonDocument j;
 
 	JsonDocument j_backends;
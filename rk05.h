@@ -6,6 +6,8 @@
 #include "gen.h"
 #include <ArduinoJson.h>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
@@ -37,8 +39,15 @@ private:
 	std::atomic_bool *const disk_read_acitivity  { nullptr };
 	std::atomic_bool *const disk_write_acitivity { nullptr };
 
+	std::atomic_bool xfer_busy   { false };  // an asynchronous transfer is in flight
+	std::atomic_bool xfer_failed { false };
+	mutable std::mutex              xfer_lock;
+	mutable std::condition_variable xfer_cv;  // signalled when xfer_busy becomes false
+
 	uint32_t get_bus_address() const;
 	void     update_bus_address(const uint16_t v);
+	bool     async_transfer(const uint16_t device, const bool is_write, const uint32_t memoff, const uint32_t diskoffb, const uint32_t reclen, const bool int_enable);
+	void     wait_for_transfer() const;
 
 public:
 	rk05(bus *const b, std::atomic_bool *const disk_read_acitivity, std::atomic_bool *const disk_write_acitivity);
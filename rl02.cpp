@@ -40,6 +40,8 @@ rl02::rl02(bus *const b, std::atomic_bool *const disk_read_activity, std::atomic
 
 rl02::~rl02()
 {
+	wait_for_transfer();
+
 	for(auto fh : fhs)
 		delete fh;
 }
@@ -51,6 +53,8 @@ void rl02::begin()
 
 void rl02::reset()
 {
+	wait_for_transfer();
+
 	memset(registers,   0x00, sizeof registers  );
 	memset(xfer_buffer, 0x00, sizeof xfer_buffer);
 	memset(mpr,         0x00, sizeof mpr        );
@@ -74,6 +78,8 @@ void rl02::show_state(console *const cnsl) const
 
 JsonDocument rl02::serialize() const
 {
+	wait_for_transfer();
+
 	JsonDocument j;
 
 	JsonDocument j_backends;
@@ -133,7 +139,7 @@ uint16_t rl02::read_word(const uint16_t addr)
 
 	if (addr == RL02_CSR) {  // control status
 		setBit(registers[reg], 0, true);  // drive ready (DRDY)
-		setBit(registers[reg], 7, true);  // controller ready (CRDY)
+		setBit(registers[reg], 7, !xfer_busy);  // controller ready (CRDY)
 	}
 
 	uint16_t value = 0;
@@ -148,7 +154,7 @@ uint16_t rl02::read_word(const uint16_t addr)
 		value = registers[reg];
 	}
 
-	TRACE("RL02: read \"%s\"/%o: %06o", regnames[reg], addr, value);
+	TRACE(tc_rl02, "RL02: read \"%s\"/%o: %06o", regnames[reg], addr, value);
 
 	return value;
 }
@@ -187,6 +193,118 @@ uint32_t rl02::calc_offset() const
 	return (rl02_sectors_per_track * track * 2 + head * rl02_sectors_per_track + sector) * rl02_bytes_per_sector;
 }
 
+void rl02::next_sector()
+{
+	sector++;
+	if (sector >= rl02_sectors_per_track) {
+		sector = 0;
+
+		head++;
+		if (head >= 2) {
+			head = 0;
+
+			track++;
+		}
+	}
+}
+
+// The whole sectors of a transfer in one go, directly between the disk
+// backend and memory. Returns the number of bytes done (the rest goes
+// through xfer_buffer) or -1 on an error.
+uint32_t rl02::bulk_transfer(const int device, const bool is_write, const uint32_t memory_address, const uint32_t disk_offset, const uint32_t count)
+{
+	uint32_t n   = count - count % rl02_bytes_per_sector;
+	uint8_t *ram = n ? b->getRAM()->get_dma_pointer(memory_address, n, !is_write) : nullptr;
+
+	if (ram == nullptr)
+		return 0;
+
+	bool rc = false;
+
+	if (size_t(device) < fhs.size() && fhs.at(device)) {
+		if (is_write)
+			rc = fhs.at(device)->accounted_write(disk_offset, n, ram, rl02_bytes_per_sector);
+		else
+			rc = fhs.at(device)->accounted_read (disk_offset, n, ram, rl02_bytes_per_sector);
+	}
+
+	if (!rc) {
+		DOLOG(ll_error, true, "RL02: %s error, device %d, disk offset %u, size %u, cylinder %d, head %d, sector %d", is_write ? "write" : "read", device, disk_offset, n, track, head, sector);
+		return uint32_t(-1);
+	}
+
+	mpr[0] += n / 2;  // BA and MPR are increased by 2
+
+	for(uint32_t i=0; i<n / rl02_bytes_per_sector; i++)
+		next_sector();
+
+	return n;
+}
+
+// Hands a transfer of whole sectors to an asynchronous backend. The
+// registers are updated right away, CRDY stays 0 and the interrupt is
+// triggered when the backend has finished. Returns false when the
+// transfer must be done synchronously.
+bool rl02::async_transfer(const int device, const bool is_write, const uint32_t memory_address, const uint32_t disk_offset, const uint32_t count)
+{
+	if (size_t(device) >= fhs.size() || fhs.at(device) == nullptr || fhs.at(device)->is_asynchronous() == false)
+		return false;
+
+	if (count == 0 || count % rl02_bytes_per_sector)
+		return false;
+
+	uint8_t *ram = b->getRAM()->get_dma_pointer(memory_address, count, !is_write);
+	if (ram == nullptr)
+		return false;
+
+	const bool        int_enable = registers[(RL02_CSR - RL02_BASE) / 2] & 64;
+	std::atomic_bool *activity   = is_write ? disk_write_activity : disk_read_activity;
+
+	auto done = [this, device, is_write, disk_offset, count, int_enable, activity](const bool ok) {
+		if (!ok)
+			DOLOG(ll_error, true, "RL02: %s error, device %d, disk offset %u, size %u", is_write ? "write" : "read", device, disk_offset, count);
+
+		if (activity)
+			*activity = false;
+
+		{
+			// notify under the lock: the controller may be deleted right after the wait
+			std::unique_lock<std::mutex> lck(xfer_lock);
+
+			xfer_busy = false;
+
+			xfer_cv.notify_all();
+		}
+
+		if (int_enable) {
+			TRACE(tc_rl02, "RL02: triggering interrupt (asynchronous transfer done)");
+
+			b->getCpu()->queue_interrupt(5, 0160);
+		}
+	};
+
+	mpr[0] += count / 2;  // BA and MPR are increased by 2
+
+	for(uint32_t i=0; i<count / rl02_bytes_per_sector; i++)
+		next_sector();
+
+	xfer_busy = true;
+
+	if (is_write)
+		fhs.at(device)->accounted_submit_write(disk_offset, count, ram, rl02_bytes_per_sector, done);
+	else
+		fhs.at(device)->accounted_submit_read (disk_offset, count, ram, rl02_bytes_per_sector, done);
+
+	return true;
+}
+
+void rl02::wait_for_transfer() const
+{
+	std::unique_lock<std::mutex> lck(xfer_lock);
+
+	xfer_cv.wait(lck, [this] { return xfer_busy == false; });
+}
+
 void rl02::update_dar()
 {
 	registers[(RL02_DAR - RL02_BASE) / 2] = (sector & 63) | (head << 6) | (track << 7);
@@ -196,7 +314,10 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 {
 	const int reg = (addr - RL02_BASE) / 2;
 
-	TRACE("RL02: write \"%s\"/%06o: %06o", regnames[reg], addr, v);
+	TRACE(tc_rl02, "RL02: write \"%s\"/%06o: %06o", regnames[reg], addr, v);
+
+	if (addr == RL02_CSR)
+		wait_for_transfer();
 
         registers[reg] = v;
 
@@ -207,7 +328,7 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 
 		int           device  = (v >> 8) & 3;
 
-		TRACE("RL02: device %d, set command %d, exec: %d (%s)", device, command, do_exec, commands[command]);
+		TRACE(tc_rl02, "RL02: device %d, set command %d, exec: %d (%s)", device, command, do_exec, commands[command]);
 
 		bool          do_int  = false;
 
@@ -234,7 +355,7 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 			else if (new_track >= rl02_track_count)
 				new_track = rl02_track_count - 1;
 
-			TRACE("RL02: device %d, seek from cylinder %d to %d (distance: %d, DAR: %06o)", device, track, new_track, cylinder_count, temp);
+			TRACE(tc_rl02, "RL02: device %d, seek from cylinder %d to %d (distance: %d, DAR: %06o)", device, track, new_track, cylinder_count, temp);
 			track  = new_track;
 
 //			update_dar();
@@ -246,7 +367,7 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 			mpr[1] = 0;  // zero
 			mpr[2] = 0;  // TODO: CRC
 
-			TRACE("RL02: device %d, read header [cylinder: %d, head: %d, sector: %d] %06o", device, track, head, sector, mpr[0]);
+			TRACE(tc_rl02, "RL02: device %d, read header [cylinder: %d, head: %d, sector: %d] %06o", device, track, head, sector, mpr[0]);
 
 			do_int = true;
 		}
@@ -268,7 +389,19 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 
 			uint32_t temp_disk_offset = calc_offset();
 
-			TRACE("RL02: device %d, write %d bytes (dec) to %d (dec) from %06o (oct) [cylinder: %d, head: %d, sector: %d]", device, count, temp_disk_offset, memory_address, track, head, sector);
+			TRACE(tc_rl02, "RL02: device %d, write %d bytes (dec) to %d (dec) from %06o (oct) [cylinder: %d, head: %d, sector: %d]", device, count, temp_disk_offset, memory_address, track, head, sector);
+
+			if (async_transfer(device, true, memory_address, temp_disk_offset, count))
+				return;  // CRDY and the interrupt follow when the backend is done
+
+			uint32_t bulk = bulk_transfer(device, true, memory_address, temp_disk_offset, count);
+			if (bulk == uint32_t(-1))
+				count = 0;
+			else {
+				memory_address   += bulk;
+				temp_disk_offset += bulk;
+				count            -= bulk;
+			}
 
 			while(count > 0) {
 				uint32_t cur = std::min(uint32_t(sizeof xfer_buffer), count);
@@ -282,7 +415,7 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 					mpr[0]++;
 				}
 
-				if (fhs.at(device) == nullptr || fhs.at(device)->write(temp_disk_offset, cur, xfer_buffer, 256) == false) {
+				if (fhs.at(device) == nullptr || fhs.at(device)->accounted_write(temp_disk_offset, cur, xfer_buffer, 256) == false) {
 					DOLOG(ll_error, true, "RL02: write error, device %d, disk offset %u, read size %u, cylinder %d, head %d, sector %d", device, temp_disk_offset, cur, track, head, sector);
 					break;
 				}
@@ -293,17 +426,7 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 
 				count -= cur;
 
-				sector++;
-				if (sector >= rl02_sectors_per_track) {
-					sector = 0;
-
-					head++;
-					if (head >= 2) {
-						head = 0;
-
-						track++;
-					}
-				}
+				next_sector();
 			}
 
 			do_int = true;
@@ -329,14 +452,26 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 
 			uint32_t temp_disk_offset = calc_offset();
 
-			TRACE("RL02: device %d, read %d bytes (dec) from %d (dec) to %06o (oct) [cylinder: %d, head: %d, sector: %d]", device, count, temp_disk_offset, memory_address, track, head, sector);
+			TRACE(tc_rl02, "RL02: device %d, read %d bytes (dec) from %d (dec) to %06o (oct) [cylinder: %d, head: %d, sector: %d]", device, count, temp_disk_offset, memory_address, track, head, sector);
 
 //			update_dar();
 
+			if (async_transfer(device, false, memory_address, temp_disk_offset, count))
+				return;  // CRDY and the interrupt follow when the backend is done
+
+			uint32_t bulk = bulk_transfer(device, false, memory_address, temp_disk_offset, count);
+			if (bulk == uint32_t(-1))
+				count = 0;
+			else {
+				memory_address   += bulk;
+				temp_disk_offset += bulk;
+				count            -= bulk;
+			}
+
 			while(count > 0) {
 				uint32_t cur = std::min(uint32_t(sizeof xfer_buffer), count);
 
-				if (fhs.at(device) == nullptr || fhs.at(device)->read(temp_disk_offset, cur, xfer_buffer, 256) == false) {
+				if (fhs.at(device) == nullptr || fhs.at(device)->accounted_read(temp_disk_offset, cur, xfer_buffer, 256) == false) {
 					DOLOG(ll_error, true, "RL02: read error, device %d, disk offset %u, read size %u, cylinder %d, head %d, sector %d", device, temp_disk_offset, cur, track, head, sector);
 					break;
 				}
@@ -355,17 +490,7 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 
 				count -= cur;
 
-				sector++;
-				if (sector >= rl02_sectors_per_track) {
-					sector = 0;
-
-					head++;
-					if (head >= 2) {
-						head = 0;
-
-						track++;
-					}
-				}
+				next_sector();
 
 //				update_dar();
 			}
@@ -376,12 +501,12 @@ void rl02::write_word(const uint16_t addr, uint16_t v)
 				*disk_read_activity = false;
 		}
 		else {
-			TRACE("RL02: command %d not implemented", command);
+			TRACE(tc_rl02, "RL02: command %d not implemented", command);
 		}
 
 		if (do_int) {
 			if (registers[(RL02_CSR - RL02_BASE) / 2] & 64) {  // interrupt enable?
-				TRACE("RL02: triggering interrupt");
+				TRACE(tc_rl02, "RL02: triggering interrupt");
 
 				b->getCpu()->queue_interrupt(5, 0160);
 			}
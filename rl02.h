@@ -6,6 +6,8 @@
 #include "gen.h"
 #include <ArduinoJson.h>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
@@ -42,10 +44,18 @@ private:
 	std::atomic_bool *const disk_read_activity  { nullptr };
 	std::atomic_bool *const disk_write_activity { nullptr };
 
+	std::atomic_bool xfer_busy { false };  // an asynchronous transfer is in flight
+	mutable std::mutex              xfer_lock;
+	mutable std::condition_variable xfer_cv;  // signalled when xfer_busy becomes false
+
 	uint32_t get_bus_address() const;
 	void     update_bus_address(const uint32_t a);
 	void     update_dar();
 	uint32_t calc_offset() const;
+	void     next_sector();
+	uint32_t bulk_transfer(const int device, const bool is_write, const uint32_t memory_address, const uint32_t disk_offset, const uint32_t count);
+	bool     async_transfer(const int device, const bool is_write, const uint32_t memory_address, const uint32_t disk_offset, const uint32_t count);
+	void     wait_for_transfer() const;
 
 public:
 	rl02(bus *const b, std::atomic_bool *const disk_read_activity, std::atomic_bool *const disk_write_activity);
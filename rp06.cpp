@@ -83,7 +83,7 @@ uint16_t rp06::read_word(const uint16_t addr)
 	else if (addr == RP06_DS)
 		value |= default_DS;
 
-	TRACE("RP06: read \"%s\"/%o: %06o", regnames[reg], addr, value);
+	TRACE(tc_rp06, "RP06: read \"%s\"/%o: %06o", regnames[reg], addr, value);
 
 	return value;
 }
@@ -150,7 +150,7 @@ void rp06::write_word(const uint16_t addr, uint16_t v)
 {
 	const int reg = reg_num(addr);
 
-	TRACE("RP06: write \"%s\"/%06o: %06o", regnames[reg], addr, v);
+	TRACE(tc_rp06, "RP06: write \"%s\"/%06o: %06o", regnames[reg], addr, v);
 
         registers[reg] = v;
 
@@ -187,13 +187,30 @@ void rp06::write_word(const uint16_t addr, uint16_t v)
 
 				uint8_t  xfer_buffer[SECTOR_SIZE] { };
 				uint32_t end_offset = offs + nb;
+
+				// the whole sectors directly between the disk backend and memory
+				uint32_t bulk       = nb - nb % SECTOR_SIZE;
+				uint8_t *ram        = bulk ? b->getRAM()->get_dma_pointer(addr, bulk, function_code == 070) : nullptr;
+				if (ram) {
+					bool rc = function_code == 070 ? fhs.at(0)->accounted_read(offs, bulk, ram, SECTOR_SIZE) : fhs.at(0)->accounted_write(offs, bulk, ram, SECTOR_SIZE);
+
+					if (rc) {
+						offs += bulk;
+						addr += bulk;
+					}
+					else {
+						DOLOG(ll_error, true, "RP06 %s error %s at %u", function_code == 070 ? "read" : "write", strerror(errno), offs);
+						end_offset = offs;
+					}
+				}
+
 				for(uint32_t cur_offset = offs; cur_offset<end_offset; cur_offset += SECTOR_SIZE) {
 					uint32_t cur_n = std::min(end_offset - cur_offset, SECTOR_SIZE);
 
 					if (function_code == 070) {
 						DOLOG(debug, false, "RP06: reading %u bytes from %u (dec) to %06o (oct)", cur_n, cur_offset, addr);
 
-						if (!fhs.at(0)->read(cur_offset, cur_n, xfer_buffer, SECTOR_SIZE)) {
+						if (!fhs.at(0)->accounted_read(cur_offset, cur_n, xfer_buffer, SECTOR_SIZE)) {
 							DOLOG(ll_error, true, "RP06 read error %s from %u", strerror(errno), cur_offset);
 							//registers[(RK05_ERROR - RK05_BASE) / 2] |= 32;  // non existing sector
 							//registers[(RK05_CS - RK05_BASE) / 2] |= 3 << 14;  // an error occured
@@ -209,7 +226,7 @@ void rp06::write_word(const uint16_t addr, uint16_t v)
 						for(uint32_t i=0; i<cur_n; i++)
 							xfer_buffer[i] = b->read_unibus_byte(addr++);
 
-						if (!fhs.at(0)->write(cur_offset, cur_n, xfer_buffer, SECTOR_SIZE)) {
+						if (!fhs.at(0)->accounted_write(cur_offset, cur_n, xfer_buffer, SECTOR_SIZE)) {
 							DOLOG(ll_error, true, "RP06 write error %s from %u", strerror(errno), cur_offset);
 							//registers[(RK05_ERROR - RK05_BASE) / 2] |= 32;  // non existing sector
 							//registers[(RK05_CS - RK05_BASE) / 2] |= 3 << 14;  // an error occured
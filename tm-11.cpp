@@ -102,7 +102,7 @@ uint16_t tm_11::read_word(const uint16_t addr)
 		vtemp = 0;
 	}
 
-	TRACE("TM-11 read addr %o: %o", addr, vtemp);
+	TRACE(tc_tm11, "TM-11 read addr %o: %o", addr, vtemp);
 
 	return vtemp;
 }
@@ -125,20 +125,20 @@ void tm_11::write_byte(const uint16_t addr, const uint8_t v)
 
 void tm_11::write_word(const uint16_t addr, uint16_t v)
 {
-	TRACE("TM-11 write %o: %o", addr, v);
+	TRACE(tc_tm11, "TM-11 write %o: %o", addr, v);
 
 	if (addr == TM_11_MTC) {
 		if (v & 1) { // GO
 			const int func = (v >> 1) & 7; // FUNCTION
 			const int reclen = 512;
 
-			TRACE("invoke %d", func);
+			TRACE(tc_tm11, "invoke %d", func);
 
 			if (func == 0) { // off-line
 				v = 128; // TODO set error if error
 			}
 			else if (func == 1) { // read
-				TRACE("reading %d bytes from offset %d", reclen, offset);
+				TRACE(tc_tm11, "reading %d bytes from offset %d", reclen, offset);
 				if (fread(xfer_buffer, 1, reclen, fh) != reclen)
 					DOLOG(info, true, "failed: %s", strerror(errno));
 				for(int i=0; i<reclen; i++)
@@ -171,9 +171,9 @@ void tm_11::write_word(const uint16_t addr, uint16_t v)
 	}
 	else if (addr == TM_11_MTCMA) {
 		v &= ~1;
-		TRACE("Set DMA address to %o", v);
+		TRACE(tc_tm11, "Set DMA address to %o", v);
 	}
 
-	TRACE("set register %o to %o", addr, v);
+	TRACE(tc_tm11, "set register %o to %o", addr, v);
 	registers[(addr - TM_11_BASE) / 2] = v;
 }
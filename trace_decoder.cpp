@@ -0,0 +1,286 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+// Turns a binary execution trace (kek -Y) into the disassembly format of
+// the debugger. Memory is reconstructed from the instruction words and the
+// memory writes in the trace, so the operand values shown for locations
+// that were not written to during the trace (or were changed by DMA) are
+// not necessarily the ones the machine saw.
+
+#include <atomic>
+#include <cinttypes>
+#include <optional>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "error.h"
+#include "gen.h"
+#include "log.h"
+#include "memory.h"
+#include "mmu.h"
+#include "trace_recorder.h"
+#include "utils.h"
+
+
+class trace_reader
+{
+private:
+	FILE *fh { nullptr };
+
+public:
+	trace_reader(FILE *const fh) : fh(fh) { }
+
+	bool eof() { int c = fgetc(fh); if (c == EOF) return true; ungetc(c, fh); return false; }
+
+	uint8_t get_byte()
+	{
+		int c = fgetc(fh);
+		if (c == EOF)
+			throw 1;  // truncated record
+
+		return c;
+	}
+
+	uint16_t get_word() { uint16_t v = get_byte(); return v | (get_byte() << 8); }
+
+	uint32_t get_varint()
+	{
+		uint32_t v     = 0;
+		int      shift = 0;
+
+		for(;;) {
+			uint8_t c = get_byte();
+			v |= uint32_t(c & 127) << shift;
+
+			if ((c & 128) == 0)
+				return v;
+
+			shift += 7;
+		}
+	}
+};
+
+static void help()
+{
+	printf("-h       this help\n");
+	printf("-f x     skip the first x instructions of the trace\n");
+	printf("-n x     decode at most x instructions\n");
+	printf("-i       show only the instructions (not the registers)\n");
+	printf("-w       show the memory writes\n");
+	printf("then the name of the trace file\n");
+}
+
+// the trace contains virtual addresses: map each run-mode 1:1 on the first 64 kB
+static void set_identity_map(bus *const b)
+{
+	mmu *m = b->getMMU();
+
+	for(int run_mode : { 0, 1, 3 }) {
+		for(int page=0; page<8; page++) {
+			for(int d : { 0, 16 }) {
+				m->write_pdr(page * 2 + d, run_mode, 077406, wm_word);  // full length, read/write
+				m->write_par(page * 2 + d, run_mode, page * 0200, wm_word);
+			}
+		}
+	}
+
+	m->setMMR0(1);
+}
+
+static void print_instruction(cpu *const c, const uint64_t nr, const uint16_t pc, const bool instruction_only)
+{
+	auto data = c->disassemble(pc);
+	if (data.empty()) {
+		printf("%" PRIu64 " PC: %06o: cannot disassemble\n", nr, pc);
+		return;
+	}
+
+	auto registers = data["registers"];
+
+	std::string instruction_values;
+	for(auto & iv : data["instruction-values"])
+		instruction_values += (instruction_values.empty() ? "" : ",") + iv;
+
+	std::string work_values;
+	for(auto & wv : data["work-values"])
+		work_values += (work_values.empty() ? "" : ",") + wv;
+
+	std::string instruction = data["instruction-text"].at(0);
+
+	// the same layout as disassemble() in debugger.cpp
+	if (instruction_only)
+		printf("%" PRIu64 " PC: %06o, instr: %s\t%s\t%s\n", nr, pc, instruction_values.c_str(), instruction.c_str(), work_values.c_str());
+	else
+		printf("%" PRIu64 " R0: %s, R1: %s, R2: %s, R3: %s, R4: %s, R5: %s, SP: %s, PC: %06o, PSW: %s (%s), instr: %s: %s\n", nr,
+				registers[0].c_str(), registers[1].c_str(), registers[2].c_str(), registers[3].c_str(), registers[4].c_str(), registers[5].c_str(),
+				registers[6].c_str(), pc,
+				data["psw"][0].c_str(), data["psw-value"][0].c_str(),
+				instruction_values.c_str(),
+				instruction.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t first           = 0;
+	std::optional<uint64_t> max_count;
+	bool     instruction_only = false;
+	bool     show_writes      = false;
+
+	int opt = -1;
+	while((opt = getopt(argc, argv, "hf:n:iw")) != -1)
+	{
+		switch(opt) {
+			case 'h':
+				help();
+				return 1;
+
+			case 'f':
+				first = std::stoull(optarg);
+				break;
+
+			case 'n':
+				max_count = std::stoull(optarg);
+				break;
+
+			case 'i':
+				instruction_only = true;
+				break;
+
+			case 'w':
+				show_writes = true;
+				break;
+
+			default:
+				fprintf(stderr, "-%c is not understood\n", opt);
+				return 1;
+		}
+	}
+
+	if (optind >= argc) {
+		help();
+		return 1;
+	}
+
+	setlogfile(nullptr, ll_error, ll_error, false);
+
+	FILE *fh = fopen(argv[optind], "rb");
+	if (!fh)
+		error_exit(true, "Cannot open %s", argv[optind]);
+
+	char magic[trace_magic_len] { };
+	if (fread(magic, 1, trace_magic_len, fh) != trace_magic_len || memcmp(magic, trace_magic, trace_magic_len) != 0)
+		error_exit(false, "%s is not a trace file", argv[optind]);
+
+	std::atomic_uint32_t event { EVENT_NONE };
+
+	bus *b = new bus();
+	b->set_memory_size(8);  // 64 kB: the virtual address space
+
+	cpu *c = new cpu(b, &event);
+	b->add_cpu(c);
+
+	set_identity_map(b);
+
+	memory  *m         = b->getRAM();
+	uint16_t regs[7]   { };
+	uint16_t psw       = 0;
+	uint16_t pc        = 0;
+	uint64_t nr        = 0;
+	bool     have_sync = false;
+	uint64_t n_shown   = 0;
+
+	trace_reader r(fh);
+
+	try {
+		while(!r.eof() && (max_count.has_value() == false || n_shown < max_count.value())) {
+			uint8_t flags = r.get_byte();
+
+			if (flags & TR_SYNC) {
+				nr = 0;
+				for(int i=0; i<8; i++)
+					nr |= uint64_t(r.get_byte()) << (i * 8);
+
+				pc = r.get_word();
+				for(int i=0; i<7; i++)
+					regs[i] = r.get_word();
+				psw = r.get_word();
+
+				have_sync = true;
+			}
+			else {
+				uint16_t zz   = r.get_varint();
+				int16_t  diff = (zz >> 1) ^ -(zz & 1);
+
+				pc += diff;
+				nr++;
+			}
+
+			if (!have_sync)
+				error_exit(false, "Trace does not start with a full state");
+
+			int n_words = TR_N_WORDS(flags);
+			for(int i=0; i<=n_words; i++)
+				m->write_word(uint16_t(pc + i * 2), r.get_word());
+
+			bool show = nr >= first;
+
+			if (show) {
+				c->lowlevel_psw_set(psw);
+				for(int i=0; i<7; i++)
+					c->set_register(i, regs[i]);
+				c->setPC(pc);
+
+				if (flags & TR_INTERRUPTED)
+					printf("%" PRIu64 " interrupt\n", nr);
+
+				print_instruction(c, nr, pc, instruction_only);
+
+				n_shown++;
+			}
+
+			uint8_t mask = r.get_byte();
+			for(int i=0; i<7; i++) {
+				if (mask & (1 << i))
+					regs[i] = r.get_word();
+			}
+
+			if (flags & TR_PSW)
+				psw = r.get_word();
+
+			if (flags & TR_WRITES) {
+				uint32_t n_writes = r.get_varint();
+
+				for(uint32_t i=0; i<n_writes; i++) {
+					bool     is_byte = r.get_byte();
+					uint16_t addr    = r.get_word();
+					uint16_t value   = is_byte ? r.get_byte() : r.get_word();
+
+					if (is_byte)
+						m->write_byte(addr, value);
+					else
+						m->write_word(addr & ~1, value);
+
+					if (show && show_writes)
+						printf("%" PRIu64 "  write%s %06o: %0*o\n", nr, is_byte ? "B" : "", addr, is_byte ? 3 : 6, value);
+				}
+			}
+
+			if (show && (flags & TR_TRAP))
+				printf("%" PRIu64 " trap\n", nr);
+		}
+	}
+	catch(const int e) {
+		fprintf(stderr, "Trace file is truncated\n");
+	}
+
+	fclose(fh);
+
+	delete b;
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#include <cinttypes>
+#include <errno.h>
+#include <string.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "log.h"
+#include "trace_recorder.h"
+
+
+constexpr const size_t flush_threshold = 1024 * 1024;
+constexpr const size_t max_record_size = 64;  // without the memory writes
+
+trace_recorder::trace_recorder(const std::string & file)
+{
+	fh = fopen(file.c_str(), "wb");
+
+	if (!fh) {
+		DOLOG(warning, true, "trace_recorder: cannot create \"%s\": %s", file.c_str(), strerror(errno));
+		return;
+	}
+
+	buffer.resize(flush_threshold + max_record_size);
+
+	memcpy(buffer.data(), trace_magic, trace_magic_len);
+	buffer_used = trace_magic_len;
+}
+
+trace_recorder::~trace_recorder()
+{
+	if (fh) {
+		flush();
+
+		fclose(fh);
+	}
+
+	DOLOG(info, false, "trace_recorder: %" PRIu64 " instructions recorded", n_records);
+}
+
+void trace_recorder::flush()
+{
+	if (buffer_used && fwrite(buffer.data(), 1, buffer_used, fh) != buffer_used)
+		DOLOG(warning, false, "trace_recorder: write error: %s", strerror(errno));
+
+	buffer_used = 0;
+}
+
+void trace_recorder::put_varint(uint32_t v)
+{
+	while(v >= 128) {
+		put_byte(v | 128);
+		v >>= 7;
+	}
+
+	put_byte(v);
+}
+
+static int get_operand_words(const uint8_t mode_register)
+{
+	int mode = mode_register >> 3;
+	int reg  = mode_register & 7;
+
+	return mode >= 6 || (reg == 7 && (mode == 2 || mode == 3)) ? 1 : 0;
+}
+
+int trace_recorder::get_operand_word_count(const uint16_t instr)
+{
+	uint8_t do_opcode = (instr >> 12) & 7;
+
+	if (do_opcode >= 1 && do_opcode <= 6)  // MOV...ADD/SUB: source and destination
+		return get_operand_words((instr >> 6) & 63) + get_operand_words(instr & 63);
+
+	if ((instr & 0170000) == 0070000)  // MUL, DIV, ASH, ASHC, XOR (not SOB)
+		return ((instr >> 9) & 7) <= 4 ? get_operand_words(instr & 63) : 0;
+
+	if ((instr & 0177700) == 0006400)  // MARK
+		return 0;
+
+	if ((instr & 0177700) == 0000100 || (instr & 0177700) == 0000300 || (instr & 0177000) == 0004000 ||  // JMP, SWAB, JSR
+	    (instr & 0077000) == 0005000 || (instr & 0077000) == 0006000)  // single operand (also the byte versions and MFP*/MTP*)
+		return get_operand_words(instr & 63);
+
+	return 0;
+}
+
+void trace_recorder::start_instruction(cpu *const c, const uint16_t pc, const uint16_t instr, const bool interrupted)
+{
+	if (!fh)
+		return;
+
+	uint16_t current[7];
+	for(int i=0; i<7; i++)
+		current[i] = c->get_register(i);
+
+	uint16_t current_psw = c->getPSW();
+
+	// registers are recorded as a delta with the state after the previous
+	// instruction: a change in between (an interrupt, the debugger) needs
+	// a full state
+	bool sync = n_since_sync >= trace_sync_interval || memcmp(current, regs, sizeof regs) != 0 || current_psw != psw;
+
+	int n_words = get_operand_word_count(instr);
+
+	flags = (sync ? TR_SYNC : 0) | (interrupted ? TR_INTERRUPTED : 0) | (n_words << TR_WORDS_SHIFT);
+
+	flags_offset = buffer_used;
+	put_byte(flags);
+
+	if (sync) {
+		uint64_t count = c->get_instructions_executed_count();
+		for(int i=0; i<8; i++)
+			put_byte(count >> (i * 8));
+
+		put_word(pc);
+		for(int i=0; i<7; i++)
+			put_word(current[i]);
+		put_word(current_psw);
+
+		n_since_sync = 0;
+	}
+	else {
+		int16_t diff = int16_t(pc - prev_pc);
+		put_varint(uint16_t((diff << 1) ^ (diff >> 15)));
+	}
+
+	put_word(instr);
+
+	bus *b = c->getBus();
+	for(int i=0; i<n_words; i++)
+		put_word(b->peek_word(c->getPSW_runmode(), pc + 2 + i * 2).value_or(0));
+
+	memcpy(regs, current, sizeof regs);
+	psw     = current_psw;
+	prev_pc = pc;
+
+	writes.clear();
+	started = true;
+}
+
+void trace_recorder::end_instruction(cpu *const c)
+{
+	if (!started)
+		return;
+
+	started = false;
+
+	uint8_t  mask = 0;
+	uint16_t current[7];
+
+	for(int i=0; i<7; i++) {
+		current[i] = c->get_register(i);
+
+		if (current[i] != regs[i])
+			mask |= 1 << i;
+	}
+
+	put_byte(mask);
+
+	for(int i=0; i<7; i++) {
+		if (mask & (1 << i))
+			put_word(current[i]);
+	}
+
+	memcpy(regs, current, sizeof regs);
+
+	uint16_t current_psw = c->getPSW();
+
+	if (current_psw != psw) {
+		flags |= TR_PSW;
+		put_word(current_psw);
+
+		psw = current_psw;
+	}
+
+	if (c->is_it_a_trap() && (flags & TR_INTERRUPTED) == 0)
+		flags |= TR_TRAP;
+
+	if (writes.empty() == false) {
+		flags |= TR_WRITES;
+
+		size_t space_needed = buffer_used + 8 + writes.size() * 5;  // varint + (type, address, value)
+		if (space_needed > buffer.size())
+			buffer.resize(space_needed);
+
+		put_varint(writes.size());
+
+		for(auto & w: writes) {
+			put_byte(w.word_mode == wm_byte);
+			put_word(w.addr);
+
+			if (w.word_mode == wm_byte)
+				put_byte(w.value);
+			else
+				put_word(w.value);
+		}
+	}
+
+	buffer[flags_offset] = flags;
+
+	n_since_sync++;
+	n_records++;
+
+	if (buffer_used >= flush_threshold)
+		flush();
+}
@@ -0,0 +1,87 @@
+// (C) 2018-2024 by Folkert van Heusden
+// Released under MIT license
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "gen.h"
+
+
+class cpu;
+
+// file layout: trace_magic, then one record per instruction:
+//   flags (TR_*)
+//   sync record: instruction count (8 bytes), PC, R0...R5, SP, PSW (before the instruction)
+//   otherwise:   PC as the (zigzag, varint) difference with the PC of the previous record
+//   the instruction word and TR_N_WORDS() operand words
+//   mask of the registers (R0...R5, SP) changed by the instruction, followed by their new values
+//   TR_PSW: the new PSW
+//   TR_WRITES: count, then per write: 0 (word) / 1 (byte), address, value
+// all values are little endian; registers are the ones selected by the PSW
+constexpr const char     trace_magic[]       = "KEKTRC01";
+constexpr const size_t   trace_magic_len     = 8;
+
+constexpr const uint8_t  TR_INTERRUPTED      = 1;   // an interrupt was started before this instruction
+constexpr const uint8_t  TR_TRAP             = 2;   // the instruction trapped
+constexpr const uint8_t  TR_PSW              = 4;
+constexpr const uint8_t  TR_WORDS_SHIFT      = 4;   // 2 bits: number of operand words
+constexpr const uint8_t  TR_WRITES           = 64;
+constexpr const uint8_t  TR_SYNC             = 128;
+
+#define TR_N_WORDS(flags) (((flags) >> TR_WORDS_SHIFT) & 3)
+
+constexpr const uint32_t trace_sync_interval = 65536;  // instructions
+
+// Records the execution in a compact binary form instead of formatting
+// disassembly for every instruction (see trace_decoder.cpp for the tool
+// that turns it into text). Memory writes are recorded with their
+// virtual address.
+class trace_recorder
+{
+private:
+	typedef struct {
+		uint16_t    addr;
+		word_mode_t word_mode;
+		uint16_t    value;
+	} write_t;
+
+	FILE                *fh                { nullptr };
+	std::vector<uint8_t> buffer;
+	size_t               buffer_used       { 0 };
+
+	bool                 started           { false };
+	uint8_t              flags             { 0 };
+	size_t               flags_offset      { 0 };  // in 'buffer', patched when the instruction ends
+	uint16_t             regs[7]           { };  // R0...R5, SP as of the last record
+	uint16_t             psw               { 0 };
+	uint16_t             prev_pc           { 0 };
+	uint64_t             n_since_sync      { trace_sync_interval };
+	std::vector<write_t> writes;
+
+	uint64_t             n_records         { 0 };
+
+	void put_byte(const uint8_t  v) { buffer[buffer_used++] = v; }
+	void put_word(const uint16_t v) { buffer[buffer_used++] = v; buffer[buffer_used++] = v >> 8; }
+	void put_varint(uint32_t v);
+	void flush();
+
+public:
+	trace_recorder(const std::string & file);
+	virtual ~trace_recorder();
+
+	bool is_open() const { return fh != nullptr; }
+
+	void start_instruction(cpu *const c, const uint16_t pc, const uint16_t instr, const bool interrupted);
+	void end_instruction(cpu *const c);
+
+	void add_memory_write(const uint16_t addr, const word_mode_t word_mode, const uint16_t value) { if (started) writes.push_back({ addr, word_mode, value }); }
+
+	uint64_t get_record_count() const { return n_records; }
+
+	// number of words after the instruction word (immediate, absolute, index)
+	static int get_operand_word_count(const uint16_t instr);
+};
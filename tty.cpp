@@ -8,6 +8,7 @@
 #include "tty.h"
 #include "cpu.h"
 #include "gen.h"
+#include "journal.h"
 #include "log.h"
 #include "memory.h"
 #include "utils.h"
@@ -29,7 +30,7 @@ void thread_wrapper_tty(void *p)
 }
 #endif
 
-tty::tty(console *const c, bus *const b) :
+tty::tty(console *const c, bus *const b, const bool own_thread) :
 	c(c),
 	b(b)
 {
@@ -39,6 +40,9 @@ tty::tty(console *const c, bus *const b) :
 	xSemaphoreGive(chars_lock);  // initialize
 #endif
 
+	if (!own_thread)
+		return;
+
 #if defined(BUILD_FOR_RP2040)
 	xTaskCreate(&thread_wrapper_tty, "tty", 2048, this, 1, nullptr);
 #else
@@ -51,8 +55,10 @@ tty::~tty()
 	stop_flag = true;
 
 #if !defined(BUILD_FOR_RP2040)
-	th->join();
-	delete th;
+	if (th) {
+		th->join();
+		delete th;
+	}
 #endif
 }
 
@@ -103,6 +109,7 @@ uint16_t tty::read_word(const uint16_t addr)
 		else {
 			uint8_t ch = chars.front();
 			chars.erase(chars.begin());
+			queue_depth = chars.size();
 
 			vtemp = ch | (parity(ch) << 7);
 
@@ -118,7 +125,7 @@ uint16_t tty::read_word(const uint16_t addr)
 	xSemaphoreGive(chars_lock);
 #endif
 
-	TRACE("PDP11TTY read addr %o (%s): %d, 7bit: %d", addr, regnames[reg], vtemp, vtemp & 127);
+	TRACE(tc_tty, "PDP11TTY read addr %o (%s): %d, 7bit: %d", addr, regnames[reg], vtemp, vtemp & 127);
 
 	registers[reg] = vtemp;
 
@@ -128,33 +135,57 @@ uint16_t tty::read_word(const uint16_t addr)
 	return vtemp;
 }
 
-void tty::operator()()
+void tty::add_char(const char ch)
 {
-	set_thread_name("kek:tty");
-
-	while(!stop_flag) {
-		if (c->poll_char()) {
+	{
 #if defined(BUILD_FOR_RP2040)
-			digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
-			xSemaphoreTake(chars_lock, portMAX_DELAY);
+		xSemaphoreTake(chars_lock, portMAX_DELAY);
 #else
-			std::unique_lock<std::mutex> lck(chars_lock);
+		std::unique_lock<std::mutex> lck(chars_lock);
 #endif
 
-			chars.push_back(c->get_char());
+		chars.push_back(ch);
+		queue_depth = chars.size();
+		n_bytes_in++;
 
 #if defined(BUILD_FOR_RP2040)
-			xSemaphoreGive(chars_lock);
+		xSemaphoreGive(chars_lock);
 #endif
+	}
 
-			notify_rx();
-		}
-		else {
+	notify_rx();
+}
+
+void tty::operator()()
+{
+	set_thread_name("kek:tty");
+
+	while(!stop_flag) {
+		if (poll() == false)
 			myusleep(100000);
-		}
 	}
 }
 
+bool tty::poll()
+{
+	if (c->poll_char() == false)
+		return false;
+
+#if defined(BUILD_FOR_RP2040)
+	digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
+#endif
+
+	char     ch = c->get_char();
+	journal *j  = b->getCpu()->get_journal();
+
+	if (j)
+		j->submit(JE_TTY_CHAR, 0, ch);
+	else
+		add_char(ch);
+
+	return true;
+}
+
 void tty::write_byte(const uint16_t addr, const uint8_t v)
 {
 	uint16_t vtemp = registers[(addr - PDP11TTY_BASE) / 2];
@@ -175,14 +206,15 @@ void tty::write_word(const uint16_t addr, uint16_t v)
 {
 	const int reg = (addr - PDP11TTY_BASE) / 2;
 
-	TRACE("PDP11TTY write %o (%s): %o", addr, regnames[reg], v);
+	TRACE(tc_tty, "PDP11TTY write %o (%s): %o", addr, regnames[reg], v);
 
 	if (addr == PDP11TTY_TPB) {
 		char ch = v & 127;
 
-		TRACE("PDP11TTY print '%c'", ch);
+		TRACE(tc_tty, "PDP11TTY print '%c'", ch);
 
 		c->put_char(ch);
+		n_bytes_out++;
 
 		registers[(PDP11TTY_TPS - PDP11TTY_BASE) / 2] |= 128;
 
@@ -190,7 +222,7 @@ void tty::write_word(const uint16_t addr, uint16_t v)
 			b->getCpu()->queue_interrupt(4, 064);
 	}
 
-	TRACE("set register %o to %o", addr, v);
+	TRACE(tc_tty, "set register %o to %o", addr, v);
 	registers[(addr - PDP11TTY_BASE) / 2] = v;
 }
 
@@ -226,5 +258,7 @@ tty *tty::deserialize(const JsonVariantConst j, bus *const b, console *const cns
 	for(auto v: ja_buf)
 		out->chars.push_back(v.as<signed char>());
 
+	out->queue_depth = out->chars.size();
+
 	return out;
 }
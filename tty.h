@@ -39,6 +39,11 @@ private:
 #endif
 	std::vector<char> chars;
 
+	// for the metrics
+	std::atomic_uint64_t n_bytes_in  { 0 };
+	std::atomic_uint64_t n_bytes_out { 0 };
+	std::atomic_uint32_t queue_depth { 0 };
+
 	uint16_t registers[4] { 0 };
 
 #if !defined(BUILD_FOR_RP2040)
@@ -49,7 +54,8 @@ private:
 	void notify_rx();
 
 public:
-	tty(console *const c, bus *const b);
+	// without 'own_thread' the owner invokes poll() for console input
+	tty(console *const c, bus *const b, const bool own_thread = true);
 	virtual ~tty();
 
 	JsonDocument serialize();
@@ -57,6 +63,13 @@ public:
 
 	void reset();
 
+	// a character typed on the console
+	void add_char(const char ch);
+
+	uint64_t get_bytes_in()    const { return n_bytes_in;  }
+	uint64_t get_bytes_out()   const { return n_bytes_out; }
+	uint32_t get_queue_depth() const { return queue_depth; }
+
 	uint8_t read_byte(const uint16_t addr);
 	uint16_t read_word(const uint16_t addr);
 
@@ -64,4 +77,6 @@ public:
 	void write_word(const uint16_t addr, uint16_t v);
 
 	void operator()();
+	// moves a character from the console, if any (returns false if not)
+	bool poll();
 };
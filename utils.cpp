@@ -23,6 +23,7 @@
 #include <optional>
 #include <pthread.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <string>
 #include <string.h>
@@ -169,6 +170,11 @@ std::vector<std::string> split(std::string in, std::string splitter)
 	return out;
 }
 
+#if IS_POSIX || defined(_WIN32)
+// get_thread_name() is called for each log message: this saves a syscall
+static thread_local std::optional<std::string> thread_name_cache;
+#endif
+
 void set_thread_name(std::string name)
 {
 #if !defined(ESP32) && !defined(BUILD_FOR_RP2040)
@@ -176,16 +182,22 @@ void set_thread_name(std::string name)
 		name = name.substr(0, 15);
 
 	pthread_setname_np(pthread_self(), name.c_str());
+
+	thread_name_cache = name;
 #endif
 }
 
 std::string get_thread_name()
 {
 #if IS_POSIX || defined(_WIN32)
-	char buffer[16 + 1] { };
-	pthread_getname_np(pthread_self(), buffer, sizeof buffer);
+	if (thread_name_cache.has_value() == false) {
+		char buffer[16 + 1] { };
+		pthread_getname_np(pthread_self(), buffer, sizeof buffer);
 
-	return buffer;
+		thread_name_cache = buffer;
+	}
+
+	return thread_name_cache.value();
 #else
 	return pcTaskGetName(xTaskGetCurrentTaskHandle());
 #endif
@@ -274,6 +286,22 @@ std::string get_endpoint_name(const int fd)
 	return std::string(inet_ntoa(addr.sin_addr)) + ":" + format("%d", ntohs(addr.sin_port));
 }
 
+std::optional<long> parse_number(const std::string & in, const int base)
+{
+	if (in.empty())
+		return { };
+
+	char *end = nullptr;
+
+	errno = 0;
+	long v = strtol(in.c_str(), &end, base);
+
+	if (errno != 0 || *end != 0)
+		return { };
+
+	return v;
+}
+
 std::optional<JsonDocument> deserialize_file(const std::string & filename)
 {
 	JsonDocument j;
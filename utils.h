@@ -1,6 +1,8 @@
 // (C) 2018-2024 by Folkert van Heusden
 // Released under MIT license
 
+#pragma once
+
 #include <ArduinoJson.h>
 #include <optional>
 #include <stdint.h>
@@ -31,4 +33,7 @@ void update_word(uint16_t *const w, const bool msb, const uint8_t v);
 void set_nodelay(const int fd);
 std::string get_endpoint_name(const int fd);
 
+// strtol() that requires all of 'in' to be a number
+std::optional<long> parse_number(const std::string & in, const int base = 10);
+
 std::optional<JsonDocument> deserialize_file(const std::string & filename);